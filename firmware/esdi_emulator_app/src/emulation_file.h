@@ -0,0 +1,81 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// ESDI emulation file format, shared by the firmware and the host side tools
+// (host_sim/image_convert.c and the benchmark).
+//
+// Version 1 images hold every sector: the data region is cylinders * heads * sectors_per_track
+// sectors of sector_size_in_image bytes each, in cylinder, head, sector order.
+//
+// Version 2 images only hold the tracks which have something on them. The header is followed
+// (at track_table_offset) by a track_entry for each track in cylinder, head order, and the data
+// region is a list of track records, each a whole track rounded up to TRACK_RECORD_ALIGNMENT
+// bytes. A track with no record reads as its fill word repeated, so one which was never
+// written reads as zeros. Identical tracks may share one record; writing to a shared track
+// gives it a record of its own first. Records are only ever added to the end of the file.
+//
+// Version 3 files are overlays, which hold the tracks written to a version 1 image while the
+// image itself is left as it was. They are laid out as version 2, with the image's geometry
+// and drive configuration, but a track with no record reads as that track of the image and
+// its fill word is unused. Deleting the overlay returns the drive to the image, and
+// host_sim/image_convert -c writes the overlay's tracks into the image.
+
+#ifndef EMULATION_FILE_H
+#define EMULATION_FILE_H
+
+#include <stdint.h>
+
+#define EMULATION_FILE_ALIGNMENT	16
+#define EMULATION_FILE_FLAT			1
+#define EMULATION_FILE_SPARSE		2
+#define EMULATION_FILE_OVERLAY		3
+
+#define TRACK_RECORD_ALIGNMENT		512				// One SD card block
+#define TRACK_SHARED				0x80000000		// Flag in track_entry.record
+#define TRACK_RECORD(entry)			((entry).record & ~TRACK_SHARED)
+
+struct __attribute__((packed)) drive_configuration {
+    uint16_t general_configuration[20];
+    uint16_t specific_configuration[15];
+};
+
+struct __attribute__((packed)) emulation_header {
+    uint16_t file_version;
+    uint32_t drive_configuration_offset;
+    uint32_t data_offset;
+    uint16_t cylinders;
+    uint16_t heads;
+    uint16_t sectors_per_track;
+    uint16_t sector_size_in_image;
+    uint16_t rpm;				// Zero in images made before there was a choice, which spin at 3600
+    uint32_t track_table_offset;	// Version 2 only
+};
+
+struct __attribute__((packed)) track_entry {
+	uint32_t record;			// Record number from 1, 0 if the track isn't stored. May have TRACK_SHARED set.
+	uint32_t fill;				// What an unstored track reads as, repeated from its first byte (little endian)
+};
+
+// Bytes from one track record to the next in a version 2 image
+static inline uint32_t track_record_stride(const struct emulation_header* header) {
+	uint32_t track_bytes = (uint32_t) header->sectors_per_track * header->sector_size_in_image;
+	return (track_bytes + TRACK_RECORD_ALIGNMENT - 1) & ~(uint32_t) (TRACK_RECORD_ALIGNMENT - 1);
+}
+
+#endif
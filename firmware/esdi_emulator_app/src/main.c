@@ -19,468 +19,3581 @@
 */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "xil_io.h"
 #include "xscugic.h"
 #include "xgpio.h"
 #include "xparameters.h"
 #include "ff.h"
+#include "diskio.h"
 #include "xtime_l.h"
 #include "sleep.h"
 #include "xil_mmu.h"
 #include "xil_cache.h"
+#include "xuartps_hw.h"
+
+#include "trace.h"
+#include "emulation_file.h"
 
 #define HW_FREQ			100000000
-#define DMA_LEAD 1		// The number of read DMA (mm2s) descriptors
-						// that we let the DMA lead the head position by
-#define MAX_SUPPORTED_CYLINDERS		1224
-#define MAX_SUPPORTED_SECTORS		128
-#define WORST_CASE_NUM_SLOTS		100
-#define DATA_BUFFER_SIZE			(1024 * WORST_CASE_NUM_SLOTS * 16 * MAX_SUPPORTED_SECTORS)
-#define NUM_WRITE_DESCRIPTORS 		8
-#define DIRTY_QUEUE_SIZE 			1024
-#define PRELOAD_CYLINDERS			100
-#define LOG_ENTRIES					1024
-
-/* ESDI Emulation File Definition */
-
-#define EMULATION_FILE_ALIGNMENT 16
-
-struct __attribute__((packed)) drive_configuration {
-    uint16_t general_configuration[20];
-    uint16_t specific_configuration[15];
+#define DEFAULT_DRIVE_RPM		3600		// For images whose header doesn't give the spindle speed
+#define DEFAULT_BIT_RATE		10000000	// For drives which don't report their unformatted bytes per track
+#define MAX_CLOCKS_PER_HALFBIT	127			// Width of the read datapath's clocks per half bit register
+#define SEQUENCER_LEAD 2	// The number of sectors the track sequencer fetches
+							// ahead of the one being read
+#define SEQUENCER_FETCH_TIME	(20e-6 * HW_FREQ)	// Longest it may take the track sequencer to fetch
+													// a sector after a head or cylinder change
+#define MAX_SUPPORTED_CYLINDERS		2048	// Entries in the track sequencer's slot table
+#define MAX_SUPPORTED_SECTORS		255		// Width of the sector timer's sector number
+#define MAX_SUPPORTED_HEADS			16		// Head select lines
+#define NUM_DRIVES					2		// Drives emulated, each with its own image and datapaths
+#define NUM_WRITE_DESCRIPTORS 		32
+#define WRITE_STAGING_SIZE			1024	// Bytes the DMA is given for each sector, the most the write datapath sends
+#define WRITE_RECORDS				32		// Completion records the write datapath keeps (RECORDS_EXP in write_datapath.v)
+#define WRITE_COALESCE_RECORDS		8		// The write datapath interrupts once this many sectors have been written,
+#define WRITE_COALESCE_TIMEOUT		(1e-3 * HW_FREQ)	// or this long after the first of them
+#define QUERIES_IN_HARDWARE			true	// The command interface answers Request Status and Request Configuration without interrupting
+#define WARM_SET_CYLINDERS			100		// Most used cylinders of each drive recorded, to be loaded first at the next boot
+#define WARM_SET_NAME				"WARMSET.BIN"
+#define DRIVE_CONFIG_NAME			"DRIVES.CFG"	// Names the image of each drive, if the defaults won't do
+#define IMAGE_NAME_LENGTH			64
+#define WARM_SET_SAVE_INTERVAL		(COUNTS_PER_SECOND * 60ull)	// Record the warm set this often, if the drives have been used
+#define TRACE_ENTRIES				1024	// Must be a power of two
+#define TRACE_FILE_BATCH			128		// Trace records written to the SD card at a time
+#define TRACE_TO_FILE				false	// Write the trace to TRACE.BIN for host_sim/trace_decode rather than print it
+#define TRACE_UART_EVENTS			(TRACE_MASK(TRACE_DROPPED) | TRACE_MASK(TRACE_SEEK) | TRACE_MASK(TRACE_HEAD_SELECT) | \
+									 TRACE_MASK(TRACE_READ_UNDERFLOW) | TRACE_MASK(TRACE_READ_MISSED) | \
+									 TRACE_MASK(TRACE_WRITE_OVERFLOW) | TRACE_MASK(TRACE_WRITE_MISSED) | TRACE_MASK(TRACE_WRITE_UNLOADED) | \
+									 TRACE_MASK(TRACE_SLOT_LOAD) | TRACE_MASK(TRACE_SLOT_PREFETCH) | \
+									 TRACE_MASK(TRACE_LOAD_FAILED) | TRACE_MASK(TRACE_WRITE_FAILED) | \
+									 TRACE_MASK(TRACE_WRITE_BACK) | TRACE_MASK(TRACE_SYNC))
+#define TRACE_FILE_EVENTS			0xFFFFFFFF
+#define SEEK_HISTORY_SIZE			8		// Number of recent seeks the prefetcher learns from
+#define PREFETCH_MAX_STRIDE			16		// Larger cylinder deltas are treated as random seeks
+#define PREFETCH_DEPTH				2		// How many strides ahead of the head to keep loaded
+#define PREFETCH_REPORT_INTERVAL	1024	// Print prefetch statistics every this many seeks
+#define FILL_STEP_BYTES				(64 * 1024)	// Prefetches and the rest of a cylinder loaded a track first are read about this much at a time
+#define IMAGE_LOAD_CHUNK			(256 * 1024)	// Largest single read when loading a resident image in the background, which a miss may wait for
+#define MIN_SLOTS_FOR_HOLD			8		// Fewer slots than this and misses load whole cylinders rather than a track first
+#define REPLACEMENT_POLICY			REPLACEMENT_2Q	// Which cylinder to evict when a slot is needed
+#define REPLACEMENT_RECENT_SHARE	25		// Percentage of the slots 2Q leaves to cylinders only seen once when others want them
+#define REPLACEMENT_GHOST_FACTOR	2		// 2Q remembers evicted cylinders for this many times the number of slots of evictions
+#define PINNED_CYLINDERS			2		// The first cylinders of each drive (partition table, FAT, root directory) are never evicted
+#define WRITEBACK_MAX_GAP			4		// Clean sectors a write-back may span to merge two dirty runs
+#define WRITEBACK_SYNC_SECTORS		512		// Sync once this many sectors have been written back
+#define WRITEBACK_SYNC_INTERVAL		(COUNTS_PER_SECOND / 4)	// or once the oldest unsynced write is this old
+#define PERF_REPORT_INTERVAL		(COUNTS_PER_SECOND * 10)	// Print the datapath counters this often
+#define PERF_SLACK_WARNING			(2e-6 * HW_FREQ)	// Warn if sector data arrived with less time than this to spare
+#define PERF_SLACK_BINS				8
+#define REPORT_TEXT_SIZE			4096	// Reports waiting to be printed
+#define MAIN_LOOP_WAKE_BIT			16		// The idle main loop wakes each time this bit of the counter goes high (every 1.3 ms)
+#define SD_ON_SECOND_CORE			1		// Do SD card I/O on core 1 rather than between passes of the main loop
+#define SD_RING_ENTRIES				8		// Must be a power of two
+#define SECOND_CORE_STACK_SIZE		(64 * 1024)
+#define SD_DRIVE					0		// FatFs physical drive the image is on
+#define SD_BLOCK_SIZE				512
+#define MAX_IMAGE_EXTENTS			64		// Images in more fragments than this are read and written through FatFs
+#define RAW_MAX_BLOCKS				2048	// Largest single transfer to or from the card
+#define USE_JOURNAL					true	// Write dirty sectors to the journal, and fold them into the images later
+#define JOURNAL_NAME				"JOURNAL.LOG"
+#define JOURNAL_SIZE				(8 * 1024 * 1024)	// The journal is folded in before it grows past this
+#define JOURNAL_RECORD_SIZE			(256 * 1024)		// Largest single journal record
+#define JOURNAL_FOLD_DELAY			(COUNTS_PER_SECOND / 10)	// Fold the journal in once nothing has been written back for this long
+#define OVERLAY_IMAGES				false	// Leave the images as they are and write to an overlay beside each (see emulation_file.h)
+#define OVERLAY_RESET_AT_BOOT		false	// Start new overlays at every boot, so the drives always start out as their images
+#define OVERLAY_TABLE_OFFSET		128		// Where a new overlay's track table goes, after its header and drive configuration
+
+// A length of time in fabric cycles: whole + (remainder / denominator). The sector timer and
+// the read datapath's bit clock take their periods in this form so that they keep exact time
+// over a revolution however it divides into cycles.
+struct cycle_ratio {
+	uint32_t whole;
+	uint32_t remainder;
+	uint32_t denominator;
+};
+
+// Sector address struct
+struct chs {
+	int c;
+	int h;
+	int s;
+};
+
+/* Xilinx Driver Instances */
+static XGpio drive_gpio_inst;
+static XGpio head_gpio_inst;
+
+XScuGic interrupt_controller;
+static XScuGic_Config *GicConfig;
+static FATFS fatfs;
+
+/* Memory Mapped Hardware Registers */
+
+// Shared by both drives, as the lines are on the daisy chained control cable
+volatile uint32_t* drive_select_gpio = (volatile uint32_t*) XPAR_GPIO_DRIVE_SELECT_BASEADDR;
+volatile uint32_t* head_select_gpio =  (volatile uint32_t*) XPAR_GPIO_HEAD_SELECT_BASEADDR;
+
+#define SLOT_TABLE		0x800	// Word offset of the track sequencer's slot table
+#define QUERY_ANSWERS	64		// Word offset of the command interface's Request Configuration answers
+#define COMMAND_INTERFACE_ENABLE	(QUERIES_IN_HARDWARE ? 0x1E : 0xE)	// Selected and enabled, and answering queries
+#define WRITE_RECORDS_BASE	64	// Word offset of the write datapath's completion records, two words each
+
+// DMA Stuff
+uint32_t write_descriptors[NUM_DRIVES][(0x40 * NUM_WRITE_DESCRIPTORS) / 4] __attribute__((section(".bram_memory"),aligned(0x40)));
+
+// Where the data region of an image is on the card, so that loads and write-backs can go
+// straight to the card in one multi-block transfer per contiguous run of clusters instead of
+// through FatFs
+struct image_extent {
+	uint32_t block;		// First block of the extent, counting from the start of the image file
+	LBA_t lba;			// Where that block is on the card
+	uint32_t blocks;
+};
+
+/* Drives */
+
+// Everything belonging to one emulated drive. Each has its own image file, geometry, command
+// interface, sector timer, datapaths, write DMA, track sequencer and performance counters.
+// The slots, the dirty sector tracking and the SD worker are shared between them.
+struct drive {
+	char image_name[IMAGE_NAME_LENGTH];		// The default unless DRIVE_CONFIG_NAME names another
+	char overlay_name[IMAGE_NAME_LENGTH];	// The image's name with .OVL in place of its extension
+	int select_code;			// Value on the drive select lines which selects this drive
+	bool present;				// Its image was loaded. Its interface is never enabled otherwise.
+
+	// Memory mapped hardware registers
+	volatile uint32_t* command_interface;
+	volatile uint32_t* sector_timer;
+	volatile uint32_t* dma;
+	volatile uint32_t* read_datapath;
+	volatile uint32_t* write_datapath;
+	volatile uint32_t* perf_counters;
+	volatile uint32_t* track_sequencer;
+
+	// The write DMA puts each sector the controller writes in the staging buffer of the next
+	// descriptor, and the write datapath adds a record saying where it was written to a ring
+	// the firmware drains. Descriptors are handed back to the DMA once their sector is copied out.
+	uint32_t* write_descriptors;
+	uint8_t* write_staging;					// NUM_WRITE_DESCRIPTORS buffers of WRITE_STAGING_SIZE bytes
+	int next_write_descriptor;				// The one holding the sector of the next record
+	uint32_t write_records_taken;			// Records drained from the write datapath so far
+
+	// Info pulled from the emulation file
+	struct emulation_header emu_header;
+	struct drive_configuration drive_conf;
+	int cylinder_size;
+	int track_stride;			// Bytes from one track of a cylinder to the next, both in the image and in a slot
+	int rpm;
+	struct cycle_ratio sector_cycles;
+	struct cycle_ratio halfbit_cycles;		// Half a period of the read clock
+	FIL image_file;				// Only used by the SD worker once the main loop is running
+
+	// With overlays the image is only read, for the tracks its overlay doesn't hold, and
+	// image_file, emu_header and the track table are the overlay's
+	bool overlaid;
+	bool overlay_new;			// Made at this boot, so anything in the journal for the drive was for an old one
+	bool overlay_discard;		// DRIVE_CONFIG_NAME asks for the overlay to be started again at boot
+	bool overlay_commit;		// DRIVE_CONFIG_NAME asks for the overlay's tracks to be written into the image at boot
+	FIL base_file;
+	FSIZE_t base_data_offset;
+	struct image_extent base_extents[MAX_IMAGE_EXTENTS];	// Empty if the image couldn't be mapped
+	int num_base_extents;
+
+	// Version 2 images only: where each track is stored, and how many track records there are.
+	// Only the SD worker changes these once the main loop is running.
+	bool sparse;
+	struct track_entry* track_table;		// A track_entry for each track
+	uint32_t num_records;
+
+	// Empty if the image couldn't be mapped, in which case FatFs is used for it
+	struct image_extent image_extents[MAX_IMAGE_EXTENTS];
+	int num_image_extents;
+	bool image_mapped;			// Track records added to a version 2 image are mapped too
+
+	// Tables with an entry for each cylinder, made at boot for the image's geometry (see
+	// allocate_drive_tables)
+	int16_t* cylinder_map;		// For converting cylinder# to slot#
+	bool* cylinder_loading;
+
+	// A miss loads the selected head's track first and the rest of the cylinder behind it.
+	// Sectors the controller writes to a track of that slot before it has been loaded go to the
+	// same place in the hold slot instead, and are copied over once it has. A later miss only
+	// takes the hold slot over once nothing is held there, and a seek back to an earlier slot
+	// which is still being loaded waits for it.
+	int partial_slot;			// Which slot the hold slot is for, -1 if none
+	int hold_slot;				// -1 if there wasn't room for one, in which case misses load whole cylinders
+	int held_sectors;			// Written to the hold slot and not yet copied over
+
+	// Current state as driven by the controller
+	int current_cylinder;
+	int current_head;
+
+	// The cylinder selected before the last seek. A sector written just before the seek may
+	// still be on its way to DDR, so its slot is kept as well as the current one.
+	int last_cyl;
+
+	// The general status which is returned to the ESDI controller. Only changed through
+	// set_general_status, which keeps the command interface's copy in step.
+	uint16_t general_status;
+
+	bool cyl_load_needed;
+
+	// The most recent seek destinations, used to detect sequential and strided access
+	int seek_history[SEEK_HISTORY_SIZE];
+	int seek_history_next;
+
+	int last_prefetch_report;
+	int reported_unchanged_writes;
+	uint32_t reported_queries;			// Queries the command interface had answered at the last report
+
+	// Cylinders to load in the background after boot, in order, and the first of them which
+	// hasn't been asked for yet
+	uint16_t* warm_up;
+	int warm_up_length;
+	int warm_up_next;
+	int pinned_cylinders;		// The drive's first cylinders, never evicted once loaded
+};
+
+struct drive drives[NUM_DRIVES] = {
+	{
+		.image_name = "MICROP~1.EMU",
+		.select_code = 2,
+		.command_interface = (volatile uint32_t*) XPAR_AXI_ESDI_CMD_CONTROL_0_BASEADDR,
+		.sector_timer =      (volatile uint32_t*) XPAR_SECTOR_TIMER_0_BASEADDR,
+		.dma =               (volatile uint32_t*) XPAR_AXI_DMA_0_BASEADDR,
+		.read_datapath =     (volatile uint32_t*) XPAR_READ_DATAPATH_0_BASEADDR,
+		.write_datapath =    (volatile uint32_t*) XPAR_WRITE_DATAPATH_0_BASEADDR,
+		.perf_counters =     (volatile uint32_t*) XPAR_PERF_COUNTERS_0_BASEADDR,
+		.track_sequencer =   (volatile uint32_t*) XPAR_TRACK_SEQUENCER_0_BASEADDR,
+		.write_descriptors = write_descriptors[0],
+	},
+	{
+		.image_name = "DRIVE_B.EMU",
+		.select_code = 3,
+		.command_interface = (volatile uint32_t*) XPAR_AXI_ESDI_CMD_CONTROL_1_BASEADDR,
+		.sector_timer =      (volatile uint32_t*) XPAR_SECTOR_TIMER_1_BASEADDR,
+		.dma =               (volatile uint32_t*) XPAR_AXI_DMA_1_BASEADDR,
+		.read_datapath =     (volatile uint32_t*) XPAR_READ_DATAPATH_1_BASEADDR,
+		.write_datapath =    (volatile uint32_t*) XPAR_WRITE_DATAPATH_1_BASEADDR,
+		.perf_counters =     (volatile uint32_t*) XPAR_PERF_COUNTERS_1_BASEADDR,
+		.track_sequencer =   (volatile uint32_t*) XPAR_TRACK_SEQUENCER_1_BASEADDR,
+		.write_descriptors = write_descriptors[1],
+	},
+};
+
+#define DRIVE_NUMBER(d)		((int) ((d) - drives))
+
+// Interrupt IDs of each drive's hardware
+struct drive_interrupts {
+	int command;
+	int track_sequencer;
+	int write_datapath;
+	int dma_s2mm;
+};
+
+const struct drive_interrupts drive_interrupts[NUM_DRIVES] = {
+	{
+		.command = XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_0_INTERRUPT_INTR,
+		.track_sequencer = XPAR_FABRIC_TRACK_SEQUENCER_0_INTERRUPT_INTR,
+		.write_datapath = XPAR_FABRIC_WRITE_DATAPATH_0_INTERRUPT_INTR,
+		.dma_s2mm = XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR,
+	},
+	{
+		.command = XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_1_INTERRUPT_INTR,
+		.track_sequencer = XPAR_FABRIC_TRACK_SEQUENCER_1_INTERRUPT_INTR,
+		.write_datapath = XPAR_FABRIC_WRITE_DATAPATH_1_INTERRUPT_INTR,
+		.dma_s2mm = XPAR_FABRIC_AXI_DMA_1_S2MM_INTROUT_INTR,
+	},
+};
+
+// Storage for emulated sector data
+// This is all of the DDR which is not used by the program itself (see lscript.ld). The start
+// of it holds each drive's write staging buffers, then the tables sized by the images'
+// geometry and the number of slots as they are made at boot (see boot_alloc), and the rest is
+// divided into as many slots as the geometry of the images allows.
+#define WRITE_STAGING_BYTES			(NUM_WRITE_DESCRIPTORS * WRITE_STAGING_SIZE)	// For each drive
+extern uint8_t __slot_buffers_start[];
+extern uint8_t __slot_buffers_end[];
+uint8_t* buffers = &__slot_buffers_start[NUM_DRIVES * WRITE_STAGING_BYTES];	// AXI DMA and the track sequencer require alignment of at least 4
+int slot_size = 0;		// The largest cylinder of any drive
+
+// Sectors which have been written by the controller but not yet written back to the SD card.
+// Each track has a bitmap with one bit per sector, and each slot keeps a count of its dirty
+// sectors so that eviction can tell whether a slot is clean without looking at its bitmaps.
+// A slot has a bitmap for each head of the drive with the most heads.
+#define DIRTY_WORDS_PER_TRACK		((MAX_SUPPORTED_SECTORS + 31) / 32)
+typedef uint32_t track_bitmap[DIRTY_WORDS_PER_TRACK];
+track_bitmap* dirty_bitmap;
+int dirty_heads = 0;
+int* dirty_sector_count;
+track_bitmap held_bitmap[NUM_DRIVES][MAX_SUPPORTED_HEADS];	// Sectors waiting in each drive's hold slot
+uint32_t* dirty_slots;				// One bit for each slot with dirty sectors
+int last_written_back_slot = 0;
+
+// The data in 'buffers' is divided into slots, each slot holds a cylinder of either drive.
+// These tables, like the others with an entry for each slot, are made at boot for the number
+// of slots there is room for (see allocate_slot_tables).
+int num_slots;
+bool image_resident = false;		// Every cylinder is loaded, so there is never a miss
+uint8_t* slot_to_drive_map;			// Drive number of the cylinder in the slot
+int16_t* slot_to_cylinder_map;		// -1 if the slot is free
+bool* slot_prefetched;				// Loaded speculatively and not yet seeked to
+uint16_t* slot_missing_tracks;		// A bit for each head of the cylinder still to be loaded
+
+int current_drive_sel = 0;		// As driven by the controller
+
+// Sectors written to the image files since the last f_sync, and when the first of them was written
+int unsynced_sectors = 0;
+uint64_t first_unsynced_write;
+
+uint8_t raw_block_buffer[SD_BLOCK_SIZE] __attribute__((aligned(64)));	// Partial blocks at either end of a raw transfer
+
+// Where each drive's turn comes next, so that neither can starve the other of loads,
+// write-backs or prefetches
+int next_load_drive = 0;
+int next_write_back_drive = 0;
+int next_prefetch_drive = 0;
+
+// Prefetch statistics for each drive
+int seek_count[NUM_DRIVES];
+int prefetch_issued[NUM_DRIVES];		// Cylinders loaded speculatively
+int prefetch_hits[NUM_DRIVES];			// Seeks that landed on a prefetched cylinder
+int prefetch_wasted[NUM_DRIVES];		// Prefetched cylinders evicted without ever being seeked to
+int seek_misses[NUM_DRIVES];			// Seeks that had to wait for a cylinder load
+
+int unchanged_writes[NUM_DRIVES];		// Sectors the controller rewrote with what they already held
+
+/* Slot replacement */
+
+// Which slot a miss or a prefetch takes is decided by one of two policies. Both keep the slots
+// on doubly linked lists threaded through slot_next and slot_prev, so a hit or a load moves
+// one slot and a victim is normally the tail of a list.
+//
+// REPLACEMENT_LRU keeps every loaded slot on the recent list, most recently used first.
+//
+// REPLACEMENT_2Q puts a cylinder loaded for the first time on the recent list, in the order
+// they were loaded, and a seek to it doesn't move it. Once that list has more than its share
+// of the slots its oldest cylinder is evicted first. A cylinder evicted from it is remembered
+// for a while, and if it is loaded again in that time it goes on the frequent list instead,
+// which is kept in LRU order. A surface scan, or a run of prefetches, so only ever cycles
+// through the recent list's slots and leaves the cylinders the controller keeps coming back to.
+//
+// Pinned slots are on no list, and neither are slots being loaded.
+enum replacement_policy {
+	REPLACEMENT_LRU,
+	REPLACEMENT_2Q,
+	NUM_REPLACEMENT_POLICIES
+};
+
+enum slot_list_id {
+	SLOT_LIST_NONE,
+	SLOT_LIST_FREE,
+	SLOT_LIST_RECENT,
+	SLOT_LIST_FREQUENT,
+	NUM_SLOT_LISTS
+};
+
+struct slot_list {
+	int head;		// -1 if the list is empty
+	int tail;
+	int length;
+};
+
+struct replacement_stats {
+	int hits;			// Seeks to a cylinder already in a slot
+	int misses;			// Seeks which had to wait for a cylinder to be loaded
+	int evictions;		// Cylinders unloaded to make room for another
+	int promotions;		// Cylinders loaded again soon after being evicted (2Q only)
+};
+
+const char* const replacement_policy_names[NUM_REPLACEMENT_POLICIES] = {"LRU", "2Q"};
+int replacement_policy = REPLACEMENT_POLICY;		// Only changed before the main loop starts
+struct replacement_stats replacement_stats[NUM_REPLACEMENT_POLICIES];
+struct slot_list slot_lists[NUM_SLOT_LISTS];
+int16_t* slot_next;					// Towards the tail
+int16_t* slot_prev;
+uint8_t* slot_list_of;
+bool* slot_pinned;
+int pinned_slots = 0;
+
+// 2Q's memory of cylinders evicted from the recent list: the eviction count just after each
+// was evicted, 0 if it is not remembered
+uint32_t recent_evictions = 0;
+uint32_t* cylinder_evicted_at[NUM_DRIVES];		// For each cylinder of each drive
+
+/* Tracing */
+
+// Events are recorded as fixed size binary records and only formatted when the main loop
+// drains them. Any context may record an event: a position is claimed with a compare and
+// swap on trace_head, and the record's sequence number is written last to mark it complete.
+// Only one context advances trace_tail: the main loop when the trace is printed, or the SD
+// worker when it goes to a file. When the ring is full new events are dropped and counted,
+// and the count is reported in the trace itself.
+struct trace_record trace_ring[TRACE_ENTRIES];
+uint32_t trace_head = 0;
+uint32_t trace_tail = 0;
+uint32_t trace_enabled = TRACE_UART_EVENTS;		// Mask of the event types to record
+uint32_t trace_dropped[NUM_TRACE_EVENTS];
+uint32_t trace_dropped_reported[NUM_TRACE_EVENTS];
+bool trace_to_file = TRACE_TO_FILE;
+FIL trace_file;
+
+#define TRACE_FORMAT(name, format)	format,
+static const char* const trace_formats[NUM_TRACE_EVENTS] = {
+	TRACE_EVENTS(TRACE_FORMAT)
+};
+
+/* SD card worker */
+
+// All SD card I/O is done by the SD worker, on core 1 when SD_ON_SECOND_CORE is set, so that
+// a slow card never holds up the main loop. The main loop sends it requests through two
+// single producer, single consumer rings: loads go in one, which is always served first, and
+// write-backs and syncs in the other, served in order. A write-back which a load is waiting
+// for goes in with the loads. The worker answers every request in the completion ring.
+enum sd_request {
+	SD_LOAD,
+	SD_PREFETCH,
+	SD_FILL,			// The rest of a cylinder loaded a track first
+	SD_PRELOAD,			// Consecutive cylinders of a resident image into consecutive slots
+	SD_WRITE_BACK,
+	SD_SYNC,
+	SD_CHECKPOINT,		// Fold the journal into the images
+	SD_SAVE_WARM_SET,
+};
+
+struct sd_message {
+	int type;
+	int drive;
+	int slot;
+	int cylinder;
+	int cylinder_unloaded;		// Loads: what the slot held before, for the trace
+	uint32_t tracks;			// Loads: a bit for each head to read
+	uint32_t tracks_left;		// Prefetches and fills: the heads not read yet, as they are read a step at a time
+	int count;					// Syncs: sectors being synced. Checkpoints: write-backs being folded in. Preloads: cylinders.
+								// Write-back completions: sectors written
+	bool ok;					// Completions: whether the card did what was asked. Prefetches: whether it has so far.
+	bool warm_up;				// Prefetches: loading the warm set rather than a predicted cylinder
+	track_bitmap bitmap[MAX_SUPPORTED_HEADS];	// Write-backs: the sectors to write, a bitmap for each head of the drive
+};
+
+// The producer only writes head and the consumer only writes tail, each on its own cache line.
+// A message stays in the ring until the consumer is done with it.
+struct sd_ring {
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	struct sd_message entries[SD_RING_ENTRIES] __attribute__((aligned(64)));
+};
+
+struct sd_ring sd_load_ring;
+struct sd_ring sd_write_back_ring;
+struct sd_ring sd_completion_ring;
+
+/* Journal */
+
+// Write-backs are appended to one journal file shared by the drives, as records of whole
+// blocks each holding the pieces of one cylinder an in place write-back would have written, so
+// that each takes one sequential write rather than one for every run of sectors. Once nothing
+// has been written back for JOURNAL_FOLD_DELAY, the main loop has the SD worker fold the
+// records into the images a step at a time, between other requests, then start the journal
+// again from the beginning. Records still in the journal at startup are folded in before any
+// cylinder is loaded. A record only counts if it has the next sequence number and its checksum
+// matches, so a torn record ends the journal. Only the SD worker touches the journal once the
+// main loop is running.
+#define JOURNAL_MAGIC				0x4C4E524A		// "JRNL"
+#define JOURNAL_RECORDS_START		SD_BLOCK_SIZE	// The header has the first block to itself
+
+struct journal_header {
+	uint32_t magic;
+	uint32_t sequence;			// Of the first record
+	uint32_t checksum;			// Of the fields above
+};
+
+// A piece of a slot, which is where it goes in the image too
+struct slot_extent {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct journal_record {
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t length;			// Padded to a whole number of blocks
+	uint32_t checksum;			// Of the record up to the end of its last piece, with this field zero
+	uint16_t drive;
+	uint16_t cylinder;
+	uint16_t extents;
+	uint16_t reserved;
+	// Followed by a slot_extent for each piece, then their contents in the same order
+};
+
+// Which cylinder a record is for and where it is in the journal, so that a cylinder loaded
+// before its records are folded in can have them copied over it
+struct journal_index_entry {
+	uint16_t drive;				// JOURNAL_NO_DRIVE for a record which is dropped rather than folded in
+	uint16_t cylinder;
+	uint32_t offset;
+};
+
+#define JOURNAL_NO_DRIVE			0xFFFF
+
+// More pieces than a write-back can have, as runs of dirty sectors which aren't merged are
+// more than WRITEBACK_MAX_GAP sectors apart
+#define MAX_WRITE_BACK_EXTENTS		((MAX_SUPPORTED_HEADS * MAX_SUPPORTED_SECTORS) / 2)
+
+bool journal_enabled = USE_JOURNAL;
+bool overlays_enabled = OVERLAY_IMAGES;
+FIL journal_file;
+uint32_t journal_sequence;			// Of the next record to be appended
+FSIZE_t journal_append;				// Where it goes
+uint32_t journal_fold_sequence;		// Of the next record to be folded in
+FSIZE_t journal_fold;				// Where it is
+int journal_folded_records;
+uint32_t journal_folded_bytes;
+int journal_records;				// Appended since the journal was started again
+struct journal_index_entry journal_index[JOURNAL_SIZE / SD_BLOCK_SIZE];
+uint32_t* journal_pending[NUM_DRIVES];	// A bit for each cylinder with records not yet folded in
+uint8_t journal_buffer[JOURNAL_RECORD_SIZE] __attribute__((aligned(64)));
+struct slot_extent write_back_extents[MAX_WRITE_BACK_EXTENTS];	// Only used by the SD worker
+struct slot_extent journal_extents[MAX_WRITE_BACK_EXTENTS];
+uint32_t crc32_table[256];
+
+/* Warm set */
+
+// Each drive counts the seeks to each of its cylinders, and every WARM_SET_SAVE_INTERVAL the
+// main loop picks out the most used and has the SD worker write them to WARM_SET_NAME, then
+// halves the counts so that the set follows what the controller is doing now. At boot the
+// drives are made ready straight away, without anything loaded, and their cylinders are loaded
+// in the background in the order the set gives, after the pinned ones and before the lowest
+// numbered ones which make up the rest of each drive's share of the slots. They go in with the
+// prefetches, so a seek to a cylinder which isn't loaded yet is always served first.
+#define WARM_SET_MAGIC				"ESDIWRM1"
+#define WARM_SET_END				0xFFFF
+
+struct warm_set_file {
+	char magic[8];
+	uint16_t drive_cylinders[NUM_DRIVES];	// The geometry the set was recorded for, 0 if the drive wasn't present
+	uint16_t cylinders[NUM_DRIVES][WARM_SET_CYLINDERS];	// Hottest first, WARM_SET_END after the last
+};
+
+uint16_t* cylinder_heat[NUM_DRIVES];	// Seeks to each cylinder, decaying
+int warm_set_seeks;					// Total of seek_count when the set was last recorded
+struct warm_set_file warm_set __attribute__((aligned(64)));	// Left alone while the SD worker writes it
+
+// State of the requests in flight, only used by the main loop
+bool* slot_busy;					// Being loaded or written back, so it can't be evicted
+bool prefetch_in_flight = false;
+bool sync_in_flight = false;
+bool checkpoint_in_flight = false;
+bool warm_set_save_in_flight = false;
+int unfolded_write_backs = 0;		// Write-backs to the journal since the last checkpoint was asked for
+uint64_t last_write_back;
+int eviction_slot = -1;			// Dirty slot being written back so that it can be evicted
+
+static inline uint64_t read_cntvct(void)
+{
+#ifdef __aarch64__
+    uint64_t val;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+    return val;
+#else
+    XTime val;		// Host build (see host_sim/)
+    XTime_GetTime(&val);
+    return val;
+#endif
+}
+
+// Record an event in the trace ring, for a drive or for none (-1). Safe to call from interrupt
+// handlers.
+void trace_event(int drive, int type, int32_t arg0, int32_t arg1, int32_t arg2) {
+	if (!(trace_enabled & TRACE_MASK(type)))
+		return;
+
+	uint64_t now = read_cntvct();
+	uint32_t position = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+	do {
+		if ((position - __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE)) >= TRACE_ENTRIES) {
+			__atomic_fetch_add(&trace_dropped[type], 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&trace_head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	struct trace_record* r = &trace_ring[position % TRACE_ENTRIES];
+	r->time = now;
+	r->type = type;
+	r->drive = (drive < 0) ? TRACE_NO_DRIVE : drive;
+	r->arg[0] = arg0;
+	r->arg[1] = arg1;
+	r->arg[2] = arg2;
+	__atomic_store_n(&r->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+// Called at the end of every pass of the main loop. The host build (see host_sim/) uses it
+// to let simulated time pass.
+#ifndef main_loop_yield
+#define main_loop_yield()
+#endif
+
+// The SD worker waits for an event when it has nothing to do, and the main loop sends one
+// whenever it gives it something. Overridden by the host build.
+#ifndef second_core_wake
+#define second_core_wake()		__asm__ volatile("dsb sy\n\tsev" ::: "memory")
+#define second_core_idle()		__asm__ volatile("wfe" ::: "memory")
+#endif
+
+/* Main loop scheduling */
+
+// Interrupt handlers and the SD worker post work for the main loop as a bit for each class in
+// work_pending, noting when the class was first posted. The main loop takes the bits at the
+// start of each pass, keeping how long each class waited, and deals with the work in priority
+// order: completions (which may let a seek complete), loads seeks are waiting for, write-backs,
+// syncs and checkpoints, prefetches and the warm-up, then the reports, which are put off while
+// anything is posted. A pass which finds nothing to do and nothing posted waits for an event:
+// an interrupt, the SD worker posting, or the timer's event stream, which wakes it every few
+// milliseconds so that syncs, checkpoints and reports which are only waiting for time are done.
+enum work_class {
+	WORK_COMPLETION,	// The SD worker has answered a request
+	WORK_SEEK_LOAD,		// A seek is waiting for a cylinder which isn't loaded
+	WORK_WRITE_BACK,	// A sector has become dirty
+	NUM_WORK_CLASSES,
 };
 
-struct __attribute__((packed)) emulation_header {
-    uint16_t file_version;
-    uint32_t drive_configuration_offset;
-    uint32_t data_offset;
-    uint16_t cylinders;
-    uint16_t heads;
-    uint16_t sectors_per_track;
-    uint16_t sector_size_in_image;
-};
+struct work_latency {
+	int count;				// Times the class was taken
+	uint64_t total;			// Counts from being posted to being taken
+	uint64_t max;
+};
+
+const char* const work_class_names[NUM_WORK_CLASSES] = {"completions", "seek loads", "write-backs"};
+uint32_t work_pending;
+uint64_t work_posted_at[NUM_WORK_CLASSES];
+struct work_latency work_latency[NUM_WORK_CLASSES];	// Since boot
+
+// Overridden by the host build, which lets simulated time pass between passes anyway
+#ifndef main_loop_idle
+#define main_loop_wake()		__asm__ volatile("dsb sy\n\tsev" ::: "memory")
+#define main_loop_idle()		__asm__ volatile("wfe" ::: "memory")
+
+// Have the generic timer send an event every time bit MAIN_LOOP_WAKE_BIT of the counter is set
+static void enable_main_loop_wake() {
+	uint64_t cntkctl;
+	__asm__ volatile("mrs %0, cntkctl_el1" : "=r"(cntkctl));
+	cntkctl = (cntkctl & ~0xFCull) | (MAIN_LOOP_WAKE_BIT << 4) | (1 << 2);	// EVNTI, EVNTDIR = 0, EVNTEN
+	__asm__ volatile("msr cntkctl_el1, %0\n\tisb" :: "r"(cntkctl) : "memory");
+}
+#endif
+
+// Post work for the main loop. Called from interrupt handlers and the SD worker, as well as the
+// main loop itself with interrupts disabled. Two posts of the same class never race, so the
+// time it was posted can be written before the bit is set.
+static void post_work(int class) {
+	if (!(__atomic_load_n(&work_pending, __ATOMIC_ACQUIRE) & (1u << class))) {
+		work_posted_at[class] = read_cntvct();
+		__atomic_fetch_or(&work_pending, 1u << class, __ATOMIC_RELEASE);
+	}
+	main_loop_wake();
+}
+
+// Take everything posted so far, noting how long each class waited
+static uint32_t take_work() {
+	uint32_t work = __atomic_exchange_n(&work_pending, 0, __ATOMIC_ACQUIRE);
+	uint64_t now = read_cntvct();
+
+	for (int i = 0; i < NUM_WORK_CLASSES; i++) {
+		if (work & (1u << i)) {
+			uint64_t waited = now - work_posted_at[i];
+			work_latency[i].count += 1;
+			work_latency[i].total += waited;
+			if (waited > work_latency[i].max)
+				work_latency[i].max = waited;
+		}
+	}
+	return work;
+}
+
+static inline bool work_posted() {
+	return __atomic_load_n(&work_pending, __ATOMIC_ACQUIRE) != 0;
+}
+
+// Space for the next message in a ring, or NULL if it is full. Only the producer may call this,
+// and the message is only sent once it calls sd_ring_push.
+static struct sd_message* sd_ring_next(struct sd_ring* ring) {
+	if ((ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= SD_RING_ENTRIES)
+		return NULL;
+	return &ring->entries[ring->head % SD_RING_ENTRIES];
+}
+
+// How many more messages the producer can put in a ring
+static uint32_t sd_ring_space(struct sd_ring* ring) {
+	return SD_RING_ENTRIES - (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+static void sd_ring_push(struct sd_ring* ring) {
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// The oldest message in a ring, or NULL if it is empty. Only the consumer may call this, and
+// the message stays put until it calls sd_ring_pop.
+static struct sd_message* sd_ring_peek(struct sd_ring* ring) {
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+		return NULL;
+	return &ring->entries[ring->tail % SD_RING_ENTRIES];
+}
+
+static void sd_ring_pop(struct sd_ring* ring) {
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+// Determine if a slot has sectors that have not been written back yet
+static inline bool slot_is_dirty(int slot) {
+	return dirty_sector_count[slot] != 0;
+}
+
+// Determine if any slot has sectors that have not been written back yet
+bool any_slot_dirty() {
+	for (int i = 0; i < (num_slots + 31) / 32; i++) {
+		if (dirty_slots[i])
+			return true;
+	}
+	return false;
+}
+
+// The dirty bitmap of each track of a slot
+static inline track_bitmap* slot_dirty_bitmap(int slot) {
+	return &dirty_bitmap[slot * dirty_heads];
+}
+
+static inline uint8_t* slot_buffer(int slot) {
+	return &buffers[(size_t) slot * slot_size];
+}
+
+// Take a zeroed table from the start of the memory the slots are made from. Only at boot,
+// before the slots are made. Returns NULL if there isn't room for it.
+static void* boot_alloc(size_t size) {
+	size_t rounded = (size + 63) & ~(size_t) 63;
+	void* table = buffers;
+
+	if (rounded > (size_t) (__slot_buffers_end - buffers))
+		return NULL;
+
+	memset(table, 0, size);
+	buffers += rounded;
+	return table;
+}
+
+// Tell a drive's track sequencer where a cylinder is in memory, or that it isn't (slot -1). A
+// cylinder which is still being loaded only counts as there while the selected head's track
+// is, so that the read datapath stays silent on the others.
+void set_slot_table_entry(struct drive* d, int cylinder, int slot) {
+	if ((slot == -1) || (slot_missing_tracks[slot] & (1u << d->current_head)))
+		d->track_sequencer[SLOT_TABLE + cylinder] = 0;
+	else
+		d->track_sequencer[SLOT_TABLE + cylinder] = ((uint32_t) (intptr_t) slot_buffer(slot)) | 1;
+}
+
+// Whether a seek to the cylinder in a slot can complete. One which is still being loaded can,
+// unless writes to the tracks it hasn't got yet would have nowhere to go.
+static inline bool slot_ready(struct drive* d, int slot) {
+	return !slot_missing_tracks[slot] || (slot == d->partial_slot);
+}
+
+// Take a slot off whichever replacement list it is on. The list functions are also used by the
+// seek handler, so the main loop must call them with interrupts disabled.
+static void slot_list_remove(int slot) {
+	struct slot_list* list = &slot_lists[slot_list_of[slot]];
+
+	if (slot_list_of[slot] == SLOT_LIST_NONE)
+		return;
+
+	if (slot_prev[slot] != -1)
+		slot_next[slot_prev[slot]] = slot_next[slot];
+	else
+		list->head = slot_next[slot];
+
+	if (slot_next[slot] != -1)
+		slot_prev[slot_next[slot]] = slot_prev[slot];
+	else
+		list->tail = slot_prev[slot];
+
+	list->length -= 1;
+	slot_list_of[slot] = SLOT_LIST_NONE;
+}
+
+// Put a slot at the head of a list, taking it off any other first
+static void slot_list_push(int list_id, int slot) {
+	struct slot_list* list = &slot_lists[list_id];
+
+	slot_list_remove(slot);
+	slot_prev[slot] = -1;
+	slot_next[slot] = list->head;
+	if (list->head != -1)
+		slot_prev[list->head] = slot;
+	else
+		list->tail = slot;
+	list->head = slot;
+	list->length += 1;
+	slot_list_of[slot] = list_id;
+}
+
+// A seek has landed on the cylinder in a slot. Only LRU, and 2Q's frequent list, care.
+void slot_used(int slot) {
+	if ((slot_list_of[slot] == SLOT_LIST_FREQUENT) ||
+		((slot_list_of[slot] == SLOT_LIST_RECENT) && (replacement_policy == REPLACEMENT_LRU)))
+		slot_list_push(slot_list_of[slot], slot);
+}
+
+// Point a drive's track sequencer at its selected cylinder and head. It silences the read
+// datapath and starts streaming the new track as soon as the first sectors have been fetched.
+void select_track(struct drive* d) {
+	int slot = d->cylinder_map[d->current_cylinder];
+	if ((slot != -1) && slot_missing_tracks[slot])
+		set_slot_table_entry(d, d->current_cylinder, slot);
+
+	d->track_sequencer[1] = (d->current_head << 16) | d->current_cylinder;
+}
+
+void drain_write_records(struct drive* d);
+
+// Change a drive's general status word. The command interface answers Request Status from its
+// own copy, so it is always changed here.
+void set_general_status(struct drive* d, uint16_t status) {
+	d->general_status = status;
+	d->command_interface[5] = status;
+}
+
+// The answer to Request Configuration with this modifier and subscript
+uint16_t query_answer(struct drive* d, int modifier, int subscript) {
+	if (modifier != 0)
+		return d->drive_conf.specific_configuration[modifier - 1];
+	if (subscript >= 20)
+		return 0;
+
+	// Mask out support for track offset and data strobe offset support.
+	return d->drive_conf.general_configuration[subscript] & 0xCFFE;
+}
+
+// Handle for commands and configuration/status queries from the ESDI controller. Each drive
+// has its own command interface, which only takes commands while the drive is selected.
+void command_interrupt_handler(void* arg) {
+	struct drive* d = arg;
+	int drive = DRIVE_NUMBER(d);
+
+	// Check that there is actually a command pending
+    if ((d->command_interface[1] & 0x2)) {
+        uint32_t command = d->command_interface[2];
+
+        uint32_t cmd = (command >> 12) & 0xf;
+        uint32_t modifier = (command >> 8) & 0xf;
+        uint32_t subscript = command & 0xff;
+
+        trace_event(drive, TRACE_COMMAND, command, 0, 0);
+
+        if ((cmd == 0x0) || (cmd == 0x1)) {	// Seek, or recalibrate, which is a seek to cylinder 0
+            int new_cylinder = (cmd == 0x1) ? 0 : (command & 0x0FFF);
+            drain_write_records(d);		// While the slots the records refer to are sure to be there
+            if (new_cylinder >= d->emu_header.cylinders)	// Past the last cylinder the heads stay where they are
+            	new_cylinder = d->current_cylinder;
+            if (new_cylinder != d->current_cylinder) {
+            	d->last_cyl = d->current_cylinder;
+            	d->current_cylinder = new_cylinder;
+            	select_track(d);
+            }
+
+            d->seek_history[d->seek_history_next] = d->current_cylinder;
+            d->seek_history_next = (d->seek_history_next + 1) % SEEK_HISTORY_SIZE;
+            seek_count[drive] += 1;
+            if (cylinder_heat[drive][d->current_cylinder] != UINT16_MAX)
+            	cylinder_heat[drive][d->current_cylinder] += 1;
+
+			// Check if cylinder is already loaded
+            int slot = d->cylinder_map[d->current_cylinder];
+			if (slot == -1) {
+				d->cyl_load_needed = true;
+				post_work(WORK_SEEK_LOAD);
+				seek_misses[drive] += 1;
+				replacement_stats[replacement_policy].misses += 1;
+			} else {
+				replacement_stats[replacement_policy].hits += 1;
+				slot_used(slot);
+				if (!slot_ready(d, slot)) {
+					d->cyl_load_needed = true;
+				} else if (slot_prefetched[slot]) {
+					slot_prefetched[slot] = false;
+					prefetch_hits[drive] += 1;
+				}
+			}
+
+			trace_event(drive, TRACE_SEEK, d->current_cylinder, slot, 0);
+
+			// If cylinder is already loaded, assert command complete
+			if (!d->cyl_load_needed) {
+				d->command_interface[3] = 0;
+				trace_event(drive, TRACE_SEEK_COMPLETE, d->current_cylinder, 0, 0);
+			}
+
+        } else if (cmd == 0x2) {	// Request Status (only with bad parity, or QUERIES_IN_HARDWARE false)
+            d->command_interface[2] = d->general_status;
+            d->command_interface[3] = 0;	// Clear the command pending bit
+        } else if (cmd == 0x3) {	// Request Configuration
+            d->command_interface[2] = query_answer(d, modifier, subscript);
+            d->command_interface[3] = 0;	// Clear the command pending bit
+        } else if (cmd == 0x5) {	// "Control"
+        	if (modifier == 0) {	// 		Reset interface attention and standard status
+        		set_general_status(d, 0);
+        	}
+        	d->command_interface[3] = 0;	// Clear the command pending bit
+        }
+    }
+}
+
+// The drive the controller has selected, or NULL if it isn't one of ours
+struct drive* selected_drive() {
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present && (drives[i].select_code == current_drive_sel))
+			return &drives[i];
+	}
+	return NULL;
+}
+
+// Enable the interface of the drive which is now selected and disable the others. The head
+// select lines are shared, so the newly selected drive picks up whatever head they select.
+void drive_sel_interrupt_handler(void* arg) {
+    if (XGpio_InterruptGetStatus(&drive_gpio_inst) & 0x1) {
+        XGpio_InterruptClear(&drive_gpio_inst, 1);
+        int new_dsel = drive_select_gpio[0];
+        if (new_dsel != current_drive_sel) {
+            current_drive_sel = new_dsel;
+            trace_event(-1, TRACE_DRIVE_SELECT, new_dsel, 0, 0);
+
+            struct drive* selected = selected_drive();
+            for (int i = 0; i < NUM_DRIVES; i++) {
+            	if (&drives[i] != selected)
+            		drives[i].command_interface[0] = 0x0;		// Disable interface
+            }
+
+            if (selected) {
+            	int head = head_select_gpio[0];
+            	if (head != selected->current_head) {
+            		selected->current_head = head;
+            		select_track(selected);
+            	}
+            	selected->command_interface[0] = COMMAND_INTERFACE_ENABLE;		// Enable interface
+            }
+        }
+    }
+}
+
+// Point the selected drive's track sequencer at the new head
+void head_sel_interrupt_handler(void* arg) {
+    if (XGpio_InterruptGetStatus(&head_gpio_inst) & 0x1) {
+        XGpio_InterruptClear(&head_gpio_inst, 1);
+        int new_hsel = head_select_gpio[0];
+        struct drive* d = selected_drive();
+        if (d && (new_hsel != d->current_head)) {
+        	d->current_head = new_hsel;
+        	select_track(d);
+        	trace_event(DRIVE_NUMBER(d), TRACE_HEAD_SELECT, new_hsel, 0, 0);
+        }
+    }
+}
+
+// Track Sequencer Interrupt Routine
+// Fires when the read datapath comes out of silence after a head or cylinder change, only
+// so that the trace shows how long that took.
+void track_sequencer_interrupt_handler(void* arg) {
+	struct drive* d = arg;
+	uint32_t status = d->track_sequencer[0];	// Reading this register has the side effect of clearing the interrupt condition
+	(void) status;
+
+	trace_event(DRIVE_NUMBER(d), TRACE_READ_RELEASE, d->current_cylinder, d->current_head, d->track_sequencer[10]);
+}
+
+// Record that a sector of a slot has been written by the controller
+static void mark_sector_dirty(struct drive* d, int slot, struct chs address) {
+	uint32_t* word = &slot_dirty_bitmap(slot)[address.h][address.s >> 5];
+	uint32_t bit = 1u << (address.s & 31);
+	if (!(*word & bit)) {
+		*word |= bit;
+		dirty_sector_count[slot] += 1;
+		dirty_slots[slot >> 5] |= 1u << (slot & 31);
+		post_work(WORK_WRITE_BACK);
+		trace_event(DRIVE_NUMBER(d), TRACE_SECTOR_DIRTY, address.c, address.h, address.s);
+	}
+}
+
+// Copy a sector from a drive's hold slot to the slot it was written to, once its track has
+// been loaded there
+static void release_held_sector(struct drive* d, int slot, struct chs address) {
+	int offset = (address.h * d->track_stride) + (address.s * d->emu_header.sector_size_in_image);
+	memcpy(&slot_buffer(slot)[offset], &slot_buffer(d->hold_slot)[offset], d->emu_header.sector_size_in_image);
+	held_bitmap[DRIVE_NUMBER(d)][address.h][address.s >> 5] &= ~(1u << (address.s & 31));
+	d->held_sectors -= 1;
+	mark_sector_dirty(d, slot, address);
+}
+
+static inline bool write_descriptor_complete(struct drive* d, int descriptor) {
+	return (d->write_descriptors[((descriptor * 0x40) + 0x1C) >> 2] & (1u << 31)) != 0;
+}
+
+// Take the records the write datapath has added since the last call, copying each written
+// sector from its staging buffer to where it belongs. A sector for a track which is still to
+// be loaded would be overwritten by it, so it goes to the hold slot instead; writing one which
+// is already held again replaces it. If a sector hasn't all reached its staging buffer yet,
+// it and the records after it wait for the DMA interrupt.
+void drain_write_records(struct drive* d) {
+	uint32_t produced = d->write_datapath[2];
+	uint32_t taken = d->write_records_taken;
+
+	while (taken != produced) {
+		uint32_t record = d->write_datapath[WRITE_RECORDS_BASE + (2 * (taken % WRITE_RECORDS))];
+		struct chs address = { (record >> 8) & 0xFFFF, (record >> 24) & 0xF, record & 0xFF };
+
+		if (record & (1u << 31)) {		// Check if the sector was written
+			int descriptor = d->next_write_descriptor;
+
+			if (!write_descriptor_complete(d, descriptor)) {
+				// The write datapath's interrupt would keep firing until then, so it is off
+				// while the DMA's is on. Look again in case the descriptor completed before that.
+				d->write_datapath[0] = 0x1;
+				d->dma[0x34 >> 2] = (1 << 12);
+				d->dma[0x30 >> 2] = 0x1 | (1 << 12);
+				if (!write_descriptor_complete(d, descriptor))
+					break;
+				d->dma[0x30 >> 2] = 0x1;
+				d->write_datapath[0] = 0x5;
+			}
+
+			// Each staging buffer starts with the label of the sector in it. After records
+			// were dropped, the buffers of the sectors they were for are skipped. A sector
+			// written with a head selected which the drive doesn't have goes nowhere.
+			uint8_t* staged = &d->write_staging[descriptor * WRITE_STAGING_SIZE];
+			bool matches = staged[0] == address.s;
+			bool in_image = (address.c < d->emu_header.cylinders) && (address.h < d->emu_header.heads) &&
+							(address.s < d->emu_header.sectors_per_track);
+			if ((matches || !(record & (1 << 29))) && in_image) {
+				int length = d->write_descriptors[((descriptor * 0x40) + 0x1C) >> 2] & 0x3FFFFFF;
+				if (length > d->emu_header.sector_size_in_image)
+					length = d->emu_header.sector_size_in_image;
+
+				int slot = d->cylinder_map[address.c];
+				int offset = (address.h * d->track_stride) + (address.s * d->emu_header.sector_size_in_image);
+				if (slot == -1) {
+					// Only possible if the controller writes before its first seek completes,
+					// as the drives are ready before anything is loaded. There is nowhere to put it.
+					trace_event(DRIVE_NUMBER(d), TRACE_WRITE_UNLOADED, address.c, address.h, address.s);
+				} else if (slot_missing_tracks[slot] & (1u << address.h)) {
+					uint32_t* held = &held_bitmap[DRIVE_NUMBER(d)][address.h][address.s >> 5];
+					uint32_t bit = 1u << (address.s & 31);
+					memcpy(&slot_buffer(d->hold_slot)[offset], staged, length);
+					if (!(*held & bit))
+						d->held_sectors += 1;
+					*held |= bit;
+				} else if (!memcmp(&slot_buffer(slot)[offset], staged, length)) {
+					// A verify pass, a format or an OS rewriting a block often writes back
+					// what is already there, which needn't be written back again
+					unchanged_writes[DRIVE_NUMBER(d)] += 1;
+					trace_event(DRIVE_NUMBER(d), TRACE_SECTOR_UNCHANGED, address.c, address.h, address.s);
+				} else {
+					memcpy(&slot_buffer(slot)[offset], staged, length);
+					mark_sector_dirty(d, slot, address);
+				}
+			}
+
+			// Hand the descriptor back to the DMA
+			d->write_descriptors[((descriptor * 0x40) + 0x1C) >> 2] = 0;
+			d->dma[0x40 >> 2] = (uint32_t) (intptr_t) &d->write_descriptors[(descriptor * 0x40) >> 2];
+			d->next_write_descriptor = (descriptor + 1) % NUM_WRITE_DESCRIPTORS;
+
+			if (!matches && (record & (1 << 29)))
+				continue;
+		}
+
+		if (record & (1 << 30))		// Check if write fifo overflowed
+			trace_event(DRIVE_NUMBER(d), TRACE_WRITE_OVERFLOW, address.s, 0, 0);
+
+		if (record & (1 << 29))		// Check if records were dropped before this one
+			trace_event(DRIVE_NUMBER(d), TRACE_WRITE_MISSED, address.s, 0, 0);
+
+		taken += 1;
+	}
+
+	if (taken != d->write_records_taken) {
+		d->write_records_taken = taken;
+		d->write_datapath[5] = taken;		// Let the write datapath reuse them
+	}
+}
+
+// Write Datapath Interrupt Routine. Fires once WRITE_COALESCE_RECORDS sectors have been
+// written, or WRITE_COALESCE_TIMEOUT after the first of fewer.
+void write_datapath_interrupt_handler(void* arg) {
+	drain_write_records(arg);
+}
+
+// S2MM DMA Interrupt Handler. Only enabled (IOC_IrqEn = 1) while a record is waiting for its
+// sector to reach the staging buffer.
+void dma_s2mm_interrupt_handler(void* arg) {
+	struct drive* d = arg;
+	if (d->dma[0x34 >> 2] & (1 << 12)) {	// Check for interrupt condition
+		d->dma[0x34 >> 2] = (1 << 12);		// Clear interrupt
+		d->dma[0x30 >> 2] = 0x1;
+		d->write_datapath[0] = 0x5;
+		drain_write_records(d);
+	}
+}
+
+// Report any read datapath errors on a drive since the last call. Nothing needs doing per
+// sector any more, so the main loop picks these up rather than an interrupt.
+void check_read_errors(struct drive* d) {
+	uint32_t status = d->read_datapath[1];
+	if (!status)
+		return;
+
+	int sector_now = d->sector_timer[3];
+	if (status & 0x1)
+		trace_event(DRIVE_NUMBER(d), TRACE_READ_UNDERFLOW, sector_now, d->sector_timer[4], 0);
+
+	if (status & 0x2)
+		trace_event(DRIVE_NUMBER(d), TRACE_READ_MISSED, sector_now, d->sector_timer[4], 0);
+
+	// Clear any errors
+	d->read_datapath[1] = 0;
+}
+
+// Put a slot a cylinder has just been loaded into on the list the replacement policy wants it
+// on. Must be called with interrupts disabled.
+void slot_loaded(int slot) {
+	int drive = slot_to_drive_map[slot];
+	int cylinder = slot_to_cylinder_map[slot];
+	uint32_t evicted_at = cylinder_evicted_at[drive][cylinder];
+
+	if ((replacement_policy == REPLACEMENT_2Q) && evicted_at &&
+		((recent_evictions - evicted_at) < (uint32_t) (num_slots * REPLACEMENT_GHOST_FACTOR))) {
+		cylinder_evicted_at[drive][cylinder] = 0;
+		replacement_stats[replacement_policy].promotions += 1;
+		slot_list_push(SLOT_LIST_FREQUENT, slot);
+	} else {
+		slot_list_push(SLOT_LIST_RECENT, slot);
+	}
+}
+
+// Walk a replacement list from its tail for a slot which can be evicted. Slots the datapaths or
+// the SD worker may still be using are skipped, and so are dirty slots if 'clean_only' is set.
+// Only a few slots are ever in use, so this normally stops at the tail.
+static int victim_from(int list_id, bool clean_only) {
+	for (int slot = slot_lists[list_id].tail; slot != -1; slot = slot_prev[slot]) {
+		int cylinder = slot_to_cylinder_map[slot];
+		struct drive* d = &drives[slot_to_drive_map[slot]];
+
+		if (slot_busy[slot] || (cylinder == d->current_cylinder) || (cylinder == d->last_cyl))
+			continue;
+		if (clean_only && slot_is_dirty(slot))
+			continue;
+		return slot;
+	}
+	return -1;
+}
+
+// Choose the slot to load a cylinder into according to the replacement policy, whichever drive
+// it belongs to. A free slot is always preferred. Must be called with interrupts disabled.
+// Returns -1 if no slot can be evicted right now.
+int select_victim_slot(bool clean_only) {
+	if (slot_lists[SLOT_LIST_FREE].head != -1)
+		return slot_lists[SLOT_LIST_FREE].head;
+
+	int victim = -1;
+	if (replacement_policy == REPLACEMENT_2Q) {
+		int recent_share = (num_slots * REPLACEMENT_RECENT_SHARE) / 100;
+		if ((slot_lists[SLOT_LIST_RECENT].length > recent_share) || (slot_lists[SLOT_LIST_FREQUENT].length == 0))
+			victim = victim_from(SLOT_LIST_RECENT, clean_only);
+		if (victim == -1)
+			victim = victim_from(SLOT_LIST_FREQUENT, clean_only);
+	}
+	if (victim == -1)
+		victim = victim_from(SLOT_LIST_RECENT, clean_only);
+
+	return victim;
+}
+
+// Unmap whatever cylinder a slot holds so it can be reloaded, and take it off its replacement
+// list until it has been. Must be called with interrupts disabled so a seek can't start using
+// the slot in the meantime. Returns the cylinder that was unloaded, or -1 if the slot was free.
+int release_slot(int slot) {
+	int cylinder_unloaded = slot_to_cylinder_map[slot];
+	struct drive* d = &drives[slot_to_drive_map[slot]];
+
+	if (cylinder_unloaded != -1) {
+		d->cylinder_map[cylinder_unloaded] = -1;
+		set_slot_table_entry(d, cylinder_unloaded, -1);
+		replacement_stats[replacement_policy].evictions += 1;
+
+		// 2Q remembers what it evicted from the recent list, in case it was wanted after all
+		if ((replacement_policy == REPLACEMENT_2Q) && (slot_list_of[slot] == SLOT_LIST_RECENT)) {
+			if (++recent_evictions == 0)
+				recent_evictions = 1;
+			cylinder_evicted_at[DRIVE_NUMBER(d)][cylinder_unloaded] = recent_evictions;
+		}
+	}
+	slot_to_cylinder_map[slot] = -1;
+	slot_list_remove(slot);
+
+	if (slot_prefetched[slot]) {
+		slot_prefetched[slot] = false;
+		prefetch_wasted[DRIVE_NUMBER(d)] += 1;
+	}
+
+	return cylinder_unloaded;
+}
+
+// Add the clusters holding bytes 'start' to 'end' of a file to an extent map of 'count'
+// extents, merging them into extents. Clusters already in the map are skipped, so that a range
+// can be added onto the end of the last one. Returns false if there are too many extents.
+static bool map_image_range(FIL* file, struct image_extent* extents, int* count, FSIZE_t start, FSIZE_t end) {
+	uint32_t cluster_bytes = fatfs.csize * SD_BLOCK_SIZE;
+	uint32_t cluster = start / cluster_bytes;
+
+	if (*count) {
+		struct image_extent* last = &extents[*count - 1];
+		if (cluster < (last->block + last->blocks) / fatfs.csize)
+			cluster = (last->block + last->blocks) / fatfs.csize;
+	}
+
+	for (; ((FSIZE_t) cluster * cluster_bytes) < end; cluster++) {
+
+		// After a seek FatFs holds the cluster with the byte before the file pointer in clust,
+		// and it only follows the chain forwards from where it was, so this walks it once.
+		FSIZE_t position = (FSIZE_t) (cluster + 1) * cluster_bytes;
+		if (position > f_size(file))
+			position = f_size(file);
+
+		if (f_lseek(file, position) || (file->clust < 2))
+			return false;
+
+		LBA_t lba = fatfs.database + ((file->clust - 2) * fatfs.csize);
+
+		if (*count && ((extents[*count - 1].lba + extents[*count - 1].blocks) == lba)) {
+			extents[*count - 1].blocks += fatfs.csize;
+		} else if (*count < MAX_IMAGE_EXTENTS) {
+			extents[(*count)++] = (struct image_extent) {
+				.block = cluster * fatfs.csize,
+				.lba = lba,
+				.blocks = fatfs.csize,
+			};
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Look up the clusters holding the data region of a drive's image and merge them into extents.
+// Needs the data region to start on a word boundary and sectors to be a whole number of
+// words, so that every whole block of a cylinder lands on a word boundary in its slot as DMA
+// requires. The tracks of a version 2 image start on block boundaries, so any sector size will
+// do for those. Returns false, leaving the map empty, if the image can't be mapped.
+bool map_image_extents(struct drive* d) {
+	FSIZE_t start = d->emu_header.data_offset;
+	FSIZE_t end = start + ((FSIZE_t) d->cylinder_size * d->emu_header.cylinders);
+	bool word_sectors = !(d->emu_header.sector_size_in_image % 4);
+
+	if (d->sparse) {
+		end = start + ((FSIZE_t) d->num_records * d->track_stride);
+		word_sectors = true;
+	}
+
+	d->num_image_extents = 0;
+	d->image_mapped = false;
+	if ((start % 4) || !word_sectors || (slot_size % 4) || (end > f_size(&d->image_file)))
+		return false;
+
+	if (!map_image_range(&d->image_file, d->image_extents, &d->num_image_extents, start, end)) {
+		d->num_image_extents = 0;
+		return false;
+	}
+
+	d->image_mapped = true;
+	return true;
+}
+
+// Look up the clusters holding the data region of an overlaid drive's image, as
+// map_image_extents does for the overlay. Returns false, leaving the map empty, if it can't
+// be mapped.
+bool map_base_extents(struct drive* d) {
+	FSIZE_t start = d->base_data_offset;
+	uint32_t track_bytes = d->emu_header.sectors_per_track * d->emu_header.sector_size_in_image;
+	FSIZE_t end = start + ((FSIZE_t) d->emu_header.cylinders * d->emu_header.heads * track_bytes);
+
+	d->num_base_extents = 0;
+	if ((start % 4) || (track_bytes % 4) || (end > f_size(&d->base_file)))
+		return false;
+
+	if (!map_image_range(&d->base_file, d->base_extents, &d->num_base_extents, start, end)) {
+		d->num_base_extents = 0;
+		return false;
+	}
+	return true;
+}
+
+// Read or write part of the mapped data region of a drive's image (or the image under its
+// overlay) directly on the card, given its extent map. Whole blocks are transferred straight
+// to or from 'data', the partial blocks at either end go through raw_block_buffer and are
+// read first when writing. FatFs's own sector buffer isn't updated, so the data region must
+// not be read through FatFs once any of it has been written this way.
+bool raw_image_io(const struct image_extent* extents, int num_extents, FSIZE_t offset, uint8_t* data, uint32_t length, bool write) {
+	int i = 0;
+
+	while (length) {
+		uint32_t block = offset / SD_BLOCK_SIZE;
+		uint32_t within = offset % SD_BLOCK_SIZE;
+
+		while ((i < num_extents) && (block >= extents[i].block + extents[i].blocks))
+			i += 1;
+		if ((i == num_extents) || (block < extents[i].block))
+			return false;
+
+		const struct image_extent* e = &extents[i];
+		LBA_t lba = e->lba + (block - e->block);
+
+		if (within || (length < SD_BLOCK_SIZE)) {
+			uint32_t count = SD_BLOCK_SIZE - within;
+			if (count > length)
+				count = length;
+
+			if (disk_read(SD_DRIVE, raw_block_buffer, lba, 1) != RES_OK)
+				return false;
+
+			if (write) {
+				memcpy(&raw_block_buffer[within], data, count);
+				if (disk_write(SD_DRIVE, raw_block_buffer, lba, 1) != RES_OK)
+					return false;
+			} else {
+				memcpy(data, &raw_block_buffer[within], count);
+			}
+
+			offset += count;
+			data += count;
+			length -= count;
+			continue;
+		}
+
+		uint32_t blocks = length / SD_BLOCK_SIZE;
+		if (blocks > (e->block + e->blocks) - block)
+			blocks = (e->block + e->blocks) - block;
+		if (blocks > RAW_MAX_BLOCKS)
+			blocks = RAW_MAX_BLOCKS;
+
+		DRESULT dr = write ? disk_write(SD_DRIVE, data, lba, blocks) : disk_read(SD_DRIVE, data, lba, blocks);
+		if (dr != RES_OK)
+			return false;
+
+		offset += blocks * SD_BLOCK_SIZE;
+		data += blocks * SD_BLOCK_SIZE;
+		length -= blocks * SD_BLOCK_SIZE;
+	}
+
+	return true;
+}
+
+// Read or write part of a drive's image, straight on the card if all of it is in the extent
+// map and through FatFs otherwise
+static bool image_io(struct drive* d, FSIZE_t offset, uint8_t* data, uint32_t length, bool write) {
+	if (d->num_image_extents) {
+		struct image_extent* first = &d->image_extents[0];
+		struct image_extent* last = &d->image_extents[d->num_image_extents - 1];
+
+		if (((offset / SD_BLOCK_SIZE) >= first->block) &&
+			(((offset + length + SD_BLOCK_SIZE - 1) / SD_BLOCK_SIZE) <= (last->block + last->blocks)))
+			return raw_image_io(d->image_extents, d->num_image_extents, offset, data, length, write);
+	}
+
+	UINT bytes;
+	FRESULT fr = f_lseek(&d->image_file, offset);
+	if (!fr)
+		fr = write ? f_write(&d->image_file, data, length, &bytes) : f_read(&d->image_file, data, length, &bytes);
+
+	return !fr && (bytes == length);
+}
+
+static inline struct track_entry* track_table_entry(struct drive* d, int cylinder, int head) {
+	return &d->track_table[(cylinder * d->emu_header.heads) + head];
+}
+
+// Where a track record of a version 2 image starts in the file
+static inline FSIZE_t track_record_offset(struct drive* d, uint32_t record) {
+	return d->emu_header.data_offset + ((FSIZE_t) (record - 1) * d->track_stride);
+}
+
+static inline bool journal_cylinder_pending(struct drive* d, int cylinder) {
+	return journal_pending[DRIVE_NUMBER(d)][cylinder >> 5] & (1u << (cylinder & 31));
+}
+
+// Whether any track of a cylinder has to be read from the card. Those of a version 2 image
+// which aren't stored are filled in instead, unless the journal has sectors of the cylinder.
+// Those an overlay doesn't hold are read from the image.
+bool cylinder_stored(struct drive* d, int cylinder) {
+	if (!d->sparse || d->overlaid || (journal_enabled && journal_cylinder_pending(d, cylinder)))
+		return true;
+
+	for (int h = 0; h < d->emu_header.heads; h++) {
+		if (track_table_entry(d, cylinder, h)->record)
+			return true;
+	}
+	return false;
+}
+
+// Fill a track of a slot with what a version 2 image's track reads as when it isn't stored
+void fill_track(struct drive* d, int cylinder, int head, int slot) {
+	uint32_t fill = track_table_entry(d, cylinder, head)->fill;
+	uint8_t* track = &slot_buffer(slot)[head * d->track_stride];
+
+	if (!fill) {
+		memset(track, 0, d->track_stride);
+		return;
+	}
+
+	// Slots are only byte aligned when a drive's sectors are an odd size, so double up copies
+	memcpy(track, &fill, sizeof(fill));
+	for (int length = sizeof(fill); length < d->track_stride; length *= 2)
+		memcpy(&track[length], track, (length * 2 <= d->track_stride) ? length : (d->track_stride - length));
+}
+
+// Read 'count' tracks of an overlaid drive's image from 'head' on into a slot, straight from
+// the card if the image is mapped. The image is flat, so its tracks are only as far apart as
+// their sectors. They are read together and then moved apart to the slot's track stride,
+// last first.
+static bool read_base_tracks(struct drive* d, int cylinder, int head, int count, int slot) {
+	uint32_t track_bytes = d->emu_header.sectors_per_track * d->emu_header.sector_size_in_image;
+	FSIZE_t offset = d->base_data_offset + ((FSIZE_t) ((cylinder * d->emu_header.heads) + head) * track_bytes);
+	uint8_t* tracks = &slot_buffer(slot)[head * d->track_stride];
+	uint32_t length = count * track_bytes;
+	bool ok;
+	UINT bytes;
+
+	if (d->num_base_extents) {
+		ok = raw_image_io(d->base_extents, d->num_base_extents, offset, tracks, length, false);
+	} else {
+		FRESULT fr = f_lseek(&d->base_file, offset);
+		if (!fr)
+			fr = f_read(&d->base_file, tracks, length, &bytes);
+		ok = !fr && (bytes == length);
+	}
+
+	for (int i = count - 1; ok && (i > 0); i--)
+		memmove(&tracks[i * d->track_stride], &tracks[i * track_bytes], track_bytes);
+	return ok;
+}
+
+bool overlay_journal(struct drive* d, int cylinder, int slot, uint32_t tracks);
+bool checkpoint_journal();
+
+// A bit for each head of a drive
+static inline uint32_t all_tracks(struct drive* d) {
+	return (1u << d->emu_header.heads) - 1;
+}
+
+// Read the tracks of a cylinder with a bit set in 'tracks' from a drive's image file into a
+// slot. Tracks of a version 2 image which aren't stored are filled in, those an overlay
+// doesn't hold are read from the image, and tracks whose data follows on in the file are read
+// together.
+bool read_image_tracks(struct drive* d, int cylinder, int slot, uint32_t tracks) {
+	int heads = d->emu_header.heads;
+
+	for (int h = 0; h < heads; ) {
+		if (!(tracks & (1u << h))) {
+			h += 1;
+			continue;
+		}
+
+		FSIZE_t offset = d->emu_header.data_offset + ((FSIZE_t) d->cylinder_size * cylinder) + (h * d->track_stride);
+		int run = 1;
+		if (d->sparse) {
+			uint32_t record = TRACK_RECORD(*track_table_entry(d, cylinder, h));
+			if (!record && d->overlaid) {
+				while (((h + run) < heads) && (tracks & (1u << (h + run))) && !track_table_entry(d, cylinder, h + run)->record)
+					run += 1;
+				if (!read_base_tracks(d, cylinder, h, run, slot)) {
+					trace_event(DRIVE_NUMBER(d), TRACE_LOAD_FAILED, cylinder, FR_DISK_ERR, 0);
+					return false;
+				}
+				h += run;
+				continue;
+			} else if (!record) {
+				fill_track(d, cylinder, h, slot);
+				h += 1;
+				continue;
+			}
+
+			offset = track_record_offset(d, record);
+			while (((h + run) < heads) && (tracks & (1u << (h + run))) && (TRACK_RECORD(*track_table_entry(d, cylinder, h + run)) == record + run))
+				run += 1;
+		} else {
+			while (((h + run) < heads) && (tracks & (1u << (h + run))))
+				run += 1;
+		}
+
+		if (!image_io(d, offset, &slot_buffer(slot)[h * d->track_stride], run * d->track_stride, false)) {
+			trace_event(DRIVE_NUMBER(d), TRACE_LOAD_FAILED, cylinder, FR_DISK_ERR, 0);
+			return false;
+		}
+		h += run;
+	}
+
+	return true;
+}
+
+// Read some of the tracks of a cylinder (see read_image_tracks) into a slot, along with any of
+// their sectors which are still in the journal
+bool read_cylinder(struct drive* d, int cylinder, int slot, uint32_t tracks) {
+	if (!read_image_tracks(d, cylinder, slot, tracks))
+		return false;
+
+	if (journal_enabled && journal_cylinder_pending(d, cylinder) && !overlay_journal(d, cylinder, slot, tracks)) {
+		trace_event(DRIVE_NUMBER(d), TRACE_LOAD_FAILED, cylinder, FR_INT_ERR, 0);
+		return false;
+	}
+	return true;
+}
+
+// Find the first sector at or after 'from' (counting across the whole cylinder) whose bit in
+// 'bitmap' is equal to 'dirty'. Returns the number of sectors in a cylinder if there is none.
+static int find_sector(struct drive* d, uint32_t bitmap[][DIRTY_WORDS_PER_TRACK], int from, bool dirty) {
+	int sectors_per_track = d->emu_header.sectors_per_track;
+	int h = from / sectors_per_track;
+	int s = from % sectors_per_track;
+
+	while (h < d->emu_header.heads) {
+		while (s < sectors_per_track) {
+			uint32_t word = bitmap[h][s >> 5];
+			if (!dirty)
+				word = ~word;
+			word >>= (s & 31);
+
+			if (word) {
+				s += __builtin_ctz(word);
+				if (s < sectors_per_track)
+					return (h * sectors_per_track) + s;
+				break;
+			}
+
+			s = (s | 31) + 1;
+		}
+
+		h += 1;
+		s = 0;
+	}
+
+	return d->emu_header.heads * sectors_per_track;
+}
+
+// Give a track of a version 2 image a new record at the end of the file holding 'track', and
+// point its entry in the track table at it. Growing the file has to go through FatFs, even
+// where the new record would fit in the unused end of a cluster which is already mapped.
+static bool allocate_track_record(struct drive* d, int cylinder, int head, uint8_t* track) {
+	struct track_entry* entry = track_table_entry(d, cylinder, head);
+	uint32_t record = d->num_records + 1;
+	FSIZE_t offset = track_record_offset(d, record);
+	UINT bytes;
+
+	FRESULT fr = f_lseek(&d->image_file, offset);
+	if (!fr)
+		fr = f_write(&d->image_file, track, d->track_stride, &bytes);
+	if (fr || (bytes != d->track_stride))
+		return false;
+
+	d->num_records = record;
+	if (d->image_mapped && !map_image_range(&d->image_file, d->image_extents, &d->num_image_extents, offset, offset + d->track_stride)) {
+		d->num_image_extents = 0;
+		d->image_mapped = false;
+	}
+
+	struct track_entry updated = { .record = record, .fill = 0 };
+	FSIZE_t entry_offset = d->emu_header.track_table_offset + ((FSIZE_t) (entry - d->track_table) * sizeof(struct track_entry));
+
+	fr = f_lseek(&d->image_file, entry_offset);
+	if (!fr)
+		fr = f_write(&d->image_file, &updated, sizeof(updated), &bytes);
+	if (fr || (bytes != sizeof(updated)))
+		return false;
+
+	*entry = updated;
+	return true;
+}
+
+// Whether a track of a version 2 image has a record of its own, which can be written in place
+static inline bool track_owned(struct drive* d, int cylinder, int head) {
+	struct track_entry* entry = track_table_entry(d, cylinder, head);
+	return entry->record && !(entry->record & TRACK_SHARED);
+}
+
+// Work out which pieces of a slot to write back for the sectors marked in 'bitmap', as byte
+// offsets into the slot, into write_back_extents. Runs of dirty sectors are merged, including
+// runs separated by no more than WRITEBACK_MAX_GAP clean sectors, and each is widened out to
+// whole blocks of the image with the slot's own copy of the sectors around it, so that writing
+// it doesn't have to read any first. Runs of a flat image may continue onto the next track and
+// are widened as far as the cylinder goes. Those of a version 2 image stay within their track's
+// record, and a track without a record of its own is one piece covering all of it. Sets
+// 'sectors' to the number of sectors covered and returns the number of pieces.
+static int find_write_back_extents(struct drive* d, int cylinder, uint32_t bitmap[][DIRTY_WORDS_PER_TRACK], int* sectors) {
+	int sectors_per_track = d->emu_header.sectors_per_track;
+	int sector_size = d->emu_header.sector_size_in_image;
+	int count = 0;
+
+	// Where the slot's first byte is in the file, as far as block alignment goes. Track records
+	// start on a block.
+	FSIZE_t base = d->sparse ? 0 : d->emu_header.data_offset + ((FSIZE_t) d->cylinder_size * cylinder);
+
+	*sectors = 0;
+
+	// A flat image is one piece of the file from the first head to the last
+	for (int h = 0; h < (d->sparse ? d->emu_header.heads : 1); h++) {
+		int first_sector = d->sparse ? h * sectors_per_track : 0;
+		int end_sector = d->sparse ? first_sector + sectors_per_track : d->emu_header.heads * sectors_per_track;
+		FSIZE_t limit_start = base + (d->sparse ? h * d->track_stride : 0);
+		FSIZE_t limit_end = d->sparse ? limit_start + d->track_stride : base + d->cylinder_size;
+
+		int start = find_sector(d, bitmap, first_sector, true);
+		if ((start < end_sector) && d->sparse && !track_owned(d, cylinder, h)) {
+			// The sectors the controller didn't write are the slot's copy of what the track read as
+			write_back_extents[count++] = (struct slot_extent) { h * d->track_stride, d->track_stride };
+			*sectors += sectors_per_track;
+			continue;
+		}
+
+		while (start < end_sector) {
+			int end = find_sector(d, bitmap, start, false);
+			int next = find_sector(d, bitmap, end, true);
+			while ((next < end_sector) && ((next - end) <= WRITEBACK_MAX_GAP)) {
+				end = find_sector(d, bitmap, next, false);
+				next = find_sector(d, bitmap, end, true);
+			}
+			if (end > end_sector)
+				end = end_sector;
+
+			FSIZE_t run_start = limit_start + ((start - first_sector) * sector_size);
+			FSIZE_t run_end = limit_start + ((end - first_sector) * sector_size);
+			FSIZE_t first = run_start & ~(FSIZE_t) (SD_BLOCK_SIZE - 1);
+			FSIZE_t last = (run_end + SD_BLOCK_SIZE - 1) & ~(FSIZE_t) (SD_BLOCK_SIZE - 1);
+			if (first < limit_start)
+				first = limit_start;
+			if (last > limit_end)
+				last = limit_end;
+
+			write_back_extents[count++] = (struct slot_extent) { first - base, last - first };
+			*sectors += end - start;
+			start = next;
+		}
+	}
+
+	return count;
+}
+
+// Write 'length' bytes from 'data' to the image, where they go at 'offset' into a slot holding
+// 'cylinder'. A track of a version 2 image without a record of its own is given one, for which
+// the whole track has to be written at once. Returns false if the write failed.
+static bool write_image_extent(struct drive* d, int cylinder, uint32_t offset, uint32_t length, uint8_t* data) {
+	if (!d->sparse)
+		return image_io(d, d->emu_header.data_offset + ((FSIZE_t) d->cylinder_size * cylinder) + offset, data, length, true);
+
+	int head = offset / d->track_stride;
+	uint32_t within = offset % d->track_stride;
+	if ((head >= d->emu_header.heads) || (within + length > d->track_stride))
+		return false;
+
+	if (track_owned(d, cylinder, head))
+		return image_io(d, track_record_offset(d, track_table_entry(d, cylinder, head)->record) + within, data, length, true);
+
+	return !within && (length == d->track_stride) && allocate_track_record(d, cylinder, head, data);
+}
+
+// Write the sectors marked in 'bitmap' from a slot back to a drive's image file in place, a
+// piece at a time (see find_write_back_extents). Returns the number of sectors written, or -1
+// if any of the writes failed.
+int write_back_slot(struct drive* d, int slot, int cylinder, uint32_t bitmap[][DIRTY_WORDS_PER_TRACK]) {
+	int sectors_written;
+	bool failed = false;
+
+	trace_event(DRIVE_NUMBER(d), TRACE_WRITE_BACK_START, cylinder, 0, 0);
+
+	int count = find_write_back_extents(d, cylinder, bitmap, &sectors_written);
+	for (int i = 0; i < count; i++) {
+		struct slot_extent* e = &write_back_extents[i];
+		if (!write_image_extent(d, cylinder, e->offset, e->length, &slot_buffer(slot)[e->offset])) {
+			trace_event(DRIVE_NUMBER(d), TRACE_WRITE_FAILED, cylinder, FR_DISK_ERR, 0);
+			failed = true;
+		}
+	}
+
+	trace_event(DRIVE_NUMBER(d), TRACE_WRITE_BACK, cylinder, sectors_written, count);
+
+	return failed ? -1 : sectors_written;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length) {
+	if (!crc32_table[1]) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			crc32_table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (length--)
+		crc = crc32_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+// Append a record holding the first 'count' pieces in journal_extents to the journal, with
+// their contents from a slot, folding the journal in first if it is full. 'used' is the size
+// of the record before padding. Returns false if the record couldn't be written.
+static bool append_journal_record(struct drive* d, int slot, int cylinder, int count, uint32_t used) {
+	uint32_t length = (used + SD_BLOCK_SIZE - 1) & ~(SD_BLOCK_SIZE - 1);
+
+	// Folding the journal in uses the same buffer, so it has to be done before filling it
+	if (((journal_append + length) > JOURNAL_SIZE) && !checkpoint_journal())
+		return false;
+
+	struct journal_record* r = (struct journal_record*) journal_buffer;
+	struct slot_extent* table = (struct slot_extent*) &journal_buffer[sizeof(struct journal_record)];
+	uint8_t* data = (uint8_t*) &table[count];
+
+	for (int i = 0; i < count; i++) {
+		table[i] = journal_extents[i];
+		memcpy(data, &slot_buffer(slot)[table[i].offset], table[i].length);
+		data += table[i].length;
+	}
+	memset(&journal_buffer[used], 0, length - used);
+
+	*r = (struct journal_record) {
+		.magic = JOURNAL_MAGIC,
+		.sequence = journal_sequence,
+		.length = length,
+		.drive = DRIVE_NUMBER(d),
+		.cylinder = cylinder,
+		.extents = count,
+	};
+	r->checksum = crc32(0, journal_buffer, used);
+
+	UINT bytes;
+	FRESULT fr = f_lseek(&journal_file, journal_append);
+	if (!fr)
+		fr = f_write(&journal_file, journal_buffer, length, &bytes);
+	if (fr || (bytes != length))
+		return false;
+
+	journal_pending[DRIVE_NUMBER(d)][cylinder >> 5] |= 1u << (cylinder & 31);
+	journal_index[journal_records++] = (struct journal_index_entry) { DRIVE_NUMBER(d), cylinder, journal_append };
+	journal_append += length;
+	journal_sequence += 1;
+	return true;
+}
+
+// Write the sectors marked in 'bitmap' from a slot to the journal, as the same pieces an in
+// place write-back would write, in as few records as they fit in. A piece too big for what is
+// left of a record is split at a block boundary, except the whole of a version 2 track which
+// is to be given a record of its own. Returns the number of sectors written, or -1 if any of
+// the writes failed.
+int journal_write_back(struct drive* d, int slot, int cylinder, uint32_t bitmap[][DIRTY_WORDS_PER_TRACK]) {
+	int sectors_written;
+	int writes = 0;
+
+	trace_event(DRIVE_NUMBER(d), TRACE_WRITE_BACK_START, cylinder, 0, 0);
+
+	int count = find_write_back_extents(d, cylinder, bitmap, &sectors_written);
+	int i = 0;
+	uint32_t done = 0;			// Of piece i, already in an earlier record
+
+	while (i < count) {
+		int pieces = 0;
+		uint32_t used = sizeof(struct journal_record);
+
+		while ((i < count) && (pieces < MAX_WRITE_BACK_EXTENTS)) {
+			struct slot_extent* e = &write_back_extents[i];
+			uint32_t room = JOURNAL_RECORD_SIZE - used - sizeof(struct slot_extent);
+			uint32_t length = e->length - done;
+
+			if ((used + sizeof(struct slot_extent) + SD_BLOCK_SIZE) > JOURNAL_RECORD_SIZE)
+				break;
+			if (length > room) {
+				if (d->sparse && !track_owned(d, cylinder, e->offset / d->track_stride))
+					break;
+				length = room & ~(SD_BLOCK_SIZE - 1);
+			}
+
+			journal_extents[pieces++] = (struct slot_extent) { e->offset + done, length };
+			used += sizeof(struct slot_extent) + length;
+			done += length;
+			if (done == e->length) {
+				i += 1;
+				done = 0;
+			}
+		}
+
+		if (!append_journal_record(d, slot, cylinder, pieces, used)) {
+			trace_event(DRIVE_NUMBER(d), TRACE_WRITE_FAILED, cylinder, FR_DISK_ERR, 0);
+			return -1;
+		}
+		writes += 1;
+	}
+
+	trace_event(DRIVE_NUMBER(d), TRACE_WRITE_BACK, cylinder, sectors_written, writes);
+
+	return sectors_written;
+}
+
+// Read the journal record at 'offset' into journal_buffer. Returns its length, or 0 if there
+// isn't a complete record with sequence number 'sequence' there.
+static uint32_t read_journal_record(FSIZE_t offset, uint32_t sequence) {
+	struct journal_record* r = (struct journal_record*) journal_buffer;
+	struct slot_extent* table = (struct slot_extent*) &journal_buffer[sizeof(struct journal_record)];
+	UINT bytes;
+
+	FRESULT fr = f_lseek(&journal_file, offset);
+	if (!fr)
+		fr = f_read(&journal_file, journal_buffer, SD_BLOCK_SIZE, &bytes);
+	if (fr || (bytes != SD_BLOCK_SIZE) || (r->magic != JOURNAL_MAGIC) || (r->sequence != sequence) ||
+		(r->length % SD_BLOCK_SIZE) || (r->length < SD_BLOCK_SIZE) || (r->length > JOURNAL_RECORD_SIZE) ||
+		(r->drive >= NUM_DRIVES) || (r->extents > MAX_WRITE_BACK_EXTENTS))
+		return 0;
+
+	uint32_t length = r->length;
+	if (length > SD_BLOCK_SIZE) {
+		fr = f_read(&journal_file, &journal_buffer[SD_BLOCK_SIZE], length - SD_BLOCK_SIZE, &bytes);
+		if (fr || (bytes != length - SD_BLOCK_SIZE))
+			return 0;
+	}
+
+	uint32_t used = sizeof(struct journal_record) + (r->extents * sizeof(struct slot_extent));
+	for (int i = 0; (i < r->extents) && (used <= length); i++)
+		used += table[i].length;
+	if (used > length)
+		return 0;
+
+	uint32_t checksum = r->checksum;
+	r->checksum = 0;
+	return (crc32(0, journal_buffer, used) == checksum) ? length : 0;
+}
+
+// Copy the pieces of a cylinder which are still in the journal over the tracks of a slot with
+// a bit set in 'tracks', which have just been read into it from the image, oldest first.
+// Returns false if any of the records couldn't be read.
+bool overlay_journal(struct drive* d, int cylinder, int slot, uint32_t tracks) {
+	struct journal_record* r = (struct journal_record*) journal_buffer;
+	struct slot_extent* table = (struct slot_extent*) &journal_buffer[sizeof(struct journal_record)];
+	uint32_t first_sequence = journal_sequence - journal_records;
+
+	for (int i = 0; i < journal_records; i++) {
+		struct journal_index_entry* entry = &journal_index[i];
+		if ((entry->drive != DRIVE_NUMBER(d)) || (entry->cylinder != cylinder) || (entry->offset < journal_fold))
+			continue;
+
+		if (!read_journal_record(entry->offset, first_sequence + i))
+			return false;
+
+		uint8_t* data = (uint8_t*) &table[r->extents];
+		for (int j = 0; j < r->extents; j++) {
+			uint32_t start = table[j].offset;
+			uint32_t end = start + table[j].length;
+			if (end > d->cylinder_size)
+				return false;
+
+			// A piece of a flat image may run on into tracks which weren't read
+			for (int h = start / d->track_stride; (h < d->emu_header.heads) && (h * d->track_stride < end); h++) {
+				uint32_t first = (h * d->track_stride > start) ? h * d->track_stride : start;
+				uint32_t last = ((h + 1) * d->track_stride < end) ? (h + 1) * d->track_stride : end;
+				if (tracks & (1u << h))
+					memcpy(&slot_buffer(slot)[first], &data[first - start], last - first);
+			}
+			data += table[j].length;
+		}
+	}
+
+	return true;
+}
+
+// Write the pieces of the journal record in journal_buffer into place in their image. Returns
+// false if any of the writes failed.
+static bool fold_journal_record() {
+	struct journal_record* r = (struct journal_record*) journal_buffer;
+	struct slot_extent* table = (struct slot_extent*) &journal_buffer[sizeof(struct journal_record)];
+	uint8_t* data = (uint8_t*) &table[r->extents];
+	struct drive* d = &drives[r->drive];
+
+	// The drive's image may have been left off the card this time
+	if (!d->present)
+		return true;
+
+	if (r->cylinder >= d->emu_header.cylinders)
+		return false;
+
+	for (int i = 0; i < r->extents; i++) {
+		if ((table[i].offset + table[i].length > d->cylinder_size) ||
+			!write_image_extent(d, r->cylinder, table[i].offset, table[i].length, data)) {
+			trace_event(r->drive, TRACE_WRITE_FAILED, r->cylinder, FR_DISK_ERR, 0);
+			return false;
+		}
+
+		journal_folded_bytes += table[i].length;
+		data += table[i].length;
+	}
+
+	return true;
+}
+
+// Fold the record at journal_fold into place and move on past it. The host was told what it
+// holds is on the card, so if it can't be read or written journal_fold is left on it, to be
+// tried again later, and false is returned.
+static bool fold_next_journal_record() {
+	uint32_t length = read_journal_record(journal_fold, journal_fold_sequence);
+	if (!length) {
+		trace_event(-1, TRACE_WRITE_FAILED, -1, FR_INT_ERR, 0);
+		return false;
+	}
+
+	struct journal_index_entry* entry = &journal_index[journal_fold_sequence - (journal_sequence - journal_records)];
+	if ((entry->drive != JOURNAL_NO_DRIVE) && !fold_journal_record())
+		return false;
+
+	journal_folded_records += 1;
+	journal_fold += length;
+	journal_fold_sequence += 1;
+	return true;
+}
+
+// Fold the next record of the journal into place, or once they all have been, sync the images
+// and start the journal again from the beginning. Returns false once there is nothing left to
+// do, with 'ok' cleared if that was because a record couldn't be folded in or the journal
+// couldn't be started again, which is left to a later pass.
+bool fold_journal_step(bool* ok) {
+	*ok = true;
+	if (journal_fold < journal_append)
+		return (*ok = fold_next_journal_record());
+
+	if (journal_append != JOURNAL_RECORDS_START)
+		*ok = checkpoint_journal();
+	return false;
+}
+
+// Fold whatever is left of the journal into the images, sync them, and start the journal again
+// from the beginning with a header giving the sequence number its first record will have.
+// Returns false, with the journal left as it is, if a record couldn't be folded in, the images
+// couldn't be synced or the header couldn't be written.
+bool checkpoint_journal() {
+	while (journal_fold < journal_append) {
+		if (!fold_next_journal_record())
+			return false;
+	}
+
+	bool ok = true;
+	bool raw = false;
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present) {
+			ok = (f_sync(&drives[i].image_file) == FR_OK) && ok;
+			raw |= (drives[i].num_image_extents != 0);
+		}
+	}
+	if (raw)
+		ok = (disk_ioctl(SD_DRIVE, CTRL_SYNC, NULL) == RES_OK) && ok;
+	if (!ok)
+		return false;
+
+	struct journal_header header = {
+		.magic = JOURNAL_MAGIC,
+		.sequence = journal_sequence,
+	};
+	header.checksum = crc32(0, (const uint8_t*) &header, offsetof(struct journal_header, checksum));
+
+	UINT bytes;
+	FRESULT fr = f_lseek(&journal_file, 0);
+	if (!fr)
+		fr = f_write(&journal_file, &header, sizeof(header), &bytes);
+	if (!fr)
+		fr = f_sync(&journal_file);
+	if (fr || (bytes != sizeof(header)))
+		return false;
+
+	trace_event(-1, TRACE_CHECKPOINT, journal_folded_records, journal_folded_bytes / 1024, 0);
+	journal_folded_records = 0;
+	journal_folded_bytes = 0;
+	journal_append = JOURNAL_RECORDS_START;
+	journal_fold = JOURNAL_RECORDS_START;
+	journal_fold_sequence = journal_sequence;
+	journal_records = 0;
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present)
+			memset(journal_pending[i], 0, ((drives[i].emu_header.cylinders + 31) / 32) * sizeof(uint32_t));
+	}
+
+	return true;
+}
+
+// Open the journal, creating it if there isn't one, and fold in any records left in it from
+// before the last power cycle. Returns false if it can't be used, in which case dirty sectors
+// are written back in place.
+bool open_journal() {
+	struct journal_header header;
+	UINT bytes;
+
+	// A track of a version 2 image is journaled whole when it is first written
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present && (sizeof(struct journal_record) + sizeof(struct slot_extent) + drives[i].track_stride > JOURNAL_RECORD_SIZE))
+			return false;
+	}
+
+	if (f_open(&journal_file, JOURNAL_NAME, FA_READ | FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+		return false;
+
+	FRESULT fr = f_read(&journal_file, &header, sizeof(header), &bytes);
+	bool valid = !fr && (bytes == sizeof(header)) && (header.magic == JOURNAL_MAGIC) &&
+				 (header.checksum == crc32(0, (const uint8_t*) &header, offsetof(struct journal_header, checksum)));
+
+	journal_sequence = valid ? header.sequence : 1;
+	journal_fold_sequence = journal_sequence;
+	journal_append = JOURNAL_RECORDS_START;
+	journal_fold = JOURNAL_RECORDS_START;
+
+	// Find the end of the journal, indexing the records as appending them would have, then
+	// fold everything before it in. What was left for an overlay started at this boot is
+	// dropped rather than folded in.
+	journal_records = 0;
+	uint32_t length;
+	while (valid && (journal_append < JOURNAL_SIZE) && ((length = read_journal_record(journal_append, journal_sequence)))) {
+		struct journal_record* r = (struct journal_record*) journal_buffer;
+		struct drive* d = &drives[r->drive];
+		bool dropped = !d->present || d->overlay_new || (r->cylinder >= d->emu_header.cylinders);
+
+		if (!dropped)
+			journal_pending[r->drive][r->cylinder >> 5] |= 1u << (r->cylinder & 31);
+		journal_index[journal_records++] = (struct journal_index_entry) {
+			dropped ? JOURNAL_NO_DRIVE : r->drive, r->cylinder, journal_append };
+		journal_append += length;
+		journal_sequence += 1;
+	}
+
+	for (int i = 0; i < NUM_DRIVES; i++)
+		drives[i].overlay_new = false;
+
+	int records = journal_records;
+	if (checkpoint_journal()) {
+		printf("Journal %s: %d records folded in\r\n", JOURNAL_NAME, records);
+		return true;
+	}
+
+	// Without records to keep, a journal which can't be started again is no use
+	if (!records) {
+		f_close(&journal_file);
+		return false;
+	}
+
+	// Otherwise they stay in the journal, laid over their cylinders as they are loaded, until
+	// the main loop has the checkpoint tried again
+	unfolded_write_backs = 1;
+	printf("Journal %s: %d of %d records folded in, trying again later\r\n", JOURNAL_NAME,
+		   (int) (journal_fold_sequence - (journal_sequence - journal_records)), records);
+	return true;
+}
+
+// Write the warm set to the card for the next boot. The file is always the same size, so it
+// is written over rather than created again. Only called by the SD worker.
+bool save_warm_set() {
+	FIL file;
+	UINT bytes;
+
+	if (f_open(&file, WARM_SET_NAME, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+		return false;
+
+	FRESULT fr = f_write(&file, &warm_set, sizeof(warm_set), &bytes);
+	return (f_close(&file) == FR_OK) && !fr && (bytes == sizeof(warm_set));
+}
+
+// Read the warm set recorded before the last power cycle, if there is one. Before the SD
+// worker is started.
+void read_warm_set() {
+	FIL file;
+	UINT bytes = 0;
+
+	memset(&warm_set, 0, sizeof(warm_set));
+	if (f_open(&file, WARM_SET_NAME, FA_READ) != FR_OK)
+		return;
+
+	FRESULT fr = f_read(&file, &warm_set, sizeof(warm_set), &bytes);
+	f_close(&file);
+	if (fr || (bytes != sizeof(warm_set)) || memcmp(warm_set.magic, WARM_SET_MAGIC, sizeof(warm_set.magic)))
+		memset(&warm_set, 0, sizeof(warm_set));
+}
+
+// Make the list of 'count' cylinders of a drive to load after boot: the one the heads start on
+// and the pinned ones, then the drive's warm set if it was recorded for an image of the same
+// size, then the lowest numbered of the rest
+void plan_warm_up(struct drive* d, int count, int pinned) {
+	int drive = DRIVE_NUMBER(d);
+	int cylinders = d->emu_header.cylinders;
+	int recorded = 0;
+
+	d->pinned_cylinders = pinned;
+	d->warm_up_length = 0;
+	d->warm_up_next = 0;
+
+	// Only needed while planning, so it is given back to the slots, which hold nothing yet
+	uint8_t* scratch = buffers;
+	bool* listed = boot_alloc(cylinders * sizeof(*listed));
+	if (!listed)		// Too little memory to be worth warming up
+		return;
+
+	for (int c = 0; (c < pinned) || (c == 0); c++) {
+		listed[c] = true;
+		d->warm_up[d->warm_up_length++] = c;
+	}
+
+	bool valid = (warm_set.drive_cylinders[drive] == cylinders);
+	for (int i = 0; valid && (i < WARM_SET_CYLINDERS) && (d->warm_up_length < count); i++) {
+		int c = warm_set.cylinders[drive][i];
+		if (c == WARM_SET_END)
+			break;
+		if ((c >= cylinders) || listed[c])
+			continue;
+		listed[c] = true;
+		d->warm_up[d->warm_up_length++] = c;
+		recorded += 1;
+	}
+
+	for (int c = 0; (c < cylinders) && (d->warm_up_length < count); c++) {
+		if (!listed[c])
+			d->warm_up[d->warm_up_length++] = c;
+	}
+	buffers = scratch;
+
+	printf("Drive %c: loading %d cylinders in the background, %d of them from %s\r\n",
+			'A' + drive, d->warm_up_length, recorded, WARM_SET_NAME);
+}
+
+// Pick the next slot of a drive with dirty sectors which isn't already being written back,
+// going round robin so that every slot gets written back eventually. Returns -1 if there are
+// none.
+int next_dirty_slot(int drive) {
+	for (int i = 1; i <= num_slots; i++) {
+		int slot = (last_written_back_slot + i) % num_slots;
+		if ((dirty_slots[slot >> 5] & (1u << (slot & 31))) && !slot_busy[slot] && (slot_to_drive_map[slot] == drive))
+			return slot;
+	}
+	return -1;
+}
+
+// Assert command complete for a drive's current seek and mark its slot as used
+void complete_seek(struct drive* d) {
+	d->command_interface[3] = 0;
+	Xil_ExceptionDisable();
+	slot_used(d->cylinder_map[d->current_cylinder]);
+	Xil_ExceptionEnable();
+	trace_event(DRIVE_NUMBER(d), TRACE_SEEK_COMPLETE, d->current_cylinder, 0, 0);
+}
+
+// Guess which cylinder the controller will seek to next on a drive based on its recent seek
+// history. Returns -1 if every predicted cylinder is already loaded or being loaded.
+int predict_prefetch_cylinder(struct drive* d) {
+	int seeks = seek_count[DRIVE_NUMBER(d)];
+	int history_length = (seeks < SEEK_HISTORY_SIZE) ? seeks : SEEK_HISTORY_SIZE;
+
+	// Find the two most recent non-zero cylinder deltas. Controllers often re-seek
+	// to the cylinder they are already on, so those are skipped over.
+	int deltas[2] = {0, 0};
+	int num_deltas = 0;
+	for (int i = 1; (i < history_length) && (num_deltas < 2); i++) {
+		int newer = d->seek_history[(d->seek_history_next - i + SEEK_HISTORY_SIZE) % SEEK_HISTORY_SIZE];
+		int older = d->seek_history[(d->seek_history_next - i - 1 + SEEK_HISTORY_SIZE) % SEEK_HISTORY_SIZE];
+		if (newer != older)
+			deltas[num_deltas++] = newer - older;
+	}
+
+	// The same small delta twice in a row is taken as a sequential or strided walk,
+	// otherwise assume the neighbours in the direction we last moved are most likely
+	int stride = (deltas[0] < 0) ? -1 : 1;
+	bool strided = (num_deltas == 2) && (deltas[0] == deltas[1]) &&
+				   (deltas[0] <= PREFETCH_MAX_STRIDE) && (deltas[0] >= -PREFETCH_MAX_STRIDE);
+	if (strided)
+		stride = deltas[0];
+
+	for (int i = 1; i <= PREFETCH_DEPTH; i++) {
+		int cylinder = d->current_cylinder + (i * stride);
+		if ((cylinder >= 0) && (cylinder < d->emu_header.cylinders) &&
+			(d->cylinder_map[cylinder] == -1) && !d->cylinder_loading[cylinder])
+			return cylinder;
+	}
+
+	if (!strided) {
+		int cylinder = d->current_cylinder - stride;
+		if ((cylinder >= 0) && (cylinder < d->emu_header.cylinders) &&
+			(d->cylinder_map[cylinder] == -1) && !d->cylinder_loading[cylinder])
+			return cylinder;
+	}
+
+	return -1;
+}
+
+// Hand a slot's dirty sectors to the SD worker to write back and mark the slot clean. A sector
+// which is written again by the controller while it is being written back will simply be
+// marked dirty again. 'urgent' puts it ahead of the other write-backs. Returns false if the
+// ring is full.
+bool request_write_back(int slot, bool urgent) {
+	struct sd_ring* ring = urgent ? &sd_load_ring : &sd_write_back_ring;
+	struct sd_message* m = sd_ring_next(ring);
+
+	if (!m)
+		return false;
+
+	Xil_ExceptionDisable();
+	int sectors = dirty_sector_count[slot];
+	memcpy(m->bitmap, slot_dirty_bitmap(slot), dirty_heads * sizeof(track_bitmap));
+	memset(slot_dirty_bitmap(slot), 0, dirty_heads * sizeof(track_bitmap));
+	dirty_sector_count[slot] = 0;
+	dirty_slots[slot >> 5] &= ~(1u << (slot & 31));
+	Xil_ExceptionEnable();
+
+	// Counted as unsynced straight away. Syncs are queued behind write-backs, so the next one
+	// covers these sectors.
+	if (unsynced_sectors == 0)
+		first_unsynced_write = read_cntvct();
+	unsynced_sectors += sectors;
+	if (journal_enabled)
+		unfolded_write_backs += 1;
+	last_write_back = read_cntvct();
+
+	m->type = SD_WRITE_BACK;
+	m->drive = slot_to_drive_map[slot];
+	m->slot = slot;
+	m->cylinder = slot_to_cylinder_map[slot];
+	slot_busy[slot] = true;
+	sd_ring_push(ring);
+	second_core_wake();
+
+	return true;
+}
+
+// Ask the SD worker to sync everything written back so far, on every drive. Returns false if
+// the write-back ring is full.
+bool request_sync() {
+	struct sd_message* m = sd_ring_next(&sd_write_back_ring);
+
+	if (!m)
+		return false;
+
+	m->type = SD_SYNC;
+	m->drive = -1;
+	m->slot = -1;
+	m->cylinder = -1;
+	m->count = unsynced_sectors;
+	sync_in_flight = true;
+	sd_ring_push(&sd_write_back_ring);
+	second_core_wake();
+
+	return true;
+}
+
+// Ask the SD worker to fold the journal into the images. Returns false if it could not be
+// asked yet.
+bool request_checkpoint() {
+	struct sd_message* m = sd_ring_next(&sd_write_back_ring);
+
+	if (!m)
+		return false;
+
+	m->type = SD_CHECKPOINT;
+	m->drive = -1;
+	m->slot = -1;
+	m->cylinder = -1;
+	m->count = unfolded_write_backs;
+	checkpoint_in_flight = true;
+	sd_ring_push(&sd_write_back_ring);
+	second_core_wake();
+
+	return true;
+}
+
+// Record the most used cylinders of each drive in the warm set, halving the counts as they are
+// read, and ask the SD worker to write it to the card. A seek counted in the meantime may be
+// lost, which doesn't matter. Returns false if it could not be asked yet.
+bool request_warm_set_save() {
+	struct sd_message* m = sd_ring_next(&sd_write_back_ring);
+	uint16_t heats[WARM_SET_CYLINDERS];
+
+	if (!m)
+		return false;
+
+	memcpy(warm_set.magic, WARM_SET_MAGIC, sizeof(warm_set.magic));
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		struct drive* d = &drives[i];
+		int length = 0;
+
+		warm_set.drive_cylinders[i] = d->present ? d->emu_header.cylinders : 0;
+		for (int c = 0; d->present && (c < d->emu_header.cylinders); c++) {
+			uint16_t heat = cylinder_heat[i][c];
+			cylinder_heat[i][c] = heat / 2;
+			if (!heat || ((length == WARM_SET_CYLINDERS) && (heat <= heats[length - 1])))
+				continue;
+
+			// Insert it in order, pushing the coolest off the end if the set is full
+			int j = (length < WARM_SET_CYLINDERS) ? length++ : length - 1;
+			for (; (j > 0) && (heats[j - 1] < heat); j--) {
+				heats[j] = heats[j - 1];
+				warm_set.cylinders[i][j] = warm_set.cylinders[i][j - 1];
+			}
+			heats[j] = heat;
+			warm_set.cylinders[i][j] = c;
+		}
+		for (int j = length; j < WARM_SET_CYLINDERS; j++)
+			warm_set.cylinders[i][j] = WARM_SET_END;
+	}
+
+	m->type = SD_SAVE_WARM_SET;
+	m->drive = -1;
+	m->slot = -1;
+	m->cylinder = -1;
+	warm_set_save_in_flight = true;
+	sd_ring_push(&sd_write_back_ring);
+	second_core_wake();
+
+	return true;
+}
+
+// The next cylinder on a drive's warm-up list which isn't loaded or being loaded, or -1 once
+// the list is done with. Warm-up only ever takes a free slot, so it stops for good once there
+// are none left rather than evict what the controller has been using since boot.
+int next_warm_up_cylinder(struct drive* d) {
+	while (d->warm_up_next < d->warm_up_length) {
+		int cylinder = d->warm_up[d->warm_up_next];
+
+		if (slot_lists[SLOT_LIST_FREE].length == 0)
+			d->warm_up_next = d->warm_up_length;
+		else if ((d->cylinder_map[cylinder] == -1) && !d->cylinder_loading[cylinder])
+			return cylinder;
+		else
+			d->warm_up_next += 1;
+	}
+
+	return -1;
+}
+
+// Make a cylinder which has just been loaded into a slot available to the track sequencer and
+// the seek handler. One of the drive's pinned cylinders stays off the replacement lists.
+void map_loaded_cylinder(struct drive* d, int cylinder, int slot, int cylinder_unloaded, bool prefetch) {
+	slot_prefetched[slot] = prefetch;
+	slot_to_drive_map[slot] = DRIVE_NUMBER(d);
+	slot_to_cylinder_map[slot] = cylinder;
+	Xil_ExceptionDisable();
+	if (cylinder < d->pinned_cylinders) {
+		slot_pinned[slot] = true;
+		pinned_slots += 1;
+	} else {
+		slot_loaded(slot);
+	}
+	Xil_ExceptionEnable();
+	d->cylinder_map[cylinder] = slot;
+	set_slot_table_entry(d, cylinder, slot);
+
+	if (prefetch) {
+		prefetch_issued[DRIVE_NUMBER(d)] += 1;
+		trace_event(DRIVE_NUMBER(d), TRACE_SLOT_PREFETCH, slot, cylinder_unloaded, cylinder);
+	} else {
+		trace_event(DRIVE_NUMBER(d), TRACE_SLOT_LOAD, slot, cylinder_unloaded, cylinder);
+	}
+}
+
+// Claim the least recently used clean slot and ask the SD worker to load a cylinder of a drive
+// into it. If every slot is dirty the least recently used one is written back instead, and the
+// load has to be asked for again once that is done. Prefetches only ever take a clean slot.
+// A cylinder with nothing stored on the card is filled in here and now instead. A cylinder a
+// seek is waiting for is loaded in two parts, the selected head's track first so that the seek
+// can complete as soon as that is in, unless the drive's hold slot is still in use. Loads of
+// the warm set after boot are made as prefetches, but not counted as them. Returns false if
+// the load could not be requested yet.
+bool request_load(struct drive* d, int cylinder, bool prefetch, bool warm_up) {
+	bool stored = cylinder_stored(d, cylinder);
+	struct sd_message* m = sd_ring_next(&sd_load_ring);
+
+	if (!m && stored)
+		return false;
+
+	Xil_ExceptionDisable();
+	int slot = select_victim_slot(true);
+	if ((slot == -1) && !prefetch && (eviction_slot == -1))
+		slot = select_victim_slot(false);
+	bool dirty = (slot != -1) && slot_is_dirty(slot);
+	int cylinder_unloaded = -1;
+	if ((slot != -1) && !dirty)
+		cylinder_unloaded = release_slot(slot);
+	Xil_ExceptionEnable();
+
+	if (slot == -1)
+		return false;
+
+	// The write-back takes the place in the ring the load would have had
+	if (dirty) {
+		if (request_write_back(slot, true))
+			eviction_slot = slot;
+		return false;
+	}
+
+	if (!stored) {
+		for (int h = 0; h < d->emu_header.heads; h++)
+			fill_track(d, cylinder, h, slot);
+		map_loaded_cylinder(d, cylinder, slot, cylinder_unloaded, prefetch && !warm_up);
+		return true;
+	}
+
+	bool partial = !prefetch && (d->hold_slot != -1) && !d->held_sectors && (d->emu_header.heads > 1) &&
+				   (d->write_records_taken == d->write_datapath[2]) && (sd_ring_space(&sd_load_ring) >= 2);
+	uint32_t first_tracks = partial ? (1u << d->current_head) : all_tracks(d);
+
+	m->type = prefetch ? SD_PREFETCH : SD_LOAD;
+	m->drive = DRIVE_NUMBER(d);
+	m->slot = slot;
+	m->cylinder = cylinder;
+	m->cylinder_unloaded = cylinder_unloaded;
+	m->tracks = first_tracks;
+	m->tracks_left = first_tracks;
+	m->ok = true;
+	m->warm_up = warm_up;
+	slot_busy[slot] = true;
+	d->cylinder_loading[cylinder] = true;
+	prefetch_in_flight |= prefetch;
+	sd_ring_push(&sd_load_ring);
+
+	if (partial) {
+		m = sd_ring_next(&sd_load_ring);
+		*m = (struct sd_message) {
+			.type = SD_FILL,
+			.drive = DRIVE_NUMBER(d),
+			.slot = slot,
+			.cylinder = cylinder,
+			.tracks = all_tracks(d) & ~first_tracks,
+			.tracks_left = all_tracks(d) & ~first_tracks,
+		};
+		slot_missing_tracks[slot] = m->tracks;
+		d->partial_slot = slot;
+		sd_ring_push(&sd_load_ring);
+	}
+	second_core_wake();
+
+	return true;
+}
+
+// Ask the SD worker to load a run of a resident image's cylinders from 'cylinder' on into
+// consecutive free slots, in one read of up to IMAGE_LOAD_CHUNK, as the whole image was read
+// at startup before the drives were made ready at once. Only a flat image whose cylinders fill
+// their slots exactly is laid out in them as it is on the card. Returns false if the load could
+// not be requested yet.
+bool request_preload(struct drive* d, int cylinder) {
+	struct sd_message* m = sd_ring_next(&sd_load_ring);
+	int limit = (IMAGE_LOAD_CHUNK > d->cylinder_size) ? (IMAGE_LOAD_CHUNK / d->cylinder_size) : 1;
+	int count = 0;
+
+	if (!m)
+		return false;
+
+	Xil_ExceptionDisable();
+	int slot = slot_lists[SLOT_LIST_FREE].head;
+	while ((count < limit) && (cylinder + count < d->emu_header.cylinders) && (slot + count < num_slots) &&
+		   (d->cylinder_map[cylinder + count] == -1) && !d->cylinder_loading[cylinder + count] &&
+		   (slot_list_of[slot + count] == SLOT_LIST_FREE)) {
+		slot_list_remove(slot + count);
+		count += 1;
+	}
+	Xil_ExceptionEnable();
+
+	for (int i = 0; i < count; i++) {
+		slot_busy[slot + i] = true;
+		d->cylinder_loading[cylinder + i] = true;
+	}
+
+	*m = (struct sd_message) {
+		.type = SD_PRELOAD,
+		.drive = DRIVE_NUMBER(d),
+		.slot = slot,
+		.cylinder = cylinder,
+		.count = count,
+	};
+	prefetch_in_flight = true;
+	sd_ring_push(&sd_load_ring);
+	second_core_wake();
+
+	return true;
+}
+
+// Some of the rest of a cylinder which was loaded a track first has arrived. Let the track
+// sequencer use it and copy any sectors the controller wrote to it in the meantime over it.
+void tracks_loaded(struct drive* d, int slot, uint32_t tracks) {
+	int cylinder = slot_to_cylinder_map[slot];
+
+	Xil_ExceptionDisable();
+	slot_missing_tracks[slot] &= ~tracks;
+	for (int h = 0; (h < d->emu_header.heads) && (slot == d->partial_slot); h++) {
+		for (int w = 0; (tracks & (1u << h)) && (w < DIRTY_WORDS_PER_TRACK); w++) {
+			uint32_t word = held_bitmap[DRIVE_NUMBER(d)][h][w];
+			while (word) {
+				struct chs address = { cylinder, h, (w * 32) + __builtin_ctz(word) };
+				release_held_sector(d, slot, address);
+				word &= word - 1;
+			}
+		}
+	}
+	if (tracks & (1u << d->current_head))
+		set_slot_table_entry(d, cylinder, slot);
+	Xil_ExceptionEnable();
+
+	if (!slot_missing_tracks[slot]) {
+		slot_busy[slot] = false;
+		if (slot == d->partial_slot)
+			d->partial_slot = -1;
+		trace_event(DRIVE_NUMBER(d), TRACE_SLOT_FILLED, slot, cylinder, 0);
+	}
+}
+
+// A write-back could not be written to the card. Its sectors were taken off the slot's dirty
+// bitmap when it was asked for, so they are put back, along with any written since, to be
+// written back again rather than lost when the slot is evicted.
+static void write_back_failed(struct drive* d, struct sd_message* m) {
+	int sectors = 0;
+
+	Xil_ExceptionDisable();
+	track_bitmap* dirty = slot_dirty_bitmap(m->slot);
+	for (int h = 0; h < d->emu_header.heads; h++) {
+		for (int w = 0; w < DIRTY_WORDS_PER_TRACK; w++) {
+			sectors += __builtin_popcount(m->bitmap[h][w] & ~dirty[h][w]);
+			dirty[h][w] |= m->bitmap[h][w];
+		}
+	}
+	dirty_sector_count[m->slot] += sectors;
+	if (dirty_sector_count[m->slot])
+		dirty_slots[m->slot >> 5] |= 1u << (m->slot & 31);
+	Xil_ExceptionEnable();
+
+	printf("Drive %c: write back of C=%d failed, keeping its sectors dirty\r\n", 'A' + DRIVE_NUMBER(d), m->cylinder);
+	post_work(WORK_WRITE_BACK);
+}
+
+// Act on everything the SD worker has finished. A cylinder a seek is waiting for is mapped
+// even if it could not be read, as the controller can't be kept waiting forever, but a
+// failed prefetch is simply dropped. The same goes for the rest of a cylinder loaded in two
+// parts. Returns whether there was anything to act on.
+bool process_sd_completions() {
+	struct sd_message* m;
+	bool popped = false;
+
+	while ((m = sd_ring_peek(&sd_completion_ring))) {
+		struct drive* d = (m->drive >= 0) ? &drives[m->drive] : NULL;
+
+		switch (m->type) {
+		case SD_FILL:
+			tracks_loaded(d, m->slot, m->tracks);
+			break;
+
+		case SD_LOAD:
+		case SD_PREFETCH:
+			// Still busy if this was the first part of a cylinder
+			slot_busy[m->slot] = (slot_missing_tracks[m->slot] != 0);
+			d->cylinder_loading[m->cylinder] = false;
+			if (m->type == SD_PREFETCH)
+				prefetch_in_flight = false;
+			if (!m->ok && (m->type == SD_PREFETCH)) {
+				Xil_ExceptionDisable();
+				slot_list_push(SLOT_LIST_FREE, m->slot);
+				Xil_ExceptionEnable();
+				break;
+			}
+
+			map_loaded_cylinder(d, m->cylinder, m->slot, m->cylinder_unloaded, (m->type == SD_PREFETCH) && !m->warm_up);
+			break;
+
+		case SD_PRELOAD:
+			prefetch_in_flight = false;
+			for (int i = 0; i < m->count; i++) {
+				slot_busy[m->slot + i] = false;
+				d->cylinder_loading[m->cylinder + i] = false;
+				if (m->ok) {
+					map_loaded_cylinder(d, m->cylinder + i, m->slot + i, -1, false);
+				} else {
+					Xil_ExceptionDisable();
+					slot_list_push(SLOT_LIST_FREE, m->slot + i);
+					Xil_ExceptionEnable();
+				}
+			}
+			break;
+
+		case SD_WRITE_BACK:
+			if (!m->ok)
+				write_back_failed(d, m);
+			slot_busy[m->slot] = false;
+			if (m->slot == eviction_slot)
+				eviction_slot = -1;
+			break;
+
+		case SD_SYNC:
+			unsynced_sectors -= m->count;
+			if (unsynced_sectors)
+				first_unsynced_write = read_cntvct();
+			sync_in_flight = false;
+			break;
+
+		case SD_CHECKPOINT:
+			// What couldn't be folded in is left in the journal until the fold delay has passed again
+			if (m->ok) {
+				unfolded_write_backs -= m->count;
+			} else {
+				printf("Journal could not be folded in, trying again later\r\n");
+				last_write_back = read_cntvct();
+			}
+			checkpoint_in_flight = false;
+			break;
+
+		case SD_SAVE_WARM_SET:
+			if (!m->ok)
+				printf("Could not write %s\r\n", WARM_SET_NAME);
+			warm_set_save_in_flight = false;
+			break;
+		}
+
+		sd_ring_pop(&sd_completion_ring);
+		popped = true;
+	}
+
+	// The worker may be waiting for room to post a completion
+	if (popped)
+		second_core_wake();
+
+	return popped;
+}
+
+// Take the oldest complete record from the trace ring, or a report of records dropped since
+// the last one. Returns false if there is nothing to take.
+static bool trace_take(struct trace_record* out) {
+	struct trace_record* r = &trace_ring[trace_tail % TRACE_ENTRIES];
+
+	if (__atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE) == trace_tail + 1) {
+		*out = *r;
+		__atomic_store_n(&trace_tail, trace_tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	for (int i = 0; i < NUM_TRACE_EVENTS; i++) {
+		uint32_t dropped = __atomic_load_n(&trace_dropped[i], __ATOMIC_RELAXED);
+		if (dropped != trace_dropped_reported[i]) {
+			*out = (struct trace_record) {
+				.time = read_cntvct(),
+				.type = TRACE_DROPPED,
+				.drive = TRACE_NO_DRIVE,
+				.arg = {dropped - trace_dropped_reported[i], i, 0},
+			};
+			trace_dropped_reported[i] = dropped;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void trace_print(const struct trace_record* r) {
+	char text[96];
+	uint64_t us = r->time / (COUNTS_PER_SECOND / 1000000);
+
+	snprintf(text, sizeof(text), trace_formats[r->type], r->arg[0], r->arg[1], r->arg[2]);
+	if (r->drive == TRACE_NO_DRIVE)
+		printf("[%5d.%06d] %s\r\n", (int) (us / 1000000), (int) (us % 1000000), text);
+	else
+		printf("[%5d.%06d] %c: %s\r\n", (int) (us / 1000000), (int) (us % 1000000), 'A' + r->drive, text);
+}
+
+// Print trace records while the UART has room for them without blocking, or once there are
+// enough of them (or 'all' is set) write them to the trace file as they are. Returns whether
+// anything was written to the file.
+bool trace_drain(bool all) {
+	static struct trace_record batch[TRACE_FILE_BATCH];
+	struct trace_record r;
+	bool written = false;
+
+	if (!trace_to_file) {
+		while ((all || XUartPs_IsTransmitEmpty(STDOUT_BASEADDRESS)) && trace_take(&r))
+			trace_print(&r);
+		return false;
+	}
+
+	while (all || ((uint32_t) (__atomic_load_n(&trace_head, __ATOMIC_RELAXED) - trace_tail) >= TRACE_FILE_BATCH)) {
+		int count = 0;
+		while ((count < TRACE_FILE_BATCH) && trace_take(&batch[count]))
+			count += 1;
+		if (!count)
+			break;
+
+		UINT bytes_written;
+		f_write(&trace_file, batch, count * sizeof(struct trace_record), &bytes_written);
+		written = true;
+	}
+
+	return written;
+}
+
+// Write out everything in the trace ring and make sure the trace file is up to date. Only
+// call this while the SD worker is idle.
+void trace_flush() {
+	trace_drain(true);
+	if (trace_to_file)
+		f_sync(&trace_file);
+}
+
+// Start the trace file on the SD card. Falls back to printing the trace if it can't be created.
+void trace_open_file() {
+	struct trace_file_header header = {
+		.magic = TRACE_FILE_MAGIC,
+		.record_size = sizeof(struct trace_record),
+		.counts_per_second = COUNTS_PER_SECOND,
+	};
+	UINT bytes_written;
+
+	if (f_open(&trace_file, "TRACE.BIN", FA_WRITE | FA_CREATE_ALWAYS) ||
+		f_write(&trace_file, &header, sizeof(header), &bytes_written) || (bytes_written != sizeof(header))) {
+		printf("Could not create TRACE.BIN, printing the trace instead\r\n");
+		trace_to_file = false;
+		return;
+	}
+
+	trace_enabled = TRACE_FILE_EVENTS;
+}
+
+// The tracks to read in the next step of a prefetch or a fill: about FILL_STEP_BYTES of them
+// from 'first_head' on, or from the first one left if that has been read already
+static uint32_t next_load_step(struct drive* d, uint32_t tracks_left, int first_head) {
+	int h = (tracks_left & (1u << first_head)) ? first_head : __builtin_ctz(tracks_left);
+	uint32_t step = 1u << h;
+
+	for (int i = 1; i < FILL_STEP_BYTES / d->track_stride; i++) {
+		h += 1;
+		if ((h >= d->emu_header.heads) || !(tracks_left & (1u << h)))
+			break;
+		step |= 1u << h;
+	}
+	return step;
+}
+
+// How much a seek may be waiting for a request in the load ring: not at all for a prefetch, and
+// only if the controller changes heads for the rest of a cylinder loaded a track first
+static int load_urgency(struct sd_message* m) {
+	return ((m->type == SD_PREFETCH) || (m->type == SD_PRELOAD)) ? 0 : (m->type == SD_FILL) ? 1 : 2;
+}
+
+// Serve one request from the main loop: loads first, as a seek may be waiting for one, then
+// write-backs, syncs and checkpoints in the order they were asked for. A checkpoint folds the
+// journal in a record at a time, and prefetches and the rest of a cylinder loaded a track
+// first are read FILL_STEP_BYTES at a time (with an answer for each step of the latter), each
+// staying at the front of its ring until it is done so that more urgent loads can be served
+// in between. When the trace goes to a file the worker writes that out
+// too. Returns false if there was nothing to do.
+bool sd_worker_poll() {
+	struct sd_ring* ring = &sd_load_ring;
+	struct sd_message* m = sd_ring_peek(ring);
+
+	// A prefetch or a fill gives way to the most urgent request behind it, which may be behind
+	// another prefetch or fill too. The ones it passes keep their order. Everything between tail
+	// and head belongs to the worker until it pops it.
+	if (m) {
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint32_t urgent = ring->tail;
+		for (uint32_t i = ring->tail + 1; i != head; i++) {
+			if (load_urgency(&ring->entries[i % SD_RING_ENTRIES]) > load_urgency(&ring->entries[urgent % SD_RING_ENTRIES]))
+				urgent = i;
+		}
+
+		if (urgent != ring->tail) {
+			struct sd_message waiting = ring->entries[urgent % SD_RING_ENTRIES];
+			for (uint32_t i = urgent; i != ring->tail; i--)
+				ring->entries[i % SD_RING_ENTRIES] = ring->entries[(i - 1) % SD_RING_ENTRIES];
+			*m = waiting;
+		}
+	}
+
+	if (!m) {
+		ring = &sd_write_back_ring;
+		m = sd_ring_peek(ring);
+	}
 
-// Sector address struct
-struct chs {
-	int c;
-	int h;
-	int s;
-};
+	if (m) {
+		// Every request is answered, so only take one on when there is room for the answer
+		struct sd_message* c = sd_ring_next(&sd_completion_ring);
+		if (!c)
+			return false;
+
+		*c = (struct sd_message) {
+			.type = m->type,
+			.drive = m->drive,
+			.slot = m->slot,
+			.cylinder = m->cylinder,
+			.cylinder_unloaded = m->cylinder_unloaded,
+			.tracks = m->tracks,
+			.count = m->count,
+			.warm_up = m->warm_up,
+		};
+
+		struct drive* d = (m->drive >= 0) ? &drives[m->drive] : NULL;
+		bool raw = false;
+		uint32_t step;
+
+		switch (m->type) {
+		case SD_LOAD:
+			trace_event(m->drive, TRACE_LOAD_START, m->cylinder, m->slot, 0);
+			c->ok = read_cylinder(d, m->cylinder, m->slot, m->tracks);
+			break;
 
-struct log_entry {
-	int type;
-	int description[3];
-};
+		case SD_PREFETCH:
+			if (m->tracks_left == m->tracks)
+				trace_event(m->drive, TRACE_LOAD_START, m->cylinder, m->slot, 0);
 
-/* Xilinx Driver Instances */
-static XGpio drive_gpio_inst;
-static XGpio head_gpio_inst;
+			step = next_load_step(d, m->tracks_left, 0);
+			m->ok = read_cylinder(d, m->cylinder, m->slot, step) && m->ok;
+			m->tracks_left &= ~step;
+			if (m->tracks_left)
+				return true;
+			c->ok = m->ok;
+			break;
 
-XScuGic interrupt_controller;
-static XScuGic_Config *GicConfig;
-static FATFS fatfs;
+		case SD_FILL:
+			// Starting from the selected head's track, in case the controller has moved on to
+			// it. Each step is answered as it is done.
+			c->tracks = next_load_step(d, m->tracks_left, d->current_head);
+			c->ok = read_cylinder(d, m->cylinder, m->slot, c->tracks);
+			m->tracks_left &= ~c->tracks;
+			if (m->tracks_left) {
+				sd_ring_push(&sd_completion_ring);
+				post_work(WORK_COMPLETION);
+				return true;
+			}
+			break;
 
-/* Memory Mapped Hardware Registers */
-volatile uint32_t* command_interface = (volatile uint32_t*) XPAR_AXI_ESDI_CMD_CONTROL_0_BASEADDR;
-volatile uint32_t* sector_timer = 	   (volatile uint32_t*) XPAR_SECTOR_TIMER_0_BASEADDR;
-volatile uint32_t* drive_select_gpio = (volatile uint32_t*) XPAR_GPIO_DRIVE_SELECT_BASEADDR;
-volatile uint32_t* head_select_gpio =  (volatile uint32_t*) XPAR_GPIO_HEAD_SELECT_BASEADDR;
-volatile uint32_t* dma =               (volatile uint32_t*) XPAR_AXI_DMA_0_BASEADDR;
-volatile uint32_t* read_datapath =     (volatile uint32_t*) XPAR_READ_DATAPATH_0_BASEADDR;
-volatile uint32_t* write_datapath =    (volatile uint32_t*) XPAR_WRITE_DATAPATH_0_BASEADDR;
+		case SD_PRELOAD:
+			trace_event(m->drive, TRACE_LOAD_START, m->cylinder, m->slot, 0);
+			c->ok = image_io(d, d->emu_header.data_offset + ((FSIZE_t) d->cylinder_size * m->cylinder),
+							 slot_buffer(m->slot), d->cylinder_size * m->count, false);
+			for (int i = 0; c->ok && (i < m->count); i++) {
+				if (journal_enabled && journal_cylinder_pending(d, m->cylinder + i))
+					c->ok = overlay_journal(d, m->cylinder + i, m->slot + i, all_tracks(d));
+			}
+			if (!c->ok)
+				trace_event(m->drive, TRACE_LOAD_FAILED, m->cylinder, FR_DISK_ERR, 0);
+			break;
 
-// DMA Stuff
-uint32_t descriptors[(0x40 * MAX_SUPPORTED_SECTORS) / 4] __attribute__((section(".bram_memory"),aligned(0x40))); // Aligned because Xilinx DMA requires it.
-uint32_t write_descriptors[(0x40 * NUM_WRITE_DESCRIPTORS) / 4] __attribute__((section(".bram_memory"),aligned(0x40)));
+		case SD_WRITE_BACK:
+			if (journal_enabled)
+				c->count = journal_write_back(d, m->slot, m->cylinder, m->bitmap);
+			else
+				c->count = write_back_slot(d, m->slot, m->cylinder, m->bitmap);
+			c->ok = (c->count >= 0);
+			if (!c->ok)		// So they can be marked dirty again
+				memcpy(c->bitmap, m->bitmap, d->emu_header.heads * sizeof(track_bitmap));
+			break;
+
+		case SD_SYNC:
+			c->ok = true;
+			for (int i = 0; i < NUM_DRIVES; i++) {
+				if (drives[i].present) {
+					c->ok = (f_sync(&drives[i].image_file) == FR_OK) && c->ok;
+					raw |= (drives[i].num_image_extents != 0);
+				}
+			}
+			if (journal_enabled)
+				c->ok = (f_sync(&journal_file) == FR_OK) && c->ok;
+			if (raw)
+				c->ok = (disk_ioctl(SD_DRIVE, CTRL_SYNC, NULL) == RES_OK) && c->ok;
+			trace_event(-1, TRACE_SYNC, m->count, 0, 0);
+			if (trace_to_file)
+				f_sync(&trace_file);
+			break;
 
-struct chs write_descriptor_chs[NUM_WRITE_DESCRIPTORS];  // Keep track of the CHS address of each write descriptor
-int current_write_descriptor;			// Index of the write descriptor that will be used next
-int last_unacked_write_descriptor;		// Index of the write descriptor we expect to complete next
+		case SD_CHECKPOINT:
+			if (fold_journal_step(&c->ok))
+				return true;
+			break;
 
-// Storage for emulated sector data
-uint8_t buffers[DATA_BUFFER_SIZE] __attribute__((aligned(EMULATION_FILE_ALIGNMENT))); // AXI DMA requires alignment of at least 4
-bool dirty_flags[WORST_CASE_NUM_SLOTS * 16 * MAX_SUPPORTED_SECTORS];
+		case SD_SAVE_WARM_SET:
+			c->ok = save_warm_set();
+			break;
+		}
 
-// The data in 'buffers' is divided into slots, each slot holds a cylinder.
-// This array holds the mapping from cylinder to slot number
-int num_slots;
-int cylinder_map[MAX_SUPPORTED_CYLINDERS];			// For converting cylinder# to slot#
-int slot_to_cylinder_map[WORST_CASE_NUM_SLOTS];
-uint64_t lru_table[WORST_CASE_NUM_SLOTS];
-
-// Current state as driven by the controller
-int current_drive_sel = 0;
-int current_cylinder = 0;
-int current_head = 0;
-
-// Global State Variables
-int tail;	// The index of the read descriptor which is currently pointed by MM2S_TAILDESC
-
-// These variables form a pipeline which is advanced in the sector timer interrupt routine
-// Their purpose is to keep track of the sector that was actually read out long enough to
-// be used when a sector is written.
-int next_cyl = 0;
-int next_head = 0;
-int last_cyl = 0;
-int last_head = 0;
-
-// Once sectors are written to memory, their address is enqueued here
-int dirty_queue_head = 0;
-int dirty_queue_tail = 0;
-struct chs dirty_queue[DIRTY_QUEUE_SIZE];
-
-// The general status which is returned to the ESDI controller
-uint16_t general_status;
-
-// The size of a cylinder derived from the emulation file
-int cylinder_size = 0;
-
-// Info pulled from the emulation file
-struct emulation_header emu_header;
-struct drive_configuration drive_conf;
-
-// Whether the main loop should print the current cylinder and head
-bool print_location = false;
-
-// Head and cylinder changes will immediately silence the read datapath.
-// These flags are used to keep track of when this happens
-bool seek_pending = false;
-bool head_change_pending = false;
-int seek_release;
-bool cyl_load_needed = false;
-bool seeks_throttled = false;
-
-/* Logging */
-
-struct log_entry log[LOG_ENTRIES];
-int log_oldest = 0;
-int log_next = 0;
-
-#define LOG_WRITE_MISSED 1
-#define LOG_READ_MISSED 2
-#define LOG_READ_UNDERFLOW 5
-#define LOG_DIRTY_FULL 3
-#define LOG_WRITE_OVERFLOW 4
+		sd_ring_pop(ring);
+		sd_ring_push(&sd_completion_ring);
+		post_work(WORK_COMPLETION);
+		return true;
+	}
 
-static inline uint64_t read_cntvct(void)
-{
-    uint64_t val;
-    asm volatile("mrs %0, cntvct_el0" : "=r"(val));
-    return val;
+	if (trace_to_file)
+		return trace_drain(false);
+
+	return false;
 }
 
-int dirty_queue_num_used() {
-	if (dirty_queue_head == dirty_queue_tail) {
-		return 0;
-	} else {
-		int num_used = dirty_queue_tail - dirty_queue_head;
-		if (num_used > 0)
-			return num_used;
-		else 
-			return num_used + DIRTY_QUEUE_SIZE;
+// Core 1 is held in reset by the boot code, so start it running 'poll' in a loop, going to
+// sleep whenever there is nothing to do. It takes on the MMU configuration of core 0 so that
+// both cores see the same memory map, coherently. This assumes the standalone BSP's default
+// of running at EL3. The host build provides its own version.
+#ifndef start_second_core
+
+#define APU_RVBARADDR1L			0xFD5C0048		// Reset vector of core 1
+#define APU_RVBARADDR1H			0xFD5C004C
+#define CRF_APB_RST_FPD_APU		0xFD1A0104
+#define RST_FPD_APU_ACPU1		((1 << 11) | (1 << 1))	// ACPU1_PWRON_RESET, ACPU1_RESET
+
+struct second_core_context {
+	uint64_t mair;
+	uint64_t tcr;
+	uint64_t ttbr0;
+	uint64_t sctlr;
+	uint64_t vbar;
+	uint64_t stack;
+};
+
+struct second_core_context second_core_context;
+uint8_t second_core_stack[SECOND_CORE_STACK_SIZE] __attribute__((aligned(16)));
+bool (*second_core_poll)(void);
+
+void second_core_main() {
+	while (1) {
+		if (!second_core_poll())
+			second_core_idle();
 	}
 }
 
-int dirty_queue_num_free() {
-	return DIRTY_QUEUE_SIZE - 1 - dirty_queue_num_used();
+// Core 1 starts here with its MMU and caches off. Join the coherency domain before turning
+// them on, then switch to core 0's translation tables.
+void second_core_entry();
+__asm__(
+	"	.section .text.second_core_entry, \"ax\"\n"
+	"	.global second_core_entry\n"
+	"	.balign 4\n"
+	"second_core_entry:\n"
+	"	msr cptr_el3, xzr\n"				// Don't trap FP/SIMD
+	"	mrs x0, S3_1_C15_C2_1\n"			// CPUECTLR_EL1.SMPEN
+	"	orr x0, x0, #(1 << 6)\n"
+	"	msr S3_1_C15_C2_1, x0\n"
+	"	isb\n"
+	"	ldr x1, =second_core_context\n"
+	"	ldp x2, x3, [x1]\n"
+	"	ldp x4, x5, [x1, #16]\n"
+	"	ldp x6, x7, [x1, #32]\n"
+	"	mov sp, x7\n"
+	"	msr vbar_el3, x6\n"
+	"	msr mair_el3, x2\n"
+	"	msr tcr_el3, x3\n"
+	"	msr ttbr0_el3, x4\n"
+	"	tlbi alle3\n"
+	"	dsb sy\n"
+	"	isb\n"
+	"	msr sctlr_el3, x5\n"
+	"	isb\n"
+	"	b second_core_main\n"
+	"	.ltorg\n"
+	"	.previous\n");
+
+void start_second_core(bool (*poll)(void)) {
+	second_core_poll = poll;
+
+	__asm__ volatile("mrs %0, mair_el3" : "=r"(second_core_context.mair));
+	__asm__ volatile("mrs %0, tcr_el3" : "=r"(second_core_context.tcr));
+	__asm__ volatile("mrs %0, ttbr0_el3" : "=r"(second_core_context.ttbr0));
+	__asm__ volatile("mrs %0, sctlr_el3" : "=r"(second_core_context.sctlr));
+	__asm__ volatile("mrs %0, vbar_el3" : "=r"(second_core_context.vbar));
+	second_core_context.stack = (uint64_t) (uintptr_t) &second_core_stack[SECOND_CORE_STACK_SIZE];
+
+	// Core 1 reads this before its caches are on
+	Xil_DCacheFlushRange((UINTPTR) &second_core_context, sizeof(second_core_context));
+	Xil_DCacheFlushRange((UINTPTR) &second_core_poll, sizeof(second_core_poll));
+
+	Xil_Out32(APU_RVBARADDR1L, (uint32_t) (uintptr_t) second_core_entry);
+	Xil_Out32(APU_RVBARADDR1H, (uint32_t) ((uintptr_t) second_core_entry >> 32));
+	dsb();
+	Xil_Out32(CRF_APB_RST_FPD_APU, Xil_In32(CRF_APB_RST_FPD_APU) & ~RST_FPD_APU_ACPU1);
 }
 
-// Handle for commands and configuration/status queries from the ESDI controller
-void command_interrupt_handler(void* arg) {
-	// Check that there is actually a command pending
-    if ((command_interface[1] & 0x2)) {
-        uint32_t command = command_interface[2];
+#endif
 
-        uint32_t cmd = (command >> 12) & 0xf;
-        uint32_t modifier = (command >> 8) & 0xf;
-        uint32_t subscript = command & 0xff;
+/* Reports */
 
-        if (cmd == 0x0) {	// Seek
-            current_cylinder = command & 0x0FFF;
-            print_location = true;
-            seek_pending = true;
-            seek_release = tail;
-            read_datapath[0] = 1;
-
-			// Slowing down seeks is our only way to stop the controller from writing faster than we can handle
-			// Don't complete a seek unless there is enough space in the dirty queue for every sector of a cylinder
-			if (dirty_queue_num_free() < (emu_header.heads * emu_header.sectors_per_track)) {
-				seeks_throttled = true;
-			}
-			
-			// Check if cylinder is already loaded
-			if (cylinder_map[current_cylinder] == -1) {
-				cyl_load_needed = true;
-			}
+// The statistics the main loop reports now and then are formatted into report_text and printed
+// a line at a time when the UART has nothing left to send, like the trace, rather than holding
+// the main loop up while tens of milliseconds of text go out. Lines which don't fit are dropped.
+char report_text[REPORT_TEXT_SIZE];
+int report_length = 0;		// Formatted
+int report_sent = 0;		// Printed
 
-			// If cylinder is already loaded and no throttling is needed, assert command complete and update last used timestamp,
-			if (!seeks_throttled && !cyl_load_needed) {
-				command_interface[3] = 0;
-				lru_table[cylinder_map[current_cylinder]] = read_cntvct();
-			}
+void report_printf(const char* format, ...) {
+	int room = REPORT_TEXT_SIZE - report_length;
+	va_list args;
 
-        } else if (cmd == 0x1) {	// recalibrate
-        	command_interface[3] = 0;	// Clear the command pending bit
-        } else if (cmd == 0x2) {	// Request Status
-            command_interface[2] = general_status;
-            command_interface[3] = 0;	// Clear the command pending bit
-        } else if (cmd == 0x3) {	// Request Configuration
-            if (modifier == 0) {
-            	// Mask out support for track offset and data strobe offset support.
-            	command_interface[2] = drive_conf.general_configuration[subscript] & 0xCFFE;
-            } else {
-                command_interface[2] = drive_conf.specific_configuration[modifier - 1];
-            }
-            command_interface[3] = 0;	// Clear the command pending bit
-        } else if (cmd == 0x5) {	// "Control"
-        	if (modifier == 0) {	// 		Reset interface attention and standard status
-        		general_status = 0;
-        	}
-        	command_interface[3] = 0;	// Clear the command pending bit
-        }
-    }
-}
+	va_start(args, format);
+	int length = vsnprintf(&report_text[report_length], room, format, args);
+	va_end(args);
 
-// Update hardware registers when the drive is [un]selected
-void drive_sel_interrupt_handler(void* arg) {
-    if (XGpio_InterruptGetStatus(&drive_gpio_inst) & 0x1) {
-        XGpio_InterruptClear(&drive_gpio_inst, 1);
-        int new_dsel = drive_select_gpio[0];
-        if (new_dsel != current_drive_sel) {
-            current_drive_sel = new_dsel;
-            if (new_dsel == 2) {
-                command_interface[0] = 0xE;		// Enable interface
-            } else {
-                command_interface[0] = 0x0;		// Disable interface
-            }
-        }
-    }
+	if ((length > 0) && (length < room))
+		report_length += length;
 }
 
-// Silence the read datapath when the head changes
-void head_sel_interrupt_handler(void* arg) {
-    if (XGpio_InterruptGetStatus(&head_gpio_inst) & 0x1) {
-        XGpio_InterruptClear(&head_gpio_inst, 1);
-        int new_hsel = head_select_gpio[0];
-        if (new_hsel != current_head) {
-        	current_head = new_hsel;
-        	print_location = true;
-        	read_datapath[0] = 1;
-        	head_change_pending = true;
-        	seek_release = tail;
-        }
-    }
+// Print the next line of the reports if the UART is idle. Returns whether any are left.
+bool report_drain() {
+	if ((report_sent != report_length) && XUartPs_IsTransmitEmpty(STDOUT_BASEADDRESS)) {
+		char* line = &report_text[report_sent];
+		char* end = memchr(line, '\n', report_length - report_sent);
+		int length = end ? ((end + 1) - line) : (report_length - report_sent);
+
+		printf("%.*s", length, line);
+		report_sent += length;
+		if (report_sent == report_length)
+			report_sent = report_length = 0;
+	}
+
+	return report_sent != report_length;
 }
 
-// Unused / Never Enabled
-void dma_mm2s_interrupt_handler(void* arg) {
+// Report how the slot replacement policy has done, for both drives together
+void print_replacement_stats() {
+	struct replacement_stats* stats = &replacement_stats[replacement_policy];
+	int seeks = stats->hits + stats->misses;
 
+	report_printf("Slots (%s): %d hits, %d misses (%d%% hit rate), %d evictions, %d promoted, %d pinned\r\n",
+			replacement_policy_names[replacement_policy], stats->hits, stats->misses,
+			seeks ? ((stats->hits * 100) / seeks) : 0, stats->evictions, stats->promotions, pinned_slots);
 }
 
-// Write Datapath Interrupt Routine
-void write_datapath_interrupt_handler(void* arg) {
-	uint32_t write_datapath_status = write_datapath[1];
-	if (write_datapath_status & 0x2) {		// Check that the interrupt actually occurred
+// Snapshot and clear a drive's datapath counters (see perf_counters.v) and report what
+// happened since the last report
+void report_perf_counters(struct drive* d) {
+	volatile uint32_t* perf_counters = d->perf_counters;
+	perf_counters[0] = 0x3;
+
+	uint64_t cycles = ((uint64_t) perf_counters[2] << 32) | perf_counters[1];
+	uint32_t min_slack = perf_counters[3];
+	uint32_t streamed = perf_counters[8];
+	uint32_t written = perf_counters[9];
+	uint32_t discarded = perf_counters[10];
+	uint32_t underflows = perf_counters[11];
+	uint32_t missed_deadlines = perf_counters[12];
+	uint32_t write_overflows = perf_counters[13];
+	uint32_t write_sectors_missed = perf_counters[14];
+	uint32_t head_changes = perf_counters[15];
+	uint32_t seeks = perf_counters[16];
+	uint32_t slack_histogram[PERF_SLACK_BINS];
+	for (int i = 0; i < PERF_SLACK_BINS; i++)
+		slack_histogram[i] = perf_counters[17 + i];
+
+	int unchanged = unchanged_writes[DRIVE_NUMBER(d)] - d->reported_unchanged_writes;
+	d->reported_unchanged_writes += unchanged;
+
+	uint32_t queries = d->command_interface[6] - d->reported_queries;
+	d->reported_queries += queries;
+
+	report_printf("Drive %c datapath over %d ms: %d streamed, %d written (%d unchanged), %d discarded, %d seeks, %d head changes, %d queries answered in hardware\r\n",
+			'A' + DRIVE_NUMBER(d), (int) (cycles / (HW_FREQ / 1000)), streamed, written, unchanged, discarded, seeks, head_changes, (int) queries);
+
+	// Bin n holds sectors whose data was ready less than (64 << n) cycles before they started
+	report_printf("    Slack histogram: %d %d %d %d %d %d %d %d (min %d us)\r\n",
+			slack_histogram[0], slack_histogram[1], slack_histogram[2], slack_histogram[3],
+			slack_histogram[4], slack_histogram[5], slack_histogram[6], slack_histogram[7],
+			(min_slack != 0xFFFFFFFF) ? (int) (min_slack / (HW_FREQ / 1000000)) : -1);
+
+	if (underflows || missed_deadlines || write_overflows || write_sectors_missed)
+		report_printf("    WARNING: %d underflows, %d missed deadlines, %d write overflows, %d write sectors missed\r\n",
+				underflows, missed_deadlines, write_overflows, write_sectors_missed);
+	else if ((min_slack != 0xFFFFFFFF) && (min_slack < PERF_SLACK_WARNING))
+		report_printf("    WARNING: read data arrived only %d cycles before its sector\r\n", min_slack);
+}
+
+// How long each class of work posted for the main loop has waited for it, since boot
+void report_work_latency() {
+	int average[NUM_WORK_CLASSES], max[NUM_WORK_CLASSES];
+	for (int i = 0; i < NUM_WORK_CLASSES; i++) {
+		struct work_latency* l = &work_latency[i];
+		average[i] = l->count ? (int) ((l->total / l->count) / (COUNTS_PER_SECOND / 1000000)) : 0;
+		max[i] = (int) (l->max / (COUNTS_PER_SECOND / 1000000));
+	}
 
-		int sector_just_finished = write_datapath[2];	// Get the physical sector number of the new sector
+	report_printf("Main loop waits (avg/max us): completions %d/%d, seek loads %d/%d, write-backs %d/%d\r\n",
+			average[WORK_COMPLETION], max[WORK_COMPLETION], average[WORK_SEEK_LOAD], max[WORK_SEEK_LOAD],
+			average[WORK_WRITE_BACK], max[WORK_WRITE_BACK]);
+}
 
-		if (write_datapath_status & 0x1) {	// Check if write fifo overflowed
+// numerator / denominator cycles, reduced until the denominator fits the hardware's registers
+struct cycle_ratio make_cycle_ratio(uint64_t numerator, uint64_t denominator) {
+	uint64_t a = numerator, b = denominator;
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	numerator /= a;
+	denominator /= a;
 
-			struct log_entry e;
-			e.type = LOG_WRITE_OVERFLOW;
-			e.description[0] = sector_just_finished;
-			log[log_next] = e;
-			log_next = (log_next + 1) % LOG_ENTRIES;
-		}
+	// Only off by a part in four billion, far less than the drive's own speed tolerance
+	while (denominator > UINT32_MAX) {
+		numerator >>= 1;
+		denominator >>= 1;
+	}
 
-		if (write_datapath_status & 0x8) {	// Check if a sector was missed
-			struct log_entry e;
-			e.type = LOG_WRITE_MISSED;
-			e.description[0] = sector_just_finished;
-			log[log_next] = e;
-			log_next = (log_next + 1) % LOG_ENTRIES;
-		}
+	struct cycle_ratio r = {numerator / denominator, numerator % denominator, denominator};
+	return r;
+}
 
-		if (write_datapath_status & 0x4) {	// Check if a sector has been written
+double cycle_ratio_value(struct cycle_ratio r) {
+	return r.whole + ((double) r.remainder / r.denominator);
+}
 
-			// Store the CHS for later when we go to write it into the file
-			write_descriptor_chs[current_write_descriptor].c  = last_cyl;
-			write_descriptor_chs[current_write_descriptor].h  = last_head;
-			write_descriptor_chs[current_write_descriptor].s  = sector_just_finished;
+// Make the tables with an entry for each cylinder of a drive for its image's geometry, and its
+// track table if it has a version 2 image or an overlay. Returns false if they don't all fit.
+static bool allocate_drive_tables(struct drive* d) {
+	int drive = DRIVE_NUMBER(d);
+	int cylinders = d->emu_header.cylinders;
+	bool tracks = overlays_enabled || (d->emu_header.file_version >= EMULATION_FILE_SPARSE);
+
+	if (tracks)
+		d->track_table = boot_alloc(cylinders * d->emu_header.heads * sizeof(struct track_entry));
+	d->cylinder_map = boot_alloc(cylinders * sizeof(*d->cylinder_map));
+	d->cylinder_loading = boot_alloc(cylinders * sizeof(*d->cylinder_loading));
+	d->warm_up = boot_alloc(cylinders * sizeof(*d->warm_up));
+	cylinder_evicted_at[drive] = boot_alloc(cylinders * sizeof(*cylinder_evicted_at[drive]));
+	cylinder_heat[drive] = boot_alloc(cylinders * sizeof(*cylinder_heat[drive]));
+	journal_pending[drive] = boot_alloc(((cylinders + 31) / 32) * sizeof(*journal_pending[drive]));
+
+	if ((tracks && !d->track_table) || !d->cylinder_map || !d->cylinder_loading || !d->warm_up ||
+		!cylinder_evicted_at[drive] || !cylinder_heat[drive] || !journal_pending[drive])
+		return false;
+
+	for (int c = 0; c < cylinders; c++)
+		d->cylinder_map[c] = -1;
+	return true;
+}
 
-			// Determine the address where the sector should be written to in memory
-			int slot = cylinder_map[last_cyl];
-			int offset = (slot * cylinder_size) + (((last_head * emu_header.sectors_per_track) + sector_just_finished) * emu_header.sector_size_in_image);
+// Bytes of the slot tables for each slot, near enough to size them before they are made. A
+// slot has a dirty bitmap for each head of the drive with the most heads (dirty_heads).
+static size_t slot_table_bytes() {
+	return (dirty_heads * sizeof(track_bitmap)) + sizeof(*dirty_sector_count) + sizeof(*slot_to_drive_map) +
+		   sizeof(*slot_to_cylinder_map) + sizeof(*slot_prefetched) + sizeof(*slot_missing_tracks) +
+		   sizeof(*slot_next) + sizeof(*slot_prev) + sizeof(*slot_list_of) + sizeof(*slot_pinned) +
+		   sizeof(*slot_busy) + 1;		// dirty_slots, rounded up
+}
 
-			// Update a write descriptor to use now
-			write_descriptors[((current_write_descriptor * 0x40) + 0x08) >> 2] = (uint32_t) (intptr_t) &buffers[offset];
-			write_descriptors[((current_write_descriptor * 0x40) + 0x1C) >> 2] = 0;
+// Make the tables with an entry for each of 'count' slots. Returns false if they don't all fit.
+static bool allocate_slot_tables(int count) {
+	dirty_bitmap = boot_alloc(count * dirty_heads * sizeof(track_bitmap));
+	dirty_sector_count = boot_alloc(count * sizeof(*dirty_sector_count));
+	dirty_slots = boot_alloc(((count + 31) / 32) * sizeof(*dirty_slots));
+	slot_to_drive_map = boot_alloc(count * sizeof(*slot_to_drive_map));
+	slot_to_cylinder_map = boot_alloc(count * sizeof(*slot_to_cylinder_map));
+	slot_prefetched = boot_alloc(count * sizeof(*slot_prefetched));
+	slot_missing_tracks = boot_alloc(count * sizeof(*slot_missing_tracks));
+	slot_next = boot_alloc(count * sizeof(*slot_next));
+	slot_prev = boot_alloc(count * sizeof(*slot_prev));
+	slot_list_of = boot_alloc(count * sizeof(*slot_list_of));
+	slot_pinned = boot_alloc(count * sizeof(*slot_pinned));
+	slot_busy = boot_alloc(count * sizeof(*slot_busy));
+
+	return dirty_bitmap && dirty_sector_count && dirty_slots && slot_to_drive_map && slot_to_cylinder_map &&
+		   slot_prefetched && slot_missing_tracks && slot_next && slot_prev && slot_list_of && slot_pinned && slot_busy;
+}
 
-			// Update the DMA tail descriptor pointer
-			dma[0x40 >> 2] = (uint32_t) (intptr_t) &write_descriptors[(current_write_descriptor * 0x40) >> 2];
+// Whether a line of DRIVE_CONFIG_NAME, after its drive letter, is 'key'
+static bool drive_config_key(const char* text, int length, const char* key) {
+	return (length == (int) strlen(key)) && !memcmp(text, key, length);
+}
 
-			// Increment write descriptor index
-			current_write_descriptor += 1;
-			if (current_write_descriptor == NUM_WRITE_DESCRIPTORS) {
-				current_write_descriptor = 0;
-			}
+// Take the names of the drives' images from DRIVE_CONFIG_NAME if there is one, which has a
+// line for each drive with an image of another name, such as "B=MICROPOLIS 1558.EMU". Each
+// drive's overlay is named after its image. With overlays, "B.OVERLAY=DISCARD" starts the
+// drive's overlay again and "B.OVERLAY=COMMIT" writes its tracks into the image and then
+// starts it again, at every boot while the line is there.
+void read_drive_config() {
+	FIL file;
+	char text[512];
+	UINT bytes = 0;
+
+	if (f_open(&file, DRIVE_CONFIG_NAME, FA_READ) == FR_OK) {
+		if (f_read(&file, text, sizeof(text) - 1, &bytes) != FR_OK)
+			bytes = 0;
+		f_close(&file);
+	}
+	text[bytes] = 0;
+
+	for (char* line = text; *line; ) {
+		int length = strcspn(line, "\r\n");
+		int drive = (line[0] | 0x20) - 'a';
+
+		if ((length > 2) && (length - 2 < IMAGE_NAME_LENGTH) && (line[1] == '=') && (drive >= 0) && (drive < NUM_DRIVES)) {
+			memcpy(drives[drive].image_name, &line[2], length - 2);
+			drives[drive].image_name[length - 2] = 0;
+		} else if ((length > 2) && (line[1] == '.') && (drive >= 0) && (drive < NUM_DRIVES)) {
+			drives[drive].overlay_discard |= drive_config_key(&line[2], length - 2, "OVERLAY=DISCARD");
+			drives[drive].overlay_commit |= drive_config_key(&line[2], length - 2, "OVERLAY=COMMIT");
 		}
-		write_datapath[1] = 0;		// Clear interrupt condition and possible errors
+
+		line += length;
+		line += strspn(line, "\r\n");
+	}
+
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		struct drive* d = &drives[i];
+		char* dot = strrchr(d->image_name, '.');
+		int length = dot ? (dot - d->image_name) : (int) strlen(d->image_name);
+		if (length > IMAGE_NAME_LENGTH - 5)
+			length = IMAGE_NAME_LENGTH - 5;
+		snprintf(d->overlay_name, IMAGE_NAME_LENGTH, "%.*s.OVL", length, d->image_name);
 	}
 }
 
-// S2MM DMA Interrupt Handler. Enabled for completed descriptors only (IOC_IrqEn = 1)
-void dma_s2mm_interrupt_handler(void* arg) {
-	if (dma[0x34 >> 2] & (1 << 12)) {	// Check for interrupt condition
-		dma[0x34 >> 2] = (1 << 12);		// Clear interrupt
+// Read a version 2 image's track table, and check that the records it refers to are all in
+// the file
+bool read_track_table(struct drive* d) {
+	UINT bytes_read;
+	uint32_t tracks = d->emu_header.cylinders * d->emu_header.heads;
+	uint32_t size = tracks * sizeof(struct track_entry);
 
-		// Get the status of the descriptor we expect to compete next
-		uint32_t desc_status = write_descriptors[((last_unacked_write_descriptor * 0x40) + 0x1C) >> 2];
-		if (desc_status & (1 << 31)) {	// If the descriptor has completed
+	FRESULT fr = f_lseek(&d->image_file, d->emu_header.track_table_offset);
+	if (!fr)
+		fr = f_read(&d->image_file, (void*) d->track_table, size, &bytes_read);
 
-			struct chs address = write_descriptor_chs[last_unacked_write_descriptor];
-			int slot = cylinder_map[address.c];
-			int dirty_flag_offset = (((slot * emu_header.heads) + address.h) * emu_header.sectors_per_track) + address.s;
-			if (!dirty_flags[dirty_flag_offset]) {
+	if (fr || (bytes_read != size)) {
+		printf("The selected disk image's track table can't be read\r\n");
+		return false;
+	}
 
-				dirty_flags[dirty_flag_offset] = true;
+	int stored = 0;
+	d->num_records = 0;
+	for (uint32_t i = 0; i < tracks; i++) {
+		uint32_t record = TRACK_RECORD(d->track_table[i]);
+		if (record)
+			stored += 1;
+		if (record > d->num_records)
+			d->num_records = record;
+	}
 
-				// Check for space in the dirty queue
-				if (((dirty_queue_tail + 1) % DIRTY_QUEUE_SIZE) != dirty_queue_head) {
-					// Enqueue the dirty sector's address
-					dirty_queue[dirty_queue_tail] = address;
-					dirty_queue_tail = (dirty_queue_tail + 1) % DIRTY_QUEUE_SIZE;
-				} else {
-					struct log_entry e;
-					e.type = LOG_DIRTY_FULL;
-					e.description[0] = address.c;
-					e.description[1] = address.h;
-					e.description[2] = address.s;
-					log[log_next] = e;
-					log_next = (log_next + 1) % LOG_ENTRIES;
-				}
+	printf("        Tracks stored = %d of %d\n", stored, (int) tracks);
 
-			}
+	if ((d->emu_header.data_offset % TRACK_RECORD_ALIGNMENT) ||
+		(track_record_offset(d, d->num_records + 1) > f_size(&d->image_file))) {
+		printf("The selected disk image's track table refers to records outside its data region\r\n");
+		return false;
+	}
 
-			// Increment
-			last_unacked_write_descriptor += 1;
-			if (last_unacked_write_descriptor == NUM_WRITE_DESCRIPTORS) {
-				last_unacked_write_descriptor = 0;
-			}
-		}
+	return true;
+}
+
+// Start a new overlay for a drive, with no tracks in it, in place of whatever its overlay file
+// held. d->emu_header is the image's on the way in and the overlay's on the way out.
+static bool create_overlay(struct drive* d) {
+	uint32_t tracks = d->emu_header.cylinders * d->emu_header.heads;
+	uint8_t start[OVERLAY_TABLE_OFFSET] = {0};
+	struct emulation_header header = d->emu_header;
+	UINT bytes, table_bytes;
+
+	header.file_version = EMULATION_FILE_OVERLAY;
+	header.drive_configuration_offset = sizeof(header);
+	header.track_table_offset = OVERLAY_TABLE_OFFSET;
+	header.data_offset = (OVERLAY_TABLE_OFFSET + (tracks * sizeof(struct track_entry)) + TRACK_RECORD_ALIGNMENT - 1) &
+						 ~(TRACK_RECORD_ALIGNMENT - 1);
+	memcpy(start, &header, sizeof(header));
+	memcpy(&start[sizeof(header)], &d->drive_conf, sizeof(d->drive_conf));
+	memset(d->track_table, 0, tracks * sizeof(struct track_entry));
+
+	FRESULT fr = f_lseek(&d->image_file, 0);
+	if (!fr)
+		fr = f_truncate(&d->image_file);
+	if (!fr)
+		fr = f_write(&d->image_file, start, sizeof(start), &bytes);
+	if (!fr)
+		fr = f_write(&d->image_file, d->track_table, tracks * sizeof(struct track_entry), &table_bytes);
+	if (!fr)
+		fr = f_lseek(&d->image_file, header.data_offset);
+	if (!fr)
+		fr = f_sync(&d->image_file);
+	if (fr || (bytes != sizeof(start)) || (table_bytes != tracks * sizeof(struct track_entry)))
+		return false;
+
+	d->emu_header = header;
+	return true;
+}
+
+// Open a drive's overlay in place of its image, which from then on is only read. A new one is
+// started if there isn't one, or it was made for an image of another size, or at every boot
+// with OVERLAY_RESET_AT_BOOT or when DRIVE_CONFIG_NAME discards it. d->emu_header is the image's on the way in, which must be flat,
+// and the overlay's on the way out.
+bool open_overlay(struct drive* d) {
+	struct emulation_header header;
+	UINT bytes = 0;
+
+	if (d->emu_header.file_version != EMULATION_FILE_FLAT) {
+		printf("Drive %c's image isn't a version 1 image, which an overlay needs\r\n", 'A' + DRIVE_NUMBER(d));
+		return false;
+	}
+
+	if (f_open(&d->image_file, d->overlay_name, FA_READ | FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+		return false;
+
+	FRESULT fr = f_read(&d->image_file, &header, sizeof(header), &bytes);
+	bool usable = !OVERLAY_RESET_AT_BOOT && !d->overlay_discard && !fr && (bytes == sizeof(header)) &&
+				  (header.file_version == EMULATION_FILE_OVERLAY) && (header.cylinders == d->emu_header.cylinders) &&
+				  (header.heads == d->emu_header.heads) && (header.sectors_per_track == d->emu_header.sectors_per_track) &&
+				  (header.sector_size_in_image == d->emu_header.sector_size_in_image);
+
+	d->base_data_offset = d->emu_header.data_offset;
+	if (usable) {
+		d->emu_header = header;
+	} else if (!create_overlay(d)) {
+		printf("Drive %c's overlay %s can't be written\r\n", 'A' + DRIVE_NUMBER(d), d->overlay_name);
+		f_close(&d->image_file);
+		return false;
 	}
+
+	d->overlaid = true;
+	d->overlay_new = !usable;
+
+	printf("    Drive %c writes to %s%s, leaving %s as it is\n", 'A' + DRIVE_NUMBER(d), d->overlay_name,
+		   usable ? "" : " (new)", d->image_name);
+	return true;
 }
 
-// Update the address in read DMA descriptors to match the current cylinder/head
-void update_descriptor_addresses(int start, int stop) {
+// Open a drive's image and read its header and drive configuration, and with overlays open its
+// overlay too, in which case the image is only written to commit the overlay. Returns false,
+// leaving the drive out of the emulation, if it has no image or the image can't be used.
+bool open_image(struct drive* d) {
+	UINT bytes_read;
+	FIL* file = overlays_enabled ? &d->base_file : &d->image_file;
+	uint8_t* tables = buffers;
 
-	if (current_cylinder >= MAX_SUPPORTED_CYLINDERS)
-		return;
+	if (f_open(file, d->image_name, (overlays_enabled && !d->overlay_commit) ? FA_READ : (FA_READ | FA_WRITE)) != FR_OK)
+		return false;
 
-	int slot = cylinder_map[current_cylinder];
+	// Read Emulation File Header
+	FRESULT fr_read = f_read(file, (void*) &d->emu_header, sizeof(struct emulation_header), &bytes_read);
 
-	if (slot == -1)
-		return;
+	if (fr_read || (bytes_read != sizeof(struct emulation_header))) {
+		f_close(file);
+		return false;
+	}
+
+	// Read Drive Configuration Data
+	FRESULT fr_seek = f_lseek(file, d->emu_header.drive_configuration_offset);
+
+	if (!fr_seek)
+		fr_read = f_read(file, (void*) &d->drive_conf, sizeof(struct drive_configuration), &bytes_read);
 
-	for (int i = start; i < stop; i++) {
-		int offset = (slot * cylinder_size) + (((current_head * emu_header.sectors_per_track) + i) * emu_header.sector_size_in_image);
-		descriptors[((i * 0x40) + 0x08) >> 2] = (uint32_t) (intptr_t) &buffers[offset];
+	if (fr_seek || fr_read || (bytes_read != sizeof(struct drive_configuration))) {
+		f_close(file);
+		return false;
 	}
-}
 
-// Sector Timer Interrupt Routine
-// This interrupt fires 15us before the end of each sector. This is when we determine
-// what sector will be read out next.
-void sector_timer_interrupt_handler(void* arg) {
-	uint32_t status = sector_timer[0];		// Reading this register has the side effect of clearing the interrupt condition
-	(void) status;
+	xil_printf("Emulation Header Loaded\r\n");
+	printf("    Drive %c emulation file parameters (%s):\n", 'A' + DRIVE_NUMBER(d), d->image_name);
+	printf("        Cylinders = %d\n", d->emu_header.cylinders);
+	printf("        Heads = %d\n", d->emu_header.heads);
+	printf("        Sectors = %d\n", d->emu_header.sectors_per_track);
+
+	// The spindle speed is in the header. The data rate follows from it and the unformatted
+	// bytes per track the drive reports (specific configuration word 3), which is what a
+	// controller uses to work it out too.
+	uint16_t unformatted_bytes_per_track = d->drive_conf.specific_configuration[3];
+	uint16_t unformatted_bytes_per_sector = d->drive_conf.specific_configuration[4];
+	d->rpm = d->emu_header.rpm ? d->emu_header.rpm : DEFAULT_DRIVE_RPM;
+	d->sector_cycles = make_cycle_ratio((uint64_t) HW_FREQ * 60, (uint64_t) d->rpm * d->emu_header.sectors_per_track);
+	if (unformatted_bytes_per_track)
+		d->halfbit_cycles = make_cycle_ratio((uint64_t) HW_FREQ * 60, (uint64_t) unformatted_bytes_per_track * 16 * d->rpm);
+	else
+		d->halfbit_cycles = make_cycle_ratio(HW_FREQ, 2 * DEFAULT_BIT_RATE);
+
+	double halfbit = cycle_ratio_value(d->halfbit_cycles);
+	printf("        RPM = %d\n", d->rpm);
+	printf("        Data rate = %.3f Mbit/s\n", HW_FREQ / (2 * halfbit) / 1e6);
+
+	bool supported = true;
+
+	if ((d->halfbit_cycles.whole < 1) || (d->halfbit_cycles.whole > MAX_CLOCKS_PER_HALFBIT)) {
+		printf("The selected disk image has a data rate the read datapath can't generate\r\n");
+		supported = false;
+	}
 
-	// Get the sector currently under the head
-	int sector_now = sector_timer[3];
+	if ((unformatted_bytes_per_sector * 16 * halfbit) > cycle_ratio_value(d->sector_cycles))
+		printf("Warning: drive %c's sectors take longer to read than they take to pass under the head\r\n", 'A' + DRIVE_NUMBER(d));
 
-	// Log any issues
-	status = read_datapath[1];
-	if (status & 0x1) {
-		struct log_entry e;
-		e.type = LOG_READ_UNDERFLOW;
-		e.description[0] = sector_now;
-		e.description[1] = sector_timer[4];
-		log[log_next] = e;
-		log_next = (log_next + 1) % LOG_ENTRIES;
+	if (d->emu_header.cylinders > MAX_SUPPORTED_CYLINDERS) {
+		printf("The selected disk image has more cylinders than the track sequencer can hold\r\n");
+		supported = false;
 	}
 
-	if (status & 0x2) {
-		struct log_entry e;
-		e.type = LOG_READ_MISSED;
-		e.description[0] = sector_now;
-		e.description[1] = sector_timer[4];
-		log[log_next] = e;
-		log_next = (log_next + 1) % LOG_ENTRIES;
+	if (d->emu_header.sectors_per_track > MAX_SUPPORTED_SECTORS) {
+		printf("The selected disk image has more sectors per track than the sector timer can count\r\n");
+		supported = false;
 	}
 
-	// Clear any errors
-	read_datapath[1] = 0;
+	if (d->emu_header.heads > MAX_SUPPORTED_HEADS) {
+		printf("The selected disk image has more heads than ESDI can select\r\n");
+		supported = false;
+	}
+
+	if (supported && !allocate_drive_tables(d)) {
+		printf("The selected disk image's geometry tables don't fit in memory\r\n");
+		supported = false;
+	}
 
-	// Advance pipeline
-	last_cyl = next_cyl;
-	last_head = next_head;
+	if (supported && overlays_enabled)
+		supported = open_overlay(d);
+
+	// Compute cylinder size from drive parameters. The tracks of a version 2 image or an
+	// overlay are stored as records of whole blocks, and are laid out in slots the same way.
+	d->sparse = (d->emu_header.file_version >= EMULATION_FILE_SPARSE);
+	if (d->sparse)
+		d->track_stride = track_record_stride(&d->emu_header);
+	else
+		d->track_stride = d->emu_header.sectors_per_track * d->emu_header.sector_size_in_image;
+	d->cylinder_size = d->emu_header.heads * d->track_stride;
+
+	if (supported && d->sparse)
+		supported = read_track_table(d);
+
+	if (!supported) {
+		f_close(file);
+		if (d->overlaid)
+			f_close(&d->image_file);
+		buffers = tables;
+	}
+
+	return supported;
+}
 
-	next_cyl = current_cylinder;
-	next_head = current_head;
+// Write the tracks an overlaid drive's overlay holds into its image and start the overlay
+// again, when DRIVE_CONFIG_NAME asks for it. Done at boot once the journal is folded in and
+// before anything is loaded, carrying each track through the first slot. The image is written
+// through FatFs and only then is the overlay emptied, so a failure part way through leaves
+// every track it held readable from one or the other. If the new overlay can't be written,
+// the drive is left out, as what is written to it would be lost at the next boot.
+void commit_overlay(struct drive* d) {
+	uint32_t track_bytes = d->emu_header.sectors_per_track * d->emu_header.sector_size_in_image;
+	uint32_t tracks = d->emu_header.cylinders * d->emu_header.heads;
+	uint8_t* track = slot_buffer(0);
+	int committed = 0;
+	UINT bytes;
+
+	if (journal_enabled && journal_records) {
+		printf("Drive %c's overlay can't be committed while the journal holds writes, trying again at the next boot\r\n",
+			   'A' + DRIVE_NUMBER(d));
+		return;
+	}
 
-	// Make local copy of current tail
-	int x = tail;
+	for (uint32_t t = 0; t < tracks; t++) {
+		uint32_t record = TRACK_RECORD(d->track_table[t]);
+		if (!record)
+			continue;
+
+		bool ok = image_io(d, track_record_offset(d, record), track, track_bytes, false);
+		FRESULT fr = ok ? f_lseek(&d->base_file, d->base_data_offset + ((FSIZE_t) t * track_bytes)) : FR_INT_ERR;
+		if (!fr)
+			fr = f_write(&d->base_file, track, track_bytes, &bytes);
+		if (fr || (bytes != track_bytes)) {
+			printf("Drive %c's overlay could not be committed to %s\r\n", 'A' + DRIVE_NUMBER(d), d->image_name);
+			return;
+		}
+		committed += 1;
+	}
 
-	// This is all modulo math, so this doesn't actually change the value of 'x'
-	if (sector_now > x)
-		x += emu_header.sectors_per_track;
+	if (f_sync(&d->base_file) != FR_OK) {
+		printf("Drive %c's overlay could not be committed to %s\r\n", 'A' + DRIVE_NUMBER(d), d->image_name);
+		return;
+	}
 
-	// Find out exactly how close we are to the reaching the tail
-	// If the difference is less than DMA lead, then it's time to issue more descriptors,
-	// otherwise stop.
-	if ((x - sector_now) >= DMA_LEAD)
+	if (!create_overlay(d)) {
+		printf("Drive %c's overlay %s can't be written, leaving the drive out\r\n", 'A' + DRIVE_NUMBER(d), d->overlay_name);
+		f_close(&d->image_file);
+		f_close(&d->base_file);
+		d->present = false;
 		return;
+	}
 
-	// We are always trying to maintain the tail DMA_LEAD sectors ahead
-	// of where we currently are. So calculate the new tail accordingly
-	int new_tail = sector_now + DMA_LEAD;
+	d->num_records = 0;
+	map_image_extents(d);
+	printf("    Drive %c overlay committed, %d tracks written to %s\n", 'A' + DRIVE_NUMBER(d), committed, d->image_name);
+}
 
-	int i = x + 1;				// Initialize 'i' to the sector following the current tail
+// Set up a drive's command interface, sector timer, track sequencer, write datapath and write
+// DMA for its image, and start it spinning
+void start_drive(struct drive* d) {
+	uint16_t unformatted_bytes_per_sector = d->drive_conf.specific_configuration[4];
 
-	// Issue the descriptors up to and including 'new_tail'
-	while (i <= new_tail) {
+    for (int i = 0; i < MAX_SUPPORTED_CYLINDERS; i++)
+    	set_slot_table_entry(d, i, (i < d->emu_header.cylinders) ? d->cylinder_map[i] : -1);
 
-		// Check the descriptors of sectors that we think have already
-		// passed under the head (or are currently) for the complete bit
-		// set in the status, just to be extra certain that we are not
-		// having too many outstanding descriptors
-		int y = (i - DMA_LEAD) % emu_header.sectors_per_track;
-		if (!(descriptors[((y * 0x40) + 0x1C) >> 2] & (1 << 31)))
-			break;
+    d->command_interface[0] = 0x0001;	// Soft reset
+    d->command_interface[0] = 0x0000;
 
-		if ((seek_pending || head_change_pending ) && (seek_release == y)) {
-//			command_interface[3] = 0;	// Clear the command pending bit
-			seek_pending = false;
-			head_change_pending = false;
-			read_datapath[0] = 0;
-		}
+    uint32_t sector_length = d->sector_cycles.whole - 1;	// The timer counts from zero
+    d->sector_timer[1] = sector_length;
+    d->sector_timer[2] = d->emu_header.sectors_per_track;
+    d->sector_timer[7] = d->sector_cycles.denominator;
+    d->sector_timer[6] = d->sector_cycles.remainder;
 
+    d->read_datapath[2] = d->halfbit_cycles.whole;
+    d->read_datapath[4] = d->halfbit_cycles.denominator;
+    d->read_datapath[3] = d->halfbit_cycles.remainder;
 
-		// Update the descriptors we are about to issue, by clearing
-		// the complete bit and updating their buffer address
-		y = i % emu_header.sectors_per_track;
-		descriptors[((y * 0x40) + 0x1C) >> 2] = 0;
-		update_descriptor_addresses(y, y+1);
+    // The track sequencer finds sectors the same way the write path does:
+    // slot base + head * track stride + sector * sector size in image
+    d->track_sequencer[2] = d->emu_header.sectors_per_track;
+    d->track_sequencer[3] = d->emu_header.sector_size_in_image;
+    d->track_sequencer[4] = d->track_stride;
+    d->track_sequencer[5] = unformatted_bytes_per_sector - 2;		// Label plus data, as the read datapath expects
+    d->track_sequencer[6] = SEQUENCER_LEAD;
+    d->track_sequencer[7] = sector_length - SEQUENCER_FETCH_TIME;	// Too late to fetch the next sector after this
 
-		// Update the tail register
-		dma[0x10 >> 2] = (uint32_t) (intptr_t) &descriptors[(0x40 * y) >> 2];
-		tail = y;
+    d->write_datapath[3] = unformatted_bytes_per_sector - 3;	// Unformatted bytes per sector less two to match read datapath and also less one to leave space for sector number
+    d->write_datapath[4] = ((uint32_t) WRITE_COALESCE_TIMEOUT << 8) | WRITE_COALESCE_RECORDS;
 
-		i += 1;
-	}
+    set_general_status(d, 1 << 8);	// Power on condition
+
+    // What the command interface answers configuration queries with. Entry n is modifier 0
+    // subscript n, and entry 32 + m is modifier m.
+    for (int i = 0; i < 32; i++)
+    	d->command_interface[QUERY_ANSWERS + i] = query_answer(d, 0, i);
+    for (int m = 1; m < 16; m++)
+    	d->command_interface[QUERY_ANSWERS + 32 + m] = query_answer(d, m, 0);
+
+    // Prepare Write Descriptors
+    for (int i = 0; i < NUM_WRITE_DESCRIPTORS; i++) {
+    	uint32_t next_desc;
+		if (i == NUM_WRITE_DESCRIPTORS - 1)
+			next_desc = 0;
+		else
+			next_desc = i + 1;
+
+		d->write_descriptors[((i * 0x40) + 0x00) >> 2] = (uint32_t) (intptr_t) &d->write_descriptors[(0x40 * next_desc) >> 2];
+		d->write_descriptors[((i * 0x40) + 0x08) >> 2] = (uint32_t) (intptr_t) &d->write_staging[i * WRITE_STAGING_SIZE];
+		d->write_descriptors[((i * 0x40) + 0x18) >> 2] = (unformatted_bytes_per_sector - 2) | (3 << 26);
+		d->write_descriptors[((i * 0x40) + 0x1C) >> 2] = 0;
+    }
+
+    // Reset DMA
+    d->dma[0x30 >> 2] = 0x4;
+    while(d->dma[0x30 >> 2] & 0x04) {}
+
+    // Set Write DMA Head
+    d->dma[0x38 >> 2] = (uint32_t) (intptr_t) &d->write_descriptors[(0x40 * 0) >> 2];
+    d->next_write_descriptor = 0;
+    d->write_records_taken = 0;
+
+    // Run DMA, with every descriptor available to it. Its interrupt is only enabled while
+    // waiting for a sector.
+    d->dma[0x30 >> 2] = 0x1;
+    while(d->dma[0x34 >> 2] & 0x01) {}
+    d->dma[0x40 >> 2] = (uint32_t) (intptr_t) &d->write_descriptors[(0x40 * (NUM_WRITE_DESCRIPTORS - 1)) >> 2];
+
+    // Enable Hardware
+    d->write_datapath[0] = 0x5;
+    d->perf_counters[0] = 0x2;		// Clear
+    d->sector_timer[0] = 1;		// Enable
+    select_track(d);
+    d->track_sequencer[0] = 3;		// Enable, with the interrupt when reading resumes
 }
 
 int main() {
@@ -488,8 +3601,9 @@ int main() {
 	// Enable HW Cache Coherence for memory areas for use by DMA
 	Xil_Out32(0xFD6E4000, 0x1);
 
-	uint32_t section = ((UINTPTR) buffers) / 0x100000U;
-	while (((uint32_t) (intptr_t) &buffers[DATA_BUFFER_SIZE - 1]) >= (section * 0x100000U)) {
+	uint32_t section = ((UINTPTR) __slot_buffers_start) / 0x100000U;
+	uint32_t last_section = (((UINTPTR) __slot_buffers_end) - 1) / 0x100000U;
+	while (section <= last_section) {
 		Xil_SetTlbAttributes((UINTPTR) (section * 0x100000U), 0x605UL);
 		section += 1;
 	}
@@ -497,13 +3611,21 @@ int main() {
 	dsb();
 
 	// Initialize hardware
-	sector_timer[0] = 0;
-	write_datapath[0] = 2;
-	read_datapath[0] = 0;
-
-	if (command_interface[1] & 0x2) {
-		uint32_t trash = command_interface[2];
-		(void) trash;
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		struct drive* d = &drives[i];
+
+		d->sector_timer[0] = 0;
+		d->track_sequencer[0] = 0;
+		d->partial_slot = -1;
+		d->hold_slot = -1;
+		d->write_staging = &__slot_buffers_start[i * WRITE_STAGING_BYTES];
+		d->write_datapath[0] = 2;
+		d->read_datapath[0] = 0;
+
+		if (d->command_interface[1] & 0x2) {
+			uint32_t trash = d->command_interface[2];
+			(void) trash;
+		}
 	}
 
 	// Setup GPIO HAL Driver
@@ -517,21 +3639,24 @@ int main() {
 
     Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT, (Xil_ExceptionHandler) XScuGic_InterruptHandler, &interrupt_controller);
 
-    XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_0_INTERRUPT_INTR, (Xil_InterruptHandler) command_interrupt_handler, (void *) 0);
     XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_GPIO_DRIVE_SELECT_IP2INTC_IRPT_INTR, (Xil_InterruptHandler) drive_sel_interrupt_handler, (void *) 0);
     XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_GPIO_HEAD_SELECT_IP2INTC_IRPT_INTR, (Xil_InterruptHandler) head_sel_interrupt_handler, (void *) 0);
-    XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_AXI_DMA_0_MM2S_INTROUT_INTR, (Xil_InterruptHandler) dma_mm2s_interrupt_handler, (void *) 0);
-    XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_WRITE_DATAPATH_0_INTERRUPT_INTR, (Xil_InterruptHandler) write_datapath_interrupt_handler, (void *) 0);
-    XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR, (Xil_InterruptHandler) dma_s2mm_interrupt_handler, (void *) 0);
-    XScuGic_Connect(&interrupt_controller, XPAR_FABRIC_SECTOR_TIMER_0_INTERRUPT_INTR,(Xil_InterruptHandler) sector_timer_interrupt_handler, (void *) 0);
 
-    XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_0_INTERRUPT_INTR);
     XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_GPIO_DRIVE_SELECT_IP2INTC_IRPT_INTR);
     XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_GPIO_HEAD_SELECT_IP2INTC_IRPT_INTR);
-    XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_AXI_DMA_0_MM2S_INTROUT_INTR);
-    XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_WRITE_DATAPATH_0_INTERRUPT_INTR);
-    XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR);
-    XScuGic_Enable(&interrupt_controller, XPAR_FABRIC_SECTOR_TIMER_0_INTERRUPT_INTR);
+
+    // Each drive's handlers are passed the drive
+    for (int i = 0; i < NUM_DRIVES; i++) {
+    	XScuGic_Connect(&interrupt_controller, drive_interrupts[i].command, (Xil_InterruptHandler) command_interrupt_handler, &drives[i]);
+    	XScuGic_Connect(&interrupt_controller, drive_interrupts[i].track_sequencer, (Xil_InterruptHandler) track_sequencer_interrupt_handler, &drives[i]);
+    	XScuGic_Connect(&interrupt_controller, drive_interrupts[i].write_datapath, (Xil_InterruptHandler) write_datapath_interrupt_handler, &drives[i]);
+    	XScuGic_Connect(&interrupt_controller, drive_interrupts[i].dma_s2mm, (Xil_InterruptHandler) dma_s2mm_interrupt_handler, &drives[i]);
+
+    	XScuGic_Enable(&interrupt_controller, drive_interrupts[i].command);
+    	XScuGic_Enable(&interrupt_controller, drive_interrupts[i].track_sequencer);
+    	XScuGic_Enable(&interrupt_controller, drive_interrupts[i].write_datapath);
+    	XScuGic_Enable(&interrupt_controller, drive_interrupts[i].dma_s2mm);
+    }
 
     XGpio_InterruptGlobalEnable(&drive_gpio_inst);
     XGpio_InterruptEnable(&drive_gpio_inst, 1);
@@ -541,288 +3666,286 @@ int main() {
 
     Xil_ExceptionEnable();
 
-    // Load Image from SD Card
+    // Load Images from SD Card
 
     f_mount(&fatfs, "0:/", 1);
+    read_drive_config();
 
-    FIL image_file;
-    FRESULT image_opened, fr_seek, fr_read, fr_write;
-    UINT bytes_read;
+    int num_present = 0;
+    int total_cylinders = 0;
 
-    image_opened = f_open(&image_file, "MICROP~1.EMU", FA_READ | FA_WRITE);
+    for (int i = 0; i < NUM_DRIVES; i++) {
+    	struct drive* d = &drives[i];
 
-    if (image_opened != FR_OK) {
-    	return 0;
-    }
-
-    // Read Emulation File Header
-    fr_read = f_read(&image_file, (void*) &emu_header, sizeof(struct emulation_header), &bytes_read);
+    	if (!open_image(d)) {
+    		printf("No usable image for drive %c (%s)\r\n", 'A' + i, d->image_name);
+    		continue;
+    	}
 
-    if (bytes_read != sizeof(struct emulation_header)) {
-    	return 0;
+    	d->present = true;
+    	num_present += 1;
+    	total_cylinders += d->emu_header.cylinders;
+    	if (d->cylinder_size > slot_size)
+    		slot_size = d->cylinder_size;
+    	if (d->emu_header.heads > dirty_heads)
+    		dirty_heads = d->emu_header.heads;
     }
 
-    // Read Drive Configuration Data
-    fr_seek = f_lseek(&image_file, emu_header.drive_configuration_offset);
-
-    if (fr_seek) {
+    if (!num_present) {
     	return 0;
     }
 
-    fr_read = f_read(&image_file, (void*) &drive_conf, sizeof(struct drive_configuration), &bytes_read);
-
-	if (bytes_read != sizeof(struct drive_configuration)) {
-		return 0;
-	}
-
-	// Compute cylinder size from drive parameters
-	cylinder_size = emu_header.heads * emu_header.sectors_per_track * emu_header.sector_size_in_image;
-
-	uint16_t unformatted_bytes_per_sector = drive_conf.specific_configuration[4];
-
-	uint16_t drive_rpm = 3600;
-
-	xil_printf("Emulation Header Loaded\r\n");
-	printf("    Emulation File parameters:\n");
-	printf("        Cylinders = %d\n", emu_header.cylinders);
-	printf("        Heads = %d\n", emu_header.heads);
-	printf("        Sectors = %d\n", emu_header.sectors_per_track);
-
-	if (emu_header.cylinders > MAX_SUPPORTED_CYLINDERS) {
-		printf("The selected disk image has more cylinders than this build can support\r\n");
-		return 0;
+	if (trace_to_file)
+		trace_open_file();
+
+	// Make as many slots as will fit in memory along with their tables, each big enough for a
+	// cylinder of either drive. If that is enough for every image, all of them are loaded and
+	// can stay resident.
+	int table_slots = (__slot_buffers_end - buffers) / (slot_size + slot_table_bytes());
+	if (table_slots > total_cylinders)
+		table_slots = total_cylinders;
+
+	// Each table is rounded up to a cache line, which the estimate leaves out
+	uint8_t* tables = buffers;
+	while ((table_slots > 0) && !allocate_slot_tables(table_slots)) {
+		buffers = tables;
+		table_slots -= 1;
 	}
 
-	if (emu_header.sectors_per_track > MAX_SUPPORTED_SECTORS) {
-		printf("The selected disk image has more sectors per track than this build can support\r\n");
-		return 0;
-	}
-
-	// num_slots = DATA_BUFFER_SIZE / cylinder_size;
-	num_slots = WORST_CASE_NUM_SLOTS;
-
-	printf("Number of slots: %d\r\n", num_slots);
+	num_slots = (__slot_buffers_end - buffers) / slot_size;
+	if (num_slots > table_slots)
+		num_slots = table_slots;
+	image_resident = (num_slots == total_cylinders);
 
-	// Load Initial cylinders
-	fr_seek = f_lseek(&image_file, emu_header.data_offset);
-
-	if (fr_seek) {
+	// A miss can't evict the cylinder a drive is on or the one it came from
+	if (num_slots < 3 * num_present) {
+		printf("Only %d slots fit in memory alongside the images' tables, which is too few\r\n", num_slots);
 		return 0;
 	}
 
-    for (int i = 0; i < MAX_SUPPORTED_CYLINDERS; i++) {
-    	if (i < PRELOAD_CYLINDERS)
-    		cylinder_map[i] = i;
-    	else
-    		cylinder_map[i] = -1;
-    }
-
-	for (int i = 0; i < PRELOAD_CYLINDERS; i++) {
-		fr_read = f_read(&image_file, (void*) &buffers[cylinder_size * i], cylinder_size, &bytes_read);
-		if (fr_read || (bytes_read < cylinder_size)) {
-			xil_printf("Failed to load cylinder %d\r\n", i);
+	// Each drive keeps a slot back to hold writes to tracks which haven't been loaded yet, if
+	// there are enough to spare
+	for (int i = 0; (i < NUM_DRIVES) && !image_resident; i++) {
+		if (drives[i].present && (num_slots > MIN_SLOTS_FOR_HOLD)) {
+			num_slots -= 1;
+			drives[i].hold_slot = num_slots;
 		}
-		slot_to_cylinder_map[i] = i;
 	}
 
-	memset(dirty_flags, 0, WORST_CASE_NUM_SLOTS * 16 * MAX_SUPPORTED_SECTORS);
-	memset(lru_table, 0, WORST_CASE_NUM_SLOTS * sizeof(uint64_t));
-
-	xil_printf("Loaded Data\r\n");
+	printf("Number of slots: %d%s, with %d KB of tables\r\n", num_slots, image_resident ? " (every image resident)" : "",
+			(int) ((buffers - &__slot_buffers_start[NUM_DRIVES * WRITE_STAGING_BYTES]) / 1024));
 
-	// Configure hardware with emulation data
-
-    command_interface[0] = 0x0001;	// Soft reset
-    command_interface[0] = 0x0000;
+	for (int i = 0; i < NUM_SLOT_LISTS; i++)
+		slot_lists[i] = (struct slot_list) { -1, -1, 0 };
 
-    sector_timer[1] = HW_FREQ / (drive_rpm / 60) / emu_header.sectors_per_track;
-    sector_timer[2] = emu_header.sectors_per_track;
-    sector_timer[5] = (HW_FREQ / (drive_rpm / 60) / emu_header.sectors_per_track) - (15e-6 * HW_FREQ);	// 15us before the end of the sector
-
-    write_datapath[3] = unformatted_bytes_per_sector - 3;	// Unformatted bytes per sector less two to match read datapath and also less one to leave space for sector number
+	for (int i = num_slots - 1; i >= 0; i--) {
+		slot_to_drive_map[i] = 0;
+		slot_to_cylinder_map[i] = -1;
+		slot_list_of[i] = SLOT_LIST_NONE;
+		slot_list_push(SLOT_LIST_FREE, i);
+	}
 
-    general_status = 1 << 8;	// Power on condition
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		struct drive* d = &drives[i];
+		if (!d->present)
+			continue;
 
-    // Prepare Read Descriptors
+		if (map_image_extents(d))
+			printf("Drive %c image data in %d extents on the card\r\n", 'A' + i, d->num_image_extents);
+		else
+			printf("Drive %c image data can't be mapped, using FatFs for it\r\n", 'A' + i);
 
-    for (int i = 0; i < emu_header.sectors_per_track; i++) {
-    	uint32_t next_desc;
-    	if (i == emu_header.sectors_per_track - 1)
-    		next_desc = 0;
-    	else
-    		next_desc = i + 1;
-
-    	descriptors[((i * 0x40) + 0x00) >> 2] = (uint32_t) (intptr_t) &descriptors[(0x40 * next_desc) >> 2];
-    	descriptors[((i * 0x40) + 0x18) >> 2] = (unformatted_bytes_per_sector - 2) | (3 << 26);
-    	descriptors[((i * 0x40) + 0x1C) >> 2] = 0;
-    }
+		if (d->overlaid && map_base_extents(d))
+			printf("Drive %c image under the overlay in %d extents on the card\r\n", 'A' + i, d->num_base_extents);
+		else if (d->overlaid)
+			printf("Drive %c image under the overlay can't be mapped, using FatFs for it\r\n", 'A' + i);
+	}
 
-    update_descriptor_addresses(0, emu_header.sectors_per_track);
+	// Anything left in the journal has to be in the images before they are loaded
+	if (journal_enabled && !open_journal()) {
+		printf("Could not open %s, writing back in place\r\n", JOURNAL_NAME);
+		journal_enabled = false;
+	}
 
-    // Prepare Write Descriptors
-    for (int i = 0; i < NUM_WRITE_DESCRIPTORS; i++) {
-    	uint32_t next_desc;
-		if (i == NUM_WRITE_DESCRIPTORS - 1)
-			next_desc = 0;
-		else
-			next_desc = i + 1;
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present && drives[i].overlaid && drives[i].overlay_commit)
+			commit_overlay(&drives[i]);
+	}
 
-		write_descriptors[((i * 0x40) + 0x00) >> 2] = (uint32_t) (intptr_t) &write_descriptors[(0x40 * next_desc) >> 2];
-		write_descriptors[((i * 0x40) + 0x18) >> 2] = (unformatted_bytes_per_sector - 2) | (3 << 26);
-		write_descriptors[((i * 0x40) + 0x1C) >> 2] = 0;
-    }
+	// Plan which cylinders to load in the background once the drives are ready, sharing the
+	// slots equally between the drives
+	read_warm_set();
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		struct drive* d = &drives[i];
+		if (!d->present)
+			continue;
 
-    // Reset DMA
-    dma[0] = 0x4;
-    while(dma[0x00 >> 2] & 0x04) {}
-    while(dma[0x30 >> 2] & 0x04) {}
+		int count = image_resident ? d->emu_header.cylinders : (num_slots / num_present);
+		if (count > d->emu_header.cylinders)
+			count = d->emu_header.cylinders;
 
-    // Set Read DMA Head
-    dma[0x08 >> 2] = (uint32_t) (intptr_t) &descriptors[(0x40 * 0) >> 2];
+		// Pinning is pointless if everything is resident, and mustn't take most of the slots
+		int pinned = image_resident ? 0 : PINNED_CYLINDERS;
+		if (pinned > count / 4)
+			pinned = count / 4;
 
-    // Set Write DMA Head
-    dma[0x38 >> 2] = (uint32_t) (intptr_t) &write_descriptors[(0x40 * 0) >> 2];
-    current_write_descriptor = 0;
-    last_unacked_write_descriptor = 0;
+		plan_warm_up(d, count, pinned);
+	}
 
-    // Run DMA
-    dma[0x00 >> 2] = 0x1;
-    while(dma[0x04 >> 2] & 0x01) {}
+	// Configure hardware with emulation data
+	for (int i = 0; i < NUM_DRIVES; i++) {
+		if (drives[i].present)
+			start_drive(&drives[i]);
+	}
 
-    dma[0x30 >> 2] = 0x1 | (1 << 12);
-    while(dma[0x34 >> 2] & 0x01) {}
+    uint64_t last_perf_report = read_cntvct();
+    uint64_t last_warm_set_save = read_cntvct();
 
-    // Set Initial Read DMA Tail
-    dma[0x10 >> 2] = (uint32_t) (intptr_t) &descriptors[(0x40 * (DMA_LEAD - 1)) >> 2];
-    tail = DMA_LEAD - 1;
+#if SD_ON_SECOND_CORE
+    start_second_core(sd_worker_poll);
+#endif
 
-    // Enable Hardware
-    write_datapath[0] = 0x5;
-    sector_timer[0] = 3;		// Enable
+    enable_main_loop_wake();
 
     // Main Loop
     while(1) {
-    	if (print_location) {
-    		print_location = false;
-    		printf("C=%d  H=%d\r\n", current_cylinder, current_head);
+    	bool busy = false;		// Whether this pass did anything which may have made more to do
+
+    	take_work();
+#if !SD_ON_SECOND_CORE
+    	busy |= sd_worker_poll();
+#endif
+    	busy |= process_sd_completions();
+
+    	bool load_needed = false;
+
+    	// Load a slot if needed, taking the drives in turn
+    	for (int i = 0; i < NUM_DRIVES; i++) {
+    		struct drive* d = &drives[(next_load_drive + i) % NUM_DRIVES];
+    		if (!d->present)
+    			continue;
+
+    		check_read_errors(d);
+
+    		if (!d->cyl_load_needed)
+    			continue;
+
+    		// A prefetch may have finished loading the cylinder after the seek came in
+    		int slot = d->cylinder_map[d->current_cylinder];
+    		if (slot != -1) {
+    			if (!slot_ready(d, slot))
+    				continue;
+    			slot_prefetched[slot] = false;
+
+    			d->cyl_load_needed = false;
+    			complete_seek(d);
+    			busy = true;
+    		} else {
+    			load_needed = true;
+    			if (!d->cylinder_loading[d->current_cylinder] && request_load(d, d->current_cylinder, false, false)) {
+    				next_load_drive = (DRIVE_NUMBER(d) + 1) % NUM_DRIVES;
+    				busy = true;
+    			}
+    		}
     	}
 
-		// Check if we can complete a throttled seek
-		if (seeks_throttled) {
-			if (dirty_queue_num_free() >= (emu_header.heads * emu_header.sectors_per_track)) {
-				seeks_throttled = false;
-				// If there are no other barriers to completing the seek
-				if (!cyl_load_needed) {
-					command_interface[3] = 0;
-					lru_table[cylinder_map[current_cylinder]] = read_cntvct();
-				}
-			}
-		}
-
-    	// Load a slot if needed
-		if (cyl_load_needed) {
-
-			// Determine which slot is least recently used
-			int lru_slot = 0;
-			uint64_t lru_timestamp = lru_table[0];
-
-			for (int i = 1; i < num_slots; i++) {
-				if (lru_table[i] < lru_timestamp) {
-					lru_slot = i;
-					lru_timestamp = lru_table[i];
-				}
-			}
-
-			// Determine if this slot has dirty sectors
-			bool slot_dirty = false;
-			int dirty_flag_offset = lru_slot * emu_header.heads * emu_header.sectors_per_track;
-			for (int i = 0; i < (emu_header.heads * emu_header.sectors_per_track); i++) {
-				if (dirty_flags[dirty_flag_offset + i])
-					slot_dirty = true;
-			}
+    	// Write back the next slot with dirty sectors, from each drive in turn
+    	for (int i = 0; i < NUM_DRIVES; i++) {
+    		int drive = (next_write_back_drive + i) % NUM_DRIVES;
+    		int dirty_slot = next_dirty_slot(drive);
+    		if (dirty_slot == -1)
+    			continue;
+
+    		if (request_write_back(dirty_slot, false)) {
+    			last_written_back_slot = dirty_slot;
+    			next_write_back_drive = (drive + 1) % NUM_DRIVES;
+    			busy = true;
+    		}
+    		break;
+    	}
 
-			// If clean, evict and load with current_cylinder
-			if (!slot_dirty) {
-				fr_seek = f_lseek(&image_file, emu_header.data_offset + (cylinder_size * current_cylinder));
+    	// Group commit: sync once everything has been written back, or sooner if a lot
+    	// of data or time has built up since the last sync
+    	if (unsynced_sectors && !sync_in_flight) {
+    		if (!any_slot_dirty() || (unsynced_sectors >= WRITEBACK_SYNC_SECTORS) ||
+    			((read_cntvct() - first_unsynced_write) >= WRITEBACK_SYNC_INTERVAL)) {
+    			busy |= request_sync();
+    		}
+    	}
 
-				if (!fr_seek)
-					fr_read = f_read(&image_file, (void*) &buffers[cylinder_size * lru_slot], cylinder_size, &bytes_read);
+    	// Fold the journal into the images once the controller has stopped writing for a while
+    	if (unfolded_write_backs && !checkpoint_in_flight && !any_slot_dirty() && !unsynced_sectors &&
+    		((read_cntvct() - last_write_back) >= JOURNAL_FOLD_DELAY)) {
+    		busy |= request_checkpoint();
+    	}
 
-				if (fr_seek || fr_read || (bytes_read < cylinder_size)) {
-					xil_printf("Failed to load cylinder %d\r\n", current_cylinder);
-				}
+    	// Record the warm set for the next boot now and then, if the drives have been used since
+    	if (!warm_set_save_in_flight && ((read_cntvct() - last_warm_set_save) >= WARM_SET_SAVE_INTERVAL)) {
+    		int seeks = 0;
+    		for (int i = 0; i < NUM_DRIVES; i++)
+    			seeks += seek_count[i];
 
-				// Update maps
-				int cylinder_unloaded = slot_to_cylinder_map[lru_slot];		// backup cylinder# that is being unloaded
-				cylinder_map[cylinder_unloaded] = -1;						// mark that cylinder as unloaded
-				cylinder_map[current_cylinder] = lru_slot;
-				slot_to_cylinder_map[lru_slot] = current_cylinder;			
+    		last_warm_set_save = read_cntvct();
+    		if ((seeks != warm_set_seeks) && request_warm_set_save()) {
+    			warm_set_seeks = seeks;
+    			busy = true;
+    		}
+    	}
 
-				printf("Slot %d load: %d -> %d\r\n", lru_slot, cylinder_unloaded, current_cylinder);
+		// Speculatively load a cylinder while the controller has nothing else for us to do,
+		// for each drive in turn, or failing that the next of its warm set
+		if (!load_needed && !any_slot_dirty() && !prefetch_in_flight) {
+			for (int i = 0; i < NUM_DRIVES; i++) {
+				struct drive* d = &drives[(next_prefetch_drive + i) % NUM_DRIVES];
+				int cylinder = d->present ? predict_prefetch_cylinder(d) : -1;
+				bool warm_up = (cylinder == -1) && d->present;
+				if (warm_up)
+					cylinder = next_warm_up_cylinder(d);
+				if (cylinder == -1)
+					continue;
 
-				cyl_load_needed = false;
-				// If there are no other barriers to completing the seek
-				if (!seeks_throttled) {
-					command_interface[3] = 0;
-					lru_table[cylinder_map[current_cylinder]] = read_cntvct();
+				bool preload = warm_up && image_resident && !d->sparse && (d->cylinder_size == slot_size);
+				if (preload ? request_preload(d, cylinder) : request_load(d, cylinder, true, warm_up)) {
+					next_prefetch_drive = (DRIVE_NUMBER(d) + 1) % NUM_DRIVES;
+					d->warm_up_next += warm_up;
+					busy = true;
 				}
+				break;
 			}
 		}
 
-    	// Write a dirty sector to SD if there is one
-    	if (dirty_queue_head != dirty_queue_tail) {
-    		struct chs dirty_sector = dirty_queue[dirty_queue_head];
-    		dirty_queue_head = (dirty_queue_head + 1) % DIRTY_QUEUE_SIZE;
-    		
-    		int slot = cylinder_map[dirty_sector.c];
-    		// if (slot == -1) {
-    		// 	continue;
-    		// }
-
-			int dirty_flag_offset = (((slot * emu_header.heads) + dirty_sector.h) * emu_header.sectors_per_track) + dirty_sector.s;
-			if (dirty_flags[dirty_flag_offset]) {
-
-				dirty_flags[dirty_flag_offset] = false;
-
-				printf("Dirty (%d,%d,%d)\r\n", dirty_sector.c, dirty_sector.h, dirty_sector.s);
-				fr_seek = f_lseek(&image_file, emu_header.data_offset + (cylinder_size * dirty_sector.c) + (((dirty_sector.h * emu_header.sectors_per_track) + dirty_sector.s) * emu_header.sector_size_in_image));
-
-				if (fr_seek) {
-					continue;
-				}
-
-				unsigned int bytes_written;
-				fr_write = f_write(&image_file, &buffers[(cylinder_size * slot) + (((dirty_sector.h * emu_header.sectors_per_track) + dirty_sector.s) * emu_header.sector_size_in_image)], emu_header.sector_size_in_image, &bytes_written);
-
-				if (fr_write) {
-					printf("Write Failed (code=%d)\r\n", fr_write);
-				}
-
+		for (int i = 0; i < NUM_DRIVES; i++) {
+			struct drive* d = &drives[i];
+			if ((seek_count[i] - d->last_prefetch_report) >= PREFETCH_REPORT_INTERVAL) {
+				d->last_prefetch_report = seek_count[i];
+				int seeks = prefetch_hits[i] + seek_misses[i];
+				report_printf("Drive %c prefetch: %d issued, %d hits, %d wasted, %d misses (%d%% hit rate)\r\n",
+						'A' + i, prefetch_issued[i], prefetch_hits[i], prefetch_wasted[i], seek_misses[i],
+						seeks ? ((prefetch_hits[i] * 100) / seeks) : 0);
+				print_replacement_stats();
 			}
+		}
 
-			if (dirty_queue_head == dirty_queue_tail) {
-				f_sync(&image_file);
-				printf("Flushed\r\n");
+		if ((read_cntvct() - last_perf_report) >= PERF_REPORT_INTERVAL) {
+			last_perf_report = read_cntvct();
+			for (int i = 0; i < NUM_DRIVES; i++) {
+				if (drives[i].present)
+					report_perf_counters(&drives[i]);
 			}
-    	}
-
-    	if (log_oldest != log_next) {
-    		struct log_entry e = log[log_oldest];
-    		log_oldest = (log_oldest + 1) % LOG_ENTRIES;
-
-    		if (e.type == LOG_WRITE_MISSED) {
-    			printf("Write missed (%d)\r\n", e.description[0]);
-    		} else if (e.type == LOG_WRITE_OVERFLOW) {
-    			printf("Write FIFO overflow (%d)\r\n", e.description[0]);
-    		} else if (e.type == LOG_READ_MISSED) {
-    			printf("Read deadline missed (%d, %d)\r\n", e.description[0], e.description[1]);
-    		} else if (e.type == LOG_READ_UNDERFLOW) {
-    			printf("Read underflow (%d)\r\n", e.description[0]);
-    		} else if (e.type == LOG_DIRTY_FULL) {
-    			printf("Dirty queue full (%d,%d,%d)\r\n", e.description[0], e.description[1], e.description[2]);
-    		}
-    	}
+			report_work_latency();
+		}
 
+    	// Printing waits for a pass with nothing else posted
+    	if (!work_posted())
+    		report_drain();
+    	if (!trace_to_file)
+    		trace_drain(false);
+    	else if ((uint32_t) (__atomic_load_n(&trace_head, __ATOMIC_RELAXED) - __atomic_load_n(&trace_tail, __ATOMIC_RELAXED)) >= TRACE_FILE_BATCH)
+    		second_core_wake();
+
+    	if (!busy && !work_posted())
+    		main_loop_idle();
+    	main_loop_yield();
 
     }
 
@@ -0,0 +1,86 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Trace record format, shared by the firmware and the host side decoder
+// (host_sim/trace_decode.c). A trace file on the SD card is a trace_file_header followed
+// by trace_records in the order they were drained from the ring.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Every event type with the format used to print it. All three arguments are always passed,
+// formats simply don't use the ones an event has no need for.
+#define TRACE_EVENTS(X) \
+	X(TRACE_DROPPED,			"Trace: %d records of type %d dropped") \
+	X(TRACE_COMMAND,			"Command %04x") \
+	X(TRACE_SEEK,				"Seek C=%d (slot %d)") \
+	X(TRACE_SEEK_COMPLETE,		"Seek complete C=%d") \
+	X(TRACE_HEAD_SELECT,		"Head select H=%d") \
+	X(TRACE_DRIVE_SELECT,		"Drive select %d") \
+	X(TRACE_READ_RELEASE,		"Reading C=%d H=%d from S=%d") \
+	X(TRACE_READ_UNDERFLOW,		"Read underflow (%d, %d)") \
+	X(TRACE_READ_MISSED,		"Read deadline missed (%d, %d)") \
+	X(TRACE_WRITE_OVERFLOW,		"Write FIFO overflow (%d)") \
+	X(TRACE_WRITE_MISSED,		"Write missed (%d)") \
+	X(TRACE_SECTOR_DIRTY,		"Dirty C=%d H=%d S=%d") \
+	X(TRACE_LOAD_START,			"Loading C=%d into slot %d") \
+	X(TRACE_LOAD_FAILED,		"Failed to load C=%d (code %d)") \
+	X(TRACE_SLOT_LOAD,			"Slot %d load: %d -> %d") \
+	X(TRACE_SLOT_PREFETCH,		"Slot %d prefetch: %d -> %d") \
+	X(TRACE_WRITE_BACK_START,	"Writing back C=%d") \
+	X(TRACE_WRITE_BACK,			"Wrote back C=%d: %d sectors in %d writes") \
+	X(TRACE_WRITE_FAILED,		"Write back of C=%d failed (code %d)") \
+	X(TRACE_SYNC,				"Flushed %d sectors") \
+	X(TRACE_CHECKPOINT,			"Folded %d journal records (%d KB) into the images") \
+	X(TRACE_SLOT_FILLED,		"Slot %d has the rest of C=%d") \
+	X(TRACE_SECTOR_UNCHANGED,	"Unchanged C=%d H=%d S=%d") \
+	X(TRACE_WRITE_UNLOADED,		"Write to C=%d H=%d S=%d dropped, as it isn't loaded")
+
+#define TRACE_ENUM(name, format)	name,
+
+enum trace_event {
+	TRACE_EVENTS(TRACE_ENUM)
+	NUM_TRACE_EVENTS
+};
+
+#define TRACE_MASK(event)		(1u << (event))
+#define TRACE_NO_DRIVE			0xFF
+
+struct trace_record {
+	uint64_t time;			// read_cntvct()
+	uint32_t sequence;		// Position in the ring plus one, written last to mark the record complete
+	uint16_t type;
+	uint8_t drive;			// 0 for drive A, 1 for B, TRACE_NO_DRIVE for events which aren't about either
+	uint8_t reserved;
+	int32_t arg[3];
+	uint32_t reserved2;
+};
+
+#define TRACE_FILE_MAGIC		"ESDITRC1"
+
+struct trace_file_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t counts_per_second;
+};
+
+#endif
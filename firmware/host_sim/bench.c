@@ -0,0 +1,823 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Benchmark suite for the emulator firmware running against the simulated hardware.
+//
+// Each workload runs in its own process with freshly generated images, since the firmware
+// keeps all of its state in globals and never returns from main. The simulated controller
+// selects drives, seeks, selects heads and writes sectors; every sector the read datapath
+// streams and every sector written back to an image is checked against what the controller
+// last wrote there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+#include "xtime_l.h"
+
+#define TRACE_NAME			"TRACE.BIN"
+#define JOURNAL_NAME		"JOURNAL.LOG"
+#define WARM_SET_NAME		"WARMSET.BIN"
+#define DRIVE_CONFIG_NAME	"DRIVES.CFG"
+#define DATA_OFFSET			128
+#define TRACK_TABLE_OFFSET	128			// Of a version 2 image, where its data region would start otherwise
+#define TRACK_SHARED		0x80000000
+#define HOT_SET_CYLINDERS	64
+#define NUM_WORK_CLASSES	3			// As in main.c
+#define COUNTS_PER_US		(COUNTS_PER_SECOND / 1000000.0)
+#define THINK_TIME_US		100			// Between the end of one operation and the next seek
+#define DRAIN_TIMEOUT_US	30000000	// Allowed for the firmware to write everything back at the end
+
+/* Firmware state the benchmark reports on */
+
+extern int seek_count[];
+extern int seek_misses[];
+extern int unchanged_writes[];
+extern int prefetch_issued[];
+extern int prefetch_hits[];
+extern int prefetch_wasted[];
+extern int num_slots;
+extern int* dirty_sector_count;
+extern int unsynced_sectors;
+extern int unfolded_write_backs;
+extern bool trace_to_file;
+extern const char* const work_class_names[];
+extern struct work_latency {
+	int count;
+	uint64_t total;
+	uint64_t max;
+} work_latency[];
+extern bool journal_enabled;
+extern bool overlays_enabled;
+extern int replacement_policy;
+extern const char* const replacement_policy_names[];
+extern struct replacement_stats {
+	int hits, misses, evictions, promotions;	// As in main.c
+} replacement_stats[];
+bool any_slot_dirty();
+void trace_flush();
+
+/* Workloads */
+
+enum seek_pattern {
+	SEQUENTIAL,
+	STRIDED,
+	RANDOM,
+	HOT_SET,		// 90% of seeks within a small set of cylinders
+	HOT_SET_SCAN,	// A surface scan, with a fifth of the seeks going to a small set of cylinders
+};
+
+struct workload {
+	const char* name;
+	const struct sim_geometry* geometry[SIM_NUM_DRIVES];	// NULL for a drive with no image
+	enum seek_pattern pattern;
+	int stride;
+	int ops;
+	int heads_per_op;		// Each head visited is dwelt on for a revolution
+	int writes_per_head;	// Consecutive sectors written on each head visited
+	int write_percent;		// Share of operations which write
+	int rewrite_percent;	// Share of written sectors rewritten with what they already hold
+	const char* image_name;	// Drive A's image, named in DRIVES.CFG, or NULL for the firmware's default
+};
+
+// Image file the firmware looks for as each drive, unless the workload names another
+static const char* const image_names[SIM_NUM_DRIVES] = {"MICROP~1.EMU", "DRIVE_B.EMU"};
+
+// About 300KB per cylinder, so a 64MB slot pool holds a sixth of the image
+static const struct sim_geometry large_disk = {1224, 15, 34, 624, 626};
+
+// Small enough to be loaded whole
+static const struct sim_geometry small_disk = {306, 4, 17, 624, 626};
+
+// 20 Mbit/s at 3600 RPM and 15 Mbit/s at 5400 RPM. Neither the sector nor the bit is a whole
+// number of cycles.
+static const struct sim_geometry fast_disk = {612, 8, 53, 624, 626, 3600, 41666};
+static const struct sim_geometry fast_spindle_disk = {306, 8, 32, 624, 626, 5400, 20833};
+
+// More cylinders and sectors per track than the firmware used to have room for: 16 heads of
+// 160 256 byte sectors at 24 Mbit/s, 1.5GB in all
+static const struct sim_geometry largest_disk = {1930, 16, 160, 312, 314, 3600, 50240};
+
+static const struct workload workloads[] = {
+	{"seq-read",       {&large_disk},              SEQUENTIAL, 1, 600, 2,  0,   0},
+	{"stride-read",    {&large_disk},              STRIDED,    4, 300, 1,  0,   0},
+	{"random-read",    {&large_disk},              RANDOM,     0, 300, 1,  0,   0},
+	{"hotset-read",    {&large_disk},              HOT_SET,    0, 600, 1,  0,   0},
+	{"scan-hotset",    {&large_disk},              HOT_SET_SCAN, 1, 2400, 1, 0,  0},
+	{"seq-write",      {&large_disk},              SEQUENTIAL, 1, 300, 2, 34, 100},
+	{"random-write",   {&large_disk},              RANDOM,     0, 300, 1,  4, 100},
+	{"hotset-rewrite", {&large_disk},              HOT_SET,    0, 600, 1,  8, 100, 75},
+	{"resident-mixed", {&small_disk},              RANDOM,     0, 400, 1,  4,  50},
+	{"dual-seq-read",  {&large_disk, &large_disk}, SEQUENTIAL, 1, 600, 2,  0,   0},
+	{"dual-mixed",     {&large_disk, &small_disk}, RANDOM,     0, 400, 1,  4,  50},
+	{"fast-mixed",     {&fast_disk, &fast_spindle_disk}, RANDOM, 0, 400, 1,  4,  50},
+	{"largest-mixed",  {&largest_disk},            RANDOM,     0, 300, 1,  8,  50, 0, "LARGEST DRIVE.EMU"},
+};
+
+#define NUM_WORKLOADS	(sizeof(workloads) / sizeof(workloads[0]))
+
+/* Run state */
+
+enum run_state {
+	BOOTING,
+	QUERYING,
+	SEEKING,
+	VISITING,
+	DRAINING,
+};
+
+static const struct workload* workload;
+static enum run_state state = BOOTING;
+static int ops_done = 0;
+static int drive_ops_done[SIM_NUM_DRIVES];
+static int num_drives = 0;			// Drives with an image, always starting from A
+static int drive = -1;				// Selected by the controller
+static int cylinder = 0;
+static int heads_visited = 0;
+static bool op_writes = false;
+static uint64_t seek_issued;
+static uint64_t* seek_latency;
+static uint64_t boot_time;
+static uint64_t drain_start;
+static int dirty_high_water = 0;
+static uint32_t random_state = 12345;
+static char image_directory[256];
+static char image_path[SIM_NUM_DRIVES][512];
+static char overlay_path[SIM_NUM_DRIVES][512];
+static bool keep_image = false;
+static bool sparse_images = false;	// Version 2 images, with no tracks stored to begin with
+static bool in_place = false;		// Write back without the journal
+static bool overlays = false;		// Leave the images as they are and write to overlays
+static off_t data_offset[SIM_NUM_DRIVES];
+static const char* trace_directory = NULL;
+static int scan_cylinder = 0;
+static int policy;					// Slot replacement policy, the firmware's default unless -r is given
+static int queries_done = 0;
+static int query_expected;			// What the query waiting for its answer should get, -1 for no answer
+static int query_errors = 0;
+
+static uint32_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static int next_cylinder(void) {
+	int cylinders = workload->geometry[drive]->cylinders;
+
+	switch (workload->pattern) {
+	case SEQUENTIAL:
+	case STRIDED:
+		return (drive_ops_done[drive] * workload->stride) % cylinders;
+	case RANDOM:
+		return next_random() % cylinders;
+	case HOT_SET:
+		if ((next_random() % 100) < 90)
+			return (cylinders / 3) + (next_random() % HOT_SET_CYLINDERS);
+		return next_random() % cylinders;
+	case HOT_SET_SCAN:
+		if ((next_random() % 100) < 20)
+			return (cylinders / 3) + (next_random() % HOT_SET_CYLINDERS);
+		return (scan_cylinder++) % cylinders;
+	}
+	return 0;
+}
+
+static void start_op(uint64_t arg);
+static void visit_head(uint64_t arg);
+
+// After boot the controller asks each drive for its status, resets it and asks again, then
+// reads every word of its configuration, as a controller's setup would
+#define QUERIES_PER_DRIVE	(3 + 20 + 15)
+
+static void issue_query(void) {
+	int query_drive = queries_done / QUERIES_PER_DRIVE;
+	int i = queries_done % QUERIES_PER_DRIVE;
+	const struct sim_geometry* g = workload->geometry[query_drive];
+
+	if (query_drive != drive) {
+		drive = query_drive;
+		sim_select_drive(SIM_DRIVE_SELECT(drive));
+	}
+
+	if (i == 0) {
+		query_expected = 1 << 8;		// Power on
+		sim_issue_command(0x2000);		// Request Status
+	} else if (i == 1) {
+		query_expected = -1;
+		sim_issue_command(0x5000);		// Control: reset status
+	} else if (i == 2) {
+		query_expected = 0;
+		sim_issue_command(0x2000);
+	} else if (i < 3 + 20) {
+		query_expected = 0;				// The images have no general configuration
+		sim_issue_command(0x3000 | (i - 3));
+	} else {
+		int modifier = i - 22;
+		query_expected = (modifier == 4) ? g->unformatted_bytes_per_track :
+						 (modifier == 5) ? g->unformatted_bytes_per_sector : 0;
+		sim_issue_command(0x3000 | (modifier << 8));
+	}
+}
+
+static void finish_op(void) {
+	ops_done += 1;
+	drive_ops_done[drive] += 1;
+	if (ops_done == workload->ops) {
+		state = DRAINING;
+		drain_start = sim_time;
+		return;
+	}
+	sim_schedule(sim_time + SIM_US(THINK_TIME_US), start_op, 0);
+}
+
+// With two drives, each operation picks one at random
+static void start_op(uint64_t arg) {
+	int next_drive = (num_drives > 1) ? (next_random() % num_drives) : 0;
+	if (next_drive != drive) {
+		drive = next_drive;
+		sim_select_drive(SIM_DRIVE_SELECT(drive));
+	}
+
+	cylinder = next_cylinder();
+	heads_visited = 0;
+	op_writes = (int) (next_random() % 100) < workload->write_percent;
+
+	state = SEEKING;
+	seek_issued = sim_time;
+	sim_issue_command(0x0000 | cylinder);		// Seek
+}
+
+static void visit_head(uint64_t arg) {
+	const struct sim_geometry* g = workload->geometry[drive];
+
+	if (heads_visited == workload->heads_per_op) {
+		finish_op();
+		return;
+	}
+
+	int head = (cylinder + heads_visited) % g->heads;
+	heads_visited += 1;
+	sim_select_head(head);
+
+	uint64_t dwell = sim_revolution_time(drive);
+
+	// Start writing a couple of sectors after the head change, as a controller would once
+	// it has seen the next sector pulse and read the header
+	if (op_writes && workload->writes_per_head) {
+		uint64_t sector_period = dwell / g->sectors_per_track;
+		uint64_t not_before = sim_time + (2 * sector_period);
+		int first = (workload->pattern == RANDOM) ? (next_random() % g->sectors_per_track) : 0;
+
+		// Stay on the head until the last sector has been written, as write gate would
+		uint64_t last_end = not_before;
+		for (int i = 0; i < workload->writes_per_head; i++) {
+			bool unchanged = (int) (next_random() % 100) < workload->rewrite_percent;
+			uint64_t end = sim_write_sector((first + i) % g->sectors_per_track, not_before, unchanged);
+			if (end > last_end)
+				last_end = end;
+		}
+
+		if (last_end + sector_period > sim_time + dwell)
+			dwell = last_end + sector_period - sim_time;
+	}
+
+	sim_schedule(sim_time + dwell, visit_head, 0);
+}
+
+static void report(void);
+
+// Follows the firmware as the hardware model runs
+static void workload_poll(void) {
+	switch (state) {
+	case BOOTING:
+		for (int i = 0; i < num_drives; i++) {
+			if (!sim_rotation_enabled(i))
+				return;
+		}
+
+		boot_time = sim_time;
+		memset(&sim_sd_stats, 0, sizeof(sim_sd_stats));
+		memset(&sim_hw_stats, 0, sizeof(sim_hw_stats));
+		state = QUERYING;
+		issue_query();
+		break;
+
+	case QUERYING:
+		if (!sim_command_pending()) {
+			if ((query_expected >= 0) && (sim_command_response() != query_expected)) {
+				if (sim_verbose)
+					fprintf(stderr, "Drive %c answered query %d with %04X, not %04X\n", 'A' + drive,
+							queries_done % QUERIES_PER_DRIVE, sim_command_response(), query_expected);
+				query_errors += 1;
+			}
+
+			queries_done += 1;
+			if (queries_done == num_drives * QUERIES_PER_DRIVE)
+				start_op(0);
+			else
+				issue_query();
+		}
+		break;
+
+	case SEEKING:
+		if (!sim_command_pending()) {
+			seek_latency[ops_done] = sim_time - seek_issued;
+			state = VISITING;
+			visit_head(0);
+		}
+		break;
+
+	case VISITING:
+		break;
+
+	case DRAINING:
+		break;
+	}
+
+	if (workload->writes_per_head && (state != BOOTING)) {
+		int dirty = 0;
+		for (int i = 0; i < num_slots; i++)
+			dirty += dirty_sector_count[i];
+		if (dirty > dirty_high_water)
+			dirty_high_water = dirty;
+	}
+}
+
+// The run is over once everything the controller wrote has been written back, synced and
+// folded in from the journal, and the SD worker has nothing left to do
+static void workload_main_loop(void) {
+	if (state != DRAINING)
+		return;
+
+	if ((!sim_writes_pending() && !any_slot_dirty() && (unsynced_sectors == 0) && (unfolded_write_backs == 0) && sim_second_core_idle()) ||
+		((sim_time - drain_start) > SIM_US(DRAIN_TIMEOUT_US)))
+		report();
+}
+
+/* Image */
+
+static void write_le16(uint8_t* p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void write_le32(uint8_t* p, uint32_t v) {
+	write_le16(p, v);
+	write_le16(p + 2, v >> 16);
+}
+
+// Bytes from one track record of a version 2 image to the next
+static off_t track_stride(const struct sim_geometry* g) {
+	return ((g->sectors_per_track * g->sector_size_in_image) + 511) & ~511;
+}
+
+// Header and drive configuration, with an all zero (sparse) data region. A version 2 image
+// has an empty track table in place of the data region, which then starts on the next block.
+static void create_image(int drive, const struct sim_geometry* g) {
+	uint8_t header[DATA_OFFSET];
+	memset(header, 0, sizeof(header));
+
+	off_t tracks = (off_t) g->cylinders * g->heads;
+	off_t size = DATA_OFFSET + (tracks * g->sectors_per_track * g->sector_size_in_image);
+	data_offset[drive] = DATA_OFFSET;
+	if (sparse_images) {
+		data_offset[drive] = (TRACK_TABLE_OFFSET + (tracks * 8) + 511) & ~511;
+		size = data_offset[drive];
+	}
+
+	write_le16(&header[0], sparse_images ? 2 : 1);		// file_version
+	write_le32(&header[2], 32);							// drive_configuration_offset
+	write_le32(&header[6], data_offset[drive]);			// data_offset
+	write_le16(&header[10], g->cylinders);
+	write_le16(&header[12], g->heads);
+	write_le16(&header[14], g->sectors_per_track);
+	write_le16(&header[16], g->sector_size_in_image);
+
+	write_le16(&header[18], g->rpm);
+	if (sparse_images)
+		write_le32(&header[20], TRACK_TABLE_OFFSET);
+
+	// specific_configuration[3] and [4] follow the 20 words of general configuration
+	write_le16(&header[32 + (2 * (20 + 3))], g->unformatted_bytes_per_track);
+	write_le16(&header[32 + (2 * (20 + 4))], g->unformatted_bytes_per_sector);
+
+	// The firmware names an overlay after its image, with .OVL in place of the extension
+	const char* name = (drive == 0) && workload->image_name ? workload->image_name : image_names[drive];
+	char* path = image_path[drive];
+	snprintf(path, sizeof(image_path[drive]), "%s/%s", image_directory, name);
+	snprintf(overlay_path[drive], sizeof(overlay_path[drive]), "%s/%.*s.OVL", image_directory,
+			 (int) (strrchr(name, '.') - name), name);
+
+	int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if ((fd < 0) || (write(fd, header, sizeof(header)) != sizeof(header)) ||
+		ftruncate(fd, size)) {
+		perror(path);
+		exit(2);
+	}
+	close(fd);
+}
+
+static void create_images(void) {
+	snprintf(image_directory, sizeof(image_directory), "/tmp/esdi_sim.XXXXXX");
+	if (!mkdtemp(image_directory)) {
+		perror("mkdtemp");
+		exit(2);
+	}
+
+	for (num_drives = 0; (num_drives < SIM_NUM_DRIVES) && workload->geometry[num_drives]; num_drives++)
+		create_image(num_drives, workload->geometry[num_drives]);
+
+	if (workload->image_name) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%s", image_directory, DRIVE_CONFIG_NAME);
+		FILE* config = fopen(path, "w");
+		if (!config) {
+			perror(path);
+			exit(2);
+		}
+		fprintf(config, "A=%s\r\n", workload->image_name);
+		fclose(config);
+	}
+
+	sim_ff_init(image_directory);
+}
+
+static void remove_image(void) {
+	char trace_path[512];
+
+	if (keep_image) {
+		fprintf(stderr, "image kept in %s\n", image_directory);
+		return;
+	}
+	snprintf(trace_path, sizeof(trace_path), "%s/%s", image_directory, TRACE_NAME);
+	unlink(trace_path);
+	snprintf(trace_path, sizeof(trace_path), "%s/%s", image_directory, JOURNAL_NAME);
+	unlink(trace_path);
+	snprintf(trace_path, sizeof(trace_path), "%s/%s", image_directory, WARM_SET_NAME);
+	unlink(trace_path);
+	snprintf(trace_path, sizeof(trace_path), "%s/%s", image_directory, DRIVE_CONFIG_NAME);
+	unlink(trace_path);
+	for (int i = 0; i < num_drives; i++) {
+		unlink(image_path[i]);
+		unlink(overlay_path[i]);
+	}
+	rmdir(image_directory);
+}
+
+// Write out what is left of the firmware's trace and copy it off the simulated card
+static void save_trace(void) {
+	char from[512], to[512];
+
+	trace_flush();
+
+	snprintf(from, sizeof(from), "%s/%s", image_directory, TRACE_NAME);
+	snprintf(to, sizeof(to), "%s/%s.trace", trace_directory, workload->name);
+
+	FILE* in = fopen(from, "rb");
+	FILE* out = fopen(to, "wb");
+	if (!in || !out) {
+		perror(in ? to : from);
+		exit(2);
+	}
+
+	char buffer[65536];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		fwrite(buffer, 1, length, out);
+
+	fclose(in);
+	fclose(out);
+}
+
+// Every sector the controller wrote must have made it to the drive's image file, or with
+// overlays to its overlay, leaving the image as it was
+static int verify_image(int drive) {
+	const struct sim_geometry* g = workload->geometry[drive];
+	uint8_t actual[4096], expected[4096], header[24];
+	off_t table_offset = TRACK_TABLE_OFFSET;
+	off_t records_offset = data_offset[drive];
+	int failures = 0;
+
+	int fd = open(overlays ? overlay_path[drive] : image_path[drive], O_RDONLY);
+	int image_fd = overlays ? open(image_path[drive], O_RDONLY) : -1;
+	if ((fd < 0) || (overlays && (image_fd < 0)))
+		return 1;
+
+	// An overlay is laid out as a version 2 image, wherever the firmware put its table and records
+	if (overlays) {
+		if (pread(fd, header, sizeof(header), 0) != sizeof(header) || (header[0] != 3))
+			return 1;
+		records_offset = header[6] | (header[7] << 8) | (header[8] << 16) | ((off_t) header[9] << 24);
+		table_offset = header[20] | (header[21] << 8) | (header[22] << 16) | ((off_t) header[23] << 24);
+	}
+
+	for (int c = 0; c < g->cylinders; c++) {
+		for (int h = 0; h < g->heads; h++) {
+			for (int s = 0; s < g->sectors_per_track; s++) {
+				uint32_t generation = sim_sector_generation(drive, c, h, s);
+				if (!generation)
+					continue;
+
+				off_t offset = data_offset[drive] + ((((off_t) c * g->heads + h) * g->sectors_per_track + s) * g->sector_size_in_image);
+				int length = g->unformatted_bytes_per_sector - 2;
+
+				// The image must still be as it was created
+				if (overlays) {
+					memset(expected, 0, length);
+					if ((pread(image_fd, actual, length, offset) != length) || memcmp(actual, expected, length)) {
+						if (sim_verbose)
+							fprintf(stderr, "Drive %c C=%d H=%d S=%d written to the image\n", 'A' + drive, c, h, s);
+						failures += 1;
+					}
+				}
+
+				// A version 2 image or an overlay must have given the track a record of its own
+				if (sparse_images || overlays) {
+					uint8_t entry[4];
+					if (pread(fd, entry, sizeof(entry), table_offset + ((((off_t) c * g->heads) + h) * 8)) != sizeof(entry)) {
+						failures += 1;
+						continue;
+					}
+					uint32_t record = entry[0] | (entry[1] << 8) | (entry[2] << 16) | ((uint32_t) entry[3] << 24);
+					if (!record || (record & TRACK_SHARED)) {
+						failures += 1;
+						continue;
+					}
+					offset = records_offset + ((record - 1) * track_stride(g)) + ((off_t) s * g->sector_size_in_image);
+				}
+
+				if (pread(fd, actual, length, offset) != length) {
+					failures += 1;
+					continue;
+				}
+				sim_sector_pattern(expected, length, drive, c, h, s, generation);
+				if (memcmp(actual, expected, length)) {
+					if (sim_verbose)
+						fprintf(stderr, "Drive %c C=%d H=%d S=%d not written back\n", 'A' + drive, c, h, s);
+					failures += 1;
+				}
+			}
+		}
+	}
+
+	close(fd);
+	if (image_fd >= 0)
+		close(image_fd);
+	return failures;
+}
+
+/* Reporting */
+
+static int compare_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static int total(const int per_drive[]) {
+	int sum = 0;
+	for (int i = 0; i < SIM_NUM_DRIVES; i++)
+		sum += per_drive[i];
+	return sum;
+}
+
+static double to_us(uint64_t counts) {
+	return counts / (double) SIM_COUNTS_PER_US;
+}
+
+static void print_header(void) {
+	printf("%-15s %5s %8s %9s %9s %9s %9s %6s %6s %9s %9s %8s %7s %7s %6s\n",
+		   "workload", "ops", "boot_ms", "seek_avg", "seek_p50", "seek_p99", "seek_max",
+		   "hit%", "pf_hit", "dirty_hwm", "sd_KB/op", "sd_io/op", "uart_ms", "missed", "errors");
+	printf("%-15s %5s %8s %9s %9s %9s %9s %6s %6s %9s %9s %8s %7s %7s %6s\n",
+		   "", "", "", "(us)", "(us)", "(us)", "(us)", "", "", "(sectors)", "", "", "", "", "");
+}
+
+static void report(void) {
+	int ops = workload->ops;
+	uint64_t total_latency = 0;
+
+	for (int i = 0; i < ops; i++)
+		total_latency += seek_latency[i];
+	qsort(seek_latency, ops, sizeof(uint64_t), compare_u64);
+
+	bool drained = !sim_writes_pending() && !any_slot_dirty() && (unsynced_sectors == 0) && (unfolded_write_backs == 0) &&
+				   sim_second_core_idle();
+	int errors = sim_hw_stats.read_mismatches + query_errors + (drained ? 0 : 1);
+	for (int i = 0; i < num_drives; i++)
+		errors += verify_image(i);
+
+	int seeks = total(seek_count);
+
+	printf("%-15s %5d %8.1f %9.0f %9.0f %9.0f %9.0f %6.1f %6d %9d %9.1f %8.2f %7.1f %7llu %6d\n",
+		   workload->name, ops,
+		   to_us(boot_time) / 1000,
+		   to_us(total_latency) / ops,
+		   to_us(seek_latency[ops / 2]),
+		   to_us(seek_latency[(ops * 99) / 100]),
+		   to_us(seek_latency[ops - 1]),
+		   seeks ? (100.0 * (seeks - total(seek_misses))) / seeks : 0.0,
+		   total(prefetch_hits),
+		   dirty_high_water,
+		   (sim_sd_stats.read_bytes + sim_sd_stats.write_bytes) / 1024.0 / ops,
+		   (double) (sim_sd_stats.reads + sim_sd_stats.writes + sim_sd_stats.syncs) / ops,
+		   to_us(sim_hw_stats.uart_stall) / 1000,
+		   (unsigned long long) sim_hw_stats.read_misses,
+		   errors);
+
+	if (sim_verbose) {
+		fprintf(stderr, "  SD: %llu reads (%llu KB), %llu writes (%llu KB), %llu seeks, %llu syncs, %.1f ms busy\n",
+				(unsigned long long) sim_sd_stats.reads, (unsigned long long) sim_sd_stats.read_bytes / 1024,
+				(unsigned long long) sim_sd_stats.writes, (unsigned long long) sim_sd_stats.write_bytes / 1024,
+				(unsigned long long) sim_sd_stats.seeks, (unsigned long long) sim_sd_stats.syncs,
+				to_us(sim_sd_stats.busy) / 1000);
+		fprintf(stderr, "  Prefetch: %d issued, %d hits, %d wasted. %d slots\n",
+				total(prefetch_issued), total(prefetch_hits), total(prefetch_wasted), num_slots);
+		fprintf(stderr, "  Slots (%s): %d hits, %d misses, %d evictions, %d promoted\n",
+				replacement_policy_names[replacement_policy], replacement_stats[replacement_policy].hits,
+				replacement_stats[replacement_policy].misses, replacement_stats[replacement_policy].evictions,
+				replacement_stats[replacement_policy].promotions);
+		fprintf(stderr, "  Writes: %llu sectors (%d unchanged), %llu interrupts\n",
+				(unsigned long long) sim_hw_stats.sectors_written, total(unchanged_writes),
+				(unsigned long long) sim_hw_stats.write_interrupts);
+		fprintf(stderr, "  Queries: %d, %llu answered by the command interface, %d wrong\n",
+				queries_done, (unsigned long long) sim_hw_stats.queries_answered, query_errors);
+		fprintf(stderr, "  Main loop waits:");
+		for (int i = 0; i < NUM_WORK_CLASSES; i++) {
+			fprintf(stderr, "%s %s %d, avg %.1f us, max %.1f us", i ? ";" : "", work_class_names[i], work_latency[i].count,
+					work_latency[i].count ? (work_latency[i].total / COUNTS_PER_US) / work_latency[i].count : 0.0,
+					work_latency[i].max / COUNTS_PER_US);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	fflush(stdout);
+	if (trace_directory)
+		save_trace();
+	remove_image();
+	exit(errors ? 1 : 0);
+}
+
+static int run_workload(const struct workload* w, double scale) {
+	static struct workload scaled;
+
+	scaled = *w;
+	scaled.ops = w->ops * scale;
+	if (scaled.ops < 1)
+		scaled.ops = 1;
+	workload = &scaled;
+
+	seek_latency = calloc(workload->ops, sizeof(uint64_t));
+	create_images();
+	sim_hw_init(workload->geometry);
+	sim_poll_hook = workload_poll;
+	sim_main_loop_hook = workload_main_loop;
+	trace_to_file = (trace_directory != NULL);
+	journal_enabled = !in_place;
+	overlays_enabled = overlays;
+	replacement_policy = policy;
+
+	firmware_main();
+
+	// The firmware only returns if it could not start
+	fprintf(stderr, "%s: firmware exited during startup\n", workload->name);
+	remove_image();
+	return 1;
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "usage: %s [-v] [-k] [-S] [-J] [-O] [-r policy] [-s scale] [-f clusters] [-F writes] [-t directory] [workload...]\n", program);
+	fprintf(stderr, "  -v  print firmware output and details of each run\n");
+	fprintf(stderr, "  -k  keep the image files\n");
+	fprintf(stderr, "  -S  start from empty version 2 (sparse) images rather than full size ones\n");
+	fprintf(stderr, "  -J  have the firmware write back in place rather than through its journal\n");
+	fprintf(stderr, "  -O  have the firmware leave the images as they are and write to overlays\n");
+	fprintf(stderr, "  -r  have the firmware replace slots with 'policy' (lru or 2q)\n");
+	fprintf(stderr, "  -s  multiply the number of operations in each workload by 'scale'\n");
+	fprintf(stderr, "  -f  fragment the image on the simulated card, a gap after every 'clusters'\n");
+	fprintf(stderr, "  -F  make the first 'writes' writes to the images or overlays fail\n");
+	fprintf(stderr, "  -t  have the firmware trace to its SD card, and save each workload's trace\n");
+	fprintf(stderr, "      to 'directory'/<workload>.trace for trace_decode\n");
+	fprintf(stderr, "workloads:");
+	for (unsigned i = 0; i < NUM_WORKLOADS; i++)
+		fprintf(stderr, " %s", workloads[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[]) {
+	double scale = 1.0;
+	int opt;
+
+	policy = replacement_policy;
+	while ((opt = getopt(argc, argv, "vkSJOr:s:f:F:t:h")) != -1) {
+		switch (opt) {
+		case 'v':
+			sim_verbose = true;
+			break;
+		case 'k':
+			keep_image = true;
+			break;
+		case 'S':
+			sparse_images = true;
+			break;
+		case 'J':
+			in_place = true;
+			break;
+		case 'O':
+			overlays = true;
+			break;
+		case 'r':
+			if (!strcmp(optarg, "lru")) {
+				policy = 0;
+			} else if (!strcmp(optarg, "2q")) {
+				policy = 1;
+			} else {
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 's':
+			scale = atof(optarg);
+			break;
+		case 'f':
+			sim_sd_model.fragment_clusters = atoi(optarg);
+			break;
+		case 'F':
+			sim_sd_model.failed_image_writes = atoi(optarg);
+			break;
+		case 't':
+			trace_directory = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	// Overlays are only made for version 1 images
+	if (overlays && sparse_images) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	bool selected[NUM_WORKLOADS];
+	for (unsigned i = 0; i < NUM_WORKLOADS; i++)
+		selected[i] = (optind == argc);
+	for (int i = optind; i < argc; i++) {
+		bool found = false;
+		for (unsigned j = 0; j < NUM_WORKLOADS; j++) {
+			if (!strcmp(argv[i], workloads[j].name)) {
+				selected[j] = true;
+				found = true;
+			}
+		}
+		if (!found) {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	print_header();
+	fflush(stdout);
+
+	int failed = 0;
+	for (unsigned i = 0; i < NUM_WORKLOADS; i++) {
+		if (!selected[i])
+			continue;
+
+		pid_t pid = fork();
+		if (pid == 0)
+			return run_workload(&workloads[i], scale);
+
+		int status;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "%s: FAILED\n", workloads[i].name);
+			failed += 1;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
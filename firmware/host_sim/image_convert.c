@@ -0,0 +1,427 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Converter between the flat (version 1) and sparse (version 2) emulation image formats (see
+// emulation_file.h).
+//
+// By default an image is made sparse. Tracks which are a single word repeated, such as ones
+// which were never written, are left out of it with that word as their fill, and tracks with
+// the same contents as an earlier one share its record. With -f an image of either version is
+// written out flat again.
+//
+// With -c the tracks held by an overlay (version 3, written by the firmware with
+// OVERLAY_IMAGES) are written into the version 1 image under it, after which the overlay can be
+// deleted.
+//
+// With -a nothing is written. Instead it reports how many bytes of each sector are framing the
+// controller wrote the same in every sector (preambles, sync bytes, gaps), as opposed to the
+// ID fields, data and ECC that differ from sector to sector. Only those could be left out of
+// the image without the emulator knowing the controller's sector format and ECC.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "emulation_file.h"
+
+#define CONFIGURATION_OFFSET	32		// Where the converted image's drive configuration goes
+#define TRACK_TABLE_OFFSET		128		// and its track table
+#define FLAT_DATA_OFFSET		128
+#define HASH_BUCKETS			65536
+
+struct image {
+	int fd;
+	struct emulation_header header;
+	struct drive_configuration configuration;
+	struct track_entry* table;			// Versions 2 and 3 only
+	uint32_t tracks;
+	uint32_t track_bytes;
+};
+
+static bool read_exactly(int fd, void* data, size_t length, off_t offset) {
+	return pread(fd, data, length, offset) == (ssize_t) length;
+}
+
+static bool write_exactly(int fd, const void* data, size_t length, off_t offset) {
+	return pwrite(fd, data, length, offset) == (ssize_t) length;
+}
+
+static bool open_image(const char* path, struct image* image, bool writable) {
+	memset(image, 0, sizeof(*image));
+
+	image->fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if (image->fd < 0) {
+		perror(path);
+		return false;
+	}
+
+	if (!read_exactly(image->fd, &image->header, sizeof(image->header), 0) ||
+		!read_exactly(image->fd, &image->configuration, sizeof(image->configuration), image->header.drive_configuration_offset)) {
+		fprintf(stderr, "%s: too short to be an emulation image\n", path);
+		return false;
+	}
+
+	if ((image->header.file_version != EMULATION_FILE_FLAT) && (image->header.file_version != EMULATION_FILE_SPARSE) &&
+		(image->header.file_version != EMULATION_FILE_OVERLAY)) {
+		fprintf(stderr, "%s: unknown image version %d\n", path, image->header.file_version);
+		return false;
+	}
+
+	image->tracks = (uint32_t) image->header.cylinders * image->header.heads;
+	image->track_bytes = (uint32_t) image->header.sectors_per_track * image->header.sector_size_in_image;
+
+	if (image->header.file_version != EMULATION_FILE_FLAT) {
+		image->table = malloc(image->tracks * sizeof(struct track_entry));
+		if (!image->table || !read_exactly(image->fd, image->table, image->tracks * sizeof(struct track_entry), image->header.track_table_offset)) {
+			fprintf(stderr, "%s: can't read the track table\n", path);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool read_track(struct image* image, uint32_t track, uint8_t* data) {
+	if (!image->table)
+		return read_exactly(image->fd, data, image->track_bytes, image->header.data_offset + ((off_t) track * image->track_bytes));
+
+	uint32_t record = TRACK_RECORD(image->table[track]);
+	if (record) {
+		off_t offset = image->header.data_offset + ((off_t) (record - 1) * track_record_stride(&image->header));
+		return read_exactly(image->fd, data, image->track_bytes, offset);
+	}
+
+	uint32_t fill = image->table[track].fill;
+	for (uint32_t i = 0; i < image->track_bytes; i++)
+		data[i] = fill >> (8 * (i % 4));
+	return true;
+}
+
+// Whether a track is its first word repeated, as the firmware fills in tracks which aren't stored
+static bool uniform_track(const uint8_t* data, uint32_t length, uint32_t* fill) {
+	uint8_t word[4] = {0};
+	memcpy(word, data, (length < 4) ? length : 4);
+
+	for (uint32_t i = 4; i < length; i++) {
+		if (data[i] != word[i % 4])
+			return false;
+	}
+
+	*fill = word[0] | (word[1] << 8) | (word[2] << 16) | ((uint32_t) word[3] << 24);
+	return true;
+}
+
+static uint64_t hash_track(const uint8_t* data, uint32_t length) {
+	uint64_t hash = 14695981039346656037ull;	// FNV-1a
+	for (uint32_t i = 0; i < length; i++)
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+// Write the header, drive configuration and (for version 2) track table of a converted image
+static bool write_metadata(int fd, const struct emulation_header* header, const struct image* in, const struct track_entry* table) {
+	uint8_t start[FLAT_DATA_OFFSET] = {0};
+	memcpy(start, header, sizeof(*header));
+	memcpy(&start[CONFIGURATION_OFFSET], &in->configuration, sizeof(in->configuration));
+
+	if (!write_exactly(fd, start, sizeof(start), 0))
+		return false;
+
+	return !table || write_exactly(fd, table, in->tracks * sizeof(struct track_entry), TRACK_TABLE_OFFSET);
+}
+
+static int to_sparse(struct image* in, int out) {
+	struct emulation_header header = in->header;
+	uint32_t stride = track_record_stride(&header);
+
+	header.file_version = EMULATION_FILE_SPARSE;
+	header.drive_configuration_offset = CONFIGURATION_OFFSET;
+	header.track_table_offset = TRACK_TABLE_OFFSET;
+	header.data_offset = (TRACK_TABLE_OFFSET + (in->tracks * sizeof(struct track_entry)) + TRACK_RECORD_ALIGNMENT - 1) &
+						 ~(TRACK_RECORD_ALIGNMENT - 1);
+
+	// Records are found again by the hash of their contents, chained from a bucket
+	struct track_entry* table = calloc(in->tracks, sizeof(struct track_entry));
+	uint64_t* record_hash = calloc(in->tracks, sizeof(uint64_t));
+	uint32_t* record_next = calloc(in->tracks, sizeof(uint32_t));
+	uint32_t* record_first_track = calloc(in->tracks, sizeof(uint32_t));
+	uint32_t* buckets = calloc(HASH_BUCKETS, sizeof(uint32_t));
+	uint8_t* track = calloc(1, stride);
+	uint8_t* existing = calloc(1, stride);
+	if (!table || !record_hash || !record_next || !record_first_track || !buckets || !track || !existing) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	uint32_t records = 0;
+	uint32_t filled = 0;
+	uint32_t shared = 0;
+
+	for (uint32_t t = 0; t < in->tracks; t++) {
+		if (!read_track(in, t, track)) {
+			fprintf(stderr, "can't read track %u (C=%u H=%u)\n", t, t / in->header.heads, t % in->header.heads);
+			return 1;
+		}
+
+		uint32_t fill;
+		if (uniform_track(track, in->track_bytes, &fill)) {
+			table[t].fill = fill;
+			filled += 1;
+			continue;
+		}
+
+		uint64_t hash = hash_track(track, in->track_bytes);
+		uint32_t record = buckets[hash % HASH_BUCKETS];
+		while (record) {
+			if ((record_hash[record - 1] == hash) &&
+				read_exactly(out, existing, in->track_bytes, header.data_offset + ((off_t) (record - 1) * stride)) &&
+				!memcmp(existing, track, in->track_bytes))
+				break;
+			record = record_next[record - 1];
+		}
+
+		if (record) {
+			table[t].record = record | TRACK_SHARED;
+			table[record_first_track[record - 1]].record |= TRACK_SHARED;
+			shared += 1;
+			continue;
+		}
+
+		record = ++records;
+		if (!write_exactly(out, track, stride, header.data_offset + ((off_t) (record - 1) * stride))) {
+			perror("write");
+			return 1;
+		}
+		record_hash[record - 1] = hash;
+		record_first_track[record - 1] = t;
+		record_next[record - 1] = buckets[hash % HASH_BUCKETS];
+		buckets[hash % HASH_BUCKETS] = record;
+		table[t].record = record;
+	}
+
+	off_t size = header.data_offset + ((off_t) records * stride);
+	if (!write_metadata(out, &header, in, table) || ftruncate(out, size)) {
+		perror("write");
+		return 1;
+	}
+
+	printf("%u tracks: %u stored, %u filled in, %u the same as another track\n", in->tracks, records, filled, shared);
+	printf("%lld bytes rather than %lld\n", (long long) size,
+		   (long long) FLAT_DATA_OFFSET + ((long long) in->tracks * in->track_bytes));
+	return 0;
+}
+
+// Which bytes of the sector are the same in every sector of every stored track
+static int analyse(struct image* in) {
+	uint32_t sector_bytes = in->header.sector_size_in_image;
+	uint8_t* track = malloc(in->track_bytes);
+	uint8_t* first = malloc(sector_bytes);
+	bool* varies = calloc(sector_bytes, sizeof(bool));
+	if (!track || !first || !varies) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	uint64_t sectors = 0;
+	uint32_t fill;
+	for (uint32_t t = 0; t < in->tracks; t++) {
+		if (!read_track(in, t, track)) {
+			fprintf(stderr, "can't read track %u (C=%u H=%u)\n", t, t / in->header.heads, t % in->header.heads);
+			return 1;
+		}
+		if (uniform_track(track, in->track_bytes, &fill))
+			continue;			// Never written, or erased
+
+		for (uint32_t s = 0; s < in->header.sectors_per_track; s++) {
+			const uint8_t* sector = &track[s * sector_bytes];
+			if (!sectors++)
+				memcpy(first, sector, sector_bytes);
+			for (uint32_t i = 0; i < sector_bytes; i++)
+				varies[i] |= (sector[i] != first[i]);
+		}
+	}
+
+	if (!sectors) {
+		printf("No tracks with anything on them\n");
+		return 0;
+	}
+
+	// The ranges of bytes which differ between sectors, in the order the controller wrote them
+	uint32_t constant = 0;
+	printf("%llu sectors of %u bytes. Bytes which differ between them:", (unsigned long long) sectors, sector_bytes);
+	for (uint32_t i = 0; i < sector_bytes; i++) {
+		if (!varies[i]) {
+			constant += 1;
+			continue;
+		}
+		uint32_t end = i;
+		while ((end + 1 < sector_bytes) && varies[end + 1])
+			end += 1;
+		printf(" %u-%u", i, end);
+		i = end;
+	}
+	printf("\n%u bytes of each sector (%.1f%%) are the same in every one\n", constant, (100.0 * constant) / sector_bytes);
+	return 0;
+}
+
+// Write the tracks an overlay holds into the flat image it was made for
+static int commit_overlay(struct image* overlay, const char* path) {
+	struct image base;
+	if (!open_image(path, &base, true))
+		return 1;
+
+	if ((base.header.file_version != EMULATION_FILE_FLAT) || (base.header.cylinders != overlay->header.cylinders) ||
+		(base.header.heads != overlay->header.heads) || (base.header.sectors_per_track != overlay->header.sectors_per_track) ||
+		(base.header.sector_size_in_image != overlay->header.sector_size_in_image)) {
+		fprintf(stderr, "%s: not the version 1 image the overlay was made for\n", path);
+		return 1;
+	}
+
+	uint8_t* track = malloc(overlay->track_bytes);
+	if (!track) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	uint32_t committed = 0;
+	for (uint32_t t = 0; t < overlay->tracks; t++) {
+		if (!TRACK_RECORD(overlay->table[t]))
+			continue;
+
+		if (!read_track(overlay, t, track) ||
+			!write_exactly(base.fd, track, base.track_bytes, base.header.data_offset + ((off_t) t * base.track_bytes))) {
+			fprintf(stderr, "can't copy track %u (C=%u H=%u)\n", t, t / base.header.heads, t % base.header.heads);
+			return 1;
+		}
+		committed += 1;
+	}
+
+	if (fsync(base.fd) || close(base.fd)) {
+		perror(path);
+		return 1;
+	}
+
+	printf("%u tracks written into %s. The overlay can now be deleted.\n", committed, path);
+	return 0;
+}
+
+static int to_flat(struct image* in, int out) {
+	struct emulation_header header = in->header;
+
+	header.file_version = EMULATION_FILE_FLAT;
+	header.drive_configuration_offset = CONFIGURATION_OFFSET;
+	header.data_offset = FLAT_DATA_OFFSET;
+	header.track_table_offset = 0;
+
+	uint8_t* track = malloc(in->track_bytes);
+	if (!track) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (uint32_t t = 0; t < in->tracks; t++) {
+		if (!read_track(in, t, track)) {
+			fprintf(stderr, "can't read track %u (C=%u H=%u)\n", t, t / in->header.heads, t % in->header.heads);
+			return 1;
+		}
+		if (!write_exactly(out, track, in->track_bytes, FLAT_DATA_OFFSET + ((off_t) t * in->track_bytes))) {
+			perror("write");
+			return 1;
+		}
+	}
+
+	if (!write_metadata(out, &header, in, NULL)) {
+		perror("write");
+		return 1;
+	}
+
+	return 0;
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "usage: %s [-f] input output\n", program);
+	fprintf(stderr, "       %s -a input\n", program);
+	fprintf(stderr, "       %s -c overlay image\n", program);
+	fprintf(stderr, "  Convert an emulation image to version 2, leaving out tracks which are one word\n");
+	fprintf(stderr, "  repeated and storing identical tracks once\n");
+	fprintf(stderr, "  -f  convert to a flat version 1 image instead\n");
+	fprintf(stderr, "  -a  report how much of each sector is framing that is the same in every sector\n");
+	fprintf(stderr, "  -c  write the tracks an overlay holds into the version 1 image under it\n");
+}
+
+int main(int argc, char* argv[]) {
+	bool flat = false;
+	bool analysis = false;
+	bool commit = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "acfh")) != -1) {
+		switch (opt) {
+		case 'a':
+			analysis = true;
+			break;
+		case 'c':
+			commit = true;
+			break;
+		case 'f':
+			flat = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind != argc - (analysis ? 1 : 2)) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	struct image in;
+	if (!open_image(argv[optind], &in, false))
+		return 1;
+
+	bool overlay = (in.header.file_version == EMULATION_FILE_OVERLAY);
+	if (commit != overlay) {
+		fprintf(stderr, commit ? "%s: not an overlay\n" : "%s: an overlay, which -c writes into its image\n", argv[optind]);
+		return 1;
+	}
+
+	if (commit)
+		return commit_overlay(&in, argv[optind + 1]);
+	if (analysis)
+		return analyse(&in);
+
+	int out = open(argv[optind + 1], O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (out < 0) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+
+	int result = flat ? to_flat(&in, out) : to_sparse(&in, out);
+
+	if (close(out) && !result) {
+		perror(argv[optind + 1]);
+		result = 1;
+	}
+	return result;
+}
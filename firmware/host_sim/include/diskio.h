@@ -0,0 +1,25 @@
+// Host stand-in for the FatFs disk I/O header. Sectors are mapped back onto the host files
+// the FatFs stand-in has opened (see ../sim_ff.c).
+
+#ifndef DISKIO_H
+#define DISKIO_H
+
+#include "ff.h"
+
+typedef BYTE DSTATUS;
+
+typedef enum {
+	RES_OK = 0,
+	RES_ERROR,
+	RES_WRPRT,
+	RES_NOTRDY,
+	RES_PARERR
+} DRESULT;
+
+#define CTRL_SYNC			0
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff);
+
+#endif
@@ -0,0 +1,79 @@
+// Host stand-in for the FatFs header. Files live in an ordinary host directory and every call
+// is charged to a model of the SD card and of FatFs itself (see ../sim_ff.c).
+
+#ifndef FF_H
+#define FF_H
+
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+typedef QWORD FSIZE_t;		// The board's FatFs is built with exFAT, which makes file sizes 64 bit
+typedef DWORD LBA_t;
+
+typedef enum {
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED,
+	FR_EXIST,
+	FR_INVALID_OBJECT,
+	FR_WRITE_PROTECTED,
+	FR_INVALID_DRIVE,
+	FR_NOT_ENABLED,
+	FR_NO_FILESYSTEM,
+	FR_MKFS_ABORTED,
+	FR_TIMEOUT,
+	FR_LOCKED,
+	FR_NOT_ENOUGH_CORE,
+	FR_TOO_MANY_OPEN_FILES,
+	FR_INVALID_PARAMETER
+} FRESULT;
+
+typedef struct {
+	BYTE fs_type;
+	BYTE pdrv;			// Physical drive, for diskio
+	WORD csize;			// Sectors per cluster
+	LBA_t database;		// Sector of cluster 2
+} FATFS;
+
+typedef struct {
+	int fd;				// Host file descriptor
+	BYTE flag;
+	FSIZE_t fptr;		// File read/write pointer
+	FSIZE_t obj_size;
+	DWORD sclust;		// First cluster of the file on the simulated card
+	DWORD clust;		// Cluster holding the byte before fptr, as FatFs keeps it
+} FIL;
+
+#define FA_READ				0x01
+#define FA_WRITE			0x02
+#define FA_OPEN_EXISTING	0x00
+#define FA_CREATE_NEW		0x04
+#define FA_CREATE_ALWAYS	0x08
+#define FA_OPEN_ALWAYS		0x10
+#define FA_OPEN_APPEND		0x30
+#define FA_MODIFIED			0x40	// Internal, written since the last sync
+
+FRESULT f_mount(FATFS* fs, const char* path, BYTE opt);
+FRESULT f_open(FIL* fp, const char* path, BYTE mode);
+FRESULT f_close(FIL* fp);
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw);
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs);
+FRESULT f_truncate(FIL* fp);
+FRESULT f_sync(FIL* fp);
+FRESULT f_unlink(const char* path);
+FRESULT f_rename(const char* path_old, const char* path_new);
+
+#define f_tell(fp)	((fp)->fptr)
+#define f_size(fp)	((fp)->obj_size)
+
+#endif
@@ -0,0 +1,13 @@
+// Host stand-in for the Xilinx BSP header of the same name. Sleeping advances simulated time.
+
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include "xil_types.h"
+
+void sim_usleep(unsigned long useconds);
+
+#define usleep(useconds)	sim_usleep(useconds)
+#define sleep(seconds)		sim_usleep((seconds) * 1000000UL)
+
+#endif
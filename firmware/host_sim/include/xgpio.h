@@ -0,0 +1,20 @@
+// Host stand-in for the Xilinx BSP header of the same name. The simulated controller
+// raises the GPIO interrupts directly (see ../sim_hw.c).
+
+#ifndef XGPIO_H
+#define XGPIO_H
+
+#include "xil_types.h"
+
+typedef struct {
+	u16 DeviceId;
+	u32 IsReady;
+} XGpio;
+
+s32 XGpio_Initialize(XGpio* instance, u16 device_id);
+void XGpio_InterruptGlobalEnable(XGpio* instance);
+void XGpio_InterruptEnable(XGpio* instance, u32 mask);
+u32 XGpio_InterruptGetStatus(XGpio* instance);
+void XGpio_InterruptClear(XGpio* instance, u32 mask);
+
+#endif
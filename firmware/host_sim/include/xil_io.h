@@ -0,0 +1,41 @@
+// Host stand-in for the Xilinx BSP header of the same name. See ../sim_hw.c
+
+#ifndef XIL_IO_H
+#define XIL_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef uintptr_t UINTPTR;
+
+// Writes to fixed PS addresses (e.g. the CCI enable) have no effect on the host
+#define Xil_Out32(addr, value)	((void) (addr), (void) (value))
+#define Xil_In32(addr)			((void) (addr), 0U)
+
+#define dsb()
+#define dmb()
+#define isb()
+
+// All firmware output is charged to a model of the 115200 baud UART
+int sim_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#define printf sim_printf
+#define xil_printf sim_printf
+
+// Called by the firmware at the end of every pass of its main loop
+void sim_main_loop_yield(void);
+#define main_loop_yield() sim_main_loop_yield()
+
+// The idle main loop's wait for an event and what wakes it. A pass which takes no simulated
+// time skips straight to the next event anyway.
+#define main_loop_idle()
+#define main_loop_wake()
+#define enable_main_loop_wake()
+
+// The firmware's second core runs as a coroutine of the first
+void sim_start_second_core(bool (*poll)(void));
+void sim_second_core_wake(void);
+#define start_second_core(poll)	sim_start_second_core(poll)
+#define second_core_wake()		sim_second_core_wake()
+
+#endif
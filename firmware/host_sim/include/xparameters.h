@@ -0,0 +1,70 @@
+// Host stand-in for the generated xparameters.h. The AXI register windows are plain arrays
+// which the hardware model in ../sim_hw.c reads and updates as simulated time passes.
+
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+#include <stdint.h>
+
+#define SIM_REGISTER_WINDOW_WORDS	1024
+#define SIM_TRACK_SEQUENCER_WORDS	0x1000		// Registers plus the slot table at 0x800
+
+extern volatile uint32_t sim_drive_select_gpio[SIM_REGISTER_WINDOW_WORDS];
+extern volatile uint32_t sim_head_select_gpio[SIM_REGISTER_WINDOW_WORDS];
+
+// Each drive has its own copy of the datapath blocks
+struct sim_drive_registers {
+	volatile uint32_t command_interface[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t sector_timer[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t dma[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t read_datapath[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t write_datapath[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t perf_counters[SIM_REGISTER_WINDOW_WORDS];
+	volatile uint32_t track_sequencer[SIM_TRACK_SEQUENCER_WORDS];
+};
+
+extern struct sim_drive_registers sim_drive_registers[];
+
+#define XPAR_GPIO_DRIVE_SELECT_BASEADDR			sim_drive_select_gpio
+#define XPAR_GPIO_HEAD_SELECT_BASEADDR			sim_head_select_gpio
+
+#define XPAR_AXI_ESDI_CMD_CONTROL_0_BASEADDR	sim_drive_registers[0].command_interface
+#define XPAR_SECTOR_TIMER_0_BASEADDR			sim_drive_registers[0].sector_timer
+#define XPAR_AXI_DMA_0_BASEADDR					sim_drive_registers[0].dma
+#define XPAR_READ_DATAPATH_0_BASEADDR			sim_drive_registers[0].read_datapath
+#define XPAR_WRITE_DATAPATH_0_BASEADDR			sim_drive_registers[0].write_datapath
+#define XPAR_PERF_COUNTERS_0_BASEADDR			sim_drive_registers[0].perf_counters
+#define XPAR_TRACK_SEQUENCER_0_BASEADDR			sim_drive_registers[0].track_sequencer
+
+#define XPAR_AXI_ESDI_CMD_CONTROL_1_BASEADDR	sim_drive_registers[1].command_interface
+#define XPAR_SECTOR_TIMER_1_BASEADDR			sim_drive_registers[1].sector_timer
+#define XPAR_AXI_DMA_1_BASEADDR					sim_drive_registers[1].dma
+#define XPAR_READ_DATAPATH_1_BASEADDR			sim_drive_registers[1].read_datapath
+#define XPAR_WRITE_DATAPATH_1_BASEADDR			sim_drive_registers[1].write_datapath
+#define XPAR_PERF_COUNTERS_1_BASEADDR			sim_drive_registers[1].perf_counters
+#define XPAR_TRACK_SEQUENCER_1_BASEADDR			sim_drive_registers[1].track_sequencer
+
+#define XPAR_GPIO_DRIVE_SELECT_DEVICE_ID		0
+#define XPAR_GPIO_HEAD_SELECT_DEVICE_ID			1
+#define XPAR_PSU_ACPU_GIC_DEVICE_ID				0
+
+// Same interrupt numbers as the ZCU104 build: drive A's blocks and the GPIOs on pl_ps_irq0[0..6],
+// drive B's command interface on pl_ps_irq0[7] and the rest of drive B on pl_ps_irq1[0..3]
+#define XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_0_INTERRUPT_INTR	121
+#define XPAR_FABRIC_SECTOR_TIMER_0_INTERRUPT_INTR			122
+#define XPAR_FABRIC_GPIO_DRIVE_SELECT_IP2INTC_IRPT_INTR		123
+#define XPAR_FABRIC_GPIO_HEAD_SELECT_IP2INTC_IRPT_INTR		124
+#define XPAR_FABRIC_TRACK_SEQUENCER_0_INTERRUPT_INTR		125
+#define XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR				126
+#define XPAR_FABRIC_WRITE_DATAPATH_0_INTERRUPT_INTR			127
+#define XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_1_INTERRUPT_INTR	128
+#define XPAR_FABRIC_TRACK_SEQUENCER_1_INTERRUPT_INTR		136
+#define XPAR_FABRIC_WRITE_DATAPATH_1_INTERRUPT_INTR			137
+#define XPAR_FABRIC_AXI_DMA_1_S2MM_INTROUT_INTR				138
+#define XPAR_FABRIC_SECTOR_TIMER_1_INTERRUPT_INTR			139
+
+#define XPAR_CPU_CORTEXA53_0_TIMESTAMP_CLK_FREQ				100000000
+
+#define STDOUT_BASEADDRESS						0xFF000000
+
+#endif
@@ -0,0 +1,36 @@
+// Host stand-in for the Xilinx BSP header of the same name. Interrupts are dispatched by
+// the hardware model in ../sim_hw.c whenever simulated time advances.
+
+#ifndef XSCUGIC_H
+#define XSCUGIC_H
+
+#include "xil_types.h"
+
+#define XIL_EXCEPTION_ID_INT	5
+
+typedef void (*Xil_ExceptionHandler)(void* data);
+typedef void (*Xil_InterruptHandler)(void* data);
+
+typedef struct {
+	u16 DeviceId;
+	UINTPTR CpuBaseAddress;
+	UINTPTR DistBaseAddress;
+} XScuGic_Config;
+
+typedef struct {
+	XScuGic_Config* Config;
+	u32 IsReady;
+} XScuGic;
+
+XScuGic_Config* XScuGic_LookupConfig(u16 device_id);
+s32 XScuGic_CfgInitialize(XScuGic* instance, XScuGic_Config* config, UINTPTR effective_address);
+s32 XScuGic_Connect(XScuGic* instance, u32 int_id, Xil_InterruptHandler handler, void* callback_ref);
+void XScuGic_Enable(XScuGic* instance, u32 int_id);
+void XScuGic_Disable(XScuGic* instance, u32 int_id);
+void XScuGic_InterruptHandler(XScuGic* instance);
+
+void Xil_ExceptionRegisterHandler(u32 exception_id, Xil_ExceptionHandler handler, void* data);
+void Xil_ExceptionEnable(void);
+void Xil_ExceptionDisable(void);
+
+#endif
@@ -0,0 +1,15 @@
+// Host stand-in for the Xilinx BSP header of the same name. Time is simulated time.
+
+#ifndef XTIME_L_H
+#define XTIME_L_H
+
+#include "xparameters.h"
+#include "xil_types.h"
+
+typedef u64 XTime;
+
+#define COUNTS_PER_SECOND	XPAR_CPU_CORTEXA53_0_TIMESTAMP_CLK_FREQ
+
+void XTime_GetTime(XTime* time);
+
+#endif
@@ -0,0 +1,13 @@
+// Host stand-in for the Xilinx BSP header of the same name. Only the transmit status the
+// firmware polls is modelled, by the UART model in ../sim_hw.c
+
+#ifndef XUARTPS_HW_H
+#define XUARTPS_HW_H
+
+#include <stdbool.h>
+
+bool sim_uart_transmit_empty(void);
+
+#define XUartPs_IsTransmitEmpty(BaseAddress)	((void) (BaseAddress), sim_uart_transmit_empty())
+
+#endif
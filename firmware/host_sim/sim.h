@@ -0,0 +1,141 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Shared declarations for the host simulation of the emulator hardware
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_COUNTS_PER_US		100					// Simulated time runs at the 100MHz fabric clock
+#define SIM_US(us)				((uint64_t) ((us) * (double) SIM_COUNTS_PER_US))
+#define SIM_DDR_SIZE			(64 * 1024 * 1024)	// Memory left over for slots after the program
+#define SIM_NUM_DRIVES			2
+#define SIM_DRIVE_SELECT(drive)	((drive) + 2)		// Drive select code the firmware answers to as each drive
+#define SIM_DEFAULT_RPM			3600				// For images which leave the spindle speed out
+#define SIM_DEFAULT_BIT_RATE	10000000			// For drives which don't report their unformatted bytes per track
+
+/* Simulated time */
+
+extern uint64_t sim_time;
+
+void sim_advance(uint64_t counts);			// Let time pass, dispatching any interrupts that fire
+bool sim_step(void);						// Jump to the next event. False if there is none.
+
+/* Events */
+
+typedef void (*sim_event_fn)(uint64_t arg);
+
+void sim_schedule(uint64_t time, sim_event_fn fn, uint64_t arg);
+
+/* Hardware model */
+
+struct sim_geometry {
+	int cylinders;
+	int heads;
+	int sectors_per_track;
+	int sector_size_in_image;
+	int unformatted_bytes_per_sector;
+	int rpm;							// 0 for SIM_DEFAULT_RPM
+	int unformatted_bytes_per_track;	// 0 for SIM_DEFAULT_BIT_RATE
+};
+
+struct sim_hw_stats {
+	uint64_t sectors_streamed;		// Sectors the read datapath sent to the controller
+	uint64_t read_misses;			// Sectors with no data ready while the read datapath was live
+	uint64_t read_mismatches;		// Sectors streamed with the wrong contents
+	uint64_t sectors_written;		// Sectors written by the controller
+	uint64_t write_interrupts;		// Raised by the write datapaths and write DMAs
+	uint64_t queries_answered;		// Status and configuration queries the command interfaces answered without the firmware
+	uint64_t uart_bytes;
+	uint64_t uart_stall;			// Time the firmware spent blocked on a full UART FIFO
+};
+
+extern struct sim_hw_stats sim_hw_stats;
+extern uint8_t sim_ddr[SIM_DDR_SIZE];
+extern bool sim_verbose;
+
+void sim_hw_init(const struct sim_geometry* const geometry[SIM_NUM_DRIVES]);	// NULL for a drive with no image
+bool sim_rotation_enabled(int drive);
+uint64_t sim_sector_start_time(int drive, int sector, uint64_t after);	// Next time 'sector' starts at or after 'after'
+uint64_t sim_revolution_time(int drive);
+
+// Controller side of the ESDI interface. Commands and writes go to the selected drive.
+void sim_select_drive(int select_code);
+void sim_select_head(int head);
+void sim_issue_command(uint16_t command);
+bool sim_command_pending(void);
+uint16_t sim_command_response(void);		// What the drive answered the last query with, once it isn't pending
+bool sim_writes_pending(void);				// Sectors written to either drive but not yet in DDR
+uint64_t sim_write_sector(int sector, uint64_t not_before, bool unchanged);	// Controller writes 'sector' as it next passes under
+																				// the head, with what it held if 'unchanged'.
+																				// Returns when the sector ends.
+
+// Expected contents of a sector: all zero until the controller writes it, then a pattern
+// which depends on its drive and address and on how many times it has been written
+uint32_t sim_sector_generation(int drive, int c, int h, int s);
+void sim_sector_pattern(uint8_t* data, int length, int drive, int c, int h, int s, uint32_t generation);
+
+// Called whenever the firmware might have changed a register the model watches
+void sim_poll(void);
+
+// Registered by the benchmark to follow along with the hardware, and to look at the
+// firmware's state between passes of its main loop, when it is not part way through anything
+extern void (*sim_poll_hook)(void);
+extern void (*sim_main_loop_hook)(void);
+
+// Whether the firmware's second core has run out of work, or was never started
+bool sim_second_core_idle(void);
+
+/* SD card and FatFs model */
+
+struct sim_sd_stats {
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t seeks;
+	uint64_t syncs;
+	uint64_t busy;					// Time spent in FatFs calls
+};
+
+struct sim_sd_model {
+	double read_latency_us;			// Per f_read command overhead
+	double write_latency_us;		// Per f_write command overhead
+	double read_mb_per_s;
+	double write_mb_per_s;
+	double sync_us;
+	double fat_sector_us;			// Reading one FAT sector while following a cluster chain
+	int cluster_size;
+	int fragment_clusters;			// Files are laid out in pieces of this many clusters, 0 for contiguous
+	int failed_image_writes;		// The next this many writes to an image or overlay fail, as a bad patch of card would
+};
+
+extern struct sim_sd_stats sim_sd_stats;
+extern struct sim_sd_model sim_sd_model;
+
+void sim_ff_init(const char* directory);
+
+/* Firmware under test */
+
+int firmware_main(void);
+
+#endif
@@ -0,0 +1,455 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// FatFs over ordinary host files. The data is real, the time each call takes is modelled:
+// a fixed overhead per card command plus transfer time for reads and writes, and one FAT
+// sector read per 128 clusters FatFs has to follow when it seeks without a fast seek table.
+//
+// Each file is given a place on the simulated card when it is first opened, so that cluster
+// numbers and sector addresses mean the same as they do on the board and the disk I/O layer
+// underneath FatFs can be used directly. Files are contiguous unless 'fragment_clusters' is
+// set, in which case a cluster is skipped after every that many.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "sim.h"
+
+#define FAT_ENTRIES_PER_SECTOR	128		// FAT32
+#define SECTOR_SIZE				512
+#define DATA_START_SECTOR		0x8000		// Where cluster 2 is
+#define FILE_CLUSTERS			(1 << 18)	// Room on the card for each file
+#define MAX_FILES				16
+
+struct sim_sd_stats sim_sd_stats;
+
+// Roughly a class 10 card behind the ZynqMP SD controller
+struct sim_sd_model sim_sd_model = {
+	.read_latency_us = 250,
+	.write_latency_us = 500,
+	.read_mb_per_s = 25,
+	.write_mb_per_s = 12,
+	.sync_us = 2000,
+	.fat_sector_us = 100,
+	.cluster_size = 32768,
+	.fragment_clusters = 0,
+	.failed_image_writes = 0,
+};
+
+static char root_directory[256];
+
+// Every file which has been opened, with where it is on the card
+struct card_file {
+	char name[512];
+	DWORD sclust;
+	int fd;				// While it is open
+	FSIZE_t size;
+};
+
+static struct card_file card_files[MAX_FILES];
+static int num_card_files = 0;
+
+void sim_ff_init(const char* directory) {
+	snprintf(root_directory, sizeof(root_directory), "%s", directory);
+}
+
+static void charge(double us) {
+	uint64_t counts = SIM_US(us);
+	sim_sd_stats.busy += counts;
+	sim_advance(counts);
+}
+
+static double transfer_us(UINT bytes, double mb_per_s) {
+	return bytes / mb_per_s;		// bytes / (MB/s) = us
+}
+
+// Strip the drive prefix and put the file in the simulated card's directory
+static void host_path(char* out, size_t size, const char* path) {
+	const char* colon = strchr(path, ':');
+	if (colon)
+		path = colon + 1;
+	while (*path == '/')
+		path++;
+	snprintf(out, size, "%s/%s", root_directory, path);
+}
+
+// Index within the file of the cluster holding the byte before 'offset', which is the one
+// FatFs keeps in fp->clust
+static DWORD file_cluster(FSIZE_t offset) {
+	return offset ? ((offset - 1) / sim_sd_model.cluster_size) : 0;
+}
+
+static DWORD card_cluster(DWORD sclust, DWORD n) {
+	int f = sim_sd_model.fragment_clusters;
+	return sclust + n + (f ? (n / f) : 0);
+}
+
+// The file and offset within it of a sector on the card. False if no file is there.
+static bool card_sector(LBA_t sector, struct card_file** file, FSIZE_t* offset) {
+	if (sector < DATA_START_SECTOR)
+		return false;
+
+	int csize = sim_sd_model.cluster_size / SECTOR_SIZE;
+	DWORD cluster = ((sector - DATA_START_SECTOR) / csize) + 2;
+
+	for (int i = 0; i < num_card_files; i++) {
+		struct card_file* cf = &card_files[i];
+		if ((cluster < cf->sclust) || (cluster >= cf->sclust + FILE_CLUSTERS))
+			continue;
+
+		DWORD n = cluster - cf->sclust;
+		int f = sim_sd_model.fragment_clusters;
+		if (f) {
+			if ((n % (f + 1)) == f)
+				return false;		// The gap after a fragment
+			n = ((n / (f + 1)) * f) + (n % (f + 1));
+		}
+
+		*file = cf;
+		*offset = ((FSIZE_t) n * sim_sd_model.cluster_size) + (((sector - DATA_START_SECTOR) % csize) * SECTOR_SIZE);
+		return true;
+	}
+
+	return false;
+}
+
+static struct card_file* card_file(const char* name) {
+	for (int i = 0; i < num_card_files; i++) {
+		if (!strcmp(card_files[i].name, name))
+			return &card_files[i];
+	}
+
+	if (num_card_files == MAX_FILES) {
+		fprintf(stderr, "sim: too many files on the card\n");
+		exit(2);
+	}
+
+	struct card_file* cf = &card_files[num_card_files];
+	snprintf(cf->name, sizeof(cf->name), "%s", name);
+	cf->sclust = 2 + (num_card_files * FILE_CLUSTERS);
+	cf->fd = -1;
+	num_card_files += 1;
+	return cf;
+}
+
+static struct card_file* open_card_file(int fd) {
+	for (int i = 0; i < num_card_files; i++) {
+		if (card_files[i].fd == fd)
+			return &card_files[i];
+	}
+	return NULL;
+}
+
+// Whether a write to a file fails, using up one of sim_sd_model.failed_image_writes. Only
+// images and overlays are failed, so the journal and trace carry on as normal.
+static bool write_fails(const struct card_file* cf) {
+	const char* extension = cf ? strrchr(cf->name, '.') : NULL;
+
+	if (!sim_sd_model.failed_image_writes || !extension || (strcmp(extension, ".EMU") && strcmp(extension, ".OVL")))
+		return false;
+
+	sim_sd_model.failed_image_writes -= 1;
+	return true;
+}
+
+static void update_position(FIL* fp, FSIZE_t fptr) {
+	fp->fptr = fptr;
+	fp->clust = card_cluster(fp->sclust, file_cluster(fptr));
+}
+
+// FatFs moves the whole sectors of a transfer straight between the card and the caller, one
+// command per cluster as it follows the chain, and the partial sectors at either end through
+// its sector buffer. A partial sector which is written has to be read first and written out
+// again later.
+static void charge_transfer(FSIZE_t offset, UINT bytes, bool write) {
+	if (!bytes)
+		return;
+
+	FSIZE_t end = offset + bytes;
+	FSIZE_t first = (offset + SECTOR_SIZE - 1) & ~(FSIZE_t) (SECTOR_SIZE - 1);
+	FSIZE_t last = end & ~(FSIZE_t) (SECTOR_SIZE - 1);
+	int partial;
+	int commands = 0;
+
+	if (first > last) {
+		partial = 1;
+	} else {
+		partial = (offset != first) + (end != last);
+		if (last > first)
+			commands = ((last - 1) / sim_sd_model.cluster_size) - (first / sim_sd_model.cluster_size) + 1;
+	}
+
+	UINT whole = (first < last) ? (last - first) : 0;
+	double us = partial * (sim_sd_model.read_latency_us + transfer_us(SECTOR_SIZE, sim_sd_model.read_mb_per_s));
+
+	if (write) {
+		us += (commands + partial) * sim_sd_model.write_latency_us;
+		us += transfer_us(whole + (partial * SECTOR_SIZE), sim_sd_model.write_mb_per_s);
+		sim_sd_stats.reads += partial;
+		sim_sd_stats.writes += commands + partial;
+	} else {
+		us += commands * sim_sd_model.read_latency_us;
+		us += transfer_us(whole, sim_sd_model.read_mb_per_s);
+		sim_sd_stats.reads += commands + partial;
+	}
+
+	charge(us);
+}
+
+static void resize(FIL* fp, FSIZE_t size) {
+	fp->obj_size = size;
+
+	struct card_file* cf = open_card_file(fp->fd);
+	if (cf)
+		cf->size = size;
+}
+
+FRESULT f_mount(FATFS* fs, const char* path, BYTE opt) {
+	fs->fs_type = 3;
+	fs->pdrv = 0;
+	fs->csize = sim_sd_model.cluster_size / SECTOR_SIZE;
+	fs->database = DATA_START_SECTOR;
+	charge(5000);
+	return FR_OK;
+}
+
+FRESULT f_open(FIL* fp, const char* path, BYTE mode) {
+	char name[512];
+	int flags = ((mode & (FA_READ | FA_WRITE)) == (FA_READ | FA_WRITE)) ? O_RDWR :
+				(mode & FA_WRITE) ? O_WRONLY : O_RDONLY;
+
+	if (mode & FA_CREATE_ALWAYS)
+		flags |= O_CREAT | O_TRUNC;
+	else if (mode & FA_OPEN_ALWAYS)
+		flags |= O_CREAT;
+	else if (mode & FA_CREATE_NEW)
+		flags |= O_CREAT | O_EXCL;
+
+	charge(1000);
+
+	host_path(name, sizeof(name), path);
+	int fd = open(name, flags, 0644);
+	if (fd < 0)
+		return FR_NO_FILE;
+
+	struct stat st;
+	fstat(fd, &st);
+
+	struct card_file* cf = card_file(name);
+	cf->fd = fd;
+	cf->size = st.st_size;
+
+	memset(fp, 0, sizeof(*fp));
+	fp->fd = fd;
+	fp->flag = mode;
+	fp->obj_size = st.st_size;
+	fp->sclust = cf->sclust;
+	update_position(fp, ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND) ? st.st_size : 0);
+
+	return FR_OK;
+}
+
+FRESULT f_close(FIL* fp) {
+	if (fp->fd <= 0)
+		return FR_INVALID_OBJECT;
+	if (fp->flag & FA_WRITE)
+		f_sync(fp);
+
+	struct card_file* cf = open_card_file(fp->fd);
+	if (cf)
+		cf->fd = -1;
+
+	close(fp->fd);
+	fp->fd = -1;
+	return FR_OK;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br) {
+	*br = 0;
+	if (fp->fd <= 0)
+		return FR_INVALID_OBJECT;
+
+	ssize_t n = pread(fp->fd, buff, btr, fp->fptr);
+	if (n < 0)
+		return FR_DISK_ERR;
+
+	sim_sd_stats.read_bytes += n;
+	charge_transfer(fp->fptr, n, false);
+
+	update_position(fp, fp->fptr + n);
+	*br = n;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw) {
+	*bw = 0;
+	if ((fp->fd <= 0) || !(fp->flag & FA_WRITE))
+		return FR_DENIED;
+	if (write_fails(open_card_file(fp->fd))) {
+		charge(sim_sd_model.write_latency_us);
+		return FR_DISK_ERR;
+	}
+
+	ssize_t n = pwrite(fp->fd, buff, btw, fp->fptr);
+	if (n < 0)
+		return FR_DISK_ERR;
+
+	sim_sd_stats.write_bytes += n;
+	charge_transfer(fp->fptr, n, true);
+
+	update_position(fp, fp->fptr + n);
+	if (fp->fptr > fp->obj_size)
+		resize(fp, fp->fptr);
+	fp->flag |= FA_MODIFIED;
+	*bw = n;
+	return FR_OK;
+}
+
+// FatFs follows the cluster chain forwards from the current cluster, or from the start of
+// the file when seeking backwards
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs) {
+	if (fp->fd <= 0)
+		return FR_INVALID_OBJECT;
+
+	DWORD target = file_cluster(ofs);
+	DWORD current = file_cluster(fp->fptr);
+
+	// FatFs keeps the FAT sector it last read, so a walk only reads the ones it moves on to
+	DWORD fat_sectors;
+	if (target >= current)
+		fat_sectors = (target / FAT_ENTRIES_PER_SECTOR) - (current / FAT_ENTRIES_PER_SECTOR);
+	else
+		fat_sectors = target ? ((target / FAT_ENTRIES_PER_SECTOR) + 1) : 0;
+
+	sim_sd_stats.seeks += 1;
+	charge(5 + (fat_sectors * sim_sd_model.fat_sector_us));
+
+	if ((ofs > fp->obj_size) && (fp->flag & FA_WRITE)) {
+		if (ftruncate(fp->fd, ofs))
+			return FR_DISK_ERR;
+		resize(fp, ofs);
+	}
+	if (ofs > fp->obj_size)
+		ofs = fp->obj_size;
+
+	update_position(fp, ofs);
+	return FR_OK;
+}
+
+FRESULT f_truncate(FIL* fp) {
+	if (ftruncate(fp->fd, fp->fptr))
+		return FR_DISK_ERR;
+	resize(fp, fp->fptr);
+	charge(sim_sd_model.sync_us);
+	return FR_OK;
+}
+
+// Nothing to do unless the file has been written through FatFs since the last sync
+FRESULT f_sync(FIL* fp) {
+	if (fp->fd <= 0)
+		return FR_INVALID_OBJECT;
+	if (!(fp->flag & FA_MODIFIED))
+		return FR_OK;
+	fp->flag &= ~FA_MODIFIED;
+	sim_sd_stats.syncs += 1;
+	charge(sim_sd_model.sync_us);
+	return FR_OK;
+}
+
+FRESULT f_unlink(const char* path) {
+	char name[512];
+	host_path(name, sizeof(name), path);
+	charge(sim_sd_model.sync_us);
+	return unlink(name) ? FR_NO_FILE : FR_OK;
+}
+
+FRESULT f_rename(const char* path_old, const char* path_new) {
+	char old_name[512], new_name[512];
+	host_path(old_name, sizeof(old_name), path_old);
+	host_path(new_name, sizeof(new_name), path_new);
+	charge(sim_sd_model.sync_us);
+	return rename(old_name, new_name) ? FR_NO_FILE : FR_OK;
+}
+
+/* Disk I/O, underneath FatFs */
+
+// One command to the card for the whole transfer. Sectors past the end of a file are the
+// slack at the end of its last cluster: they read as zeros and writes to them are dropped.
+static DRESULT disk_transfer(BYTE* buff, LBA_t sector, UINT count, bool write) {
+	struct card_file* first;
+	FSIZE_t first_offset;
+
+	if (write && card_sector(sector, &first, &first_offset) && write_fails(first)) {
+		charge(sim_sd_model.write_latency_us);
+		return RES_ERROR;
+	}
+
+	for (UINT i = 0; i < count; i++) {
+		struct card_file* cf;
+		FSIZE_t offset;
+
+		if (!card_sector(sector + i, &cf, &offset) || (cf->fd < 0) || (offset >= cf->size + sim_sd_model.cluster_size)) {
+			fprintf(stderr, "sim: %s of sector %u which no open file is in\n", write ? "write" : "read", (unsigned) (sector + i));
+			return RES_PARERR;
+		}
+
+		BYTE* data = buff + (i * SECTOR_SIZE);
+		UINT length = (offset >= cf->size) ? 0 : ((cf->size - offset < SECTOR_SIZE) ? (cf->size - offset) : SECTOR_SIZE);
+
+		if (write) {
+			if (pwrite(cf->fd, data, length, offset) != (ssize_t) length)
+				return RES_ERROR;
+		} else {
+			memset(data + length, 0, SECTOR_SIZE - length);
+			if (pread(cf->fd, data, length, offset) != (ssize_t) length)
+				return RES_ERROR;
+		}
+	}
+
+	if (write) {
+		sim_sd_stats.writes += 1;
+		sim_sd_stats.write_bytes += count * SECTOR_SIZE;
+		charge(sim_sd_model.write_latency_us + transfer_us(count * SECTOR_SIZE, sim_sd_model.write_mb_per_s));
+	} else {
+		sim_sd_stats.reads += 1;
+		sim_sd_stats.read_bytes += count * SECTOR_SIZE;
+		charge(sim_sd_model.read_latency_us + transfer_us(count * SECTOR_SIZE, sim_sd_model.read_mb_per_s));
+	}
+
+	return RES_OK;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+	return disk_transfer(buff, sector, count, false);
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
+	return disk_transfer((BYTE*) buff, sector, count, true);
+}
+
+// Writes are on the card once disk_write returns
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
+	return (cmd == CTRL_SYNC) ? RES_OK : RES_PARERR;
+}
@@ -0,0 +1,1228 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Time-stepped model of the FPGA side of the emulator: the GIC, the GPIOs and the UART, and
+// for each drive the sector timer, the track sequencer, the write DMA and the read and write
+// datapaths.
+//
+// The firmware runs natively and takes no simulated time except where it calls into the BSP
+// or FatFs stand-ins, or finishes a pass of its main loop. Those are the points where time
+// moves forward, events fire and interrupts are dispatched, just as they would be taken
+// between instructions on the board.
+//
+// The firmware's second core is a coroutine. It runs whenever the hardware is polled and it
+// is not waiting, until it either waits for simulated time to pass or has nothing to do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ucontext.h>
+
+#include "xil_io.h"
+#include "xscugic.h"
+#include "xgpio.h"
+#include "xparameters.h"
+#include "xtime_l.h"
+#include "sleep.h"
+
+#include "sim.h"
+
+#undef printf
+
+#define NUM_INTERRUPTS			256
+#define MAX_EVENTS				4096
+#define DMA_DESCRIPTOR_US		2		// Time for the DMA to move one sector to or from DDR
+#define SEQUENCER_FETCH_US		2		// Time for the track sequencer to fetch one sector from DDR
+#define WRITE_RECORD_DELAY_US	2		// From the end of a written sector to its completion record
+#define WRITE_RECORDS			32		// Completion records the write datapath keeps
+#define WRITE_RECORDS_BASE		64		// Word offset of them in its register window
+#define UART_CHAR_COUNTS		8681	// 10 bits at 115200 baud
+#define UART_FIFO_DEPTH			64
+#define WRITE_QUEUE_SIZE		64
+#define SECOND_CORE_STACK_SIZE	(1024 * 1024)
+
+/* Register windows */
+
+volatile uint32_t sim_drive_select_gpio[SIM_REGISTER_WINDOW_WORDS];
+volatile uint32_t sim_head_select_gpio[SIM_REGISTER_WINDOW_WORDS];
+struct sim_drive_registers sim_drive_registers[SIM_NUM_DRIVES];
+
+// DDR left over for slot buffers. The symbols lscript.ld provides on the board are made to
+// point at the start and end of it. The executable is linked without PIE so that this, like
+// the descriptors, has an address which fits in the 32 bit DMA descriptor fields.
+uint8_t sim_ddr[SIM_DDR_SIZE] __attribute__((aligned(0x100000)));
+
+#define SIM_STRINGIFY(x)	#x
+#define SIM_TO_STRING(x)	SIM_STRINGIFY(x)
+__asm__(".globl __slot_buffers_start\n"
+		".set __slot_buffers_start, sim_ddr\n"
+		".globl __slot_buffers_end\n"
+		".set __slot_buffers_end, sim_ddr + " SIM_TO_STRING(SIM_DDR_SIZE) "\n");
+
+uint64_t sim_time = 0;
+bool sim_verbose = false;
+struct sim_hw_stats sim_hw_stats;
+void (*sim_poll_hook)(void) = NULL;
+void (*sim_main_loop_hook)(void) = NULL;
+
+/* Events */
+
+struct sim_event {
+	uint64_t time;
+	uint64_t sequence;		// Keeps events at the same time in the order they were scheduled
+	sim_event_fn fn;
+	uint64_t arg;
+};
+
+static struct sim_event event_heap[MAX_EVENTS];
+static int num_events = 0;
+static uint64_t event_sequence = 0;
+
+static bool event_before(const struct sim_event* a, const struct sim_event* b) {
+	if (a->time != b->time)
+		return a->time < b->time;
+	return a->sequence < b->sequence;
+}
+
+void sim_schedule(uint64_t time, sim_event_fn fn, uint64_t arg) {
+	if (num_events == MAX_EVENTS) {
+		fprintf(stderr, "sim: event queue overflow\n");
+		exit(2);
+	}
+
+	int i = num_events++;
+	event_heap[i] = (struct sim_event) {time, event_sequence++, fn, arg};
+
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!event_before(&event_heap[i], &event_heap[parent]))
+			break;
+		struct sim_event t = event_heap[i];
+		event_heap[i] = event_heap[parent];
+		event_heap[parent] = t;
+		i = parent;
+	}
+}
+
+static struct sim_event pop_event(void) {
+	struct sim_event top = event_heap[0];
+	event_heap[0] = event_heap[--num_events];
+
+	int i = 0;
+	while (1) {
+		int smallest = i;
+		int l = (2 * i) + 1;
+		int r = l + 1;
+		if ((l < num_events) && event_before(&event_heap[l], &event_heap[smallest]))
+			smallest = l;
+		if ((r < num_events) && event_before(&event_heap[r], &event_heap[smallest]))
+			smallest = r;
+		if (smallest == i)
+			break;
+		struct sim_event t = event_heap[i];
+		event_heap[i] = event_heap[smallest];
+		event_heap[smallest] = t;
+		i = smallest;
+	}
+
+	return top;
+}
+
+static bool on_second_core(void);
+static void second_core_wait(uint64_t counts);
+
+void sim_advance(uint64_t counts) {
+	uint64_t target = sim_time + counts;
+
+	// Only the second core is held up while it is busy
+	if (on_second_core()) {
+		second_core_wait(counts);
+		return;
+	}
+
+	while (num_events && (event_heap[0].time <= target)) {
+		struct sim_event e = pop_event();
+		sim_time = e.time;
+		e.fn(e.arg);
+		sim_poll();
+	}
+
+	sim_time = target;
+	sim_poll();
+}
+
+static void perf_poll(void);
+
+bool sim_step(void) {
+	if (!num_events)
+		return false;
+
+	// A clear written since the last poll must not take the next event with it
+	perf_poll();
+
+	struct sim_event e = pop_event();
+	if (e.time > sim_time)
+		sim_time = e.time;
+	e.fn(e.arg);
+	sim_poll();
+	return true;
+}
+
+/* Interrupt controller */
+
+static Xil_InterruptHandler interrupt_handlers[NUM_INTERRUPTS];
+static void* interrupt_refs[NUM_INTERRUPTS];
+static bool interrupt_enabled[NUM_INTERRUPTS];
+static bool interrupt_pending[NUM_INTERRUPTS];
+static bool exceptions_masked = true;
+static bool in_interrupt = false;
+static XScuGic_Config gic_config;
+
+static void after_interrupt(u32 int_id);
+
+static void dispatch_interrupts(void) {
+	if (exceptions_masked || in_interrupt)
+		return;
+
+	// Lowest interrupt number first, like the GIC does for equal priorities
+	bool dispatched = true;
+	while (dispatched) {
+		dispatched = false;
+		for (int i = 0; i < NUM_INTERRUPTS; i++) {
+			if (interrupt_pending[i] && interrupt_enabled[i] && interrupt_handlers[i]) {
+				interrupt_pending[i] = false;
+				in_interrupt = true;
+				interrupt_handlers[i](interrupt_refs[i]);
+				in_interrupt = false;
+				after_interrupt(i);
+				dispatched = true;
+				break;
+			}
+		}
+	}
+}
+
+static void raise_interrupt(u32 int_id) {
+	interrupt_pending[int_id] = true;
+	dispatch_interrupts();
+}
+
+XScuGic_Config* XScuGic_LookupConfig(u16 device_id) {
+	gic_config.DeviceId = device_id;
+	return &gic_config;
+}
+
+s32 XScuGic_CfgInitialize(XScuGic* instance, XScuGic_Config* config, UINTPTR effective_address) {
+	instance->Config = config;
+	instance->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+s32 XScuGic_Connect(XScuGic* instance, u32 int_id, Xil_InterruptHandler handler, void* callback_ref) {
+	interrupt_handlers[int_id] = handler;
+	interrupt_refs[int_id] = callback_ref;
+	return XST_SUCCESS;
+}
+
+void XScuGic_Enable(XScuGic* instance, u32 int_id) {
+	interrupt_enabled[int_id] = true;
+	dispatch_interrupts();
+}
+
+void XScuGic_Disable(XScuGic* instance, u32 int_id) {
+	interrupt_enabled[int_id] = false;
+}
+
+void XScuGic_InterruptHandler(XScuGic* instance) {
+	dispatch_interrupts();
+}
+
+void Xil_ExceptionRegisterHandler(u32 exception_id, Xil_ExceptionHandler handler, void* data) {
+}
+
+void Xil_ExceptionEnable(void) {
+	exceptions_masked = false;
+	dispatch_interrupts();
+}
+
+void Xil_ExceptionDisable(void) {
+	exceptions_masked = true;
+}
+
+/* GPIO */
+
+static bool gpio_interrupt_pending[2];
+
+s32 XGpio_Initialize(XGpio* instance, u16 device_id) {
+	instance->DeviceId = device_id;
+	instance->IsReady = 1;
+	return XST_SUCCESS;
+}
+
+void XGpio_InterruptGlobalEnable(XGpio* instance) {
+}
+
+void XGpio_InterruptEnable(XGpio* instance, u32 mask) {
+}
+
+u32 XGpio_InterruptGetStatus(XGpio* instance) {
+	return gpio_interrupt_pending[instance->DeviceId] ? 1 : 0;
+}
+
+void XGpio_InterruptClear(XGpio* instance, u32 mask) {
+	if (mask & 1)
+		gpio_interrupt_pending[instance->DeviceId] = false;
+}
+
+/* Time */
+
+void XTime_GetTime(XTime* time) {
+	*time = sim_time;
+}
+
+void sim_usleep(unsigned long useconds) {
+	sim_advance(SIM_US(useconds));
+}
+
+/* UART */
+
+static uint64_t uart_busy_until = 0;
+
+// printf blocks once the UART transmit FIFO is full, so long messages cost the main loop
+// real time on the board. Charge the same here.
+int sim_printf(const char* format, ...) {
+	char text[512];
+	va_list args;
+
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (length < 0)
+		return length;
+	if (length >= (int) sizeof(text))
+		length = sizeof(text) - 1;
+
+	if (sim_verbose)
+		fprintf(stderr, "%10.3f ms  %s", sim_time / (SIM_COUNTS_PER_US * 1000.0), text);
+
+	uint64_t start = (uart_busy_until > sim_time) ? uart_busy_until : sim_time;
+	uart_busy_until = start + ((uint64_t) length * UART_CHAR_COUNTS);
+	sim_hw_stats.uart_bytes += length;
+
+	uint64_t fifo_time = (uint64_t) UART_FIFO_DEPTH * UART_CHAR_COUNTS;
+	if (uart_busy_until > sim_time + fifo_time) {
+		uint64_t stall = uart_busy_until - fifo_time - sim_time;
+		sim_hw_stats.uart_stall += stall;
+		sim_advance(stall);
+	}
+
+	return length;
+}
+
+bool sim_uart_transmit_empty(void) {
+	return uart_busy_until <= sim_time;
+}
+
+/* Drives */
+
+// Everything the model keeps for one drive's share of the hardware
+struct sim_drive {
+	struct sim_drive_registers* regs;
+	int select_code;
+	u32 command_irq;
+	u32 sector_timer_irq;
+	u32 sequencer_irq;
+	u32 dma_irq;
+	u32 write_irq;
+
+	bool present;
+	struct sim_geometry geometry;
+	uint32_t* sector_generation;
+
+	int cylinder;					// Where the controller last seeked it
+
+	// Sector timer. A sector lasts sector_whole + (sector_remainder / sector_denominator)
+	// cycles on average, and the timer spreads the fraction so that sector k after it was
+	// enabled starts floor(k * that) cycles in.
+	bool rotation_enabled;
+	uint64_t rotation_start;
+	uint64_t sector_whole;
+	uint64_t sector_remainder;
+	uint64_t sector_denominator;
+
+	// S2MM (write) DMA
+	bool dma_reset_done;
+	bool s2mm_running;
+	uint32_t s2mm_last;				// Descriptor most recently taken, 0 if none yet
+	uint32_t s2mm_idle_tail;		// The tail it stopped at, 0 while it hasn't
+	uint64_t s2mm_free_at;
+
+	// Sectors which have come out of the write datapath, waiting for a descriptor
+	uint64_t write_queue[WRITE_QUEUE_SIZE];
+	int write_queue_head;
+	int write_queue_tail;
+
+	int writes_in_flight;			// Written by the controller, not yet delivered to DDR
+
+	// Write datapath completion records. The interrupt is asserted while any are waiting and
+	// either enough of them are or the oldest has waited long enough.
+	uint32_t records_produced;
+	uint32_t records_consumed;		// As the firmware last wrote it
+	uint64_t records_waiting_since;	// When the wait for the timeout started
+	bool write_irq_enabled;
+
+	uint64_t perf_cleared_at;
+
+	// What the sequencer last saw in its registers. Rewriting cylinder_head with the value it
+	// already holds restarts the real sequencer, but can't be seen here; the firmware never does.
+	bool sequencer_enabled;
+	uint32_t sequencer_chs;
+	uint32_t sequencer_entry;
+
+	bool sequencer_streaming;		// Fetching the selected track, silent or not
+	bool sequencer_silent;
+	bool sequencer_released;
+	int sequencer_start_sector;		// First sector it will stream after a restart
+	uint64_t sequencer_ready_at;	// When that sector has been fetched
+};
+
+static struct sim_drive drives[SIM_NUM_DRIVES] = {
+	{
+		.regs = &sim_drive_registers[0],
+		.select_code = SIM_DRIVE_SELECT(0),
+		.command_irq = XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_0_INTERRUPT_INTR,
+		.sector_timer_irq = XPAR_FABRIC_SECTOR_TIMER_0_INTERRUPT_INTR,
+		.sequencer_irq = XPAR_FABRIC_TRACK_SEQUENCER_0_INTERRUPT_INTR,
+		.dma_irq = XPAR_FABRIC_AXI_DMA_0_S2MM_INTROUT_INTR,
+		.write_irq = XPAR_FABRIC_WRITE_DATAPATH_0_INTERRUPT_INTR,
+	},
+	{
+		.regs = &sim_drive_registers[1],
+		.select_code = SIM_DRIVE_SELECT(1),
+		.command_irq = XPAR_FABRIC_AXI_ESDI_CMD_CONTROL_1_INTERRUPT_INTR,
+		.sector_timer_irq = XPAR_FABRIC_SECTOR_TIMER_1_INTERRUPT_INTR,
+		.sequencer_irq = XPAR_FABRIC_TRACK_SEQUENCER_1_INTERRUPT_INTR,
+		.dma_irq = XPAR_FABRIC_AXI_DMA_1_S2MM_INTROUT_INTR,
+		.write_irq = XPAR_FABRIC_WRITE_DATAPATH_1_INTERRUPT_INTR,
+	},
+};
+
+// Events which concern a drive carry its number in the top byte of their argument
+#define DRIVE_EVENT_ARG(drive, value)	(((uint64_t) (drive) << 56) | (value))
+#define EVENT_DRIVE(arg)				(&drives[(arg) >> 56])
+#define EVENT_VALUE(arg)				((arg) & ((1ull << 56) - 1))
+
+static int drive_select = 0;		// As driven by the controller
+static int controller_head = 0;		// The head select lines are shared by both drives
+
+static int drive_number(const struct sim_drive* dr) {
+	return dr - drives;
+}
+
+// The drive the controller has selected. Exits if it isn't one with an image.
+static struct sim_drive* selected_drive(void) {
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		if (drives[i].present && (drives[i].select_code == drive_select))
+			return &drives[i];
+	}
+
+	fprintf(stderr, "sim: controller is using drive select %d, which has no image\n", drive_select);
+	exit(2);
+}
+
+static bool command_pending(const struct sim_drive* dr) {
+	return dr->regs->command_interface[3] != 0;
+}
+
+// Side effects of register accesses the handlers make
+static void after_interrupt(u32 int_id) {
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		struct sim_drive* dr = &drives[i];
+		if (int_id == dr->command_irq)
+			dr->regs->command_interface[1] &= ~0x2;		// Reading the command clears buffered_data_in_valid
+		if (int_id == dr->dma_irq)
+			dr->regs->dma[0x34 >> 2] &= ~(1 << 12);		// IOC_Irq is write one to clear
+		if (int_id == dr->sequencer_irq)
+			dr->sequencer_released = false;				// Reading the control register clears it
+	}
+}
+
+/* Disk contents */
+
+static uint32_t* generation_entry(struct sim_drive* dr, int c, int h, int s) {
+	const struct sim_geometry* g = &dr->geometry;
+	return &dr->sector_generation[(((size_t) c * g->heads) + h) * g->sectors_per_track + s];
+}
+
+uint32_t sim_sector_generation(int drive, int c, int h, int s) {
+	return *generation_entry(&drives[drive], c, h, s);
+}
+
+void sim_sector_pattern(uint8_t* data, int length, int drive, int c, int h, int s, uint32_t generation) {
+	if (generation == 0) {
+		memset(data, 0, length);
+		return;
+	}
+
+	// The first byte is the sector number, as put there by the labeler
+	data[0] = s;
+
+	uint32_t x = (c * 0x9E3779B1u) ^ (h * 0x85EBCA77u) ^ (s * 0xC2B2AE3Du) ^ (generation * 0x27D4EB2Fu) ^ (drive * 0x165667B1u);
+	for (int i = 1; i < length; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		data[i] = x;
+	}
+}
+
+/* Sector timer */
+
+bool sim_rotation_enabled(int drive) {
+	return drives[drive].rotation_enabled;
+}
+
+// When the k'th sector since the timer was enabled starts
+static uint64_t sector_time(const struct sim_drive* dr, uint64_t k) {
+	return dr->rotation_start + (k * dr->sector_whole) + ((k * dr->sector_remainder) / dr->sector_denominator);
+}
+
+// Which sector since the timer was enabled is under the head at 't'
+static uint64_t sector_index_at(const struct sim_drive* dr, uint64_t t) {
+	uint64_t elapsed = t - dr->rotation_start;
+	return (((elapsed + 1) * dr->sector_denominator) - 1) / ((dr->sector_whole * dr->sector_denominator) + dr->sector_remainder);
+}
+
+// Rounded up to a whole cycle
+static uint64_t revolution_time(const struct sim_drive* dr) {
+	uint64_t spt = dr->geometry.sectors_per_track;
+	return (spt * dr->sector_whole) + (((spt * dr->sector_remainder) + dr->sector_denominator - 1) / dr->sector_denominator);
+}
+
+uint64_t sim_revolution_time(int drive) {
+	return revolution_time(&drives[drive]);
+}
+
+// The next time 'sector' starts at or after 'after', as a count of sectors since the timer was enabled
+static uint64_t sector_start_index(const struct sim_drive* dr, int sector, uint64_t after) {
+	int spt = dr->geometry.sectors_per_track;
+	uint64_t k = (after > dr->rotation_start) ? sector_index_at(dr, after - 1) + 1 : 0;
+	return k + ((sector + spt - (k % spt)) % spt);
+}
+
+uint64_t sim_sector_start_time(int drive, int sector, uint64_t after) {
+	const struct sim_drive* dr = &drives[drive];
+	return sector_time(dr, sector_start_index(dr, sector, after));
+}
+
+static volatile uint32_t* descriptor_at(uint32_t address) {
+	return (volatile uint32_t*) (uintptr_t) address;
+}
+
+/* S2MM (write) DMA */
+
+static uint64_t pack_sector(int c, int h, int s, uint32_t generation) {
+	return ((uint64_t) generation << 32) | ((uint64_t) c << 16) | ((uint64_t) h << 8) | s;
+}
+
+// The firmware clears IOC_Irq before it enables the interrupt, which can't be seen here, so
+// the bit is only set while it is enabled
+static void s2mm_complete(uint64_t arg) {
+	struct sim_drive* dr = EVENT_DRIVE(arg);
+	uint32_t address = arg & 0xFFFFFFFF;
+	int slot = EVENT_VALUE(arg) >> 32;
+	uint64_t sector = dr->write_queue[slot];
+
+	volatile uint32_t* d = descriptor_at(address);
+	int length = d[0x18 >> 2] & 0x3FFFFFF;
+	uint8_t* buffer = (uint8_t*) (uintptr_t) d[0x08 >> 2];
+
+	if ((buffer < sim_ddr) || (buffer + length > sim_ddr + SIM_DDR_SIZE)) {
+		fprintf(stderr, "sim: write descriptor points outside DDR (0x%08x)\n", d[0x08 >> 2]);
+		exit(2);
+	}
+
+	sim_sector_pattern(buffer, length, drive_number(dr), (sector >> 16) & 0xFFFF, (sector >> 8) & 0xFF, sector & 0xFF, sector >> 32);
+
+	d[0x1C >> 2] = (1u << 31) | length;
+	dr->writes_in_flight -= 1;
+	if (dr->regs->dma[0x30 >> 2] & (1 << 12)) {
+		dr->regs->dma[0x34 >> 2] |= (1 << 12);
+		sim_hw_stats.write_interrupts += 1;
+		raise_interrupt(dr->dma_irq);
+	}
+}
+
+// Give each sector waiting in the write datapath the next descriptor. The DMA stops after the
+// one which is the tail as it takes it, until the tail is moved.
+static void s2mm_issue(struct sim_drive* dr) {
+	volatile uint32_t* dma = dr->regs->dma;
+	uint32_t tail = dma[0x40 >> 2];
+
+	if (!dr->s2mm_running || !tail)
+		return;
+	if (dr->s2mm_idle_tail && (tail != dr->s2mm_idle_tail))
+		dr->s2mm_idle_tail = 0;
+
+	while ((dr->write_queue_head != dr->write_queue_tail) && !dr->s2mm_idle_tail) {
+		uint32_t address = dr->s2mm_last ? descriptor_at(dr->s2mm_last)[0x00 >> 2] : dma[0x38 >> 2];
+		if (descriptor_at(address)[0x1C >> 2] & (1u << 31)) {
+			fprintf(stderr, "sim: write descriptor reused before its status was cleared\n");
+			exit(2);
+		}
+
+		int slot = dr->write_queue_head;
+		dr->write_queue_head = (dr->write_queue_head + 1) % WRITE_QUEUE_SIZE;
+
+		dr->s2mm_free_at = ((dr->s2mm_free_at > sim_time) ? dr->s2mm_free_at : sim_time) + SIM_US(DMA_DESCRIPTOR_US);
+		sim_schedule(dr->s2mm_free_at, s2mm_complete, DRIVE_EVENT_ARG(drive_number(dr), ((uint64_t) slot << 32) | address));
+		dr->s2mm_last = address;
+		if (address == tail)
+			dr->s2mm_idle_tail = tail;
+	}
+}
+
+static void s2mm_poll(struct sim_drive* dr) {
+	volatile uint32_t* dma = dr->regs->dma;
+
+	if (!dr->s2mm_running) {
+		if (!(dma[0x30 >> 2] & 0x1))
+			return;
+		dr->s2mm_running = true;
+		dr->s2mm_last = 0;
+		dr->s2mm_idle_tail = 0;
+	}
+
+	s2mm_issue(dr);
+}
+
+/* Performance counters */
+
+// The window holds the live counts rather than a snapshot; the firmware reads it straight
+// after asking for a snapshot, and the clear only lands at the next poll.
+#define PERF_CONTROL			0
+#define PERF_CYCLES_LOW			1
+#define PERF_CYCLES_HIGH		2
+#define PERF_MIN_SLACK			3
+#define PERF_STREAMED			8
+#define PERF_WRITTEN			9
+#define PERF_MISSED_DEADLINES	12
+#define PERF_HEAD_CHANGES		15
+#define PERF_SEEKS				16
+#define PERF_SLACK_HISTOGRAM	17
+#define PERF_SLACK_BINS			8
+
+static void perf_clear(struct sim_drive* dr) {
+	volatile uint32_t* perf = dr->regs->perf_counters;
+
+	for (int i = PERF_CYCLES_LOW; i < PERF_SLACK_HISTOGRAM + PERF_SLACK_BINS; i++)
+		perf[i] = 0;
+	perf[PERF_MIN_SLACK] = 0xFFFFFFFF;
+	dr->perf_cleared_at = sim_time;
+}
+
+static void perf_poll(void) {
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		struct sim_drive* dr = &drives[i];
+		volatile uint32_t* perf = dr->regs->perf_counters;
+
+		if (perf[PERF_CONTROL] & 0x2)
+			perf_clear(dr);
+		perf[PERF_CONTROL] = 0;
+
+		uint64_t cycles = sim_time - dr->perf_cleared_at;
+		perf[PERF_CYCLES_LOW] = (uint32_t) cycles;
+		perf[PERF_CYCLES_HIGH] = (uint32_t) (cycles >> 32);
+	}
+}
+
+static void perf_count_slack(struct sim_drive* dr, uint64_t slack) {
+	volatile uint32_t* perf = dr->regs->perf_counters;
+
+	int bin = 0;
+	while ((bin < PERF_SLACK_BINS - 1) && (slack >= (64u << bin)))
+		bin++;
+	perf[PERF_SLACK_HISTOGRAM + bin] += 1;
+
+	if (slack < perf[PERF_MIN_SLACK])
+		perf[PERF_MIN_SLACK] = (uint32_t) slack;
+}
+
+/* Track sequencer */
+
+#define SEQ_CONTROL				0
+#define SEQ_CYLINDER_HEAD		1
+#define SEQ_SECTORS_PER_TRACK	2
+#define SEQ_SECTOR_STRIDE		3
+#define SEQ_TRACK_STRIDE		4
+#define SEQ_SECTOR_BYTES		5
+#define SEQ_LEAD				6
+#define SEQ_LATE_CYCLE			7
+#define SEQ_PREVIOUS_CHS		8
+#define SEQ_RESYNCS				9
+#define SEQ_RELEASE_SECTOR		10
+#define SEQ_SLOT_TABLE			0x800
+
+static uint32_t sequencer_table_entry(struct sim_drive* dr, uint32_t chs) {
+	uint32_t cylinder = chs & 0xFFFF;
+	if (cylinder >= SIM_TRACK_SEQUENCER_WORDS - SEQ_SLOT_TABLE)
+		return 0;
+	return dr->regs->track_sequencer[SEQ_SLOT_TABLE + cylinder];
+}
+
+// Throw away what was fetched and start again from the next sector that can still be made
+static void sequencer_restart(struct sim_drive* dr) {
+	dr->sequencer_silent = true;
+	dr->sequencer_streaming = dr->sequencer_enabled && (dr->sequencer_entry & 1);
+	if (!dr->sequencer_streaming)
+		return;
+
+	uint64_t k = sector_index_at(dr, sim_time);
+	int sector = k % dr->geometry.sectors_per_track;
+	int skip = ((sim_time - sector_time(dr, k)) > dr->regs->track_sequencer[SEQ_LATE_CYCLE]) ? 2 : 1;
+
+	dr->sequencer_start_sector = (sector + skip) % dr->geometry.sectors_per_track;
+	dr->sequencer_ready_at = sim_time + SIM_US(SEQUENCER_FETCH_US * dr->regs->track_sequencer[SEQ_LEAD]);
+}
+
+static void sequencer_poll(struct sim_drive* dr) {
+	volatile uint32_t* seq = dr->regs->track_sequencer;
+
+	if (!dr->rotation_enabled)
+		return;
+
+	bool enabled = seq[SEQ_CONTROL] & 0x1;
+	uint32_t chs = seq[SEQ_CYLINDER_HEAD];
+	uint32_t entry = sequencer_table_entry(dr, chs);
+
+	if ((enabled == dr->sequencer_enabled) && (chs == dr->sequencer_chs) && (entry == dr->sequencer_entry))
+		return;
+
+	if (seq[SEQ_SECTORS_PER_TRACK] != (uint32_t) dr->geometry.sectors_per_track) {
+		fprintf(stderr, "sim: track sequencer set for %d sectors, image has %d\n", seq[SEQ_SECTORS_PER_TRACK], dr->geometry.sectors_per_track);
+		exit(2);
+	}
+
+	dr->sequencer_enabled = enabled;
+	dr->sequencer_chs = chs;
+	dr->sequencer_entry = entry;
+	sequencer_restart(dr);
+}
+
+// A sector boundary. Come out of silence if the sector the sequencer was aiming for has
+// arrived in time, otherwise keep waiting for it or, if it has gone by, start again.
+static void sequencer_sector_start(struct sim_drive* dr, int sector) {
+	volatile uint32_t* seq = dr->regs->track_sequencer;
+
+	seq[SEQ_PREVIOUS_CHS] = seq[SEQ_CYLINDER_HEAD];
+
+	if (!dr->sequencer_streaming || !dr->sequencer_silent)
+		return;
+
+	if ((sector == dr->sequencer_start_sector) && (sim_time >= dr->sequencer_ready_at)) {
+		dr->sequencer_silent = false;
+		dr->sequencer_released = true;
+		seq[SEQ_RELEASE_SECTOR] = sector;
+		if (seq[SEQ_CONTROL] & 0x2)
+			raise_interrupt(dr->sequencer_irq);
+	} else if (((sector + 1) % dr->geometry.sectors_per_track) != dr->sequencer_start_sector) {
+		seq[SEQ_RESYNCS] += 1;
+		sequencer_restart(dr);
+	}
+}
+
+/* Read datapath */
+
+static uint8_t expected_sector[4096];
+
+// The sector is starting under the head. It goes out to the controller unless the firmware
+// or the track sequencer is holding the datapath silent, or the drive isn't selected, and is
+// checked against what the controller last wrote there.
+static void read_sector_start(struct sim_drive* dr, int sector) {
+	struct sim_drive_registers* regs = dr->regs;
+	bool first = dr->sequencer_silent;
+
+	sequencer_sector_start(dr, sector);
+
+	if ((regs->read_datapath[0] & 0x1) || dr->sequencer_silent)
+		return;
+	if ((dr->select_code != drive_select) || (regs->command_interface[0] == 0) || command_pending(dr))
+		return;
+
+	sim_hw_stats.sectors_streamed += 1;
+	regs->perf_counters[PERF_STREAMED] += 1;
+
+	// After a restart the first sector only just made it. From then on the sequencer keeps
+	// 'lead' sectors ahead.
+	if (first)
+		perf_count_slack(dr, sim_time - dr->sequencer_ready_at);
+	else
+		perf_count_slack(dr, regs->track_sequencer[SEQ_LEAD] * dr->sector_whole);
+
+	int h = (dr->sequencer_chs >> 16) & 0xF;
+	int length = regs->track_sequencer[SEQ_SECTOR_BYTES];
+	uint8_t* buffer = (uint8_t*) (uintptr_t) ((dr->sequencer_entry & ~1u) + (h * regs->track_sequencer[SEQ_TRACK_STRIDE]) +
+											 (sector * regs->track_sequencer[SEQ_SECTOR_STRIDE]));
+	if ((length > (int) sizeof(expected_sector)) || (buffer < sim_ddr) || (buffer + length > sim_ddr + SIM_DDR_SIZE)) {
+		sim_hw_stats.read_mismatches += 1;
+		return;
+	}
+
+	sim_sector_pattern(expected_sector, length, drive_number(dr), dr->cylinder, controller_head, sector,
+					   *generation_entry(dr, dr->cylinder, controller_head, sector));
+	if (memcmp(buffer, expected_sector, length)) {
+		sim_hw_stats.read_mismatches += 1;
+		if (sim_verbose)
+			fprintf(stderr, "sim: drive %c C=%d H=%d S=%d streamed wrong data\n", 'A' + drive_number(dr), dr->cylinder, controller_head, sector);
+	}
+}
+
+/* Rotation */
+
+// Both events carry the count of sectors since the timer was enabled
+static void sector_start(uint64_t arg) {
+	struct sim_drive* dr = EVENT_DRIVE(arg);
+	uint64_t k = EVENT_VALUE(arg);
+	int sector = k % dr->geometry.sectors_per_track;
+
+	dr->regs->sector_timer[3] = sector;
+	dr->regs->sector_timer[4] = 0;
+
+	read_sector_start(dr, sector);
+
+	sim_schedule(sector_time(dr, k + 1), sector_start, DRIVE_EVENT_ARG(drive_number(dr), k + 1));
+}
+
+static void sector_interrupt(uint64_t arg) {
+	struct sim_drive* dr = EVENT_DRIVE(arg);
+	uint64_t k = EVENT_VALUE(arg);
+	int sector = k % dr->geometry.sectors_per_track;
+	volatile uint32_t* timer = dr->regs->sector_timer;
+
+	sim_schedule(sector_time(dr, k + 1) + timer[5], sector_interrupt, DRIVE_EVENT_ARG(drive_number(dr), k + 1));
+
+	if (!(timer[0] & 0x2))
+		return;
+
+	timer[3] = sector;
+	timer[4] = timer[5];
+	raise_interrupt(dr->sector_timer_irq);
+}
+
+// The firmware should have set the sector timer for the image's spindle speed, and the read
+// clock for the unformatted bytes per track, to within a cycle a revolution and a bit a
+// revolution respectively
+static void check_timing(const struct sim_drive* dr) {
+	volatile uint32_t* rd = dr->regs->read_datapath;
+	const struct sim_geometry* g = &dr->geometry;
+	int rpm = g->rpm ? g->rpm : SIM_DEFAULT_RPM;
+	double bits_per_revolution = g->unformatted_bytes_per_track ? (8.0 * g->unformatted_bytes_per_track) : (SIM_DEFAULT_BIT_RATE * 60.0 / rpm);
+
+	double revolution = g->sectors_per_track * (dr->sector_whole + ((double) dr->sector_remainder / dr->sector_denominator));
+	double expected = SIM_COUNTS_PER_US * 60e6 / rpm;
+	if ((revolution - expected > 1) || (expected - revolution > 1)) {
+		fprintf(stderr, "sim: drive %c revolution is %.1f cycles, should be %.1f\n", 'A' + drive_number(dr), revolution, expected);
+		exit(2);
+	}
+
+	if ((rd[4] == 0) || (rd[3] >= rd[4])) {
+		fprintf(stderr, "sim: read clock fraction %u/%u is invalid\n", rd[3], rd[4]);
+		exit(2);
+	}
+	double bits = revolution / (2 * (rd[2] + ((double) rd[3] / rd[4])));
+	if ((bits - bits_per_revolution > 1) || (bits_per_revolution - bits > 1)) {
+		fprintf(stderr, "sim: drive %c read clock gives %.1f bits a revolution, should be %.1f\n", 'A' + drive_number(dr), bits, bits_per_revolution);
+		exit(2);
+	}
+}
+
+static void rotation_poll(struct sim_drive* dr) {
+	volatile uint32_t* timer = dr->regs->sector_timer;
+
+	if (dr->rotation_enabled || !(timer[0] & 0x1))
+		return;
+
+	dr->rotation_enabled = true;
+	dr->rotation_start = sim_time;
+	dr->sector_whole = timer[1] + 1;
+	dr->sector_remainder = timer[6];
+	dr->sector_denominator = timer[7];
+
+	if (timer[2] != (uint32_t) dr->geometry.sectors_per_track) {
+		fprintf(stderr, "sim: sector timer set for %d sectors, image has %d\n", timer[2], dr->geometry.sectors_per_track);
+		exit(2);
+	}
+	if ((dr->sector_denominator == 0) || (dr->sector_remainder >= dr->sector_denominator)) {
+		fprintf(stderr, "sim: sector timer fraction %u/%u is invalid\n", timer[6], timer[7]);
+		exit(2);
+	}
+
+	check_timing(dr);
+
+	sim_schedule(dr->rotation_start, sector_start, DRIVE_EVENT_ARG(drive_number(dr), 0));
+	sim_schedule(dr->rotation_start + timer[5], sector_interrupt, DRIVE_EVENT_ARG(drive_number(dr), 0));
+}
+
+/* Write datapath */
+
+static uint64_t write_coalesce_timeout(const struct sim_drive* dr) {
+	return dr->regs->write_datapath[4] >> 8;
+}
+
+static void write_irq_check(struct sim_drive* dr) {
+	volatile uint32_t* wd = dr->regs->write_datapath;
+	uint32_t waiting = dr->records_produced - dr->records_consumed;
+
+	if ((wd[0] & 0x4) && waiting &&
+		((waiting >= (wd[4] & 0xFF)) || (sim_time >= dr->records_waiting_since + write_coalesce_timeout(dr)))) {
+		sim_hw_stats.write_interrupts += 1;
+		raise_interrupt(dr->write_irq);
+	}
+}
+
+// Only the timeout scheduled by the latest write_records_wait() counts
+static void write_timeout(uint64_t arg) {
+	struct sim_drive* dr = EVENT_DRIVE(arg);
+	if (EVENT_VALUE(arg) == dr->records_waiting_since)
+		write_irq_check(dr);
+}
+
+// Records start waiting out the timeout afresh when the firmware takes some
+static void write_records_wait(struct sim_drive* dr) {
+	dr->records_waiting_since = sim_time;
+	sim_schedule(sim_time + write_coalesce_timeout(dr), write_timeout, DRIVE_EVENT_ARG(drive_number(dr), sim_time));
+}
+
+// The sector has passed under the head. What the controller wrote becomes the new contents
+// of the sector and goes to the DMA, and a record of where it was written to the ring. A
+// sector rewritten unchanged keeps its contents, unless it was never written before.
+static void write_sector_end(uint64_t arg) {
+	struct sim_drive* dr = EVENT_DRIVE(arg);
+	uint64_t sector = arg & 0xFFFFFFFF;
+	bool unchanged = (EVENT_VALUE(arg) >> 32) & 1;
+	volatile uint32_t* wd = dr->regs->write_datapath;
+
+	uint32_t* generation = generation_entry(dr, (sector >> 16) & 0xFFFF, (sector >> 8) & 0xFF, sector & 0xFF);
+	if (!unchanged || !*generation)
+		*generation += 1;
+	sector |= (uint64_t) *generation << 32;
+
+	sim_hw_stats.sectors_written += 1;
+	dr->regs->perf_counters[PERF_WRITTEN] += 1;
+
+	int next = (dr->write_queue_tail + 1) % WRITE_QUEUE_SIZE;
+	if (next == dr->write_queue_head) {
+		fprintf(stderr, "sim: write datapath backed up\n");
+		exit(2);
+	}
+	dr->write_queue[dr->write_queue_tail] = sector;
+	dr->write_queue_tail = next;
+	s2mm_issue(dr);
+
+	// The real datapath drops records when the ring is full, and the sector's data with them
+	if (dr->records_produced - dr->records_consumed == WRITE_RECORDS) {
+		fprintf(stderr, "sim: write completion records not taken\n");
+		exit(2);
+	}
+	int record = WRITE_RECORDS_BASE + (2 * (dr->records_produced % WRITE_RECORDS));
+	wd[record] = (1u << 31) | (((sector >> 8) & 0xF) << 24) | (((sector >> 16) & 0xFFFF) << 8) | (sector & 0xFF);
+	wd[record + 1] = (uint32_t) sim_time;
+	if (dr->records_produced == dr->records_consumed)
+		write_records_wait(dr);
+	dr->records_produced += 1;
+	wd[2] = dr->records_produced;
+
+	write_irq_check(dr);
+}
+
+// Pick up the firmware taking records or turning the interrupt on
+static void write_datapath_poll(struct sim_drive* dr) {
+	volatile uint32_t* wd = dr->regs->write_datapath;
+	bool enabled = (wd[0] & 0x4) != 0;
+	bool check = enabled && !dr->write_irq_enabled;
+
+	dr->write_irq_enabled = enabled;
+	if (wd[5] != dr->records_consumed) {
+		dr->records_consumed = wd[5];
+		if (dr->records_produced != dr->records_consumed)
+			write_records_wait(dr);
+		check = true;
+	}
+	if (check)
+		write_irq_check(dr);
+}
+
+uint64_t sim_write_sector(int sector, uint64_t not_before, bool unchanged) {
+	struct sim_drive* dr = selected_drive();
+
+	dr->writes_in_flight += 1;
+
+	uint64_t end = sector_time(dr, sector_start_index(dr, sector, not_before) + 1);
+	sim_schedule(end + SIM_US(WRITE_RECORD_DELAY_US), write_sector_end,
+				 DRIVE_EVENT_ARG(drive_number(dr), pack_sector(dr->cylinder, controller_head, sector, unchanged)));
+	return end;
+}
+
+/* Controller interface */
+
+bool sim_writes_pending(void) {
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		if (drives[i].writes_in_flight || (drives[i].records_produced != drives[i].records_consumed))
+			return true;
+	}
+	return false;
+}
+
+void sim_select_drive(int select_code) {
+	drive_select = select_code;
+	sim_drive_select_gpio[0] = select_code;
+	gpio_interrupt_pending[XPAR_GPIO_DRIVE_SELECT_DEVICE_ID] = true;
+	raise_interrupt(XPAR_FABRIC_GPIO_DRIVE_SELECT_IP2INTC_IRPT_INTR);
+}
+
+void sim_select_head(int head) {
+	if (head != controller_head) {
+		for (int i = 0; i < SIM_NUM_DRIVES; i++)
+			drives[i].regs->perf_counters[PERF_HEAD_CHANGES] += 1;
+	}
+	controller_head = head;
+	sim_head_select_gpio[0] = head;
+	gpio_interrupt_pending[XPAR_GPIO_HEAD_SELECT_DEVICE_ID] = true;
+	raise_interrupt(XPAR_FABRIC_GPIO_HEAD_SELECT_IP2INTC_IRPT_INTR);
+}
+
+static uint16_t hardware_response;
+static bool hardware_responded;
+
+void sim_issue_command(uint16_t command) {
+	struct sim_drive* dr = selected_drive();
+	volatile uint32_t* cmd = dr->regs->command_interface;
+	int code = (command >> 12) & 0xF;
+	int modifier = (command >> 8) & 0xF;
+	int subscript = command & 0xFF;
+
+	if (code == 0x0) {
+		dr->cylinder = command & 0x0FFF;
+		dr->regs->perf_counters[PERF_SEEKS] += 1;
+	}
+
+	// Status and configuration queries are answered by the command interface itself once the
+	// firmware has set it to, from the status word and configuration table it loaded
+	hardware_responded = (cmd[0] & 0x10) && ((code == 0x2) || ((code == 0x3) && ((modifier != 0) || (subscript < 32))));
+	if (hardware_responded) {
+		if (code == 0x2)
+			hardware_response = cmd[5];
+		else
+			hardware_response = cmd[64 + ((modifier == 0) ? subscript : 32 + modifier)];
+		cmd[6] += 1;
+		sim_hw_stats.queries_answered += 1;
+		return;
+	}
+
+	cmd[2] = command;
+	cmd[3] = 1;
+	cmd[1] |= 0x2 | 0x4;
+	raise_interrupt(dr->command_irq);
+}
+
+bool sim_command_pending(void) {
+	return command_pending(selected_drive());
+}
+
+uint16_t sim_command_response(void) {
+	return hardware_responded ? hardware_response : selected_drive()->regs->command_interface[2];
+}
+
+/* Second core */
+
+static ucontext_t first_core_context;
+static ucontext_t second_core_context;
+static bool (*second_core_poll)(void);
+static bool running_second_core = false;
+static bool second_core_asleep = false;			// Waiting for an event from the first core
+static uint64_t second_core_resume = UINT64_MAX;	// When it can run again, if not asleep
+
+static bool on_second_core(void) {
+	return running_second_core;
+}
+
+static bool second_core_runnable(void) {
+	return !second_core_asleep && (second_core_resume <= sim_time);
+}
+
+static void second_core_loop(void) {
+	while (1) {
+		if (!second_core_poll()) {
+			second_core_asleep = true;
+			swapcontext(&second_core_context, &first_core_context);
+		}
+	}
+}
+
+// The resume time has come. sim_poll, which is always called after an event, switches to it.
+static void second_core_timer(uint64_t arg) {
+}
+
+static void second_core_wait(uint64_t counts) {
+	second_core_resume = sim_time + counts;
+	sim_schedule(second_core_resume, second_core_timer, 0);
+	swapcontext(&second_core_context, &first_core_context);
+}
+
+static void second_core_run(void) {
+	if (!second_core_poll || running_second_core || !second_core_runnable())
+		return;
+
+	running_second_core = true;
+	swapcontext(&first_core_context, &second_core_context);
+	running_second_core = false;
+}
+
+void sim_start_second_core(bool (*poll)(void)) {
+	static void* stack;
+
+	stack = malloc(SECOND_CORE_STACK_SIZE);
+	if (!stack) {
+		fprintf(stderr, "sim: out of memory\n");
+		exit(2);
+	}
+
+	getcontext(&second_core_context);
+	second_core_context.uc_stack.ss_sp = stack;
+	second_core_context.uc_stack.ss_size = SECOND_CORE_STACK_SIZE;
+	second_core_context.uc_link = NULL;
+	makecontext(&second_core_context, second_core_loop, 0);
+
+	second_core_poll = poll;
+	second_core_resume = sim_time;
+}
+
+// sev
+void sim_second_core_wake(void) {
+	second_core_asleep = false;
+}
+
+bool sim_second_core_idle(void) {
+	return !second_core_poll || second_core_asleep;
+}
+
+/* Main loop */
+
+static uint64_t last_yield = UINT64_MAX;
+
+// If nothing the firmware did on this pass took any time it is just spinning, so skip
+// straight to whatever happens next, unless the second core has something to do now
+void sim_main_loop_yield(void) {
+	if ((sim_time == last_yield) && second_core_poll && second_core_runnable()) {
+		sim_poll();
+	} else if (sim_time == last_yield) {
+		if (!sim_step()) {
+			fprintf(stderr, "sim: firmware is idle and nothing is scheduled\n");
+			exit(2);
+		}
+	} else {
+		sim_poll();
+	}
+	last_yield = sim_time;
+
+	if (sim_main_loop_hook)
+		sim_main_loop_hook();
+}
+
+static void hardware_poll(void) {
+	perf_poll();
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		if (!drives[i].present)
+			continue;
+		s2mm_poll(&drives[i]);
+		write_datapath_poll(&drives[i]);
+		rotation_poll(&drives[i]);
+		sequencer_poll(&drives[i]);
+	}
+}
+
+void sim_poll(void) {
+	static bool polling = false;
+
+	if (polling)
+		return;
+	polling = true;
+
+	hardware_poll();
+	second_core_run();
+
+	// The benchmark drives the controller from here, and the interrupts that raises can have
+	// the firmware write registers the model has already looked at on this pass
+	if (sim_poll_hook) {
+		sim_poll_hook();
+		hardware_poll();
+	}
+
+	polling = false;
+}
+
+// The firmware spins waiting for the DMA soft reset to finish, without calling anything that
+// could advance time. Stand in for each drive's DMA clearing the reset bit.
+static void* dma_reset_thread(void* arg) {
+	int resets_left = 0;
+	for (int i = 0; i < SIM_NUM_DRIVES; i++)
+		resets_left += drives[i].present;
+
+	while (resets_left) {
+		for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+			struct sim_drive* dr = &drives[i];
+			volatile uint32_t* dma = dr->regs->dma;
+			if (!dr->dma_reset_done && ((dma[0x00 >> 2] & 0x4) || (dma[0x30 >> 2] & 0x4))) {
+				dma[0x00 >> 2] = 0;
+				dma[0x30 >> 2] = 0;
+				dr->dma_reset_done = true;
+				resets_left -= 1;
+			}
+		}
+		sched_yield();
+	}
+	return NULL;
+}
+
+void sim_hw_init(const struct sim_geometry* const geometry[SIM_NUM_DRIVES]) {
+	for (int i = 0; i < SIM_NUM_DRIVES; i++) {
+		struct sim_drive* dr = &drives[i];
+		if (!geometry[i])
+			continue;
+
+		dr->present = true;
+		dr->geometry = *geometry[i];
+		dr->sector_generation = calloc((size_t) dr->geometry.cylinders * dr->geometry.heads * dr->geometry.sectors_per_track, sizeof(uint32_t));
+		if (!dr->sector_generation) {
+			fprintf(stderr, "sim: out of memory\n");
+			exit(2);
+		}
+		dr->sequencer_silent = true;
+
+		perf_clear(dr);
+	}
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, dma_reset_thread, NULL);
+	pthread_detach(thread);
+}
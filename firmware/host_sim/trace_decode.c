@@ -0,0 +1,251 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Decoder for the binary trace the firmware writes to TRACE.BIN (see trace.h).
+//
+// Prints every record with the same formatting the firmware uses on the UART, annotating the
+// ones which end an interval with how long it took, then a summary of each interval. Intervals
+// are followed separately for each drive, and the summary covers both.
+//   seek          seek command to command complete
+//   seek-read     seek command to the read datapath streaming again
+//   head-read     head select to the read datapath streaming again
+//   load          start of a cylinder load to the slot being mapped
+//   write-back    start to end of writing back a slot
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_FORMAT(name, format)	format,
+static const char* const trace_formats[NUM_TRACE_EVENTS] = {
+	TRACE_EVENTS(TRACE_FORMAT)
+};
+
+enum interval {
+	SEEK,
+	SEEK_READ,
+	HEAD_READ,
+	LOAD,
+	WRITE_BACK,
+	NUM_INTERVALS
+};
+
+static const char* const interval_names[NUM_INTERVALS] = {
+	"seek", "seek-read", "head-read", "load", "write-back",
+};
+
+struct samples {
+	double* us;
+	int count;
+	int size;
+};
+
+#define MAX_CYLINDERS	4096
+#define MAX_DRIVES		2
+
+// Start of each interval in progress on a drive, zero if there is none
+struct drive_intervals {
+	uint64_t seek_start;
+	uint64_t read_start;
+	enum interval read_interval;
+	uint64_t load_start[MAX_CYLINDERS];		// Loads can overlap, so keep one per cylinder
+	uint64_t write_back_start;
+};
+
+static struct samples samples[NUM_INTERVALS];
+static double counts_per_us;
+
+static void add_sample(enum interval i, double us) {
+	struct samples* s = &samples[i];
+	if (s->count == s->size) {
+		s->size = s->size ? (s->size * 2) : 256;
+		s->us = realloc(s->us, s->size * sizeof(double));
+		if (!s->us) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+	}
+	s->us[s->count++] = us;
+}
+
+static int compare_double(const void* a, const void* b) {
+	double x = *(const double*) a, y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static void print_summary(void) {
+	printf("%-12s %7s %10s %10s %10s %10s\n", "interval", "count", "avg_us", "p50_us", "p99_us", "max_us");
+	for (int i = 0; i < NUM_INTERVALS; i++) {
+		struct samples* s = &samples[i];
+		if (!s->count) {
+			printf("%-12s %7d\n", interval_names[i], 0);
+			continue;
+		}
+
+		double total = 0;
+		for (int j = 0; j < s->count; j++)
+			total += s->us[j];
+		qsort(s->us, s->count, sizeof(double), compare_double);
+
+		printf("%-12s %7d %10.0f %10.0f %10.0f %10.0f\n", interval_names[i], s->count, total / s->count,
+			   s->us[s->count / 2], s->us[(s->count * 99) / 100], s->us[s->count - 1]);
+	}
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "usage: %s [-s] TRACE.BIN\n", program);
+	fprintf(stderr, "  -s  only print the interval summary\n");
+}
+
+int main(int argc, char* argv[]) {
+	bool summary_only = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "sh")) != -1) {
+		switch (opt) {
+		case 's':
+			summary_only = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	FILE* f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 2;
+	}
+
+	struct trace_file_header header;
+	if ((fread(&header, sizeof(header), 1, f) != 1) || memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) ||
+		(header.record_size != sizeof(struct trace_record)) || (header.counts_per_second < 1000000)) {
+		fprintf(stderr, "%s: not a trace file from this version of the firmware\n", argv[optind]);
+		return 1;
+	}
+	counts_per_us = header.counts_per_second / 1000000.0;
+
+	static struct drive_intervals drives[MAX_DRIVES];
+
+	struct trace_record r;
+	long records = 0;
+	long dropped = 0;
+
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		records += 1;
+
+		if (r.type >= NUM_TRACE_EVENTS) {
+			fprintf(stderr, "%s: record %ld has unknown type %d\n", argv[optind], records, r.type);
+			return 1;
+		}
+
+		double elapsed = -1;
+
+		if (r.type == TRACE_DROPPED) {
+			dropped += r.arg[0];
+			// Anything in progress may have lost its end
+			memset(drives, 0, sizeof(drives));
+		}
+
+		if (r.drive < MAX_DRIVES) {
+			struct drive_intervals* d = &drives[r.drive];
+
+			switch (r.type) {
+			case TRACE_SEEK:
+				d->seek_start = r.time;
+				d->read_start = r.time;
+				d->read_interval = SEEK_READ;
+				break;
+			case TRACE_HEAD_SELECT:
+				if (!d->read_start || (d->read_interval != SEEK_READ)) {
+					d->read_start = r.time;
+					d->read_interval = HEAD_READ;
+				}
+				break;
+			case TRACE_SEEK_COMPLETE:
+				if (d->seek_start) {
+					elapsed = (r.time - d->seek_start) / counts_per_us;
+					add_sample(SEEK, elapsed);
+					d->seek_start = 0;
+				}
+				break;
+			case TRACE_READ_RELEASE:
+				if (d->read_start) {
+					elapsed = (r.time - d->read_start) / counts_per_us;
+					add_sample(d->read_interval, elapsed);
+					d->read_start = 0;
+				}
+				break;
+			case TRACE_LOAD_START:
+				if ((unsigned) r.arg[0] < MAX_CYLINDERS)
+					d->load_start[r.arg[0]] = r.time;
+				break;
+			case TRACE_SLOT_LOAD:
+			case TRACE_SLOT_PREFETCH:
+				if (((unsigned) r.arg[2] < MAX_CYLINDERS) && d->load_start[r.arg[2]]) {
+					elapsed = (r.time - d->load_start[r.arg[2]]) / counts_per_us;
+					add_sample(LOAD, elapsed);
+					d->load_start[r.arg[2]] = 0;
+				}
+				break;
+			case TRACE_WRITE_BACK_START:
+				d->write_back_start = r.time;
+				break;
+			case TRACE_WRITE_BACK:
+				if (d->write_back_start) {
+					elapsed = (r.time - d->write_back_start) / counts_per_us;
+					add_sample(WRITE_BACK, elapsed);
+					d->write_back_start = 0;
+				}
+				break;
+			}
+		}
+
+		if (summary_only)
+			continue;
+
+		uint64_t us = r.time / counts_per_us;
+		printf("[%5d.%06d] ", (int) (us / 1000000), (int) (us % 1000000));
+		if (r.drive != TRACE_NO_DRIVE)
+			printf("%c: ", 'A' + r.drive);
+		printf(trace_formats[r.type], r.arg[0], r.arg[1], r.arg[2]);
+		if (elapsed >= 0)
+			printf("  (+%.0f us)", elapsed);
+		printf("\n");
+	}
+
+	fclose(f);
+
+	if (!summary_only)
+		printf("\n");
+	printf("%ld records, %ld dropped\n", records, dropped);
+	print_summary();
+
+	return 0;
+}
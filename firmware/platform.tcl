@@ -21,6 +21,8 @@ domain active {standalone_domain}
 bsp reload
 platform generate
 bsp setlib -name xilffs -ver 5.0
+bsp config use_lfn 1
+bsp config enable_exfat true
 bsp write
 bsp reload
 catch {bsp regenerate}
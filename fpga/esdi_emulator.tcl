@@ -28,12 +28,13 @@
 # 3. The following remote source files that were added to the original project:-
 #
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/sector_timer.v"
-#    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/unlabeler.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/labeler.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/fifo_registered.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/write_datapath.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/read_datapath.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/axi_esdi_cmd_slave.v"
+#    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/perf_counters.v"
+#    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/track_sequencer.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/top.v"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/constraints/zcu104.xdc"
 #    "C:/Users/chris.simmons/repos/emu2/fpga/hdl/tb/write_datapath_tb.v"
@@ -47,12 +48,13 @@ proc checkRequiredFiles { origin_dir} {
   set status true
   set files [list \
  "[file normalize "$origin_dir/hdl/sector_timer.v"]"\
- "[file normalize "$origin_dir/hdl/unlabeler.v"]"\
  "[file normalize "$origin_dir/hdl/labeler.v"]"\
  "[file normalize "$origin_dir/hdl/fifo_registered.v"]"\
  "[file normalize "$origin_dir/hdl/write_datapath.v"]"\
  "[file normalize "$origin_dir/hdl/read_datapath.v"]"\
  "[file normalize "$origin_dir/hdl/axi_esdi_cmd_slave.v"]"\
+ "[file normalize "$origin_dir/hdl/perf_counters.v"]"\
+ "[file normalize "$origin_dir/hdl/track_sequencer.v"]"\
  "[file normalize "$origin_dir/hdl/top.v"]"\
  "[file normalize "$origin_dir/constraints/zcu104.xdc"]"\
  "[file normalize "$origin_dir/hdl/tb/write_datapath_tb.v"]"\
@@ -191,12 +193,13 @@ if {[string equal [get_filesets -quiet sources_1] ""]} {
 set obj [get_filesets sources_1]
 set files [list \
  [file normalize "${origin_dir}/hdl/sector_timer.v"] \
- [file normalize "${origin_dir}/hdl/unlabeler.v"] \
  [file normalize "${origin_dir}/hdl/labeler.v"] \
  [file normalize "${origin_dir}/hdl/fifo_registered.v"] \
  [file normalize "${origin_dir}/hdl/write_datapath.v"] \
  [file normalize "${origin_dir}/hdl/read_datapath.v"] \
  [file normalize "${origin_dir}/hdl/axi_esdi_cmd_slave.v"] \
+ [file normalize "${origin_dir}/hdl/perf_counters.v"] \
+ [file normalize "${origin_dir}/hdl/track_sequencer.v"] \
  [file normalize "${origin_dir}/hdl/top.v"] \
 ]
 add_files -norecurse -fileset $obj $files
@@ -270,9 +273,6 @@ set obj [get_filesets utils_1]
 if { [get_files sector_timer.v] == "" } {
   import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/sector_timer.v
 }
-if { [get_files unlabeler.v] == "" } {
-  import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/unlabeler.v
-}
 if { [get_files labeler.v] == "" } {
   import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/labeler.v
 }
@@ -288,13 +288,20 @@ if { [get_files read_datapath.v] == "" } {
 if { [get_files axi_esdi_cmd_slave.v] == "" } {
   import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/axi_esdi_cmd_slave.v
 }
+if { [get_files perf_counters.v] == "" } {
+  import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/perf_counters.v
+}
+if { [get_files track_sequencer.v] == "" } {
+  import_files -quiet -fileset sources_1 C:/Users/chris.simmons/repos/emu2/fpga/hdl/track_sequencer.v
+}
 
 
 # Proc to create BD design_1
 proc cr_bd_design_1 { parentCell } {
 # The design that will be created by this Tcl proc contains the following 
 # module references:
-# unlabeler, labeler, axi_esdi_cmd_controller, sector_timer, write_datapath, read_datapath
+# labeler, axi_esdi_cmd_controller, sector_timer, write_datapath, read_datapath, perf_counters, track_sequencer
+# Each of them, with its DMA and FIFO, is instantiated once per emulated drive (_0 for A, _1 for B).
 
 
 
@@ -347,12 +354,13 @@ proc cr_bd_design_1 { parentCell } {
   set bCheckModules 1
   if { $bCheckModules == 1 } {
      set list_check_mods "\ 
-  unlabeler\
   labeler\
   axi_esdi_cmd_controller\
   sector_timer\
   write_datapath\
   read_datapath\
+  perf_counters\
+  track_sequencer\
   "
 
    set list_mods_missing ""
@@ -424,6 +432,20 @@ proc cr_bd_design_1 { parentCell } {
   set esdi_write_data [ create_bd_port -dir I esdi_write_data ]
   set esdi_write_clock [ create_bd_port -dir I -type clk esdi_write_clock ]
   set esdi_write_gate [ create_bd_port -dir I esdi_write_gate ]
+  set esdi_transfer_ack_b [ create_bd_port -dir O esdi_transfer_ack_b ]
+  set esdi_confstat_data_b [ create_bd_port -dir O esdi_confstat_data_b ]
+  set esdi_command_complete_b [ create_bd_port -dir O esdi_command_complete_b ]
+  set esdi_attention_b [ create_bd_port -dir O esdi_attention_b ]
+  set esdi_ready_b [ create_bd_port -dir O esdi_ready_b ]
+  set esdi_drive_selected_b [ create_bd_port -dir O esdi_drive_selected_b ]
+  set esdi_index_b [ create_bd_port -dir O esdi_index_b ]
+  set esdi_sector_b [ create_bd_port -dir O esdi_sector_b ]
+  set esdi_read_data_b [ create_bd_port -dir O esdi_read_data_b ]
+  set esdi_read_clock_b [ create_bd_port -dir O -type clk esdi_read_clock_b ]
+  set esdi_read_gate_b [ create_bd_port -dir I esdi_read_gate_b ]
+  set esdi_write_data_b [ create_bd_port -dir I esdi_write_data_b ]
+  set esdi_write_clock_b [ create_bd_port -dir I -type clk esdi_write_clock_b ]
+  set esdi_write_gate_b [ create_bd_port -dir I esdi_write_gate_b ]
 
   # Create instance: gpio_drive_select, and set properties
   set gpio_drive_select [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_gpio:2.0 gpio_drive_select ]
@@ -724,6 +746,7 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
     CONFIG.PSU__USB__RESET__MODE {Boot Pin} \
     CONFIG.PSU__USB__RESET__POLARITY {Active Low} \
     CONFIG.PSU__USE__IRQ0 {1} \
+    CONFIG.PSU__USE__IRQ1 {1} \
     CONFIG.PSU__USE__M_AXI_GP0 {1} \
     CONFIG.PSU__USE__M_AXI_GP1 {0} \
     CONFIG.PSU__USE__M_AXI_GP2 {0} \
@@ -734,8 +757,8 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   # Create instance: ps8_0_axi_periph, and set properties
   set ps8_0_axi_periph [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_interconnect:2.1 ps8_0_axi_periph ]
   set_property -dict [list \
-    CONFIG.NUM_MI {8} \
-    CONFIG.NUM_SI {2} \
+    CONFIG.NUM_MI {17} \
+    CONFIG.NUM_SI {3} \
   ] $ps8_0_axi_periph
 
 
@@ -744,31 +767,41 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
 
   # Create instance: xlconcat_0, and set properties
   set xlconcat_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:xlconcat:2.1 xlconcat_0 ]
-  set_property CONFIG.NUM_PORTS {7} $xlconcat_0
+  set_property CONFIG.NUM_PORTS {8} $xlconcat_0
 
 
-  # Create instance: axis_data_fifo_0, and set properties
-  set axis_data_fifo_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axis_data_fifo:2.0 axis_data_fifo_0 ]
-  set_property CONFIG.FIFO_DEPTH {4096} $axis_data_fifo_0
+  # Create instance: xlconcat_1, and set properties
+  set xlconcat_1 [ create_bd_cell -type ip -vlnv xilinx.com:ip:xlconcat:2.1 xlconcat_1 ]
+  set_property CONFIG.NUM_PORTS {4} $xlconcat_1
 
 
   # Create instance: axi_dma_0, and set properties
   set axi_dma_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_dma:7.1 axi_dma_0 ]
   set_property -dict [list \
+    CONFIG.c_include_mm2s {0} \
     CONFIG.c_include_s2mm {1} \
-    CONFIG.c_m_axi_mm2s_data_width {128} \
     CONFIG.c_m_axi_s2mm_data_width {128} \
-    CONFIG.c_m_axis_mm2s_tdata_width {8} \
-    CONFIG.c_mm2s_burst_size {64} \
     CONFIG.c_s2mm_burst_size {64} \
     CONFIG.c_s_axis_s2mm_tdata_width {8} \
     CONFIG.c_sg_include_stscntrl_strm {0} \
   ] $axi_dma_0
 
 
+  # Create instance: axi_dma_1, and set properties
+  set axi_dma_1 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_dma:7.1 axi_dma_1 ]
+  set_property -dict [list \
+    CONFIG.c_include_mm2s {0} \
+    CONFIG.c_include_s2mm {1} \
+    CONFIG.c_m_axi_s2mm_data_width {128} \
+    CONFIG.c_s2mm_burst_size {64} \
+    CONFIG.c_s_axis_s2mm_tdata_width {8} \
+    CONFIG.c_sg_include_stscntrl_strm {0} \
+  ] $axi_dma_1
+
+
   # Create instance: smartconnect_0, and set properties
   set smartconnect_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:smartconnect:1.0 smartconnect_0 ]
-  set_property CONFIG.NUM_SI {2} $smartconnect_0
+  set_property CONFIG.NUM_SI {4} $smartconnect_0
 
 
   # Create instance: axcache_coherent, and set properties
@@ -787,17 +820,6 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   ] $axprot_unsecure
 
 
-  # Create instance: unlabeler_0, and set properties
-  set block_name unlabeler
-  set block_cell_name unlabeler_0
-  if { [catch {set unlabeler_0 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
-     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
-     return 1
-   } elseif { $unlabeler_0 eq "" } {
-     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
-     return 1
-   }
-  
   # Create instance: labeler_0, and set properties
   set block_name labeler
   set block_cell_name labeler_0
@@ -868,14 +890,115 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
      return 1
    }
   
+  # Create instance: perf_counters_0, and set properties
+  set block_name perf_counters
+  set block_cell_name perf_counters_0
+  if { [catch {set perf_counters_0 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $perf_counters_0 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: track_sequencer_0, and set properties
+  set block_name track_sequencer
+  set block_cell_name track_sequencer_0
+  if { [catch {set track_sequencer_0 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $track_sequencer_0 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: labeler_1, and set properties
+  set block_name labeler
+  set block_cell_name labeler_1
+  if { [catch {set labeler_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $labeler_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: axis_data_fifo_2, and set properties
+  set axis_data_fifo_2 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axis_data_fifo:2.0 axis_data_fifo_2 ]
+  set_property CONFIG.FIFO_DEPTH {4096} $axis_data_fifo_2
+
+
+  # Create instance: axi_esdi_cmd_control_1, and set properties
+  set block_name axi_esdi_cmd_controller
+  set block_cell_name axi_esdi_cmd_control_1
+  if { [catch {set axi_esdi_cmd_control_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $axi_esdi_cmd_control_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: sector_timer_1, and set properties
+  set block_name sector_timer
+  set block_cell_name sector_timer_1
+  if { [catch {set sector_timer_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $sector_timer_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: write_datapath_1, and set properties
+  set block_name write_datapath
+  set block_cell_name write_datapath_1
+  if { [catch {set write_datapath_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $write_datapath_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: read_datapath_1, and set properties
+  set block_name read_datapath
+  set block_cell_name read_datapath_1
+  if { [catch {set read_datapath_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $read_datapath_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: perf_counters_1, and set properties
+  set block_name perf_counters
+  set block_cell_name perf_counters_1
+  if { [catch {set perf_counters_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $perf_counters_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
+  # Create instance: track_sequencer_1, and set properties
+  set block_name track_sequencer
+  set block_cell_name track_sequencer_1
+  if { [catch {set track_sequencer_1 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $track_sequencer_1 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
   # Create interface connections
   connect_bd_intf_net -intf_net axi_bram_ctrl_0_BRAM_PORTA [get_bd_intf_pins axi_bram_ctrl_0_bram/BRAM_PORTA] [get_bd_intf_pins axi_bram_ctrl_0/BRAM_PORTA]
   connect_bd_intf_net -intf_net axi_bram_ctrl_0_BRAM_PORTB [get_bd_intf_pins axi_bram_ctrl_0_bram/BRAM_PORTB] [get_bd_intf_pins axi_bram_ctrl_0/BRAM_PORTB]
-  connect_bd_intf_net -intf_net axi_dma_0_M_AXIS_MM2S [get_bd_intf_pins axi_dma_0/M_AXIS_MM2S] [get_bd_intf_pins axis_data_fifo_0/S_AXIS]
-  connect_bd_intf_net -intf_net axi_dma_0_M_AXI_MM2S [get_bd_intf_pins axi_dma_0/M_AXI_MM2S] [get_bd_intf_pins smartconnect_0/S01_AXI]
   connect_bd_intf_net -intf_net axi_dma_0_M_AXI_S2MM [get_bd_intf_pins smartconnect_0/S00_AXI] [get_bd_intf_pins axi_dma_0/M_AXI_S2MM]
   connect_bd_intf_net -intf_net axi_dma_0_M_AXI_SG [get_bd_intf_pins axi_dma_0/M_AXI_SG] [get_bd_intf_pins ps8_0_axi_periph/S01_AXI]
-  connect_bd_intf_net -intf_net axis_data_fifo_0_M_AXIS [get_bd_intf_pins axis_data_fifo_0/M_AXIS] [get_bd_intf_pins unlabeler_0/in]
   connect_bd_intf_net -intf_net axis_data_fifo_1_M_AXIS [get_bd_intf_pins axis_data_fifo_1/M_AXIS] [get_bd_intf_pins labeler_0/in]
   connect_bd_intf_net -intf_net labeler_0_out [get_bd_intf_pins labeler_0/out] [get_bd_intf_pins axi_dma_0/S_AXIS_S2MM]
   connect_bd_intf_net -intf_net ps8_0_axi_periph_M00_AXI [get_bd_intf_pins ps8_0_axi_periph/M00_AXI] [get_bd_intf_pins axi_esdi_cmd_control_0/csr]
@@ -886,14 +1009,30 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   connect_bd_intf_net -intf_net ps8_0_axi_periph_M05_AXI [get_bd_intf_pins axi_dma_0/S_AXI_LITE] [get_bd_intf_pins ps8_0_axi_periph/M05_AXI]
   connect_bd_intf_net -intf_net ps8_0_axi_periph_M06_AXI [get_bd_intf_pins ps8_0_axi_periph/M06_AXI] [get_bd_intf_pins write_datapath_0/csr]
   connect_bd_intf_net -intf_net ps8_0_axi_periph_M09_AXI [get_bd_intf_pins ps8_0_axi_periph/M07_AXI] [get_bd_intf_pins axi_bram_ctrl_0/S_AXI]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M08_AXI [get_bd_intf_pins ps8_0_axi_periph/M08_AXI] [get_bd_intf_pins perf_counters_0/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M10_AXI [get_bd_intf_pins ps8_0_axi_periph/M09_AXI] [get_bd_intf_pins track_sequencer_0/csr]
   connect_bd_intf_net -intf_net smartconnect_0_M00_AXI [get_bd_intf_pins smartconnect_0/M00_AXI] [get_bd_intf_pins zynq_ultra_ps_e_0/S_AXI_HPC0_FPD]
-  connect_bd_intf_net -intf_net unlabeler_0_out [get_bd_intf_pins unlabeler_0/out] [get_bd_intf_pins read_datapath_0/parallel]
+  connect_bd_intf_net -intf_net track_sequencer_0_m_axi [get_bd_intf_pins track_sequencer_0/m_axi] [get_bd_intf_pins smartconnect_0/S01_AXI]
+  connect_bd_intf_net -intf_net track_sequencer_0_parallel [get_bd_intf_pins track_sequencer_0/parallel] [get_bd_intf_pins read_datapath_0/parallel]
   connect_bd_intf_net -intf_net write_datapath_0_parallel [get_bd_intf_pins write_datapath_0/parallel] [get_bd_intf_pins axis_data_fifo_1/S_AXIS]
+  connect_bd_intf_net -intf_net axi_dma_1_M_AXI_S2MM [get_bd_intf_pins smartconnect_0/S02_AXI] [get_bd_intf_pins axi_dma_1/M_AXI_S2MM]
+  connect_bd_intf_net -intf_net axi_dma_1_M_AXI_SG [get_bd_intf_pins axi_dma_1/M_AXI_SG] [get_bd_intf_pins ps8_0_axi_periph/S02_AXI]
+  connect_bd_intf_net -intf_net axis_data_fifo_2_M_AXIS [get_bd_intf_pins axis_data_fifo_2/M_AXIS] [get_bd_intf_pins labeler_1/in]
+  connect_bd_intf_net -intf_net labeler_1_out [get_bd_intf_pins labeler_1/out] [get_bd_intf_pins axi_dma_1/S_AXIS_S2MM]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M10_AXI_1 [get_bd_intf_pins ps8_0_axi_periph/M10_AXI] [get_bd_intf_pins axi_esdi_cmd_control_1/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M11_AXI [get_bd_intf_pins ps8_0_axi_periph/M11_AXI] [get_bd_intf_pins sector_timer_1/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M12_AXI [get_bd_intf_pins ps8_0_axi_periph/M12_AXI] [get_bd_intf_pins read_datapath_1/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M13_AXI [get_bd_intf_pins axi_dma_1/S_AXI_LITE] [get_bd_intf_pins ps8_0_axi_periph/M13_AXI]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M14_AXI [get_bd_intf_pins ps8_0_axi_periph/M14_AXI] [get_bd_intf_pins write_datapath_1/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M15_AXI [get_bd_intf_pins ps8_0_axi_periph/M15_AXI] [get_bd_intf_pins perf_counters_1/csr]
+  connect_bd_intf_net -intf_net ps8_0_axi_periph_M16_AXI [get_bd_intf_pins ps8_0_axi_periph/M16_AXI] [get_bd_intf_pins track_sequencer_1/csr]
+  connect_bd_intf_net -intf_net track_sequencer_1_m_axi [get_bd_intf_pins track_sequencer_1/m_axi] [get_bd_intf_pins smartconnect_0/S03_AXI]
+  connect_bd_intf_net -intf_net track_sequencer_1_parallel [get_bd_intf_pins track_sequencer_1/parallel] [get_bd_intf_pins read_datapath_1/parallel]
+  connect_bd_intf_net -intf_net write_datapath_1_parallel [get_bd_intf_pins write_datapath_1/parallel] [get_bd_intf_pins axis_data_fifo_2/S_AXIS]
   connect_bd_intf_net -intf_net zynq_ultra_ps_e_0_M_AXI_HPM0_FPD [get_bd_intf_pins zynq_ultra_ps_e_0/M_AXI_HPM0_FPD] [get_bd_intf_pins ps8_0_axi_periph/S00_AXI]
 
   # Create port connections
   connect_bd_net -net axcache_coherent_dout [get_bd_pins axcache_coherent/dout] [get_bd_pins zynq_ultra_ps_e_0/saxigp0_awcache] [get_bd_pins zynq_ultra_ps_e_0/saxigp0_arcache]
-  connect_bd_net -net axi_dma_0_mm2s_introut [get_bd_pins axi_dma_0/mm2s_introut] [get_bd_pins xlconcat_0/In3]
   connect_bd_net -net axi_dma_0_s2mm_introut [get_bd_pins axi_dma_0/s2mm_introut] [get_bd_pins xlconcat_0/In5]
   connect_bd_net -net axi_esdi_cmd_control_0_esdi_attention [get_bd_pins axi_esdi_cmd_control_0/esdi_attention] [get_bd_ports esdi_attention]
   connect_bd_net -net axi_esdi_cmd_control_0_esdi_command_complete [get_bd_pins axi_esdi_cmd_control_0/esdi_command_complete] [get_bd_ports esdi_command_complete]
@@ -902,30 +1041,79 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   connect_bd_net -net axi_esdi_cmd_control_0_esdi_ready [get_bd_pins axi_esdi_cmd_control_0/esdi_ready] [get_bd_ports esdi_ready]
   connect_bd_net -net axi_esdi_cmd_control_0_esdi_transfer_ack [get_bd_pins axi_esdi_cmd_control_0/esdi_transfer_ack] [get_bd_ports esdi_transfer_ack]
   connect_bd_net -net axi_esdi_cmd_control_0_interrupt [get_bd_pins axi_esdi_cmd_control_0/interrupt] [get_bd_pins xlconcat_0/In0]
+  connect_bd_net -net axi_esdi_cmd_control_0_stat_seek [get_bd_pins axi_esdi_cmd_control_0/stat_seek] [get_bd_pins perf_counters_0/seek]
   connect_bd_net -net axprot_unsecure_dout [get_bd_pins axprot_unsecure/dout] [get_bd_pins zynq_ultra_ps_e_0/saxigp0_awprot] [get_bd_pins zynq_ultra_ps_e_0/saxigp0_arprot]
-  connect_bd_net -net esdi_command_data_0_1 [get_bd_ports esdi_command_data] [get_bd_pins axi_esdi_cmd_control_0/esdi_command_data]
+  connect_bd_net -net esdi_command_data_0_1 [get_bd_ports esdi_command_data] [get_bd_pins axi_esdi_cmd_control_0/esdi_command_data] [get_bd_pins axi_esdi_cmd_control_1/esdi_command_data]
   connect_bd_net -net esdi_read_gate_0_1 [get_bd_ports esdi_read_gate] [get_bd_pins read_datapath_0/esdi_read_gate]
-  connect_bd_net -net esdi_transfer_req_0_1 [get_bd_ports esdi_transfer_req] [get_bd_pins axi_esdi_cmd_control_0/esdi_transfer_req]
+  connect_bd_net -net esdi_transfer_req_0_1 [get_bd_ports esdi_transfer_req] [get_bd_pins axi_esdi_cmd_control_0/esdi_transfer_req] [get_bd_pins axi_esdi_cmd_control_1/esdi_transfer_req]
   connect_bd_net -net esdi_write_clock_0_1 [get_bd_ports esdi_write_clock] [get_bd_pins write_datapath_0/esdi_write_clock]
   connect_bd_net -net esdi_write_data_0_1 [get_bd_ports esdi_write_data] [get_bd_pins write_datapath_0/esdi_write_data]
   connect_bd_net -net esdi_write_gate_0_1 [get_bd_ports esdi_write_gate] [get_bd_pins write_datapath_0/esdi_write_gate]
   connect_bd_net -net gpio_drive_select_ip2intc_irpt [get_bd_pins gpio_drive_select/ip2intc_irpt] [get_bd_pins xlconcat_0/In1]
   connect_bd_net -net gpio_head_select_ip2intc_irpt [get_bd_pins gpio_head_select/ip2intc_irpt] [get_bd_pins xlconcat_0/In2]
   connect_bd_net -net gpio_io_i_0_1 [get_bd_ports esdi_drive_select] [get_bd_pins gpio_drive_select/gpio_io_i]
-  connect_bd_net -net gpio_io_i_1_1 [get_bd_ports esdi_head_select] [get_bd_pins gpio_head_select/gpio_io_i]
+  connect_bd_net -net gpio_io_i_1_1 [get_bd_ports esdi_head_select] [get_bd_pins gpio_head_select/gpio_io_i] [get_bd_pins perf_counters_0/esdi_head_select] [get_bd_pins perf_counters_1/esdi_head_select]
   connect_bd_net -net read_datapath_0_esdi_read_clock [get_bd_pins read_datapath_0/esdi_read_clock] [get_bd_ports esdi_read_clock]
   connect_bd_net -net read_datapath_0_esdi_read_data [get_bd_pins read_datapath_0/esdi_read_data] [get_bd_ports esdi_read_data]
   connect_bd_net -net read_datapath_0_esdi_read_data_ungated [get_bd_pins read_datapath_0/esdi_read_data_ungated] [get_bd_pins write_datapath_0/esdi_read_data_ungated]
   connect_bd_net -net read_datapath_0_read_data_valid [get_bd_pins read_datapath_0/read_data_valid] [get_bd_pins write_datapath_0/read_data_valid]
-  connect_bd_net -net rst_ps8_0_100M_peripheral_aresetn [get_bd_pins rst_ps8_0_100M/peripheral_aresetn] [get_bd_pins ps8_0_axi_periph/S00_ARESETN] [get_bd_pins gpio_drive_select/s_axi_aresetn] [get_bd_pins gpio_head_select/s_axi_aresetn] [get_bd_pins ps8_0_axi_periph/M00_ARESETN] [get_bd_pins ps8_0_axi_periph/ARESETN] [get_bd_pins ps8_0_axi_periph/M01_ARESETN] [get_bd_pins ps8_0_axi_periph/M02_ARESETN] [get_bd_pins ps8_0_axi_periph/M03_ARESETN] [get_bd_pins ps8_0_axi_periph/M04_ARESETN] [get_bd_pins ps8_0_axi_periph/M05_ARESETN] [get_bd_pins axi_dma_0/axi_resetn] [get_bd_pins axis_data_fifo_0/s_axis_aresetn] [get_bd_pins smartconnect_0/aresetn] [get_bd_pins unlabeler_0/aresetn] [get_bd_pins ps8_0_axi_periph/M06_ARESETN] [get_bd_pins axis_data_fifo_1/s_axis_aresetn] [get_bd_pins labeler_0/aresetn] [get_bd_pins axi_esdi_cmd_control_0/csr_aresetn] [get_bd_pins ps8_0_axi_periph/M07_ARESETN] [get_bd_pins sector_timer_0/csr_aresetn] [get_bd_pins axi_bram_ctrl_0/s_axi_aresetn] [get_bd_pins ps8_0_axi_periph/S01_ARESETN] [get_bd_pins write_datapath_0/aresetn] [get_bd_pins read_datapath_0/csr_aresetn] [get_bd_pins read_datapath_0/parallel_aresetn]
-  connect_bd_net -net sector_timer_0_cycle_count [get_bd_pins sector_timer_0/cycle_count] [get_bd_pins write_datapath_0/cycle_count] [get_bd_pins read_datapath_0/cycle_count]
+  connect_bd_net -net rst_ps8_0_100M_peripheral_aresetn [get_bd_pins rst_ps8_0_100M/peripheral_aresetn] [get_bd_pins ps8_0_axi_periph/S00_ARESETN] [get_bd_pins ps8_0_axi_periph/M08_ARESETN] [get_bd_pins perf_counters_0/csr_aresetn] [get_bd_pins gpio_drive_select/s_axi_aresetn] [get_bd_pins gpio_head_select/s_axi_aresetn] [get_bd_pins ps8_0_axi_periph/M00_ARESETN] [get_bd_pins ps8_0_axi_periph/ARESETN] [get_bd_pins ps8_0_axi_periph/M01_ARESETN] [get_bd_pins ps8_0_axi_periph/M02_ARESETN] [get_bd_pins ps8_0_axi_periph/M03_ARESETN] [get_bd_pins ps8_0_axi_periph/M04_ARESETN] [get_bd_pins ps8_0_axi_periph/M05_ARESETN] [get_bd_pins axi_dma_0/axi_resetn] [get_bd_pins smartconnect_0/aresetn] [get_bd_pins ps8_0_axi_periph/M06_ARESETN] [get_bd_pins axis_data_fifo_1/s_axis_aresetn] [get_bd_pins labeler_0/aresetn] [get_bd_pins axi_esdi_cmd_control_0/csr_aresetn] [get_bd_pins ps8_0_axi_periph/M07_ARESETN] [get_bd_pins sector_timer_0/csr_aresetn] [get_bd_pins axi_bram_ctrl_0/s_axi_aresetn] [get_bd_pins ps8_0_axi_periph/S01_ARESETN] [get_bd_pins write_datapath_0/aresetn] [get_bd_pins read_datapath_0/csr_aresetn] [get_bd_pins read_datapath_0/parallel_aresetn] [get_bd_pins ps8_0_axi_periph/M09_ARESETN] [get_bd_pins track_sequencer_0/csr_aresetn] [get_bd_pins ps8_0_axi_periph/M10_ARESETN] [get_bd_pins ps8_0_axi_periph/M11_ARESETN] [get_bd_pins ps8_0_axi_periph/M12_ARESETN] [get_bd_pins ps8_0_axi_periph/M13_ARESETN] [get_bd_pins ps8_0_axi_periph/M14_ARESETN] [get_bd_pins ps8_0_axi_periph/M15_ARESETN] [get_bd_pins ps8_0_axi_periph/M16_ARESETN] [get_bd_pins ps8_0_axi_periph/S02_ARESETN] [get_bd_pins axi_dma_1/axi_resetn] [get_bd_pins axis_data_fifo_2/s_axis_aresetn] [get_bd_pins labeler_1/aresetn] [get_bd_pins axi_esdi_cmd_control_1/csr_aresetn] [get_bd_pins sector_timer_1/csr_aresetn] [get_bd_pins write_datapath_1/aresetn] [get_bd_pins read_datapath_1/csr_aresetn] [get_bd_pins read_datapath_1/parallel_aresetn] [get_bd_pins perf_counters_1/csr_aresetn] [get_bd_pins track_sequencer_1/csr_aresetn]
+  connect_bd_net -net read_datapath_0_stat_data_arrived [get_bd_pins read_datapath_0/stat_data_arrived] [get_bd_pins perf_counters_0/read_data_arrived]
+  connect_bd_net -net read_datapath_0_stat_missed_deadline [get_bd_pins read_datapath_0/stat_missed_deadline] [get_bd_pins perf_counters_0/read_missed_deadline]
+  connect_bd_net -net read_datapath_0_stat_sector_started [get_bd_pins read_datapath_0/stat_sector_started] [get_bd_pins perf_counters_0/read_sector_started]
+  connect_bd_net -net read_datapath_0_stat_underflow [get_bd_pins read_datapath_0/stat_underflow] [get_bd_pins perf_counters_0/read_underflow]
+  connect_bd_net -net sector_timer_0_cycle_count [get_bd_pins sector_timer_0/cycle_count] [get_bd_pins write_datapath_0/cycle_count] [get_bd_pins read_datapath_0/cycle_count] [get_bd_pins track_sequencer_0/cycle_count]
   connect_bd_net -net sector_timer_0_esdi_index [get_bd_pins sector_timer_0/esdi_index] [get_bd_ports esdi_index]
   connect_bd_net -net sector_timer_0_esdi_sector [get_bd_pins sector_timer_0/esdi_sector] [get_bd_ports esdi_sector]
   connect_bd_net -net sector_timer_0_interrupt [get_bd_pins sector_timer_0/interrupt] [get_bd_pins xlconcat_0/In6]
-  connect_bd_net -net sector_timer_0_sector_number [get_bd_pins sector_timer_0/sector_number] [get_bd_pins write_datapath_0/sector_number] [get_bd_pins read_datapath_0/sector_number]
+  connect_bd_net -net sector_timer_0_sector_number [get_bd_pins sector_timer_0/sector_number] [get_bd_pins write_datapath_0/sector_number] [get_bd_pins read_datapath_0/sector_number] [get_bd_pins track_sequencer_0/sector_number]
+  connect_bd_net -net track_sequencer_0_interrupt [get_bd_pins track_sequencer_0/interrupt] [get_bd_pins xlconcat_0/In3]
+  connect_bd_net -net track_sequencer_0_selected_chs [get_bd_pins track_sequencer_0/selected_chs] [get_bd_pins write_datapath_0/cylinder_head]
+  connect_bd_net -net track_sequencer_0_parallel_flush [get_bd_pins track_sequencer_0/parallel_flush] [get_bd_pins read_datapath_0/parallel_flush]
+  connect_bd_net -net track_sequencer_0_silence [get_bd_pins track_sequencer_0/silence] [get_bd_pins read_datapath_0/sequencer_silence]
   connect_bd_net -net write_datapath_0_interrupt [get_bd_pins write_datapath_0/interrupt] [get_bd_pins xlconcat_0/In4]
+  connect_bd_net -net write_datapath_0_stat_overflow [get_bd_pins write_datapath_0/stat_overflow] [get_bd_pins perf_counters_0/write_overflow]
+  connect_bd_net -net write_datapath_0_stat_sector_discarded [get_bd_pins write_datapath_0/stat_sector_discarded] [get_bd_pins perf_counters_0/write_sector_discarded]
+  connect_bd_net -net write_datapath_0_stat_sector_missed [get_bd_pins write_datapath_0/stat_sector_missed] [get_bd_pins perf_counters_0/write_sector_missed]
+  connect_bd_net -net write_datapath_0_stat_sector_written [get_bd_pins write_datapath_0/stat_sector_written] [get_bd_pins perf_counters_0/write_sector_written]
+  connect_bd_net -net axi_dma_1_s2mm_introut [get_bd_pins axi_dma_1/s2mm_introut] [get_bd_pins xlconcat_1/In2]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_attention [get_bd_pins axi_esdi_cmd_control_1/esdi_attention] [get_bd_ports esdi_attention_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_command_complete [get_bd_pins axi_esdi_cmd_control_1/esdi_command_complete] [get_bd_ports esdi_command_complete_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_confstat_data [get_bd_pins axi_esdi_cmd_control_1/esdi_confstat_data] [get_bd_ports esdi_confstat_data_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_drive_selected [get_bd_pins axi_esdi_cmd_control_1/esdi_drive_selected] [get_bd_ports esdi_drive_selected_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_ready [get_bd_pins axi_esdi_cmd_control_1/esdi_ready] [get_bd_ports esdi_ready_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_esdi_transfer_ack [get_bd_pins axi_esdi_cmd_control_1/esdi_transfer_ack] [get_bd_ports esdi_transfer_ack_b]
+  connect_bd_net -net axi_esdi_cmd_control_1_interrupt [get_bd_pins axi_esdi_cmd_control_1/interrupt] [get_bd_pins xlconcat_0/In7]
+  connect_bd_net -net axi_esdi_cmd_control_1_stat_seek [get_bd_pins axi_esdi_cmd_control_1/stat_seek] [get_bd_pins perf_counters_1/seek]
+  connect_bd_net -net esdi_read_gate_b_1 [get_bd_ports esdi_read_gate_b] [get_bd_pins read_datapath_1/esdi_read_gate]
+  connect_bd_net -net esdi_write_clock_b_1 [get_bd_ports esdi_write_clock_b] [get_bd_pins write_datapath_1/esdi_write_clock]
+  connect_bd_net -net esdi_write_data_b_1 [get_bd_ports esdi_write_data_b] [get_bd_pins write_datapath_1/esdi_write_data]
+  connect_bd_net -net esdi_write_gate_b_1 [get_bd_ports esdi_write_gate_b] [get_bd_pins write_datapath_1/esdi_write_gate]
+  connect_bd_net -net read_datapath_1_esdi_read_clock [get_bd_pins read_datapath_1/esdi_read_clock] [get_bd_ports esdi_read_clock_b]
+  connect_bd_net -net read_datapath_1_esdi_read_data [get_bd_pins read_datapath_1/esdi_read_data] [get_bd_ports esdi_read_data_b]
+  connect_bd_net -net read_datapath_1_esdi_read_data_ungated [get_bd_pins read_datapath_1/esdi_read_data_ungated] [get_bd_pins write_datapath_1/esdi_read_data_ungated]
+  connect_bd_net -net read_datapath_1_read_data_valid [get_bd_pins read_datapath_1/read_data_valid] [get_bd_pins write_datapath_1/read_data_valid]
+  connect_bd_net -net read_datapath_1_stat_data_arrived [get_bd_pins read_datapath_1/stat_data_arrived] [get_bd_pins perf_counters_1/read_data_arrived]
+  connect_bd_net -net read_datapath_1_stat_missed_deadline [get_bd_pins read_datapath_1/stat_missed_deadline] [get_bd_pins perf_counters_1/read_missed_deadline]
+  connect_bd_net -net read_datapath_1_stat_sector_started [get_bd_pins read_datapath_1/stat_sector_started] [get_bd_pins perf_counters_1/read_sector_started]
+  connect_bd_net -net read_datapath_1_stat_underflow [get_bd_pins read_datapath_1/stat_underflow] [get_bd_pins perf_counters_1/read_underflow]
+  connect_bd_net -net sector_timer_1_cycle_count [get_bd_pins sector_timer_1/cycle_count] [get_bd_pins write_datapath_1/cycle_count] [get_bd_pins read_datapath_1/cycle_count] [get_bd_pins track_sequencer_1/cycle_count]
+  connect_bd_net -net sector_timer_1_esdi_index [get_bd_pins sector_timer_1/esdi_index] [get_bd_ports esdi_index_b]
+  connect_bd_net -net sector_timer_1_esdi_sector [get_bd_pins sector_timer_1/esdi_sector] [get_bd_ports esdi_sector_b]
+  connect_bd_net -net sector_timer_1_interrupt [get_bd_pins sector_timer_1/interrupt] [get_bd_pins xlconcat_1/In3]
+  connect_bd_net -net sector_timer_1_sector_number [get_bd_pins sector_timer_1/sector_number] [get_bd_pins write_datapath_1/sector_number] [get_bd_pins read_datapath_1/sector_number] [get_bd_pins track_sequencer_1/sector_number]
+  connect_bd_net -net track_sequencer_1_interrupt [get_bd_pins track_sequencer_1/interrupt] [get_bd_pins xlconcat_1/In0]
+  connect_bd_net -net track_sequencer_1_selected_chs [get_bd_pins track_sequencer_1/selected_chs] [get_bd_pins write_datapath_1/cylinder_head]
+  connect_bd_net -net track_sequencer_1_parallel_flush [get_bd_pins track_sequencer_1/parallel_flush] [get_bd_pins read_datapath_1/parallel_flush]
+  connect_bd_net -net track_sequencer_1_silence [get_bd_pins track_sequencer_1/silence] [get_bd_pins read_datapath_1/sequencer_silence]
+  connect_bd_net -net write_datapath_1_interrupt [get_bd_pins write_datapath_1/interrupt] [get_bd_pins xlconcat_1/In1]
+  connect_bd_net -net write_datapath_1_stat_overflow [get_bd_pins write_datapath_1/stat_overflow] [get_bd_pins perf_counters_1/write_overflow]
+  connect_bd_net -net write_datapath_1_stat_sector_discarded [get_bd_pins write_datapath_1/stat_sector_discarded] [get_bd_pins perf_counters_1/write_sector_discarded]
+  connect_bd_net -net write_datapath_1_stat_sector_missed [get_bd_pins write_datapath_1/stat_sector_missed] [get_bd_pins perf_counters_1/write_sector_missed]
+  connect_bd_net -net write_datapath_1_stat_sector_written [get_bd_pins write_datapath_1/stat_sector_written] [get_bd_pins perf_counters_1/write_sector_written]
   connect_bd_net -net xlconcat_0_dout [get_bd_pins xlconcat_0/dout] [get_bd_pins zynq_ultra_ps_e_0/pl_ps_irq0]
-  connect_bd_net -net zynq_ultra_ps_e_0_pl_clk0 [get_bd_pins zynq_ultra_ps_e_0/pl_clk0] [get_bd_pins zynq_ultra_ps_e_0/maxihpm0_fpd_aclk] [get_bd_pins ps8_0_axi_periph/S00_ACLK] [get_bd_pins rst_ps8_0_100M/slowest_sync_clk] [get_bd_pins gpio_drive_select/s_axi_aclk] [get_bd_pins gpio_head_select/s_axi_aclk] [get_bd_pins ps8_0_axi_periph/M00_ACLK] [get_bd_pins ps8_0_axi_periph/ACLK] [get_bd_pins ps8_0_axi_periph/M01_ACLK] [get_bd_pins ps8_0_axi_periph/M02_ACLK] [get_bd_pins ps8_0_axi_periph/M03_ACLK] [get_bd_pins ps8_0_axi_periph/M04_ACLK] [get_bd_pins ps8_0_axi_periph/M05_ACLK] [get_bd_pins axi_dma_0/s_axi_lite_aclk] [get_bd_pins axi_dma_0/m_axi_mm2s_aclk] [get_bd_pins axis_data_fifo_0/s_axis_aclk] [get_bd_pins axi_dma_0/m_axi_sg_aclk] [get_bd_pins zynq_ultra_ps_e_0/saxihpc0_fpd_aclk] [get_bd_pins smartconnect_0/aclk] [get_bd_pins unlabeler_0/aclk] [get_bd_pins ps8_0_axi_periph/M06_ACLK] [get_bd_pins axi_dma_0/m_axi_s2mm_aclk] [get_bd_pins axis_data_fifo_1/s_axis_aclk] [get_bd_pins labeler_0/aclk] [get_bd_pins axi_esdi_cmd_control_0/csr_aclk] [get_bd_pins ps8_0_axi_periph/M07_ACLK] [get_bd_pins sector_timer_0/csr_aclk] [get_bd_pins axi_bram_ctrl_0/s_axi_aclk] [get_bd_pins ps8_0_axi_periph/S01_ACLK] [get_bd_pins write_datapath_0/aclk] [get_bd_pins read_datapath_0/csr_aclk] [get_bd_pins read_datapath_0/parallel_aclk]
+  connect_bd_net -net xlconcat_1_dout [get_bd_pins xlconcat_1/dout] [get_bd_pins zynq_ultra_ps_e_0/pl_ps_irq1]
+  connect_bd_net -net zynq_ultra_ps_e_0_pl_clk0 [get_bd_pins zynq_ultra_ps_e_0/pl_clk0] [get_bd_pins zynq_ultra_ps_e_0/maxihpm0_fpd_aclk] [get_bd_pins ps8_0_axi_periph/S00_ACLK] [get_bd_pins ps8_0_axi_periph/M08_ACLK] [get_bd_pins perf_counters_0/csr_aclk] [get_bd_pins rst_ps8_0_100M/slowest_sync_clk] [get_bd_pins gpio_drive_select/s_axi_aclk] [get_bd_pins gpio_head_select/s_axi_aclk] [get_bd_pins ps8_0_axi_periph/M00_ACLK] [get_bd_pins ps8_0_axi_periph/ACLK] [get_bd_pins ps8_0_axi_periph/M01_ACLK] [get_bd_pins ps8_0_axi_periph/M02_ACLK] [get_bd_pins ps8_0_axi_periph/M03_ACLK] [get_bd_pins ps8_0_axi_periph/M04_ACLK] [get_bd_pins ps8_0_axi_periph/M05_ACLK] [get_bd_pins axi_dma_0/s_axi_lite_aclk] [get_bd_pins axi_dma_0/m_axi_sg_aclk] [get_bd_pins zynq_ultra_ps_e_0/saxihpc0_fpd_aclk] [get_bd_pins smartconnect_0/aclk] [get_bd_pins ps8_0_axi_periph/M06_ACLK] [get_bd_pins axi_dma_0/m_axi_s2mm_aclk] [get_bd_pins axis_data_fifo_1/s_axis_aclk] [get_bd_pins labeler_0/aclk] [get_bd_pins axi_esdi_cmd_control_0/csr_aclk] [get_bd_pins ps8_0_axi_periph/M07_ACLK] [get_bd_pins sector_timer_0/csr_aclk] [get_bd_pins axi_bram_ctrl_0/s_axi_aclk] [get_bd_pins ps8_0_axi_periph/S01_ACLK] [get_bd_pins write_datapath_0/aclk] [get_bd_pins read_datapath_0/csr_aclk] [get_bd_pins read_datapath_0/parallel_aclk] [get_bd_pins ps8_0_axi_periph/M09_ACLK] [get_bd_pins track_sequencer_0/csr_aclk] [get_bd_pins ps8_0_axi_periph/M10_ACLK] [get_bd_pins ps8_0_axi_periph/M11_ACLK] [get_bd_pins ps8_0_axi_periph/M12_ACLK] [get_bd_pins ps8_0_axi_periph/M13_ACLK] [get_bd_pins ps8_0_axi_periph/M14_ACLK] [get_bd_pins ps8_0_axi_periph/M15_ACLK] [get_bd_pins ps8_0_axi_periph/M16_ACLK] [get_bd_pins ps8_0_axi_periph/S02_ACLK] [get_bd_pins axi_dma_1/s_axi_lite_aclk] [get_bd_pins axi_dma_1/m_axi_sg_aclk] [get_bd_pins axi_dma_1/m_axi_s2mm_aclk] [get_bd_pins axis_data_fifo_2/s_axis_aclk] [get_bd_pins labeler_1/aclk] [get_bd_pins axi_esdi_cmd_control_1/csr_aclk] [get_bd_pins sector_timer_1/csr_aclk] [get_bd_pins write_datapath_1/aclk] [get_bd_pins read_datapath_1/csr_aclk] [get_bd_pins read_datapath_1/parallel_aclk] [get_bd_pins perf_counters_1/csr_aclk] [get_bd_pins track_sequencer_1/csr_aclk]
   connect_bd_net -net zynq_ultra_ps_e_0_pl_resetn0 [get_bd_pins zynq_ultra_ps_e_0/pl_resetn0] [get_bd_pins rst_ps8_0_100M/ext_reset_in]
 
   # Create address segments
@@ -937,13 +1125,23 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   assign_bd_address -offset 0xA0002000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs read_datapath_0/csr/reg0] -force
   assign_bd_address -offset 0xA0001000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs sector_timer_0/csr/reg0] -force
   assign_bd_address -offset 0xA0006000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs write_datapath_0/csr/reg0] -force
-  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_MM2S] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_DDR_LOW] -force
+  assign_bd_address -offset 0xA0007000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs perf_counters_0/csr/reg0] -force
+  assign_bd_address -offset 0xA000C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs track_sequencer_0/csr/reg0] -force
   assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_DDR_LOW] -force
   assign_bd_address -offset 0xA0008000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs axi_bram_ctrl_0/S_AXI/Mem0] -force
+  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces track_sequencer_0/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_DDR_LOW] -force
+  assign_bd_address -offset 0xA0010000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs axi_esdi_cmd_control_1/csr/reg0] -force
+  assign_bd_address -offset 0xA0011000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs sector_timer_1/csr/reg0] -force
+  assign_bd_address -offset 0xA0012000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs read_datapath_1/csr/reg0] -force
+  assign_bd_address -offset 0xA0015000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs axi_dma_1/S_AXI_LITE/Reg] -force
+  assign_bd_address -offset 0xA0016000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs write_datapath_1/csr/reg0] -force
+  assign_bd_address -offset 0xA0017000 -range 0x00001000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs perf_counters_1/csr/reg0] -force
+  assign_bd_address -offset 0xA001C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs track_sequencer_1/csr/reg0] -force
+  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_DDR_LOW] -force
+  assign_bd_address -offset 0xA0008000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs axi_bram_ctrl_0/S_AXI/Mem0] -force
+  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces track_sequencer_1/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_DDR_LOW] -force
 
   # Exclude Address Segments
-  exclude_bd_addr_seg -offset 0xFF000000 -range 0x01000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_MM2S] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_LPS_OCM]
-  exclude_bd_addr_seg -offset 0xC0000000 -range 0x20000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_MM2S] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_QSPI]
   exclude_bd_addr_seg -offset 0xFF000000 -range 0x01000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_LPS_OCM]
   exclude_bd_addr_seg -offset 0xC0000000 -range 0x20000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_QSPI]
   exclude_bd_addr_seg -offset 0xA0005000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs axi_dma_0/S_AXI_LITE/Reg]
@@ -953,6 +1151,37 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
   exclude_bd_addr_seg -offset 0xA0002000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs read_datapath_0/csr/reg0]
   exclude_bd_addr_seg -offset 0xA0001000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs sector_timer_0/csr/reg0]
   exclude_bd_addr_seg -offset 0xA0006000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs write_datapath_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0007000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs perf_counters_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA000C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs track_sequencer_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xFF000000 -range 0x01000000 -target_address_space [get_bd_addr_spaces track_sequencer_0/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_LPS_OCM]
+  exclude_bd_addr_seg -offset 0xC0000000 -range 0x20000000 -target_address_space [get_bd_addr_spaces track_sequencer_0/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_QSPI]
+  exclude_bd_addr_seg -offset 0xA0010000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs axi_esdi_cmd_control_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0011000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs sector_timer_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0012000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs read_datapath_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0015000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs axi_dma_1/S_AXI_LITE/Reg]
+  exclude_bd_addr_seg -offset 0xA0016000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs write_datapath_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0017000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs perf_counters_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA001C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_SG] [get_bd_addr_segs track_sequencer_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0005000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs axi_dma_0/S_AXI_LITE/Reg]
+  exclude_bd_addr_seg -offset 0xA0000000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs axi_esdi_cmd_control_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0003000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs gpio_drive_select/S_AXI/Reg]
+  exclude_bd_addr_seg -offset 0xA0004000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs gpio_head_select/S_AXI/Reg]
+  exclude_bd_addr_seg -offset 0xA0002000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs read_datapath_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0001000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs sector_timer_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0006000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs write_datapath_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0007000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs perf_counters_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA000C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs track_sequencer_0/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0010000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs axi_esdi_cmd_control_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0011000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs sector_timer_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0012000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs read_datapath_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0015000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs axi_dma_1/S_AXI_LITE/Reg]
+  exclude_bd_addr_seg -offset 0xA0016000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs write_datapath_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA0017000 -range 0x00001000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs perf_counters_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xA001C000 -range 0x00004000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_SG] [get_bd_addr_segs track_sequencer_1/csr/reg0]
+  exclude_bd_addr_seg -offset 0xFF000000 -range 0x01000000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_LPS_OCM]
+  exclude_bd_addr_seg -offset 0xC0000000 -range 0x20000000 -target_address_space [get_bd_addr_spaces axi_dma_1/Data_S2MM] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_QSPI]
+  exclude_bd_addr_seg -offset 0xFF000000 -range 0x01000000 -target_address_space [get_bd_addr_spaces track_sequencer_1/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_LPS_OCM]
+  exclude_bd_addr_seg -offset 0xC0000000 -range 0x20000000 -target_address_space [get_bd_addr_spaces track_sequencer_1/m_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP0/HPC0_QSPI]
 
   # Perform GUI Layout
   regenerate_bd_layout -layout_string {
@@ -986,12 +1215,11 @@ preplace inst zynq_ultra_ps_e_0 -pg 1 -lvl 3 -x 800 -y -210 -defaultsOSRD
 preplace inst ps8_0_axi_periph -pg 1 -lvl 6 -x 2380 -y 160 -defaultsOSRD
 preplace inst rst_ps8_0_100M -pg 1 -lvl 5 -x 1870 -y -230 -defaultsOSRD
 preplace inst xlconcat_0 -pg 1 -lvl 9 -x 3628 -y 470 -defaultsOSRD
-preplace inst axis_data_fifo_0 -pg 1 -lvl 6 -x 2380 -y 1000 -defaultsOSRD
 preplace inst axi_dma_0 -pg 1 -lvl 4 -x 1450 -y 1040 -defaultsOSRD
 preplace inst smartconnect_0 -pg 1 -lvl 5 -x 1870 -y 1260 -defaultsOSRD
 preplace inst axcache_coherent -pg 1 -lvl 2 -x 210 -y -280 -defaultsOSRD
 preplace inst axprot_unsecure -pg 1 -lvl 2 -x 210 -y -180 -defaultsOSRD
-preplace inst unlabeler_0 -pg 1 -lvl 7 -x 2768 -y 960 -defaultsOSRD
+preplace inst track_sequencer_0 -pg 1 -lvl 7 -x 2768 -y 960 -defaultsOSRD
 preplace inst labeler_0 -pg 1 -lvl 10 -x 3918 -y 1530 -defaultsOSRD
 preplace inst axis_data_fifo_1 -pg 1 -lvl 9 -x 3628 -y 1570 -defaultsOSRD
 preplace inst axi_esdi_cmd_control_0 -pg 1 -lvl 8 -x 3228 -y 230 -defaultsOSRD
@@ -1001,7 +1229,6 @@ preplace inst axi_bram_ctrl_0_bram -pg 1 -lvl 2 -x 210 -y 920 -defaultsOSRD
 preplace inst write_datapath_0 -pg 1 -lvl 8 -x 3228 -y 1550 -defaultsOSRD
 preplace inst read_datapath_0 -pg 1 -lvl 8 -x 3228 -y 1080 -defaultsOSRD
 preplace netloc axcache_coherent_dout 1 2 1 460 -280n
-preplace netloc axi_dma_0_mm2s_introut 1 4 5 1640 490 NJ 490 NJ 490 NJ 490 3450J
 preplace netloc axi_dma_0_s2mm_introut 1 4 5 1670 500 NJ 500 NJ 500 NJ 500 3450J
 preplace netloc axi_esdi_cmd_control_0_esdi_attention 1 8 3 3440J 260 N 260 4070
 preplace netloc axi_esdi_cmd_control_0_esdi_command_complete 1 8 3 NJ 230 3760 220 4040
@@ -1037,11 +1264,8 @@ preplace netloc zynq_ultra_ps_e_0_pl_clk0 1 0 10 -260 -120 N -120 450 -340 1260
 preplace netloc zynq_ultra_ps_e_0_pl_resetn0 1 3 2 1280 -250 N
 preplace netloc axi_bram_ctrl_0_BRAM_PORTA 1 1 1 N 910
 preplace netloc axi_bram_ctrl_0_BRAM_PORTB 1 1 1 N 930
-preplace netloc axi_dma_0_M_AXIS_MM2S 1 4 2 1680 980 N
-preplace netloc axi_dma_0_M_AXI_MM2S 1 4 1 1630 990n
 preplace netloc axi_dma_0_M_AXI_S2MM 1 4 1 1620 1010n
 preplace netloc axi_dma_0_M_AXI_SG 1 4 2 1620 -50 NJ
-preplace netloc axis_data_fifo_0_M_AXIS 1 6 1 2668 940n
 preplace netloc axis_data_fifo_1_M_AXIS 1 9 1 3780 1510n
 preplace netloc labeler_0_out 1 3 8 1270 860 NJ 860 NJ 860 NJ 860 NJ 860 NJ 860 NJ 860 4020
 preplace netloc ps8_0_axi_periph_M00_AXI 1 6 2 2550 100 2910
@@ -1053,7 +1277,7 @@ preplace netloc ps8_0_axi_periph_M05_AXI 1 3 4 1280 880 NJ 880 NJ 880 2540
 preplace netloc ps8_0_axi_periph_M06_AXI 1 6 2 NJ 210 2870
 preplace netloc ps8_0_axi_periph_M09_AXI 1 0 7 -250 780 N 780 N 780 N 780 N 780 N 780 2530
 preplace netloc smartconnect_0_M00_AXI 1 2 4 470 890 NJ 890 N 890 2040
-preplace netloc unlabeler_0_out 1 7 1 2880 960n
+preplace netloc track_sequencer_0_parallel 1 7 1 2880 960n
 preplace netloc write_datapath_0_parallel 1 8 1 3468 1540n
 preplace netloc zynq_ultra_ps_e_0_M_AXI_HPM0_FPD 1 3 3 NJ -240 1680 -130 2230
 levelinfo -pg 1 -300 -110 210 800 1450 1870 2380 2768 3228 3628 3918 4090
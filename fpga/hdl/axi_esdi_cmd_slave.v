@@ -30,7 +30,7 @@ module axi_esdi_cmd_controller #(
 
     input csr_awvalid,
     output csr_awready,
-    input [4:0] csr_awaddr,
+    input [8:0] csr_awaddr,
     input [2:0] csr_awprot,
 
     input csr_wvalid,
@@ -44,7 +44,7 @@ module axi_esdi_cmd_controller #(
 
     input csr_arvalid,
     output csr_arready,
-    input [4:0] csr_araddr,
+    input [8:0] csr_araddr,
     input [2:0] csr_arprot,
 
     output reg csr_rvalid,
@@ -64,12 +64,15 @@ module axi_esdi_cmd_controller #(
     output esdi_command_complete,
     output esdi_attention,
     output esdi_ready,
-    output esdi_drive_selected
+    output esdi_drive_selected,
+
+    // One cycle pulse for perf_counters when a seek command arrives
+    output reg stat_seek
 );
 
     reg write_addr_valid;
     reg write_data_valid;
-    reg [4:0] write_addr;
+    reg [8:0] write_addr;
     reg [31:0] write_data;
 
     assign csr_awready = !write_addr_valid;
@@ -82,6 +85,7 @@ module axi_esdi_cmd_controller #(
     wire interface_enable = control_register[1];
     wire drive_selected = control_register[2];
     wire drive_ready = control_register[3];
+    wire answer_queries = control_register[4];
 
     reg buffered_data_out_valid;
     reg [31:0] buffered_data_out;
@@ -105,6 +109,24 @@ module axi_esdi_cmd_controller #(
     reg [2:0] esdi_transfer_req_shift;
     reg [2:0] esdi_command_data_shift;
 
+    // Answers to Request Status and Request Configuration, loaded by the firmware. While
+    // answer_queries is set the controller sends them itself, without raising the interrupt.
+    // Entry n of the configuration table answers modifier 0 subscript n (n < 32), and entry
+    // 32 + m answers modifier m. Anything else still goes to the firmware, as does a command
+    // with bad parity.
+    reg [15:0] status_word;
+    reg [15:0] configuration [0:63];
+    reg [31:0] queries_answered;
+
+    wire [3:0] received_command = data_in[16:13];
+    wire [3:0] received_modifier = data_in[12:9];
+    wire [7:0] received_subscript = data_in[8:1];
+    wire received_parity_ok = (~^data_in[16:1] == data_in[0]);
+    wire [5:0] configuration_index = (received_modifier == 0) ? {1'b0, received_subscript[4:0]} : {2'b10, received_modifier};
+    wire received_query = answer_queries && received_parity_ok &&
+                          ((received_command == 4'h2) ||
+                           ((received_command == 4'h3) && ((received_modifier != 0) || (received_subscript < 32))));
+
 
     assign esdi_transfer_ack = transfer_ack && drive_selected;
     assign esdi_confstat_data = confstat_data && drive_selected;
@@ -126,6 +148,7 @@ module axi_esdi_cmd_controller #(
             confstat_data <= 0;
 
             command_complete <= 1;
+            command_pending <= 0;
             attention <= 0;
             
             state <= 0;
@@ -140,10 +163,17 @@ module axi_esdi_cmd_controller #(
             write_data_valid <= 0;
             csr_bvalid <= 0;
             csr_rvalid <= 0;
+
+            status_word <= 0;
+            queries_answered <= 0;
+
+            stat_seek <= 0;
         end
         else
         begin
 
+            stat_seek <= 0;
+
             /* Serial Processing */
 
             cycle_count <= cycle_count + 1;
@@ -211,10 +241,22 @@ module axi_esdi_cmd_controller #(
 
                         if (!sending)
                         begin
-                            buffered_data_in_valid <= 1;
                             buffered_data_in <= {15'h0, (~^data_in[16:1] != data_in[0]), data_in[16:1]};
-                            command_pending <= 1;
+                            stat_seek <= (data_in[16:13] == 0);
                             state <= 3;
+
+                            if (received_query)
+                            begin
+                                // Answered here, so state 3 starts sending straight away
+                                buffered_data_out_valid <= 1;
+                                buffered_data_out <= {16'h0, (received_command == 4'h2) ? status_word : configuration[configuration_index]};
+                                queries_answered <= queries_answered + 1;
+                            end
+                            else
+                            begin
+                                buffered_data_in_valid <= 1;
+                                command_pending <= 1;
+                            end
                         end
                         else
                         begin
@@ -310,15 +352,21 @@ module axi_esdi_cmd_controller #(
                 write_addr_valid <= 0;
                 write_data_valid <= 0;
 
-                case (write_addr[4:2])
-                    0 : control_register <= write_data;
-                    2 : begin
-                        buffered_data_out_valid <= 1;
-                        buffered_data_out <= write_data;
-                    end
-                    3 : if (write_data[0] == 0) command_pending <= 0;   // command_pending can only be cleared by software, not set
-                    4 : attention <= write_data[0];
-                endcase
+                if (write_addr[8])
+                    configuration[write_addr[7:2]] <= write_data[15:0];
+                else
+                begin
+                    case (write_addr[4:2])
+                        0 : control_register <= write_data;
+                        2 : begin
+                            buffered_data_out_valid <= 1;
+                            buffered_data_out <= write_data;
+                        end
+                        3 : if (write_data[0] == 0) command_pending <= 0;   // command_pending can only be cleared by software, not set
+                        4 : attention <= write_data[0];
+                        5 : status_word <= write_data[15:0];
+                    endcase
+                end
 
                 csr_bvalid <= 1;
                 csr_bresp <= 2'b00;
@@ -327,16 +375,23 @@ module axi_esdi_cmd_controller #(
             if (csr_arvalid && (!csr_rvalid || csr_rready))
             begin
 
-                case (csr_araddr[4:2])
-                    0 : csr_rdata <= control_register;
-                    1 : csr_rdata <= {28'h0, attention, command_pending, buffered_data_in_valid, buffered_data_out_valid};
-                    2 : begin
-                        csr_rdata <= buffered_data_in;
-                        buffered_data_in_valid <= 0;
-                    end
-                    3 : csr_rdata <= {31'h0, command_pending};
-                    4 : csr_rdata <= {31'h0, attention};
-                endcase
+                if (csr_araddr[8])
+                    csr_rdata <= {16'h0, configuration[csr_araddr[7:2]]};
+                else
+                begin
+                    case (csr_araddr[4:2])
+                        0 : csr_rdata <= control_register;
+                        1 : csr_rdata <= {28'h0, attention, command_pending, buffered_data_in_valid, buffered_data_out_valid};
+                        2 : begin
+                            csr_rdata <= buffered_data_in;
+                            buffered_data_in_valid <= 0;
+                        end
+                        3 : csr_rdata <= {31'h0, command_pending};
+                        4 : csr_rdata <= {31'h0, attention};
+                        5 : csr_rdata <= {16'h0, status_word};
+                        6 : csr_rdata <= queries_answered;
+                    endcase
+                end
 
                 csr_rvalid <= 1;
                 csr_rresp <= 2'b00;
@@ -0,0 +1,299 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Free running event counters for the datapaths. Writing the control register takes a
+// snapshot of every counter in the same cycle (bit 0) and/or clears them (bit 1), and reads
+// return the snapshot, so software always sees a consistent set.
+//
+// Register map (word offsets):
+//    0      control           W: bit 0 snapshot, bit 1 clear     R: number of counters
+//    1      cycles [31:0]     100 MHz cycles since the last clear
+//    2      cycles [63:32]
+//    3      min_slack         least cycles a sector's data was ready before its sector started,
+//                             all ones if no sector has been streamed
+//    8      sectors_streamed
+//    9      sectors_written   dirty sectors sent to the write DMA
+//    10     sectors_discarded clean sectors dropped by the write datapath
+//    11     underflows
+//    12     missed_deadlines
+//    13     write_overflows
+//    14     write_sectors_missed
+//    15     head_changes
+//    16     seeks
+//    17-24  slack histogram, bin n counts slack below 64 << n cycles (the last bin, the rest)
+
+module perf_counters (
+    input csr_aclk,
+    input csr_aresetn,
+
+    input csr_awvalid,
+    output csr_awready,
+    input [6:0] csr_awaddr,
+    input [2:0] csr_awprot,
+
+    input csr_wvalid,
+    output csr_wready,
+    input [31:0] csr_wdata,
+    input [3:0] csr_wstrb,
+
+    output reg csr_bvalid,
+    input csr_bready,
+    output reg [1:0] csr_bresp,
+
+    input csr_arvalid,
+    output csr_arready,
+    input [6:0] csr_araddr,
+    input [2:0] csr_arprot,
+
+    output reg csr_rvalid,
+    input csr_rready,
+    output reg [31:0] csr_rdata,
+    output reg [1:0] csr_rresp,
+
+    // One cycle pulses from the datapaths
+    input read_sector_started,
+    input read_data_arrived,
+    input read_underflow,
+    input read_missed_deadline,
+    input write_sector_written,
+    input write_sector_discarded,
+    input write_overflow,
+    input write_sector_missed,
+    input seek,
+
+    input [3:0] esdi_head_select
+);
+
+    localparam NUM_COUNTERS = 17;
+    localparam HISTOGRAM_BASE = 9;
+    localparam COUNTER_REG_BASE = 8;
+
+    reg write_addr_valid;
+    reg write_data_valid;
+    reg [6:0] write_addr;
+    reg [31:0] write_data;
+
+    assign csr_awready = !write_addr_valid;
+    assign csr_wready = !write_data_valid;
+    assign csr_arready = !csr_rvalid || csr_rready;
+
+    reg [31:0] counter [0:NUM_COUNTERS-1];
+    reg [31:0] snapshot [0:NUM_COUNTERS-1];
+    reg [63:0] cycles;
+    reg [63:0] snapshot_cycles;
+    reg [31:0] min_slack;
+    reg [31:0] snapshot_min_slack;
+
+    reg [NUM_COUNTERS-1:0] events;
+
+    // Snapshot and clear take effect in the cycle the write is answered, so a read issued
+    // after the write response sees the new snapshot
+    wire control_write = write_addr_valid && write_data_valid && (!csr_bvalid || csr_bready) &&
+                         (write_addr[6:2] == 0);
+    wire take_snapshot = csr_aresetn && control_write && write_data[0];
+    wire clear = !csr_aresetn || (control_write && write_data[1]);
+
+    // Head select comes straight from the connector. Only count a change once the lines
+    // have settled, so skew between them is not counted as several changes.
+    reg [3:0] head_sync [0:1];
+    reg [3:0] head_candidate;
+    reg [3:0] head_current;
+    reg [3:0] head_stable_count;
+    reg head_changed;
+
+    // Time from a sector's first byte reaching read_datapath to that sector starting
+    reg [31:0] arrival_cycle;
+    reg arrival_pending;
+    reg slack_valid;
+    reg [31:0] slack;
+
+    reg [2:0] slack_bin;
+    integer i;
+
+    always @(*)
+    begin
+        if (slack < 64)
+            slack_bin = 0;
+        else if (slack < 128)
+            slack_bin = 1;
+        else if (slack < 256)
+            slack_bin = 2;
+        else if (slack < 512)
+            slack_bin = 3;
+        else if (slack < 1024)
+            slack_bin = 4;
+        else if (slack < 2048)
+            slack_bin = 5;
+        else if (slack < 4096)
+            slack_bin = 6;
+        else
+            slack_bin = 7;
+    end
+
+    always @(posedge csr_aclk)
+    begin
+
+        head_sync[0] <= esdi_head_select;
+        head_sync[1] <= head_sync[0];
+
+        if (!csr_aresetn)
+        begin
+
+            write_addr_valid <= 0;
+            write_data_valid <= 0;
+            csr_bvalid <= 0;
+            csr_rvalid <= 0;
+
+            events <= 0;
+            head_candidate <= head_sync[1];
+            head_current <= head_sync[1];
+            head_changed <= 0;
+            head_stable_count <= 0;
+            arrival_pending <= 0;
+            slack_valid <= 0;
+
+        end
+        else
+        begin
+
+            head_changed <= 0;
+            slack_valid <= 0;
+
+            if (head_sync[1] != head_candidate)
+            begin
+                head_candidate <= head_sync[1];
+                head_stable_count <= 0;
+            end
+            else if (head_stable_count != 4'hF)
+            begin
+                head_stable_count <= head_stable_count + 1;
+            end
+            else if (head_candidate != head_current)
+            begin
+                head_current <= head_candidate;
+                head_changed <= 1;
+            end
+
+            // Back to back, the next sector's data can arrive in the same cycle as a sector
+            // starts. The start is timed from the arrival before and the new one is kept.
+            if (read_sector_started && arrival_pending)
+            begin
+                slack <= cycles[31:0] - arrival_cycle;
+                slack_valid <= 1;
+                arrival_pending <= 0;
+            end
+
+            if (read_data_arrived)
+            begin
+                arrival_cycle <= cycles[31:0];
+                arrival_pending <= 1;
+            end
+
+            // Register the events to keep the datapaths' timing to themselves
+            events <= 0;
+            events[0] <= read_sector_started;
+            events[1] <= write_sector_written;
+            events[2] <= write_sector_discarded;
+            events[3] <= read_underflow;
+            events[4] <= read_missed_deadline;
+            events[5] <= write_overflow;
+            events[6] <= write_sector_missed;
+            events[7] <= head_changed;
+            events[8] <= seek;
+
+            /* Register Interface*/
+
+            if (csr_bready)
+                csr_bvalid <= 0;
+
+            if (csr_rready)
+                csr_rvalid <= 0;
+
+            if (csr_awvalid && csr_awready)
+            begin
+                write_addr_valid <= 1;
+                write_addr <= csr_awaddr;
+            end
+
+            if (csr_wvalid && csr_wready)
+            begin
+                write_data_valid <= 1;
+                write_data <= csr_wdata;
+            end
+
+            if (write_addr_valid && write_data_valid && (!csr_bvalid || csr_bready))
+            begin
+                write_addr_valid <= 0;
+                write_data_valid <= 0;
+
+                csr_bvalid <= 1;
+                csr_bresp <= 2'b00;
+            end
+
+            if (csr_arvalid && (!csr_rvalid || csr_rready))
+            begin
+
+                if (csr_araddr[6:2] == 0)
+                    csr_rdata <= NUM_COUNTERS;
+                else if (csr_araddr[6:2] == 1)
+                    csr_rdata <= snapshot_cycles[31:0];
+                else if (csr_araddr[6:2] == 2)
+                    csr_rdata <= snapshot_cycles[63:32];
+                else if (csr_araddr[6:2] == 3)
+                    csr_rdata <= snapshot_min_slack;
+                else if (csr_araddr[6:2] >= COUNTER_REG_BASE && csr_araddr[6:2] < COUNTER_REG_BASE + NUM_COUNTERS)
+                    csr_rdata <= snapshot[csr_araddr[6:2] - COUNTER_REG_BASE];
+                else
+                    csr_rdata <= 0;
+
+                csr_rvalid <= 1;
+                csr_rresp <= 2'b00;
+            end
+        end
+
+        /* Counters */
+
+        // A snapshot and a clear in the same write hand over every event exactly once:
+        // what happened up to now goes in the snapshot, this cycle's events stay counted.
+        if (take_snapshot)
+        begin
+            for (i = 0; i < NUM_COUNTERS; i = i + 1)
+                snapshot[i] <= counter[i];
+            snapshot_cycles <= cycles;
+            snapshot_min_slack <= min_slack;
+        end
+
+        for (i = 0; i < NUM_COUNTERS; i = i + 1)
+        begin
+            if (i >= HISTOGRAM_BASE)
+                counter[i] <= (clear ? 0 : counter[i]) + (slack_valid && (slack_bin == i - HISTOGRAM_BASE));
+            else
+                counter[i] <= (clear ? 0 : counter[i]) + events[i];
+        end
+
+        cycles <= clear ? 1 : cycles + 1;
+
+        if (clear)
+            min_slack <= 32'hFFFFFFFF;
+        else if (slack_valid && slack < min_slack)
+            min_slack <= slack;
+
+    end
+
+endmodule
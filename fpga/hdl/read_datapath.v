@@ -60,6 +60,11 @@ module read_datapath (
     input parallel_tlast,
     input [7:0] parallel_tid,
 
+    // From track_sequencer: drop whatever is held from the stream, and stay quiet while
+    // the stream is not the selected track
+    input parallel_flush,
+    input sequencer_silence,
+
     input [7:0] sector_number,
     input [31:0] cycle_count,
 
@@ -68,7 +73,13 @@ module read_datapath (
     output reg esdi_read_clock,
 
     output reg read_data_valid,
-    output reg esdi_read_data_ungated
+    output reg esdi_read_data_ungated,
+
+    // One cycle pulses for perf_counters
+    output reg stat_sector_started,
+    output reg stat_data_arrived,
+    output reg stat_underflow,
+    output reg stat_missed_deadline
 );
 
     reg write_addr_valid;
@@ -82,9 +93,20 @@ module read_datapath (
 
     reg [31:0] control_register;
 
-    wire silence = control_register[0];
+    wire silence = control_register[0] || sequencer_silence;
 
+    // Each half of a bit lasts clocks_per_halfbit + (halfbit_remainder / halfbit_denominator)
+    // cycles on average, the same way the sector timer spreads the fraction of a cycle in a
+    // sector, so rates which aren't a whole number of cycles per bit don't drift
     reg [6:0] clocks_per_halfbit;
+    reg [31:0] halfbit_remainder;
+    reg [31:0] halfbit_denominator;
+    reg [31:0] halfbit_fraction;
+    reg long_halfbit;
+    reg second_halfbit;
+
+    wire [32:0] next_halfbit_fraction = halfbit_fraction + halfbit_remainder;
+    wire next_long_halfbit = next_halfbit_fraction >= halfbit_denominator;
 
     reg [3:0] esdi_read_gate_shift;
     reg [7:0] clock_counter;
@@ -104,6 +126,8 @@ module read_datapath (
     reg underflow;
     reg missed_deadline;
 
+    reg next_beat_first;
+
     assign parallel_tready = !hold_valid;
     assign esdi_read_data = esdi_read_data_ungated && !esdi_read_gate_shift[1] && !silence;
 
@@ -118,6 +142,11 @@ module read_datapath (
 
             control_register <= 0;
             clocks_per_halfbit <= 5;
+            halfbit_remainder <= 0;
+            halfbit_denominator <= 1;
+            halfbit_fraction <= 0;
+            long_halfbit <= 0;
+            second_halfbit <= 0;
 
             write_addr_valid <= 0;
             write_data_valid <= 0;
@@ -131,37 +160,60 @@ module read_datapath (
             missed_deadline <= 0;
             read_data_valid <= 0;
 
+            next_beat_first <= 1;
+            stat_sector_started <= 0;
+            stat_data_arrived <= 0;
+            stat_underflow <= 0;
+            stat_missed_deadline <= 0;
+
         end
         else
         begin
 
             read_data_valid <= 0;
 
+            stat_sector_started <= 0;
+            stat_data_arrived <= 0;
+            stat_underflow <= 0;
+            stat_missed_deadline <= 0;
+
             if (parallel_tvalid && parallel_tready)
             begin
                 hold_valid <= 1;
                 hold_data <= parallel_tdata;
                 hold_last <= parallel_tlast;
                 hold_id <= parallel_tid;
+
+                // The first byte of a sector is the one after the previous sector's last
+                next_beat_first <= parallel_tlast;
+                stat_data_arrived <= next_beat_first;
             end
 
             if (cycle_count == 0 && hold_valid && hold_id == sector_number)
             begin
+                stat_sector_started <= !reading;
                 reading <= 1;
                 shift_reg_last <= 0;
                 bit_count <= 3'b111; // we want an overflow on next increment
             end
 
             clock_counter <= clock_counter + 1;
-            if (clock_counter == (clocks_per_halfbit - 1))
+            if (clock_counter == (clocks_per_halfbit - 1 + long_halfbit))
+            begin
+                clock_counter <= 0;
+                second_halfbit <= !second_halfbit;
+
+                long_halfbit <= next_long_halfbit;
+                halfbit_fraction <= next_long_halfbit ? (next_halfbit_fraction - halfbit_denominator) : next_halfbit_fraction;
+            end
+
+            if ((clock_counter == (clocks_per_halfbit - 1 + long_halfbit)) && !second_halfbit)
             begin
                 esdi_read_clock <= 1;
             end
-            else if (clock_counter == ((clocks_per_halfbit << 1) - 1))
+            else if ((clock_counter == (clocks_per_halfbit - 1 + long_halfbit)) && second_halfbit)
             begin
 
-                clock_counter <= 0;
-
                 esdi_read_clock <= 0;
 
                 read_data_valid <= 1;
@@ -181,7 +233,10 @@ module read_datapath (
                         else
                         begin
                             if (!hold_valid)
+                            begin
                                 underflow <= 1;
+                                stat_underflow <= 1;
+                            end
 
                             shift_reg <= hold_data[6:0];
                             shift_reg_last <= hold_last;
@@ -210,7 +265,18 @@ module read_datapath (
             begin
                 // Look for instances where read gate was asserted when we were not reading
                 if (!reading)
+                begin
                     missed_deadline <= 1;
+                    stat_missed_deadline <= 1;
+                end
+            end
+
+            // Last, so it wins over a byte taken this cycle or a sector starting
+            if (parallel_flush)
+            begin
+                hold_valid <= 0;
+                reading <= 0;
+                next_beat_first <= 1;
             end
 
             /* Register Interface*/
@@ -245,6 +311,8 @@ module read_datapath (
                             underflow <= write_data[0];
                         end
                     2 : clocks_per_halfbit <= write_data[6:0];
+                    3 : halfbit_remainder <= write_data;        // Less than halfbit_denominator
+                    4 : halfbit_denominator <= write_data;      // Cannot be zero
                 endcase
 
                 csr_bvalid <= 1;
@@ -258,6 +326,8 @@ module read_datapath (
                     0 : csr_rdata <= control_register;
                     1 : csr_rdata <= {30'b0, missed_deadline, underflow};
                     2 : csr_rdata <= {25'h0, clocks_per_halfbit};
+                    3 : csr_rdata <= halfbit_remainder;
+                    4 : csr_rdata <= halfbit_denominator;
                 endcase
 
                 csr_rvalid <= 1;
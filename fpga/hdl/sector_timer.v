@@ -75,6 +75,17 @@ module sector_timer #(
     reg [31:0] interrupt_time;
     reg [7:0] num_sectors;
 
+    // A sector lasts sector_length + 1 + (sector_remainder / sector_denominator) cycles on
+    // average. Each sector that carries the fraction over a whole cycle is one cycle longer,
+    // so the index never drifts however the rotation time divides into cycles.
+    reg [31:0] sector_remainder;
+    reg [31:0] sector_denominator;
+    reg [31:0] fraction;
+    reg long_sector;
+
+    wire [32:0] next_fraction = fraction + sector_remainder;
+    wire next_long_sector = next_fraction >= sector_denominator;
+
     reg interrupt_time_reached;
     assign interrupt = interrupt_time_reached && interrupt_enable;
 
@@ -86,6 +97,10 @@ module sector_timer #(
             control_register <= 32'b0000;
             sector_length <= 0;
             num_sectors <= 0;
+            sector_remainder <= 0;
+            sector_denominator <= 1;
+            fraction <= 0;
+            long_sector <= 0;
 
             cycle_count <= 0;
             sector_number <= 0;
@@ -119,10 +134,13 @@ module sector_timer #(
                     esdi_index <= 0;
                     esdi_sector <= 0;
                 end
-                else if (cycle_count == sector_length)
+                else if (cycle_count == (sector_length + long_sector))
                 begin
                     cycle_count <= 0;
 
+                    long_sector <= next_long_sector;
+                    fraction <= next_long_sector ? (next_fraction - sector_denominator) : next_fraction;
+
                     if (sector_number == (num_sectors - 1))
                     begin
                         sector_number <= 0;
@@ -148,6 +166,11 @@ module sector_timer #(
                 esdi_index <= 0;
                 esdi_sector <= 0;
 
+                // The first sector is never long. The fraction it would have carried counts
+                // towards the second.
+                fraction <= sector_remainder;
+                long_sector <= 0;
+
             end
 
 
@@ -181,6 +204,8 @@ module sector_timer #(
                     1 : sector_length <= write_data;           // Cannot be zero
                     2 : num_sectors <= write_data[7:0];
                     5 : interrupt_time <= write_data;
+                    6 : sector_remainder <= write_data;       // Less than sector_denominator
+                    7 : sector_denominator <= write_data;     // Cannot be zero
                 endcase
 
                 csr_bvalid <= 1;
@@ -200,6 +225,8 @@ module sector_timer #(
                     3 : csr_rdata <= {24'b0, sector_number};
                     4 : csr_rdata <= cycle_count;
                     5 : csr_rdata <= interrupt_time;
+                    6 : csr_rdata <= sector_remainder;
+                    7 : csr_rdata <= sector_denominator;
                 endcase
 
                 csr_rvalid <= 1;
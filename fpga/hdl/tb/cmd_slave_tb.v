@@ -7,11 +7,11 @@ module axi_esdi_cmd_controller_tb ();
     reg csr_aclk;
     reg csr_aresetn;
     reg csr_awvalid;
-    reg [4:0] csr_awaddr;
+    reg [8:0] csr_awaddr;
     reg csr_wvalid;
     reg [31:0] csr_wdata;
     reg csr_arvalid;
-    reg [4:0] csr_araddr;
+    reg [8:0] csr_araddr;
 
     reg esdi_transfer_req;
     reg esdi_command_data;
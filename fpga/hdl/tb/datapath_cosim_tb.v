@@ -0,0 +1,1165 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+/*
+    Co-simulation of the whole emulator datapath, wired up the way esdi_emulator.tcl does it:
+
+        DDR -> track_sequencer -> read_datapath -> ESDI read clock/data
+        ESDI write clock/data -> write_datapath -> FIFO -> labeler -> DMA S2MM
+        sector_timer drives all three, axi_esdi_cmd_controller handles the serial commands
+
+    fifo_registered stands in for the axis_data_fifo IP. Around the hardware are three
+    behavioural models:
+
+        firmware    - sets up the track sequencer and services the interrupts over AXI-Lite
+                      the way main.c does, with a configurable interrupt latency and cost per
+                      register access
+        DDR/DMA     - answers the track sequencer's read bursts from one slot with a
+                      configurable latency per burst, and takes written sectors back into memory
+        controller  - reads and writes sectors with read/write gate, and sends commands over
+                      the serial interface
+
+    Every sector carries a preamble, a sync byte and a payload that depends on the sector and
+    how many times it has been written, so the controller and the DMA model can check what
+    they receive bit for bit. Settings are plusargs so one build covers a whole sweep:
+
+        +cph=N          clocks per half bit of the read clock (5 = 10 Mbit/s)
+        +kbps=N         read clock rate in kbit/s instead, which needn't be a whole number of
+                        cycles per bit (15000, 20000, 24000)
+        +spt=N          sectors per track
+        +rpm=N          spindle speed
+        +ddr_latency=N  cycles before each read burst, and each DMA write burst of +burst=N bytes
+        +ddr_jitter=N   extra random cycles added to each of those
+        +irq_latency=N  cycles from an interrupt to the first instruction of its handler
+        +csr_latency=N  extra cycles for each firmware register access
+        +lead=N         sectors the track sequencer fetches ahead, as SEQUENCER_LEAD in main.c
+        +write_every=N  write every Nth sector instead of reading it, 0 to only read
+        +revolutions=N  revolutions to measure after one of warm up
+        +cmd_gap=N      cycles between serial commands, 0 for none
+        +cmd_hw=N       1 (the default) to have the command interface answer Request Status
+                        and Request Configuration itself, as main.c sets it up, 0 to answer
+                        them from the interrupt
+
+    At the end a single line starting with COSIM reports the settings and results as
+    key=value pairs. See run_cosim_sweep.sh.
+*/
+
+`timescale 1ns / 1ps
+
+
+module datapath_cosim_tb ();
+
+    localparam HW_FREQ = 100000000;
+    localparam PREAMBLE = 12;           // Zero bytes ahead of the sync byte
+    localparam POSTAMBLE = 3;           // Zero bytes after the payload, room for the data to slip a few bits
+    localparam GATE_BITS = 24;          // Bit times from the sector pulse to read/write gate
+    localparam MAX_BYTES = 1024;
+    localparam QUEUE_SIZE = 256;
+    localparam STATUS_WORD = 16'h5A3C;
+    localparam SLOT_BASE = 32'h10000000;    // Where the one slot the track sequencer reads from is
+    localparam SECTOR_STRIDE = 2048;        // Bytes between sectors in the slot
+
+    localparam ST = 0;                  // AXI-Lite slaves
+    localparam RD = 1;
+    localparam WD = 2;
+    localparam CMD = 3;
+    localparam TS = 4;
+
+    /* Settings */
+
+    integer cph = 5;
+    integer kbps = 0;
+    integer spt = 34;
+    integer rpm = 3600;
+    integer ddr_latency = 32;
+    integer ddr_jitter = 0;
+    integer burst = 64;
+    integer irq_latency = 50;
+    integer csr_latency = 25;
+    integer lead = 2;
+    integer write_every = 3;
+    integer revolutions = 2;
+    integer cmd_gap = 20000;
+    integer cmd_hw = 1;
+    integer seed = 1;
+
+    integer sector_length;
+    integer sector_remainder;
+    integer sector_denominator;
+    integer halfbit_remainder = 0;
+    integer halfbit_denominator = 1;
+    reg [63:0] cycles_per_minute;
+    integer late_cycle;
+    integer unformatted;
+    integer sector_bytes;
+
+    /* Results */
+
+    integer reads_ok = 0;
+    integer reads_lost = 0;             // No sync found, the datapath did not send the sector
+    integer reads_corrupt = 0;
+    integer writes_sent = 0;
+    integer writes_ok = 0;
+    integer writes_corrupt = 0;
+    integer underflows = 0;
+    integer missed_deadlines = 0;
+    integer write_overflows = 0;
+    integer write_sectors_missed = 0;
+    integer write_interrupts = 0;
+    integer records_taken = 0;
+    integer late_sectors = 0;
+    integer min_slack = -1;
+    integer wfifo_hwm = 0;
+    integer commands_sent = 0;
+    integer cmd_count = 0;
+    integer cmd_errors = 0;
+    integer cmd_timeouts = 0;
+    integer cmd_interrupts = 0;
+    integer queries_sent = 0;           // That the command interface should have answered itself
+    integer rtt_min = -1;
+    integer rtt_max = 0;
+    real rtt_sum = 0;
+
+    reg measuring = 0;
+    integer index_count = 0;
+
+    /* Clock and reset */
+
+    reg aclk = 0;
+    reg aresetn = 0;
+
+    always #5 aclk <= !aclk;
+
+    task tick;
+    begin
+        @(posedge aclk);
+        #1;
+    end
+    endtask
+
+    /* AXI-Lite */
+
+    reg [4:0] csr_awvalid = 0;
+    reg [4:0] csr_wvalid = 0;
+    reg [4:0] csr_arvalid = 0;
+    reg [13:0] csr_awaddr = 0;
+    reg [31:0] csr_wdata = 0;
+    reg [13:0] csr_araddr = 0;
+
+    wire [4:0] csr_bvalid;
+    wire [4:0] csr_rvalid;
+    wire [31:0] st_rdata;
+    wire [31:0] rd_rdata;
+    wire [31:0] wd_rdata;
+    wire [31:0] cmd_rdata;
+    wire [31:0] ts_rdata;
+
+    task csr_write(input integer slave, input [13:0] addr, input [31:0] data);
+    begin
+        csr_awaddr <= addr;
+        csr_wdata <= data;
+        csr_awvalid[slave] <= 1;
+        csr_wvalid[slave] <= 1;
+        tick;
+        csr_awvalid[slave] <= 0;
+        csr_wvalid[slave] <= 0;
+        while (!csr_bvalid[slave])
+            tick;
+        repeat (csr_latency) tick;
+    end
+    endtask
+
+    task csr_read(input integer slave, input [13:0] addr, output [31:0] data);
+    begin
+        csr_araddr <= addr;
+        csr_arvalid[slave] <= 1;
+        tick;
+        csr_arvalid[slave] <= 0;
+        while (!csr_rvalid[slave])
+            tick;
+        case (slave)
+            ST : data = st_rdata;
+            RD : data = rd_rdata;
+            WD : data = wd_rdata;
+            TS : data = ts_rdata;
+            default : data = cmd_rdata;
+        endcase
+        repeat (csr_latency) tick;
+    end
+    endtask
+
+    /* Hardware */
+
+    wire esdi_index;
+    wire [19:0] selected_chs;
+    wire esdi_sector;
+    wire [31:0] cycle_count;
+    wire [7:0] sector_number;
+
+    sector_timer uut_sector_timer (
+        .csr_aclk               (aclk),
+        .csr_aresetn            (aresetn),
+        .csr_awvalid            (csr_awvalid[ST]),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr[4:0]),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid[ST]),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid[ST]),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid[ST]),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr[4:0]),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid[ST]),
+        .csr_rready             (1'b1),
+        .csr_rdata              (st_rdata),
+        .csr_rresp              (),
+
+        .esdi_index             (esdi_index),
+        .esdi_sector            (esdi_sector),
+        .cycle_count            (cycle_count),
+        .sector_number          (sector_number),
+        .interrupt              ()
+    );
+
+    // Read path: DDR -> track_sequencer -> read_datapath
+
+    wire [31:0] ddr_araddr;
+    wire [7:0] ddr_arlen;
+    wire ddr_arvalid;
+    reg [31:0] ddr_rdata = 0;
+    reg ddr_rlast = 0;
+    reg ddr_rvalid = 0;
+
+    wire read_parallel_tvalid;
+    wire read_parallel_tready;
+    wire [7:0] read_parallel_tdata;
+    wire read_parallel_tlast;
+    wire [7:0] read_parallel_tid;
+    wire read_parallel_flush;
+    wire sequencer_silence;
+    wire ts_interrupt;
+
+    track_sequencer uut_track_sequencer (
+        .csr_aclk               (aclk),
+        .csr_aresetn            (aresetn),
+        .csr_awvalid            (csr_awvalid[TS]),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid[TS]),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid[TS]),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid[TS]),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid[TS]),
+        .csr_rready             (1'b1),
+        .csr_rdata              (ts_rdata),
+        .csr_rresp              (),
+
+        .m_axi_araddr           (ddr_araddr),
+        .m_axi_arlen            (ddr_arlen),
+        .m_axi_arsize           (),
+        .m_axi_arburst          (),
+        .m_axi_arcache          (),
+        .m_axi_arprot           (),
+        .m_axi_arvalid          (ddr_arvalid),
+        .m_axi_arready          (1'b1),
+        .m_axi_rdata            (ddr_rdata),
+        .m_axi_rresp            (2'b00),
+        .m_axi_rlast            (ddr_rlast),
+        .m_axi_rvalid           (ddr_rvalid),
+        .m_axi_rready           (),
+
+        .parallel_tvalid        (read_parallel_tvalid),
+        .parallel_tready        (read_parallel_tready),
+        .parallel_tdata         (read_parallel_tdata),
+        .parallel_tlast         (read_parallel_tlast),
+        .parallel_tid           (read_parallel_tid),
+
+        .parallel_flush         (read_parallel_flush),
+        .silence                (sequencer_silence),
+
+        .sector_number          (sector_number),
+        .cycle_count            (cycle_count),
+        .selected_chs           (selected_chs),
+
+        .interrupt              (ts_interrupt)
+    );
+
+    reg esdi_read_gate = 1;
+    wire esdi_read_data;
+    wire esdi_read_clock;
+    wire read_data_valid;
+    wire esdi_read_data_ungated;
+    wire read_underflow;
+    wire read_missed_deadline;
+
+    read_datapath uut_read_datapath (
+        .csr_aclk               (aclk),
+        .csr_aresetn            (aresetn),
+
+        .trig_out               (),
+        .trig_out_ack           (1'b0),
+        .trig_in                (1'b0),
+        .trig_in_ack            (),
+
+        .parallel_aclk          (aclk),
+        .parallel_aresetn       (aresetn),
+
+        .csr_awvalid            (csr_awvalid[RD]),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr[4:0]),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid[RD]),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid[RD]),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid[RD]),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr[4:0]),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid[RD]),
+        .csr_rready             (1'b1),
+        .csr_rdata              (rd_rdata),
+        .csr_rresp              (),
+
+        .parallel_tvalid        (read_parallel_tvalid),
+        .parallel_tready        (read_parallel_tready),
+        .parallel_tdata         (read_parallel_tdata),
+        .parallel_tlast         (read_parallel_tlast),
+        .parallel_tid           (read_parallel_tid),
+
+        .parallel_flush         (read_parallel_flush),
+        .sequencer_silence      (sequencer_silence),
+
+        .sector_number          (sector_number),
+        .cycle_count            (cycle_count),
+
+        .esdi_read_gate         (esdi_read_gate),
+        .esdi_read_data         (esdi_read_data),
+        .esdi_read_clock        (esdi_read_clock),
+
+        .read_data_valid        (read_data_valid),
+        .esdi_read_data_ungated (esdi_read_data_ungated),
+
+        .stat_sector_started    (),
+        .stat_data_arrived      (),
+        .stat_underflow         (read_underflow),
+        .stat_missed_deadline   (read_missed_deadline)
+    );
+
+    // Write path: write_datapath -> axis_data_fifo_1 -> labeler -> DMA S2MM
+
+    reg esdi_write_gate = 1;
+    reg esdi_write_data = 0;
+    wire esdi_write_clock = esdi_read_clock;        // The controller sends the read clock back as write clock
+    wire wd_interrupt;
+
+    wire write_parallel_tvalid;
+    wire write_parallel_tready;
+    wire [7:0] write_parallel_tdata;
+    wire write_parallel_tlast;
+    wire [7:0] write_parallel_tid;
+
+    write_datapath uut_write_datapath (
+        .aclk                   (aclk),
+        .aresetn                (aresetn),
+
+        .csr_awvalid            (csr_awvalid[WD]),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr[8:0]),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid[WD]),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid[WD]),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid[WD]),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr[8:0]),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid[WD]),
+        .csr_rready             (1'b1),
+        .csr_rdata              (wd_rdata),
+        .csr_rresp              (),
+
+        .sector_number          (sector_number),
+        .cycle_count            (cycle_count),
+        .cylinder_head          (selected_chs),
+
+        .esdi_write_gate        (esdi_write_gate),
+        .esdi_write_clock       (esdi_write_clock),
+        .esdi_write_data        (esdi_write_data),
+
+        .esdi_read_data_ungated (esdi_read_data_ungated),
+        .read_data_valid        (read_data_valid),
+
+        .interrupt              (wd_interrupt),
+
+        .parallel_tvalid        (write_parallel_tvalid),
+        .parallel_tready        (write_parallel_tready),
+        .parallel_tdata         (write_parallel_tdata),
+        .parallel_tlast         (write_parallel_tlast),
+        .parallel_tid           (write_parallel_tid)
+    );
+
+    wire wfifo_tvalid;
+    wire wfifo_tready;
+    wire [7:0] wfifo_tdata;
+    wire wfifo_tlast;
+    wire [7:0] wfifo_tid;
+    wire [12:0] wfifo_used;
+
+    fifo_registered #(1, 12, 8, 0) write_fifo (
+        .clk            (aclk),
+        .reset_n        (aresetn),
+
+        .in_tvalid      (write_parallel_tvalid),
+        .in_tready      (write_parallel_tready),
+        .in_tdata       (write_parallel_tdata),
+        .in_tkeep       (1'b1),
+        .in_tlast       (write_parallel_tlast),
+        .in_tid         (write_parallel_tid),
+
+        .out_tvalid     (wfifo_tvalid),
+        .out_tready     (wfifo_tready),
+        .out_tdata      (wfifo_tdata),
+        .out_tkeep      (),
+        .out_tlast      (wfifo_tlast),
+        .out_tid        (wfifo_tid),
+
+        .num_free       (),
+        .num_used       (wfifo_used)
+    );
+
+    wire s2mm_tvalid;
+    reg s2mm_tready = 1;
+    wire [7:0] s2mm_tdata;
+    wire s2mm_tlast;
+
+    labeler uut_labeler (
+        .aclk           (aclk),
+        .aresetn        (aresetn),
+
+        .in_tvalid      (wfifo_tvalid),
+        .in_tready      (wfifo_tready),
+        .in_tdata       (wfifo_tdata),
+        .in_tlast       (wfifo_tlast),
+        .in_tid         (wfifo_tid),
+
+        .out_tvalid     (s2mm_tvalid),
+        .out_tready     (s2mm_tready),
+        .out_tdata      (s2mm_tdata),
+        .out_tlast      (s2mm_tlast)
+    );
+
+    // Command interface
+
+    reg esdi_transfer_req = 0;
+    reg esdi_command_data = 0;
+    wire esdi_transfer_ack;
+    wire esdi_confstat_data;
+    wire esdi_command_complete;
+    wire cmd_interrupt;
+
+    axi_esdi_cmd_controller uut_cmd_controller (
+        .csr_aclk               (aclk),
+        .csr_aresetn            (aresetn),
+        .csr_awvalid            (csr_awvalid[CMD]),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr[8:0]),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid[CMD]),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid[CMD]),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid[CMD]),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr[8:0]),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid[CMD]),
+        .csr_rready             (1'b1),
+        .csr_rdata              (cmd_rdata),
+        .csr_rresp              (),
+
+        .interrupt              (cmd_interrupt),
+
+        .esdi_transfer_req      (esdi_transfer_req),
+        .esdi_command_data      (esdi_command_data),
+        .esdi_transfer_ack      (esdi_transfer_ack),
+        .esdi_confstat_data     (esdi_confstat_data),
+        .esdi_command_complete  (esdi_command_complete),
+        .esdi_attention         (),
+        .esdi_ready             (),
+        .esdi_drive_selected    ()
+    );
+
+    /* Sector contents */
+
+    reg [7:0] ddr [0:256*MAX_BYTES-1];     // One buffer per physical sector, as a slot holds them
+    integer generation [0:255];             // Times each sector has been written
+    integer write_generation [0:255];       // What the controller last wrote to each sector
+
+    function [7:0] layout_byte(input integer s, input integer g, input integer i);
+    begin
+        if (i < PREAMBLE)
+            layout_byte = 8'h00;
+        else if (i == PREAMBLE)
+            layout_byte = 8'h01;            // Sync, the first one bit in the sector
+        else if (i >= sector_bytes - POSTAMBLE)
+            layout_byte = 8'h00;
+        else
+            layout_byte = (s * 29) + (g * 113) + (i * 7) + (i >> 5);
+    end
+    endfunction
+
+    function layout_bit(input integer s, input integer g, input integer b);
+        reg [7:0] value;
+    begin
+        value = layout_byte(s, g, b >> 3);
+        layout_bit = value[7 - (b & 7)];
+    end
+    endfunction
+
+    function integer jitter(input integer dummy);
+    begin
+        if (ddr_jitter > 0)
+            jitter = ($random(seed) & 32'h7fffffff) % (ddr_jitter + 1);
+        else
+            jitter = 0;
+    end
+    endfunction
+
+    // Bits as received, checked against what sector 's' should hold after 'g' writes.
+    // Hunts for the sync bit so that slipping a bit or two at write gate is not an error.
+    reg check_bits [0:8*MAX_BYTES-1];
+    reg read_bits [0:8*MAX_BYTES-1];
+
+    localparam CHECK_OK = 0;
+    localparam CHECK_LOST = 1;
+    localparam CHECK_CORRUPT = 2;
+
+    task check_sector(input integer nbits, input integer s, input integer g, output integer result);
+        integer b;
+        integer i;
+        integer k;
+        reg [7:0] value;
+    begin
+        b = 0;
+        while (b < nbits && check_bits[b] !== 1'b1)
+            b = b + 1;
+
+        if (b >= nbits)
+            result = CHECK_LOST;
+        else
+        begin
+            result = CHECK_OK;
+            b = b + 1;
+            for (i = PREAMBLE + 1; i < sector_bytes - POSTAMBLE; i = i + 1)
+            begin
+                for (k = 0; k < 8; k = k + 1)
+                    value = {value[6:0], (b + k < nbits) ? check_bits[b + k] : 1'b0};
+                if ((b + 8 > nbits) || (value !== layout_byte(s, g, i)))
+                    result = CHECK_CORRUPT;
+                b = b + 8;
+            end
+        end
+    end
+    endtask
+
+    /* DDR: read bursts from the track sequencer */
+
+    // The slot as the track sequencer sees it: each sector at SECTOR_STRIDE, its label then
+    // its contents, and zeros after
+    function [7:0] slot_byte(input integer address);
+        integer s;
+        integer i;
+    begin
+        s = address / SECTOR_STRIDE;
+        i = address % SECTOR_STRIDE;
+        if (s >= 256 || i > MAX_BYTES)
+            slot_byte = 8'h00;
+        else if (i == 0)
+            slot_byte = s;
+        else
+            slot_byte = ddr[(s * MAX_BYTES) + i - 1];
+    end
+    endfunction
+
+    // arready is tied high, so requests are only queued here and their latencies overlap
+    // the way they do behind the HP port
+    integer ar_addr [0:QUEUE_SIZE-1];
+    integer ar_beats [0:QUEUE_SIZE-1];
+    integer ar_due [0:QUEUE_SIZE-1];
+    integer ar_issued = 0;
+    integer ar_taken = 0;
+
+    always @(posedge aclk)
+    begin
+        if (ddr_arvalid)
+        begin
+            ar_addr[ar_issued % QUEUE_SIZE] = ddr_araddr - SLOT_BASE;
+            ar_beats[ar_issued % QUEUE_SIZE] = ddr_arlen + 1;
+            ar_due[ar_issued % QUEUE_SIZE] = ($time / 10) + ddr_latency + jitter(0);
+            ar_issued = ar_issued + 1;
+        end
+    end
+
+    initial
+    begin : ddr_read
+        integer n;
+        integer beat;
+        integer address;
+
+        forever
+        begin
+            while (ar_taken == ar_issued)
+                tick;
+            n = ar_taken % QUEUE_SIZE;
+            ar_taken = ar_taken + 1;
+
+            ddr_rvalid <= 0;
+            ddr_rlast <= 0;
+            while (($time / 10) < ar_due[n])
+                tick;
+
+            for (beat = 0; beat < ar_beats[n]; beat = beat + 1)
+            begin
+                address = ar_addr[n] + (beat * 4);
+                ddr_rvalid <= 1;
+                ddr_rdata <= {slot_byte(address + 3), slot_byte(address + 2), slot_byte(address + 1), slot_byte(address)};
+                ddr_rlast <= (beat == ar_beats[n] - 1);
+                tick;
+            end
+            ddr_rvalid <= 0;
+            ddr_rlast <= 0;
+        end
+    end
+
+    // How long before its sector started the first byte reached read_datapath
+    integer arrival_time [0:255];
+    reg arrival_valid [0:255];
+    reg read_first_beat = 1;
+
+    always @(posedge aclk)
+    begin
+        if (uut_sector_timer.enable && cycle_count == 0)
+        begin
+            if (arrival_valid[sector_number])
+            begin
+                if (measuring && (min_slack < 0 || ($time / 10) - arrival_time[sector_number] < min_slack))
+                    min_slack = ($time / 10) - arrival_time[sector_number];
+                arrival_valid[sector_number] = 0;
+            end
+            else if (measuring)
+                late_sectors = late_sectors + 1;
+        end
+
+        // After the check above, as read_datapath cannot start on a byte that arrives this cycle
+        if (read_parallel_tvalid && read_parallel_tready)
+        begin
+            if (read_first_beat)
+            begin
+                arrival_time[read_parallel_tid] = $time / 10;
+                arrival_valid[read_parallel_tid] = 1;
+            end
+            read_first_beat <= read_parallel_tlast;
+        end
+
+        if (measuring && wfifo_used > wfifo_hwm)
+            wfifo_hwm = wfifo_used;
+
+        if (measuring)
+        begin
+            underflows = underflows + read_underflow;
+            missed_deadlines = missed_deadlines + read_missed_deadline;
+        end
+    end
+
+    /* DMA S2MM: written sectors go back into memory, as the firmware copies them into the slot */
+
+    reg [7:0] s2mm_buffer [0:MAX_BYTES];
+    integer s2mm_beat = 0;
+    integer s2mm_stall = 0;
+
+    always @(posedge aclk)
+    begin : s2mm
+        integer s;
+        integer b;
+        integer result;
+
+        if (s2mm_stall > 0)
+        begin
+            s2mm_stall = s2mm_stall - 1;
+            if (s2mm_stall == 0)
+                s2mm_tready <= 1;
+        end
+
+        if (s2mm_tvalid && s2mm_tready)
+        begin
+            if (s2mm_beat <= MAX_BYTES)
+                s2mm_buffer[s2mm_beat] = s2mm_tdata;
+            s2mm_beat = s2mm_beat + 1;
+
+            if (s2mm_tlast)
+            begin
+                s = s2mm_buffer[0];
+                for (b = 0; b < 8 * (s2mm_beat - 1) && b < 8 * MAX_BYTES; b = b + 1)
+                    check_bits[b] = s2mm_buffer[1 + (b >> 3)][7 - (b & 7)];
+                check_sector(8 * (s2mm_beat - 1), s, write_generation[s], result);
+                if (s2mm_beat - 1 != sector_bytes)
+                    result = CHECK_CORRUPT;
+
+                if (result == CHECK_OK)
+                    writes_ok = writes_ok + 1;
+                else
+                begin
+                    writes_corrupt = writes_corrupt + 1;
+                    $display("%t: sector %0d written incorrectly (%0d bytes)", $time, s, s2mm_beat - 1);
+                end
+
+                for (b = 0; b < sector_bytes; b = b + 1)
+                    ddr[(s * MAX_BYTES) + b] = s2mm_buffer[1 + b];
+                generation[s] = write_generation[s];
+                s2mm_beat = 0;
+            end
+            else if (ddr_latency > 0 && (s2mm_beat % burst) == 0)
+            begin
+                s2mm_tready <= 0;
+                s2mm_stall = ddr_latency + jitter(0);
+            end
+        end
+    end
+
+    /* Firmware */
+
+    // As track_sequencer_interrupt_handler(), which only traces when reading resumed
+    task track_sequencer_interrupt;
+        reg [31:0] value;
+    begin
+        csr_read(TS, 0, value);         // Clears the interrupt
+        csr_read(TS, 10 << 2, value);
+    end
+    endtask
+
+    // As drain_write_records(), taking every record the datapath has produced
+    task write_datapath_interrupt;
+        reg [31:0] produced;
+        reg [31:0] value;
+    begin
+        csr_read(WD, 2 << 2, produced);
+        while (records_taken != produced)
+        begin
+            csr_read(WD, (64 + 2 * (records_taken % 32)) << 2, value);
+            if (measuring)
+            begin
+                write_overflows = write_overflows + value[30];
+                write_sectors_missed = write_sectors_missed + value[29];
+            end
+            records_taken = records_taken + 1;
+        end
+        csr_write(WD, 5 << 2, produced);
+        if (measuring)
+            write_interrupts = write_interrupts + 1;
+    end
+    endtask
+
+    // As query_answer(), a different word for each modifier and subscript
+    function [15:0] configuration_word(input [3:0] modifier, input [7:0] subscript);
+    begin
+        configuration_word = {4'hC, modifier, subscript};
+    end
+    endfunction
+
+    // Whether the command interface answers a command itself once main.c has set it up
+    function answered_in_hardware(input [15:0] command);
+    begin
+        answered_in_hardware = cmd_hw && ((command[15:12] == 4'h2) ||
+            ((command[15:12] == 4'h3) && ((command[11:8] != 0) || (command[7:0] < 32))));
+    end
+    endfunction
+
+    task command_interrupt;
+        reg [31:0] value;
+    begin
+        csr_read(CMD, 1 << 2, value);
+        if (value[1])
+        begin
+            cmd_interrupts = cmd_interrupts + 1;
+            csr_read(CMD, 2 << 2, value);
+            if (answered_in_hardware(value[15:0]))
+                cmd_errors = cmd_errors + 1;        // Should have been answered without us
+            if (value[15:12] == 4'h2)               // Request Status
+                csr_write(CMD, 2 << 2, STATUS_WORD);
+            else if (value[15:12] == 4'h3)          // Request Configuration
+                csr_write(CMD, 2 << 2, configuration_word(value[11:8], value[7:0]));
+            csr_write(CMD, 3 << 2, 0);
+        end
+    end
+    endtask
+
+    initial
+    begin : firmware
+        integer i;
+
+        if ($value$plusargs("cph=%d", cph)) ;
+        if ($value$plusargs("kbps=%d", kbps)) ;
+        if ($value$plusargs("spt=%d", spt)) ;
+        if ($value$plusargs("rpm=%d", rpm)) ;
+        if ($value$plusargs("ddr_latency=%d", ddr_latency)) ;
+        if ($value$plusargs("ddr_jitter=%d", ddr_jitter)) ;
+        if ($value$plusargs("burst=%d", burst)) ;
+        if ($value$plusargs("irq_latency=%d", irq_latency)) ;
+        if ($value$plusargs("csr_latency=%d", csr_latency)) ;
+        if ($value$plusargs("lead=%d", lead)) ;
+        if ($value$plusargs("write_every=%d", write_every)) ;
+        if ($value$plusargs("revolutions=%d", revolutions)) ;
+        if ($value$plusargs("cmd_gap=%d", cmd_gap)) ;
+        if ($value$plusargs("cmd_hw=%d", cmd_hw)) ;
+        if ($value$plusargs("seed=%d", seed)) ;
+
+        // As main.c sets up the sector timer and read clock, but with the sector as long as
+        // fits the datapaths (10 bit length register, 1024 byte FIFO)
+        cycles_per_minute = HW_FREQ * 64'd60;
+        sector_denominator = rpm * spt;
+        sector_length = (cycles_per_minute / sector_denominator) - 1;
+        sector_remainder = cycles_per_minute % sector_denominator;
+        late_cycle = sector_length - (HW_FREQ / 1000000 * 20);
+        if (kbps)
+        begin
+            halfbit_denominator = 2000 * kbps;
+            cph = HW_FREQ / halfbit_denominator;
+            halfbit_remainder = HW_FREQ % halfbit_denominator;
+            unformatted = (((sector_length + 1) * 64'd1000 * kbps) / (8 * HW_FREQ)) - 1;
+        end
+        else
+            unformatted = ((sector_length + 1) / (16 * cph)) - 1;
+        if (!$value$plusargs("unformatted=%d", unformatted) && unformatted > 1026)
+            unformatted = 1026;
+        sector_bytes = unformatted - 3;
+
+        if (sector_bytes - PREAMBLE - 1 - POSTAMBLE < 1)
+        begin
+            $display("COSIM cph=%0d kbps=%0d spt=%0d ddr_latency=%0d sector_bytes=%0d result=SKIP",
+                cph, kbps, spt, ddr_latency, sector_bytes);
+            $finish;
+        end
+
+        for (i = 0; i < 256; i = i + 1)
+        begin
+            generation[i] = 0;
+            write_generation[i] = 0;
+            arrival_valid[i] = 0;
+        end
+        for (i = 0; i < 256 * MAX_BYTES; i = i + 1)
+            ddr[i] = layout_byte(i / MAX_BYTES, 0, i % MAX_BYTES);
+
+        repeat (4) tick;
+        aresetn <= 1;
+        repeat (4) tick;
+
+        csr_write(CMD, 0, 32'h1);           // Soft reset
+        csr_write(CMD, 0, 32'h0);
+        csr_write(CMD, 5 << 2, STATUS_WORD);
+        for (i = 0; i < 32; i = i + 1)
+            csr_write(CMD, 9'h100 + (i << 2), configuration_word(0, i));
+        for (i = 1; i < 16; i = i + 1)
+            csr_write(CMD, 9'h100 + ((32 + i) << 2), configuration_word(i, 0));
+        csr_write(CMD, 0, cmd_hw ? 32'h1E : 32'hE);     // Drive 2 selected, interface enabled, queries answered in hardware
+
+        csr_write(ST, 1 << 2, sector_length);
+        csr_write(ST, 2 << 2, spt);
+        csr_write(ST, 7 << 2, sector_denominator);
+        csr_write(ST, 6 << 2, sector_remainder);
+        csr_write(RD, 2 << 2, cph);
+        csr_write(RD, 4 << 2, halfbit_denominator);
+        csr_write(RD, 3 << 2, halfbit_remainder);
+        csr_write(WD, 3 << 2, sector_bytes);
+        csr_write(WD, 4 << 2, ((HW_FREQ / 1000) << 8) | 8);    // Every 8 records, or 1 ms after the first
+
+        csr_write(TS, 2 << 2, spt);
+        csr_write(TS, 3 << 2, SECTOR_STRIDE);
+        csr_write(TS, 4 << 2, spt * SECTOR_STRIDE);
+        csr_write(TS, 5 << 2, sector_bytes + 1);        // With the label
+        csr_write(TS, 6 << 2, lead);
+        csr_write(TS, 7 << 2, late_cycle);
+        csr_write(TS, 14'h2000, SLOT_BASE | 1);         // Cylinder 0
+        csr_write(TS, 1 << 2, 0);                       // C=0 H=0
+
+        csr_write(WD, 0, 32'h5);
+        csr_write(ST, 0, 32'h1);
+        csr_write(TS, 0, 32'h3);
+
+        // The GIC takes the lowest interrupt ID first: command, track sequencer, then write datapath
+        forever
+        begin
+            while (!cmd_interrupt && !ts_interrupt && !wd_interrupt)
+                tick;
+            repeat (irq_latency) tick;
+            if (cmd_interrupt)
+                command_interrupt;
+            else if (ts_interrupt)
+                track_sequencer_interrupt;
+            else if (wd_interrupt)
+                write_datapath_interrupt;
+        end
+    end
+
+    /* Controller: read or write each sector as it passes under the head */
+
+    wire sector_pulse = esdi_index | esdi_sector;
+
+    always @(posedge esdi_index)
+    begin
+        index_count = index_count + 1;
+        if (index_count == 2)
+            measuring = 1;                  // One revolution for the track sequencer to start streaming
+        else if (index_count == 2 + revolutions)
+            measuring = 0;
+    end
+
+    initial
+    begin : controller
+        integer s;
+        integer bitpos;
+        integer nbits;
+        integer end_bits;
+        integer sectors_seen;
+        integer result;
+        integer i;
+        reg writing;
+
+        sectors_seen = 0;
+
+        forever
+        begin
+            @(posedge sector_pulse);
+            s = sector_number;
+            end_bits = (sector_bytes - 1) * 8;
+
+            if (measuring)
+            begin
+                writing = (write_every > 0) && ((sectors_seen % write_every) == (write_every - 1));
+                sectors_seen = sectors_seen + 1;
+                if (writing)
+                begin
+                    write_generation[s] = generation[s] + 1;
+                    writes_sent = writes_sent + 1;
+                end
+
+                bitpos = 0;
+                nbits = 0;
+                while (bitpos < end_bits)
+                begin
+                    @(posedge esdi_read_clock);
+                    bitpos = bitpos + 1;
+
+                    if (!writing && !esdi_read_gate)
+                    begin
+                        read_bits[nbits] = esdi_read_data;
+                        nbits = nbits + 1;
+                    end
+
+                    if (bitpos == GATE_BITS)
+                    begin
+                        if (writing)
+                            esdi_write_gate <= 0;
+                        else
+                            esdi_read_gate <= 0;
+                    end
+
+                    if (writing && bitpos >= GATE_BITS)
+                    begin
+                        @(negedge esdi_read_clock);
+                        esdi_write_data <= layout_bit(s, write_generation[s], bitpos);
+                    end
+                end
+
+                esdi_read_gate <= 1;
+                esdi_write_gate <= 1;
+                esdi_write_data <= 0;
+
+                if (!writing)
+                begin
+                    for (i = 0; i < nbits; i = i + 1)
+                        check_bits[i] = read_bits[i];
+                    check_sector(nbits, s, generation[s], result);
+                    if (result == CHECK_OK)
+                        reads_ok = reads_ok + 1;
+                    else if (result == CHECK_LOST)
+                    begin
+                        reads_lost = reads_lost + 1;
+                        $display("%t: sector %0d not sent", $time, s);
+                    end
+                    else
+                    begin
+                        reads_corrupt = reads_corrupt + 1;
+                        $display("%t: sector %0d read back incorrectly", $time, s);
+                    end
+                end
+            end
+        end
+    end
+
+    /* Controller: serial commands, Request Status and Recalibrate in turn with Request
+       Configuration for a table entry, for a subscript past the table (answered by the
+       firmware), and for a modifier */
+
+    task send_command_bit(input value, output reg received, output reg timed_out);
+        integer waited;
+    begin
+        esdi_command_data <= value;
+        repeat (10) tick;
+        esdi_transfer_req <= 1;
+        waited = 0;
+        while (!esdi_transfer_ack && waited < 2 * 1000000)
+        begin
+            tick;
+            waited = waited + 1;
+        end
+        received = esdi_confstat_data;
+        timed_out = !esdi_transfer_ack;
+        repeat (10) tick;
+        esdi_transfer_req <= 0;
+        while (esdi_transfer_ack)
+            tick;
+    end
+    endtask
+
+    initial
+    begin : commands
+        reg [15:0] command;
+        reg [16:0] frame;
+        reg [16:0] response;
+        reg [15:0] expected;
+        reg received;
+        reg timed_out;
+        reg failed;
+        integer i;
+        integer start;
+        integer rtt;
+        integer waited;
+
+        forever
+        begin
+            while (!measuring || cmd_gap == 0)
+                tick;
+            repeat (cmd_gap) tick;
+            if (measuring)
+            begin
+                case (commands_sent % 5)
+                    0 : command = 16'h2000;
+                    1 : command = 16'h1000;
+                    2 : command = 16'h3000 | ((commands_sent / 5) % 32);
+                    3 : command = 16'h3000 | (32 + (commands_sent / 5) % 224);
+                    4 : command = 16'h3000 | ((1 + (commands_sent / 5) % 15) << 8);
+                endcase
+                commands_sent = commands_sent + 1;
+                if (answered_in_hardware(command))
+                    queries_sent = queries_sent + 1;
+
+                start = $time / 10;
+                failed = 0;
+
+                frame = {command, ~^command};   // Odd parity
+                for (i = 16; i >= 0; i = i - 1)
+                begin
+                    send_command_bit(frame[i], received, timed_out);
+                    failed = failed | timed_out;
+                end
+
+                if (command[15:12] == 4'h2 || command[15:12] == 4'h3)
+                begin
+                    for (i = 16; i >= 0; i = i - 1)
+                    begin
+                        send_command_bit(0, received, timed_out);
+                        response[i] = received;
+                        failed = failed | timed_out;
+                    end
+                    expected = (command[15:12] == 4'h2) ? STATUS_WORD : configuration_word(command[11:8], command[7:0]);
+                    if (response[16:1] != expected || response[0] != ~^response[16:1])
+                        cmd_errors = cmd_errors + 1;
+                end
+
+                waited = 0;
+                while (!esdi_command_complete && waited < 2 * 1000000)
+                begin
+                    tick;
+                    waited = waited + 1;
+                end
+                failed = failed | !esdi_command_complete;
+
+                if (failed)
+                    cmd_timeouts = cmd_timeouts + 1;
+                else
+                begin
+                    rtt = ($time / 10) - start;
+                    cmd_count = cmd_count + 1;
+                    rtt_sum = rtt_sum + rtt;
+                    if (rtt_min < 0 || rtt < rtt_min)
+                        rtt_min = rtt;
+                    if (rtt > rtt_max)
+                        rtt_max = rtt;
+                end
+            end
+        end
+    end
+
+    /* Report */
+
+    initial
+    begin : report
+        wait (index_count == 2 + revolutions);
+        repeat (2 * sector_length) tick;    // Let the last write reach memory and the last command complete
+
+        $display("COSIM cph=%0d kbps=%0d spt=%0d rpm=%0d ddr_latency=%0d ddr_jitter=%0d irq_latency=%0d csr_latency=%0d lead=%0d sector_bytes=%0d reads=%0d reads_lost=%0d reads_corrupt=%0d underflows=%0d missed_deadlines=%0d late_sectors=%0d resyncs=%0d min_slack_us=%0.2f writes=%0d writes_corrupt=%0d writes_lost=%0d write_overflows=%0d write_sectors_missed=%0d write_interrupts=%0d wfifo_hwm=%0d commands=%0d cmd_errors=%0d cmd_timeouts=%0d cmd_interrupts=%0d queries_answered=%0d queries_sent=%0d rtt_min_us=%0.2f rtt_avg_us=%0.2f rtt_max_us=%0.2f result=%s",
+            cph, kbps, spt, rpm, ddr_latency, ddr_jitter, irq_latency, csr_latency, lead, sector_bytes,
+            reads_ok + reads_lost + reads_corrupt, reads_lost, reads_corrupt,
+            underflows, missed_deadlines, late_sectors, uut_track_sequencer.resyncs, min_slack / 100.0,
+            writes_sent, writes_corrupt, writes_sent - writes_ok - writes_corrupt,
+            write_overflows, write_sectors_missed, write_interrupts, wfifo_hwm,
+            cmd_count, cmd_errors, cmd_timeouts, cmd_interrupts, uut_cmd_controller.queries_answered, queries_sent,
+            rtt_min / 100.0, (cmd_count > 0) ? rtt_sum / cmd_count / 100.0 : 0.0, rtt_max / 100.0,
+            (reads_lost || reads_corrupt || underflows || missed_deadlines || writes_corrupt ||
+             (writes_sent != writes_ok) || write_overflows || write_sectors_missed ||
+             cmd_errors || cmd_timeouts || (cmd_count != commands_sent) ||
+             (uut_cmd_controller.queries_answered != queries_sent)) ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
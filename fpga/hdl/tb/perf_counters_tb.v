@@ -0,0 +1,391 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+/*
+    Self checking testbench for perf_counters. Pulses each event input a known number of
+    times, moves the head select lines with skew and glitches, times sectors against their
+    data arriving, and checks everything read back through the snapshot. Snapshots and
+    clears are taken while events keep arriving to check none is lost or counted twice.
+
+        iverilog -g2005 -s perf_counters_tb -o perf_counters.vvp tb/perf_counters_tb.v perf_counters.v
+        vvp -n perf_counters.vvp
+
+    Ends with a line starting PERF_COUNTERS reporting the number of checks and failures.
+*/
+
+`timescale 1ns / 1ps
+
+
+module perf_counters_tb ();
+
+    localparam NUM_COUNTERS = 17;
+
+    localparam STREAMED = 8;            // Register offsets
+    localparam WRITTEN = 9;
+    localparam DISCARDED = 10;
+    localparam UNDERFLOWS = 11;
+    localparam MISSED_DEADLINES = 12;
+    localparam WRITE_OVERFLOWS = 13;
+    localparam WRITE_SECTORS_MISSED = 14;
+    localparam HEAD_CHANGES = 15;
+    localparam SEEKS = 16;
+    localparam HISTOGRAM = 17;
+
+    integer checks = 0;
+    integer failures = 0;
+
+    reg aclk = 0;
+    reg aresetn = 0;
+
+    always #5 aclk <= !aclk;
+
+    task tick;
+    begin
+        @(posedge aclk);
+        #1;
+    end
+    endtask
+
+    /* AXI-Lite */
+
+    reg csr_awvalid = 0;
+    reg csr_wvalid = 0;
+    reg csr_arvalid = 0;
+    reg [6:0] csr_awaddr = 0;
+    reg [31:0] csr_wdata = 0;
+    reg [6:0] csr_araddr = 0;
+
+    wire csr_bvalid;
+    wire csr_rvalid;
+    wire [31:0] csr_rdata;
+
+    task csr_write(input [4:0] register, input [31:0] data);
+    begin
+        csr_awaddr <= register << 2;
+        csr_wdata <= data;
+        csr_awvalid <= 1;
+        csr_wvalid <= 1;
+        tick;
+        csr_awvalid <= 0;
+        csr_wvalid <= 0;
+        while (!csr_bvalid)
+            tick;
+    end
+    endtask
+
+    task csr_read(input [4:0] register, output [31:0] data);
+    begin
+        csr_araddr <= register << 2;
+        csr_arvalid <= 1;
+        tick;
+        csr_arvalid <= 0;
+        while (!csr_rvalid)
+            tick;
+        data = csr_rdata;
+    end
+    endtask
+
+    task check_register(input [4:0] register, input [31:0] expected);
+        reg [31:0] value;
+    begin
+        csr_read(register, value);
+        checks = checks + 1;
+        if (value !== expected)
+        begin
+            failures = failures + 1;
+            $display("%t: register %0d read %0d, expected %0d", $time, register, value, expected);
+        end
+    end
+    endtask
+
+    /* Hardware */
+
+    reg read_sector_started = 0;
+    reg read_data_arrived = 0;
+    reg read_underflow = 0;
+    reg read_missed_deadline = 0;
+    reg write_sector_written = 0;
+    reg write_sector_discarded = 0;
+    reg write_overflow = 0;
+    reg write_sector_missed = 0;
+    reg seek = 0;
+    reg train_seek = 0;                 // From the seek train below
+    reg [3:0] esdi_head_select = 4'h5;
+
+    perf_counters uut (
+        .csr_aclk               (aclk),
+        .csr_aresetn            (aresetn),
+        .csr_awvalid            (csr_awvalid),
+        .csr_awready            (),
+        .csr_awaddr             (csr_awaddr),
+        .csr_awprot             (3'b000),
+        .csr_wvalid             (csr_wvalid),
+        .csr_wready             (),
+        .csr_wdata              (csr_wdata),
+        .csr_wstrb              (4'b1111),
+        .csr_bvalid             (csr_bvalid),
+        .csr_bready             (1'b1),
+        .csr_bresp              (),
+        .csr_arvalid            (csr_arvalid),
+        .csr_arready            (),
+        .csr_araddr             (csr_araddr),
+        .csr_arprot             (3'b000),
+        .csr_rvalid             (csr_rvalid),
+        .csr_rready             (1'b1),
+        .csr_rdata              (csr_rdata),
+        .csr_rresp              (),
+
+        .read_sector_started    (read_sector_started),
+        .read_data_arrived      (read_data_arrived),
+        .read_underflow         (read_underflow),
+        .read_missed_deadline   (read_missed_deadline),
+        .write_sector_written   (write_sector_written),
+        .write_sector_discarded (write_sector_discarded),
+        .write_overflow         (write_overflow),
+        .write_sector_missed    (write_sector_missed),
+        .seek                   (seek || train_seek),
+
+        .esdi_head_select       (esdi_head_select)
+    );
+
+    // One cycle pulse on each input set in 'which', in the order of the counter registers
+    task pulse(input [8:0] which);
+    begin
+        read_sector_started <= which[0];
+        write_sector_written <= which[1];
+        write_sector_discarded <= which[2];
+        read_underflow <= which[3];
+        read_missed_deadline <= which[4];
+        write_overflow <= which[5];
+        write_sector_missed <= which[6];
+        seek <= which[8];
+        tick;
+        read_sector_started <= 0;
+        write_sector_written <= 0;
+        write_sector_discarded <= 0;
+        read_underflow <= 0;
+        read_missed_deadline <= 0;
+        write_overflow <= 0;
+        write_sector_missed <= 0;
+        seek <= 0;
+    end
+    endtask
+
+    // A sector that starts 'slack' cycles after its first byte arrived
+    task sector(input integer slack);
+    begin
+        read_data_arrived <= 1;
+        tick;
+        read_data_arrived <= 0;
+        repeat (slack - 1) tick;
+        pulse(9'h001);
+    end
+    endtask
+
+    // Move the head select lines one at a time, 'skew' cycles apart, and leave them to settle
+    task select_head(input [3:0] head, input integer skew);
+        integer b;
+    begin
+        for (b = 0; b < 4; b = b + 1)
+        begin
+            if (esdi_head_select[b] != head[b])
+            begin
+                esdi_head_select[b] <= head[b];
+                repeat (skew) tick;
+            end
+        end
+        repeat (40) tick;
+    end
+    endtask
+
+    /* Seek pulses every third cycle while snapshots are taken, see below */
+
+    reg seek_train = 0;
+    integer seeks_sent = 0;
+
+    always @(posedge aclk)
+    begin : train
+        integer phase;
+
+        train_seek <= 0;
+        if (!seek_train)
+            phase = 0;
+        else
+        begin
+            phase = phase + 1;
+            if (phase == 3)
+            begin
+                phase = 0;
+                train_seek <= 1;
+                seeks_sent = seeks_sent + 1;
+            end
+        end
+    end
+
+    /* Test */
+
+    initial
+    begin : test
+        integer i;
+        integer n;
+        integer total;
+        reg [31:0] value;
+        reg [31:0] cycles_before;
+
+        repeat (4) tick;
+        aresetn <= 1;
+        repeat (4) tick;
+
+        // Cleared by reset, and the head select lines held through reset are not a change
+        check_register(0, NUM_COUNTERS);
+        csr_write(0, 32'h1);
+        for (i = STREAMED; i < STREAMED + NUM_COUNTERS; i = i + 1)
+            check_register(i, 0);
+        check_register(3, 32'hFFFFFFFF);
+        check_register(4, 0);
+
+        // Input n pulsed n + 1 times, with seek alongside the first to count two at once
+        for (i = 0; i < 9; i = i + 1)
+        begin
+            if (i != 7)
+            begin
+                for (n = 0; n <= i; n = n + 1)
+                    pulse((9'h1 << i) | ((i == 0) ? 9'h100 : 9'h000));
+            end
+        end
+        repeat (4) tick;
+        csr_write(0, 32'h1);
+        check_register(STREAMED, 1);
+        check_register(WRITTEN, 2);
+        check_register(DISCARDED, 3);
+        check_register(UNDERFLOWS, 4);
+        check_register(MISSED_DEADLINES, 5);
+        check_register(WRITE_OVERFLOWS, 6);
+        check_register(WRITE_SECTORS_MISSED, 7);
+        check_register(HEAD_CHANGES, 0);
+        check_register(SEEKS, 10);
+
+        // The snapshot holds until the next one
+        pulse(9'h002);
+        repeat (4) tick;
+        check_register(WRITTEN, 2);
+        csr_write(0, 32'h1);
+        check_register(WRITTEN, 3);
+
+        // Clear starts the cycle count again, and the snapshot keeps the old values
+        csr_read(1, cycles_before);
+        csr_write(0, 32'h2);
+        repeat (4) tick;
+        check_register(WRITTEN, 3);
+        csr_write(0, 32'h1);
+        check_register(WRITTEN, 0);
+        check_register(SEEKS, 0);
+        csr_read(1, value);
+        checks = checks + 1;
+        if (value >= cycles_before || value == 0)
+        begin
+            failures = failures + 1;
+            $display("%t: cycles %0d after the clear, %0d before", $time, value, cycles_before);
+        end
+
+        // Head changes: skew between the lines is one change, a glitch shorter than the
+        // settling time is none, and going back to the old head after settling is one more
+        select_head(4'hA, 2);           // 5 -> A, all four lines move
+        select_head(4'hA, 2);
+        esdi_head_select <= 4'hB;       // Glitch
+        repeat (6) tick;
+        esdi_head_select <= 4'hA;
+        repeat (40) tick;
+        select_head(4'h3, 5);
+        select_head(4'hA, 1);
+        csr_write(0, 32'h1);
+        check_register(HEAD_CHANGES, 3);
+
+        // Slack: the least time seen, and each sector in its bin of the histogram. A sector
+        // with no data arriving ahead of it has no slack.
+        csr_write(0, 32'h3);
+        sector(300);
+        sector(30);
+        sector(100);
+        sector(5000);
+        sector(64);
+        sector(4095);
+        pulse(9'h001);
+        repeat (4) tick;
+        csr_write(0, 32'h1);
+        check_register(STREAMED, 7);
+        check_register(3, 30);
+        check_register(HISTOGRAM + 0, 1);       // < 64
+        check_register(HISTOGRAM + 1, 2);       // < 128
+        check_register(HISTOGRAM + 2, 0);
+        check_register(HISTOGRAM + 3, 1);       // < 512
+        check_register(HISTOGRAM + 4, 0);
+        check_register(HISTOGRAM + 5, 0);
+        check_register(HISTOGRAM + 6, 1);       // < 4096
+        check_register(HISTOGRAM + 7, 1);       // the rest
+
+        // Back to back: the next sector's data arrives in the same cycle as a sector starts,
+        // and both sectors are timed
+        csr_write(0, 32'h3);
+        read_data_arrived <= 1;
+        tick;
+        read_data_arrived <= 0;
+        repeat (199) tick;
+        read_data_arrived <= 1;
+        pulse(9'h001);
+        read_data_arrived <= 0;
+        repeat (49) tick;
+        pulse(9'h001);
+        repeat (4) tick;
+        csr_write(0, 32'h1);
+        check_register(STREAMED, 2);
+        check_register(3, 50);
+        check_register(HISTOGRAM + 0, 1);       // < 64
+        check_register(HISTOGRAM + 2, 1);       // < 256
+
+        // Snapshot and clear together while seeks keep arriving: every seek lands in
+        // exactly one snapshot
+        csr_write(0, 32'h3);
+        seeks_sent = 0;
+        seek_train <= 1;
+        total = 0;
+        for (i = 0; i < 8; i = i + 1)
+        begin
+            repeat (7 + i) tick;
+            csr_write(0, 32'h3);
+            csr_read(SEEKS, value);
+            total = total + value;
+        end
+        seek_train <= 0;
+        repeat (8) tick;
+        csr_write(0, 32'h1);
+        csr_read(SEEKS, value);
+        total = total + value;
+        checks = checks + 1;
+        if (total != seeks_sent)
+        begin
+            failures = failures + 1;
+            $display("%t: %0d seeks in the snapshots, %0d sent", $time, total, seeks_sent);
+        end
+
+        $display("PERF_COUNTERS checks=%0d failures=%0d result=%s", checks, failures, failures ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
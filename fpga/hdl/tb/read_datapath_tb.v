@@ -31,6 +31,11 @@ module read_datapath_tb ();
         .csr_aclk               (csr_aclk),
         .csr_aresetn            (csr_aresetn),
 
+        .trig_out               (),
+        .trig_out_ack           (1'b0),
+        .trig_in                (1'b0),
+        .trig_in_ack            (),
+
         .parallel_aclk          (1'b0),
         .parallel_aresetn       (1'b0),
 
@@ -60,10 +65,13 @@ module read_datapath_tb ();
         .parallel_tlast         (parallel_tlast),
         .parallel_tid           (parallel_tid),
 
+        .parallel_flush         (1'b0),
+        .sequencer_silence      (1'b0),
+
         .sector_number          (sector_number),
         .cycle_count            (cycle_count),
 
-        .esdi_read_gate         (),
+        .esdi_read_gate         (1'b0),         // Active low, so the read data is seen
         .esdi_read_data         (esdi_read_data),
         .esdi_read_clock        (esdi_read_clock)
     );
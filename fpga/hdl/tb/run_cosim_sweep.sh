@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Build datapath_cosim_tb once and run it over a sweep of read clock rates, sectors per
+# track and DDR latencies, printing one row per run.
+#
+#   SIM=iverilog|verilator   simulator to use, the first one found by default
+#   CPH_LIST                 clocks per half bit to try (5 = 10 Mbit/s, 2 = 25 Mbit/s)
+#   KBPS_LIST                read clock rates in kbit/s to try as well, e.g. "15000 20000 24000"
+#   SPT_LIST                 sectors per track to try
+#   LATENCY_LIST             DDR latency per burst to try, in 10ns cycles
+#   EXTRA                    any other plusargs, e.g. "+irq_latency=200 +ddr_jitter=100"
+#
+# Exits non zero if any run fails.
+
+set -e
+
+HDL=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${BUILD:-$HDL/tb/cosim_build}
+
+CPH_LIST=${CPH_LIST:-"5 4 3 2"}
+KBPS_LIST=${KBPS_LIST:-}
+SPT_LIST=${SPT_LIST:-"34 36 48 53 70"}
+LATENCY_LIST=${LATENCY_LIST:-"16 256 1024 2048"}
+REVOLUTIONS=${REVOLUTIONS:-2}
+EXTRA=${EXTRA:-}
+
+SOURCES="$HDL/tb/datapath_cosim_tb.v $HDL/sector_timer.v $HDL/read_datapath.v $HDL/write_datapath.v
+	$HDL/labeler.v $HDL/track_sequencer.v $HDL/fifo_registered.v $HDL/axi_esdi_cmd_slave.v"
+
+if [ -z "$SIM" ]; then
+	if command -v iverilog >/dev/null 2>&1; then
+		SIM=iverilog
+	elif command -v verilator >/dev/null 2>&1; then
+		SIM=verilator
+	else
+		echo "Neither iverilog nor verilator found" >&2
+		exit 1
+	fi
+fi
+
+mkdir -p "$BUILD"
+
+case "$SIM" in
+	iverilog)
+		iverilog -g2005 -s datapath_cosim_tb -o "$BUILD/cosim.vvp" $SOURCES
+		run() { vvp -n "$BUILD/cosim.vvp" "$@"; }
+		;;
+	verilator)
+		verilator --binary --timing -O3 -Wno-fatal -Wno-lint -Wno-style -Wno-TIMESCALEMOD \
+			--top-module datapath_cosim_tb -Mdir "$BUILD" -o cosim $SOURCES >/dev/null
+		run() { "$BUILD/cosim" "$@"; }
+		;;
+	*)
+		echo "Unknown simulator $SIM" >&2
+		exit 1
+		;;
+esac
+
+printf "%4s %6s %4s %8s %6s %6s %6s %6s %6s %10s %6s %6s %6s %6s %9s %9s  %s\n" \
+	cph kbps spt latency bytes reads lost undfl missed slack_us writes wrerr ovfl hwm rtt_avg rtt_max result
+
+rates=
+for cph in $CPH_LIST; do
+	rates="$rates +cph=$cph"
+done
+for kbps in $KBPS_LIST; do
+	rates="$rates +kbps=$kbps"
+done
+
+failed=0
+for rate in $rates; do
+	for spt in $SPT_LIST; do
+		for latency in $LATENCY_LIST; do
+			line=$(run $rate +spt=$spt +ddr_latency=$latency +revolutions=$REVOLUTIONS $EXTRA | grep '^COSIM')
+			echo "$line" | awk '
+				{
+					for (i = 2; i <= NF; i++) {
+						split($i, kv, "=")
+						v[kv[1]] = kv[2]
+					}
+					if (v["result"] == "SKIP") {
+						printf "%4s %6s %4s %8s %6s %s\n", v["cph"], v["kbps"], v["spt"], v["ddr_latency"], v["sector_bytes"], "sector too short, skipped"
+						exit
+					}
+					printf "%4s %6s %4s %8s %6s %6s %6s %6s %6s %10s %6s %6s %6s %6s %9s %9s  %s\n",
+						v["cph"], v["kbps"], v["spt"], v["ddr_latency"], v["sector_bytes"], v["reads"],
+						v["reads_lost"] + v["reads_corrupt"], v["underflows"], v["missed_deadlines"],
+						v["min_slack_us"], v["writes"], v["writes_corrupt"] + v["writes_lost"],
+						v["write_overflows"] + v["write_sectors_missed"], v["wfifo_hwm"],
+						v["rtt_avg_us"], v["rtt_max_us"], v["result"]
+				}'
+			case "$line" in
+				*result=FAIL*) failed=1 ;;
+			esac
+		done
+	done
+done
+
+exit $failed
@@ -5,11 +5,11 @@
 module write_datapath_tb ();
 
     reg dp_csr_awvalid;
-    reg [4:0] dp_csr_awaddr;
+    reg [8:0] dp_csr_awaddr;
     reg dp_csr_wvalid;
     reg [31:0] dp_csr_wdata;
     reg dp_csr_arvalid;
-    reg [4:0] dp_csr_araddr;
+    reg [8:0] dp_csr_araddr;
 
     reg csr_aclk;
     reg csr_aresetn;
@@ -68,6 +68,7 @@ module write_datapath_tb ();
 
         .sector_number          (sector_number),
         .cycle_count            (cycle_count),
+        .cylinder_head          (20'd0),
 
         .esdi_write_gate        (esdi_write_gate),
         .esdi_write_clock       (esdi_write_clock),
@@ -59,30 +59,57 @@ module top(
 
 );
 
-    assign esdi_index_gated = esdi_drive_selected_A && esdi_index_ungated_A;
-    assign esdi_sector_gated = esdi_drive_selected_A && esdi_sector_ungated_A;
+    // Both drives share the controller's cable. Each one only drives the shared outputs while
+    // it is selected, so they can simply be ORed together.
+    wire esdi_transfer_ack_A, esdi_transfer_ack_B;
+    wire esdi_confstat_data_A, esdi_confstat_data_B;
+    wire esdi_attention_A, esdi_attention_B;
+    wire esdi_ready_A, esdi_ready_B;
+
+    assign esdi_transfer_ack = esdi_transfer_ack_A || esdi_transfer_ack_B;
+    assign esdi_confstat_data = esdi_confstat_data_A || esdi_confstat_data_B;
+    assign esdi_attention = esdi_attention_A || esdi_attention_B;
+    assign esdi_ready = esdi_ready_A || esdi_ready_B;
+
+    assign esdi_index_gated = (esdi_drive_selected_A && esdi_index_ungated_A) || (esdi_drive_selected_B && esdi_index_ungated_B);
+    assign esdi_sector_gated = (esdi_drive_selected_A && esdi_sector_ungated_A) || (esdi_drive_selected_B && esdi_sector_ungated_B);
 
     design_1 design_1_i(
 
 
-        .esdi_attention             (esdi_attention),
+        .esdi_attention             (esdi_attention_A),
         .esdi_command_complete      (esdi_command_complete_A),
         .esdi_command_data          (!esdi_command_data),
-        .esdi_confstat_data         (esdi_confstat_data),
+        .esdi_confstat_data         (esdi_confstat_data_A),
         .esdi_drive_select          (~esdi_drive_select),
         .esdi_drive_selected        (esdi_drive_selected_A),
         .esdi_head_select           (~esdi_head_select),
         .esdi_index                 (esdi_index_ungated_A),
         .esdi_read_clock            (esdi_read_clock_A),
         .esdi_read_data             (esdi_read_data_A),
-        .esdi_read_gate             (esdi_read_gate),
-        .esdi_ready                 (esdi_ready),
+        .esdi_read_gate             (esdi_read_gate && esdi_drive_selected_A),
+        .esdi_ready                 (esdi_ready_A),
         .esdi_sector                (esdi_sector_ungated_A),
-        .esdi_transfer_ack          (esdi_transfer_ack),
+        .esdi_transfer_ack          (esdi_transfer_ack_A),
         .esdi_transfer_req          (!esdi_transfer_req),
-        .esdi_write_gate            (esdi_write_gate),
+        .esdi_write_gate            (esdi_write_gate && esdi_drive_selected_A),
         .esdi_write_clock           (esdi_write_clock_A),
-        .esdi_write_data            (esdi_write_data_A)
+        .esdi_write_data            (esdi_write_data_A),
+
+        .esdi_attention_b           (esdi_attention_B),
+        .esdi_command_complete_b    (esdi_command_complete_B),
+        .esdi_confstat_data_b       (esdi_confstat_data_B),
+        .esdi_drive_selected_b      (esdi_drive_selected_B),
+        .esdi_index_b               (esdi_index_ungated_B),
+        .esdi_read_clock_b          (esdi_read_clock_B),
+        .esdi_read_data_b           (esdi_read_data_B),
+        .esdi_read_gate_b           (esdi_read_gate && esdi_drive_selected_B),
+        .esdi_ready_b               (esdi_ready_B),
+        .esdi_sector_b              (esdi_sector_ungated_B),
+        .esdi_transfer_ack_b        (esdi_transfer_ack_B),
+        .esdi_write_gate_b          (esdi_write_gate && esdi_drive_selected_B),
+        .esdi_write_clock_b         (esdi_write_clock_B),
+        .esdi_write_data_b          (esdi_write_data_B)
     );
 
 endmodule
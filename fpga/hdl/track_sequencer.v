@@ -0,0 +1,562 @@
+/*
+
+    Copyright 2025 Christopher Simmons
+
+  This program is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free
+  Software Foundation, either version 2 of the License, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Fetches the sectors of the selected track from DDR and streams them to read_datapath, so
+// nothing has to be done per sector in software. Software keeps a table with the address of
+// the slot holding each cylinder and writes the selected cylinder and head to a single
+// register. The sectors are read in rotation order a few sectors ahead of the one under the
+// head, each as [label][data] at
+//
+//     slot + (head * track_stride) + (sector * sector_stride)
+//
+// with the label byte passed on as tid rather than streamed (labeler puts it back on writes).
+//
+// Changing the cylinder or head, or the table entry for the selected cylinder, throws away
+// everything fetched and starts again from the next sector that can still be made. The read
+// datapath is kept silent until that sector starts, and reading resumes with a whole sector.
+// If the selected cylinder has no valid table entry nothing is fetched and the datapath stays
+// silent until the entry is written. Should the stream ever fall out of step with the sector
+// timer, the same restart brings it back (and is counted).
+//
+// Register map (word offsets):
+//    0      control           W: bit 0 enable, bit 1 release interrupt enable
+//                             R: bits 1:0 as written, bit 2 released since the last read
+//                                (reading clears it and the interrupt), bit 3 silent
+//    1      cylinder_head     bits 15:0 cylinder, bits 19:16 head. Writing restarts the stream
+//    2      sectors_per_track
+//    3      sector_stride     bytes between sectors in a track, a multiple of 4
+//    4      track_stride      bytes between tracks in a slot, a multiple of 4
+//    5      sector_bytes      bytes to stream per sector, including the label
+//    6      lead              sectors fetched ahead of the one being streamed
+//    7      late_cycle        restarts after this cycle_count skip the next sector, there
+//                             is not enough time left to fetch it
+//    8      previous_chs      R: cylinder_head as it was at the end of the last sector
+//    9      resyncs           R: restarts because the stream fell behind
+//    10     release_sector    R: sector at which the stream last came out of silence
+//    0x800+ slot table        W: one word per cylinder, slot address | 1 if the cylinder is
+//                             loaded. Slot addresses must be a multiple of 4
+
+module track_sequencer #(
+    parameter FIFO_DEPTH_EXP = 10       // In 32 bit words
+) (
+    input csr_aclk,
+    input csr_aresetn,
+
+    input csr_awvalid,
+    output csr_awready,
+    input [13:0] csr_awaddr,
+    input [2:0] csr_awprot,
+
+    input csr_wvalid,
+    output csr_wready,
+    input [31:0] csr_wdata,
+    input [3:0] csr_wstrb,
+
+    output reg csr_bvalid,
+    input csr_bready,
+    output reg [1:0] csr_bresp,
+
+    input csr_arvalid,
+    output csr_arready,
+    input [13:0] csr_araddr,
+    input [2:0] csr_arprot,
+
+    output reg csr_rvalid,
+    input csr_rready,
+    output reg [31:0] csr_rdata,
+    output reg [1:0] csr_rresp,
+
+    // Read only AXI4 master to DDR
+    output reg [31:0] m_axi_araddr,
+    output reg [7:0] m_axi_arlen,
+    output [2:0] m_axi_arsize,
+    output [1:0] m_axi_arburst,
+    output [3:0] m_axi_arcache,
+    output [2:0] m_axi_arprot,
+    output reg m_axi_arvalid,
+    input m_axi_arready,
+
+    input [31:0] m_axi_rdata,
+    input [1:0] m_axi_rresp,
+    input m_axi_rlast,
+    input m_axi_rvalid,
+    output m_axi_rready,
+
+    output reg parallel_tvalid,
+    input parallel_tready,
+    output reg [7:0] parallel_tdata,
+    output reg parallel_tlast,
+    output reg [7:0] parallel_tid,
+
+    output reg parallel_flush,
+    output reg silence,
+
+    input [7:0] sector_number,
+    input [31:0] cycle_count,
+
+    output [19:0] selected_chs,         // cylinder_head, for write_datapath to say where each sector was written
+
+    (* X_INTERFACE_INFO = "xilinx.com:signal:interrupt:1.0 intr INTERRUPT" *)
+    (* X_INTERFACE_PARAMETER = "SENSITIVITY LEVEL_HIGH" *)
+    output interrupt
+);
+
+    localparam TABLE_ENTRIES = 2048;
+    localparam FIFO_WORDS = 1 << FIFO_DEPTH_EXP;
+    localparam MAX_BURST = 16;
+
+    localparam IDLE = 0;        // Nothing to fetch
+    localparam FLUSH = 1;       // Waiting for bursts in flight, their data is dropped
+    localparam LOOKUP = 2;      // Reading the table entry for the cylinder
+    localparam LOCATE = 3;
+    localparam START = 4;
+    localparam RUN = 5;
+
+    reg write_addr_valid;
+    reg write_data_valid;
+    reg [13:0] write_addr;
+    reg [31:0] write_data;
+
+    assign csr_awready = !write_addr_valid;
+    assign csr_wready = !write_data_valid;
+    assign csr_arready = !csr_rvalid || csr_rready;
+
+    wire csr_write = write_addr_valid && write_data_valid && (!csr_bvalid || csr_bready);
+
+    reg [1:0] control_register;
+    wire enable = control_register[0];
+    wire release_interrupt_enable = control_register[1];
+
+    reg [31:0] cylinder_head;
+    wire [15:0] cylinder = cylinder_head[15:0];
+    wire [3:0] head = cylinder_head[19:16];
+    assign selected_chs = cylinder_head[19:0];
+
+    reg [7:0] sectors_per_track;
+    reg [31:0] sector_stride;
+    reg [31:0] track_stride;
+    reg [15:0] sector_bytes;
+    reg [2:0] lead;
+    reg [31:0] late_cycle;
+    reg [31:0] previous_chs;
+    reg [31:0] resyncs;
+    reg [7:0] release_sector;
+
+    reg released;
+    assign interrupt = released && release_interrupt_enable;
+
+    assign m_axi_arsize = 3'b010;       // 4 bytes
+    assign m_axi_arburst = 2'b01;       // INCR
+    assign m_axi_arcache = 4'b0011;
+    assign m_axi_arprot = 3'b000;
+    assign m_axi_rready = 1;            // Space is reserved in the FIFO before a sector is requested
+
+    reg [2:0] state;
+
+    /* Slot table */
+
+    reg [31:0] slot_table [0:TABLE_ENTRIES-1];
+    reg [31:0] table_entry;
+
+    wire table_write = csr_write && write_addr[13];
+    wire [10:0] table_index = write_addr[12:2];
+    wire cylinder_in_table = cylinder < TABLE_ENTRIES;
+
+    always @(posedge csr_aclk)
+    begin
+        if (table_write)
+            slot_table[table_index] <= write_data;
+        table_entry <= slot_table[cylinder[10:0]];
+    end
+
+    /* FIFO of fetched words */
+
+    reg [31:0] fifo_mem [0:FIFO_WORDS-1];
+    reg [FIFO_DEPTH_EXP:0] fifo_wr_ptr;
+    reg [FIFO_DEPTH_EXP:0] fifo_rd_ptr;
+    reg [31:0] fifo_word;
+    reg [FIFO_DEPTH_EXP+1:0] reserved;       // Words in the FIFO plus words requested
+
+    reg word_valid;                         // fifo_word holds bytes still to be sent
+    reg [1:0] lane;
+    reg [15:0] byte_index;                  // Of the next byte in its sector, 0 is the label
+    reg [7:0] label;
+
+    wire fifo_push = m_axi_rvalid && (state == RUN);
+    wire fifo_pop = (state == RUN) && !word_valid && (fifo_rd_ptr != fifo_wr_ptr);
+
+    always @(posedge csr_aclk)
+    begin
+        if (fifo_push)
+            fifo_mem[fifo_wr_ptr[FIFO_DEPTH_EXP-1:0]] <= m_axi_rdata;
+        if (fifo_pop)
+            fifo_word <= fifo_mem[fifo_rd_ptr[FIFO_DEPTH_EXP-1:0]];
+    end
+
+    /* Fetching */
+
+    wire [15:0] words_per_sector = (sector_bytes + 3) >> 2;
+
+    reg [31:0] track_base;
+    reg [7:0] start_sector;
+    reg [7:0] fetch_sector;
+    reg [31:0] sector_addr;
+
+    reg issue_active;
+    reg [31:0] burst_addr;
+    reg [15:0] words_left;
+    reg [15:0] rx_words;
+    reg [7:0] outstanding;
+
+    // Sectors requested, wholly received and wholly sent since the last restart
+    reg [7:0] sectors_issued;
+    reg [7:0] sectors_received;
+    reg [7:0] sectors_sent;
+
+    reg [7:0] out_sector;                   // The sector being sent
+
+    wire [7:0] sectors_queued = sectors_issued - sectors_sent;
+    wire head_sector_complete = sectors_received != sectors_sent;
+
+    // Bursts are at most MAX_BURST beats and never cross a 4 KB boundary
+    wire [10:0] words_to_boundary = 11'd1024 - burst_addr[11:2];
+    reg [15:0] burst_len;
+
+    always @(*)
+    begin
+        burst_len = MAX_BURST;
+        if (words_left < burst_len)
+            burst_len = words_left;
+        if (words_to_boundary < burst_len)
+            burst_len = words_to_boundary;
+    end
+
+    function [7:0] sector_after(input [7:0] s, input [1:0] n);
+        reg [8:0] t;
+    begin
+        t = s + n;
+        sector_after = (t >= sectors_per_track) ? (t - sectors_per_track) : t;
+    end
+    endfunction
+
+    wire issue_sector = (state == RUN) && !issue_active && (sectors_queued <= lead) &&
+                        ((reserved + words_per_sector) <= FIFO_WORDS);
+
+    reg cycle_count_was_zero;
+    wire sector_boundary = (cycle_count == 0) && !cycle_count_was_zero;
+
+    // Set where the stream has to start over, handled at the end of the block
+    reg restart;
+
+    always @(posedge csr_aclk)
+    begin
+        if (!csr_aresetn)
+        begin
+
+            control_register <= 0;
+            cylinder_head <= 0;
+            sectors_per_track <= 1;
+            sector_stride <= 0;
+            track_stride <= 0;
+            sector_bytes <= 1;
+            lead <= 2;
+            late_cycle <= 0;
+            previous_chs <= 0;
+            resyncs <= 0;
+            release_sector <= 0;
+            released <= 0;
+
+            write_addr_valid <= 0;
+            write_data_valid <= 0;
+            csr_bvalid <= 0;
+            csr_rvalid <= 0;
+
+            state <= IDLE;
+            silence <= 1;
+            parallel_flush <= 0;
+            parallel_tvalid <= 0;
+            m_axi_arvalid <= 0;
+            outstanding <= 0;
+            issue_active <= 0;
+            word_valid <= 0;
+            cycle_count_was_zero <= 1;
+
+        end
+        else
+        begin
+
+            restart = 0;
+            parallel_flush <= 0;
+            cycle_count_was_zero <= (cycle_count == 0);
+
+            if (sector_boundary)
+                previous_chs <= cylinder_head;
+
+            /* Requests */
+
+            if (m_axi_arvalid && m_axi_arready)
+                m_axi_arvalid <= 0;
+
+            outstanding <= outstanding + (m_axi_arvalid && m_axi_arready) - (m_axi_rvalid && m_axi_rlast);
+
+            if (issue_sector)
+            begin
+                issue_active <= 1;
+                burst_addr <= sector_addr;
+                words_left <= words_per_sector;
+                sectors_issued <= sectors_issued + 1;
+
+                fetch_sector <= sector_after(fetch_sector, 1);
+                if (sector_after(fetch_sector, 1) == 0)
+                    sector_addr <= track_base;
+                else
+                    sector_addr <= sector_addr + sector_stride;
+            end
+
+            if ((state == RUN) && issue_active && !m_axi_arvalid)
+            begin
+                m_axi_arvalid <= 1;
+                m_axi_araddr <= burst_addr;
+                m_axi_arlen <= burst_len - 1;
+                burst_addr <= burst_addr + (burst_len << 2);
+                words_left <= words_left - burst_len;
+                if (words_left == burst_len)
+                    issue_active <= 0;
+            end
+
+            reserved <= reserved + (issue_sector ? words_per_sector : 0) - fifo_pop;
+
+            /* Data */
+
+            if (fifo_push)
+            begin
+                fifo_wr_ptr <= fifo_wr_ptr + 1;
+                if (rx_words == words_per_sector - 1)
+                begin
+                    rx_words <= 0;
+                    sectors_received <= sectors_received + 1;
+                end
+                else
+                    rx_words <= rx_words + 1;
+            end
+
+            if (fifo_pop)
+            begin
+                fifo_rd_ptr <= fifo_rd_ptr + 1;
+                word_valid <= 1;
+            end
+
+            if (parallel_tready)
+                parallel_tvalid <= 0;
+
+            if ((state == RUN) && word_valid && (!parallel_tvalid || parallel_tready))
+            begin
+                if (byte_index == 0)
+                    label <= fifo_word[8*lane +: 8];
+                else
+                begin
+                    parallel_tvalid <= 1;
+                    parallel_tdata <= fifo_word[8*lane +: 8];
+                    parallel_tid <= label;
+                    parallel_tlast <= (byte_index == sector_bytes - 1);
+                end
+
+                if (byte_index == sector_bytes - 1)
+                begin
+                    // The rest of the last word is padding, the next sector starts on a new word
+                    byte_index <= 0;
+                    lane <= 0;
+                    word_valid <= 0;
+                    sectors_sent <= sectors_sent + 1;
+                    out_sector <= sector_after(out_sector, 1);
+                end
+                else
+                begin
+                    byte_index <= byte_index + 1;
+                    lane <= lane + 1;
+                    if (lane == 3)
+                        word_valid <= 0;
+                end
+            end
+
+            /* Keeping in step with the sector timer */
+
+            // read_datapath starts a sector at cycle_count == 0 if it is holding that sector's
+            // first byte. Anything but the sector about to start at the head of the stream,
+            // or one that has not arrived whole, and the stream has fallen behind. While
+            // silent the stream may also be waiting for the sector after next.
+            if (sector_boundary && (state == RUN))
+            begin
+                if ((out_sector == sector_number) && head_sector_complete)
+                begin
+                    if (silence)
+                    begin
+                        silence <= 0;
+                        released <= 1;
+                        release_sector <= sector_number;
+                    end
+                end
+                else if (!(silence && (out_sector == sector_after(sector_number, 1))))
+                begin
+                    if (!silence)
+                        resyncs <= resyncs + 1;
+                    restart = 1;
+                end
+            end
+
+            /* State */
+
+            case (state)
+                FLUSH : begin
+                    if (!m_axi_arvalid && (outstanding == 0))
+                    begin
+                        fifo_wr_ptr <= 0;
+                        fifo_rd_ptr <= 0;
+                        reserved <= 0;
+                        word_valid <= 0;
+                        lane <= 0;
+                        byte_index <= 0;
+                        rx_words <= 0;
+                        issue_active <= 0;
+                        sectors_issued <= 0;
+                        sectors_received <= 0;
+                        sectors_sent <= 0;
+                        parallel_flush <= 1;
+                        state <= LOOKUP;
+                    end
+                end
+                LOOKUP : begin
+                    state <= LOCATE;
+                end
+                LOCATE : begin
+                    if (!enable || !cylinder_in_table || !table_entry[0])
+                        state <= IDLE;
+                    else
+                    begin
+                        track_base <= {table_entry[31:2], 2'b00} + (head * track_stride);
+                        start_sector <= sector_after(sector_number, (cycle_count > late_cycle) ? 2 : 1);
+                        state <= START;
+                    end
+                end
+                START : begin
+                    sector_addr <= track_base + (start_sector * sector_stride);
+                    fetch_sector <= start_sector;
+                    out_sector <= start_sector;
+                    state <= RUN;
+                end
+            endcase
+
+            /* Register Interface*/
+
+            if (csr_bready)
+                csr_bvalid <= 0;
+
+            if (csr_rready)
+                csr_rvalid <= 0;
+
+            if (csr_awvalid && csr_awready)
+            begin
+                write_addr_valid <= 1;
+                write_addr <= csr_awaddr;
+            end
+
+            if (csr_wvalid && csr_wready)
+            begin
+                write_data_valid <= 1;
+                write_data <= csr_wdata;
+            end
+
+            if (csr_write)
+            begin
+                write_addr_valid <= 0;
+                write_data_valid <= 0;
+
+                if (write_addr[13])
+                begin
+                    if (table_index == cylinder)
+                        restart = 1;
+                end
+                else
+                begin
+                    case (write_addr[5:2])
+                        0 : begin
+                                if (write_data[0] != enable)
+                                    restart = 1;
+                                control_register <= write_data[1:0];
+                            end
+                        1 : begin
+                                cylinder_head <= write_data;
+                                restart = 1;
+                            end
+                        2 : sectors_per_track <= write_data[7:0];
+                        3 : sector_stride <= write_data;
+                        4 : track_stride <= write_data;
+                        5 : sector_bytes <= write_data[15:0];
+                        6 : lead <= write_data[2:0];
+                        7 : late_cycle <= write_data;
+                    endcase
+                end
+
+                csr_bvalid <= 1;
+                csr_bresp <= 2'b00;
+            end
+
+            if (csr_arvalid && (!csr_rvalid || csr_rready))
+            begin
+
+                if (csr_araddr[13])
+                    csr_rdata <= 0;
+                else
+                begin
+                    case (csr_araddr[5:2])
+                        0 : begin
+                            csr_rdata <= {28'b0, silence, released, control_register};
+                            released <= 0;
+                        end
+                        1 : csr_rdata <= cylinder_head;
+                        2 : csr_rdata <= {24'b0, sectors_per_track};
+                        3 : csr_rdata <= sector_stride;
+                        4 : csr_rdata <= track_stride;
+                        5 : csr_rdata <= {16'b0, sector_bytes};
+                        6 : csr_rdata <= {29'b0, lead};
+                        7 : csr_rdata <= late_cycle;
+                        8 : csr_rdata <= previous_chs;
+                        9 : csr_rdata <= resyncs;
+                        10 : csr_rdata <= {24'b0, release_sector};
+                        default : csr_rdata <= 0;
+                    endcase
+                end
+
+                csr_rvalid <= 1;
+                csr_rresp <= 2'b00;
+            end
+
+            // Stop sending and fetching straight away, the bursts already requested are
+            // waited out in FLUSH
+            if (restart)
+            begin
+                state <= FLUSH;
+                silence <= 1;
+                parallel_tvalid <= 0;
+                word_valid <= 0;
+            end
+        end
+    end
+
+endmodule
@@ -18,13 +18,40 @@
 
 */
 
-module write_datapath (
+// Deserialises what the controller writes and passes each sector it wrote on towards the DMA,
+// sector number first. Sectors which were only read are dropped.
+//
+// Rather than interrupting for each sector, the datapath adds a record to a ring for every
+// sector the controller wrote and every one which overflowed the FIFO. The interrupt is raised
+// once coalesce_count records are waiting, or the oldest has waited coalesce_timeout cycles.
+// Software reads as many records as it likes straight out of the ring, then writes the total
+// it has taken to consumed, which also restarts the timeout.
+//
+// Register map (word offsets):
+//    0      control           bit 0 enable, bit 1 soft reset, bit 2 interrupt enable
+//    1      status            bit 0 the FIFO overflowed, bit 3 records were dropped as the ring
+//                             was full. Both stay set until written with 0
+//    2      produced          R: records added since reset, wrapping
+//    3      sector_length     unformatted bytes per sector, less three
+//    4      coalesce          bits 7:0 coalesce_count, bits 31:8 coalesce_timeout
+//    5      consumed          records software has taken since reset, wrapping
+//    64+    records           two words per record, record n at 64 + 2 * (n % RECORDS)
+//
+// Each record is:
+//    word 0   bit 31 written (the sector went to the DMA), bit 30 the FIFO overflowed during
+//             it, bit 29 records were dropped just before it, bits 27:24 head, bits 23:8
+//             cylinder, bits 7:0 sector. Cylinder and head are as selected when it ended.
+//    word 1   a free running cycle count when it ended
+
+module write_datapath #(
+    parameter RECORDS_EXP = 5
+) (
     input aclk,
     input aresetn,
 
     input csr_awvalid,
     output csr_awready,
-    input [4:0] csr_awaddr,
+    input [8:0] csr_awaddr,
     input [2:0] csr_awprot,
 
     input csr_wvalid,
@@ -38,7 +65,7 @@ module write_datapath (
 
     input csr_arvalid,
     output csr_arready,
-    input [4:0] csr_araddr,
+    input [8:0] csr_araddr,
     input [2:0] csr_arprot,
 
     output reg csr_rvalid,
@@ -48,6 +75,7 @@ module write_datapath (
 
     input [7:0] sector_number,
     input [31:0] cycle_count,
+    input [19:0] cylinder_head,         // As selected on the track sequencer
 
     input esdi_write_gate,
     input esdi_write_clock,
@@ -64,12 +92,18 @@ module write_datapath (
     input parallel_tready,
     output [7:0] parallel_tdata,
     output parallel_tlast,
-    output reg [7:0] parallel_tid
+    output reg [7:0] parallel_tid,
+
+    // One cycle pulses for perf_counters
+    output reg stat_sector_written,
+    output reg stat_sector_discarded,
+    output reg stat_overflow,
+    output reg stat_sector_missed
 );
 
     reg write_addr_valid;
     reg write_data_valid;
-    reg [4:0] write_addr;
+    reg [8:0] write_addr;
     reg [31:0] write_data;
 
     assign csr_awready = !write_addr_valid;
@@ -116,12 +150,27 @@ module write_datapath (
     reg [9:0] byte_count;
 
     reg overflow;
-    reg new_sector;
-    reg new_sector_dirty;
-    reg sector_missed;
-    reg [7:0] new_sector_number;
+    reg sector_overflow;
+    reg records_dropped;
+
+    // Completion records
+    localparam RECORDS = 1 << RECORDS_EXP;
+
+    reg [63:0] record_ring [0:RECORDS - 1];     // Stamp in the top half
+    reg record_write;
+    reg [63:0] record;
+    reg [31:0] produced;
+    reg [31:0] consumed;
+    reg dropped_since_record;
+    reg [7:0] coalesce_count;
+    reg [23:0] coalesce_timeout;
+    reg [23:0] record_age;          // Cycles since the oldest record was added, or consumed was written
+    reg [31:0] stamp;
 
-    assign interrupt = new_sector & interrupt_enable;
+    wire [31:0] records_waiting = produced - consumed;
+
+    assign interrupt = interrupt_enable && (records_waiting != 0) &&
+                       ((records_waiting >= coalesce_count) || (record_age >= coalesce_timeout));
 
 
     fifo_registered #(1, 10, 8, 0) fifo_of_uncertainty (
@@ -158,6 +207,21 @@ module write_datapath (
         new_byte_valid <= 0;
         sector_discard <= 0;
 
+        stat_sector_written <= 0;
+        stat_sector_discarded <= 0;
+        stat_overflow <= 0;
+        stat_sector_missed <= 0;
+
+        record_write <= 0;
+        if (record_write)
+            produced <= produced + 1;
+
+        stamp <= stamp + 1;
+        if (records_waiting == 0)
+            record_age <= 0;
+        else if (record_age != 24'hFFFFFF)
+            record_age <= record_age + 1;
+
         if (!aresetn)
         begin
 
@@ -170,13 +234,21 @@ module write_datapath (
 
             active <= 0;
             overflow <= 0;
-            new_sector <= 0;
-            new_sector_dirty <= 0;
-            sector_missed <= 0;
+            sector_overflow <= 0;
+            records_dropped <= 0;
             fifo_in_valid <= 0;
             send_out <= 0;
             sector_complete <= 0;
 
+            produced <= 0;
+            consumed <= 0;
+            record_write <= 0;
+            dropped_since_record <= 0;
+            coalesce_count <= 0;
+            coalesce_timeout <= 0;
+            record_age <= 0;
+            stamp <= 0;
+
         end
         else
         begin
@@ -221,6 +293,7 @@ module write_datapath (
                     bit_count <= 0;
                     byte_count <= 0;
                     sector_dirty <= 0;
+                    sector_overflow <= 0;
 
                     current_sector <= sector_number;
                 end
@@ -255,7 +328,11 @@ module write_datapath (
                     end
 
                     if (fifo_in_valid)
+                    begin
                         overflow <= 1;
+                        sector_overflow <= 1;
+                        stat_overflow <= 1;
+                    end
 
                 end
 
@@ -265,20 +342,35 @@ module write_datapath (
                 if (sector_complete)
                 begin
                     sector_complete <= 0;
-                    new_sector <= 1;
-                    if (new_sector)
-                        sector_missed <= 1;
-                    new_sector_dirty <= sector_dirty;
-                    new_sector_number <= current_sector;
+
+                    if (sector_dirty || sector_overflow)
+                    begin
+                        if (records_waiting == RECORDS)
+                        begin
+                            records_dropped <= 1;
+                            dropped_since_record <= 1;
+                            stat_sector_missed <= 1;
+                        end
+                        else
+                        begin
+                            record_write <= 1;
+                            record <= {stamp, sector_dirty, sector_overflow, dropped_since_record, 1'b0,
+                                       cylinder_head[19:16], cylinder_head[15:0], current_sector};
+                            dropped_since_record <= 0;
+                        end
+                    end
+
                     if (sector_dirty)
                     begin
                         send_out <= 1;
                         parallel_tid <= current_sector;
+                        stat_sector_written <= 1;
                     end
                     else
                     begin
                         fifo_in_valid <= 0;
                         sector_discard <= 1;
+                        stat_sector_discarded <= 1;
                     end
                 end
 
@@ -291,10 +383,11 @@ module write_datapath (
                 fifo_in_valid <= 0;
                 overflow <= 0;
                 sector_complete <= 0;
-                new_sector <= 0;
-                new_sector_dirty <= 0;
-                sector_missed <= 0;
+                records_dropped <= 0;
                 send_out <= 0;
+                produced <= 0;
+                consumed <= 0;
+                dropped_since_record <= 0;
             end
 
             /* Register Interface*/
@@ -322,15 +415,25 @@ module write_datapath (
                 write_addr_valid <= 0;
                 write_data_valid <= 0;
 
-                case (write_addr[4:2])
-                    0 : control_register <= write_data;
-                    1 : begin
-                        sector_missed <= write_data[3];
-                        new_sector <= write_data[1];
-                        overflow <= write_data[0];
-                    end
-                    3 : unformatted_sector_length <= write_data[9:0];
-                endcase
+                if (!write_addr[8])
+                begin
+                    case (write_addr[4:2])
+                        0 : control_register <= write_data;
+                        1 : begin
+                            records_dropped <= write_data[3];
+                            overflow <= write_data[0];
+                        end
+                        3 : unformatted_sector_length <= write_data[9:0];
+                        4 : begin
+                            coalesce_count <= write_data[7:0];
+                            coalesce_timeout <= write_data[31:8];
+                        end
+                        5 : begin
+                            consumed <= write_data;
+                            record_age <= 0;
+                        end
+                    endcase
+                end
 
                 csr_bvalid <= 1;
                 csr_bresp <= 2'b00;
@@ -339,12 +442,21 @@ module write_datapath (
             if (csr_arvalid && (!csr_rvalid || csr_rready))
             begin
 
-                case (csr_araddr[4:2])
-                    0 : csr_rdata <= control_register;
-                    1 : csr_rdata <= {29'b0, sector_missed, new_sector_dirty, new_sector, overflow};
-                    2 : csr_rdata <= {24'b0, new_sector_number};
-                    3 : csr_rdata <= {22'b0, unformatted_sector_length};
-                endcase
+                if (csr_araddr[8])
+                    csr_rdata <= csr_araddr[2] ? record_ring[csr_araddr[RECORDS_EXP + 2:3]][63:32] :
+                                                 record_ring[csr_araddr[RECORDS_EXP + 2:3]][31:0];
+                else
+                begin
+                    case (csr_araddr[4:2])
+                        0 : csr_rdata <= control_register;
+                        1 : csr_rdata <= {28'b0, records_dropped, 2'b0, overflow};
+                        2 : csr_rdata <= produced;
+                        3 : csr_rdata <= {22'b0, unformatted_sector_length};
+                        4 : csr_rdata <= {coalesce_timeout, coalesce_count};
+                        5 : csr_rdata <= consumed;
+                        default : csr_rdata <= 0;
+                    endcase
+                end
 
                 csr_rvalid <= 1;
                 csr_rresp <= 2'b00;
@@ -352,5 +464,12 @@ module write_datapath (
         end
     end
 
+    // The ring is only written here, so that it can be distributed RAM. The record goes in at
+    // the same edge as produced counts it.
+    always @(posedge aclk)
+    begin
+        if (record_write)
+            record_ring[produced[RECORDS_EXP - 1:0]] <= record;
+    end
 
 endmodule
\ No newline at end of file